@@ -250,14 +250,18 @@ static void boot_start_lmb(struct bootm_headers *images)
 
 	lmb_init_and_reserve_range(&images->lmb, mem_start,
 				   mem_size, NULL);
+	/* the FDT may have any number of reserved-memory regions */
+	lmb_enable_grow(&images->lmb);
 }
 #else
 #define lmb_reserve(lmb, base, size)
+#define lmb_release(lmb)
 static inline void boot_start_lmb(struct bootm_headers *images) { }
 #endif
 
 static int bootm_start(void)
 {
+	lmb_release(images_lmb(&images));
 	memset((void *)&images, 0, sizeof(images));
 	images.verify = env_get_yesno("verify");
 
@@ -12,6 +12,7 @@
 #include <bootstd.h>
 #include <dm.h>
 #include <env_internal.h>
+#include <errno.h>
 #include <fs.h>
 #include <malloc.h>
 #include <mapmem.h>
@@ -326,6 +327,7 @@ int bootmeth_alloc_other(struct bootflow *bflow, const char *fname,
 			 void **bufp, uint *sizep)
 {
 	struct blk_desc *desc = NULL;
+	struct fs_file *file;
 	char path[200];
 	loff_t size;
 	void *buf;
@@ -341,14 +343,14 @@ int bootmeth_alloc_other(struct bootflow *bflow, const char *fname,
 	if (ret)
 		return log_msg_ret("fs", ret);
 
-	ret = fs_size(path, &size);
-	log_debug("   %s - err=%d\n", path, ret);
-
-	ret = bootmeth_setup_fs(bflow, desc);
-	if (ret)
-		return log_msg_ret("fs", ret);
+	file = fs_openfile(path);
+	log_debug("   %s - err=%d\n", path, file ? 0 : -errno);
+	if (!file)
+		return log_msg_ret("open", -errno);
 
-	ret = fs_read_alloc(path, size, 0, &buf);
+	size = file->size;
+	ret = fs_pread_alloc(file, 0, &buf);
+	fs_closefile(file);
 	if (ret)
 		return log_msg_ret("all", ret);
 
@@ -362,8 +364,9 @@ int bootmeth_common_read_file(struct udevice *dev, struct bootflow *bflow,
 			      const char *file_path, ulong addr, ulong *sizep)
 {
 	struct blk_desc *desc = NULL;
+	struct fs_file *file;
 	loff_t len_read;
-	loff_t size;
+	void *buf;
 	int ret;
 
 	if (bflow->blk)
@@ -373,17 +376,18 @@ int bootmeth_common_read_file(struct udevice *dev, struct bootflow *bflow,
 	if (ret)
 		return log_msg_ret("fs", ret);
 
-	ret = fs_size(file_path, &size);
-	if (ret)
-		return log_msg_ret("size", ret);
-	if (size > *sizep)
+	file = fs_openfile(file_path);
+	if (!file)
+		return log_msg_ret("size", -errno);
+	if (file->size > *sizep) {
+		fs_closefile(file);
 		return log_msg_ret("spc", -ENOSPC);
+	}
 
-	ret = bootmeth_setup_fs(bflow, desc);
-	if (ret)
-		return log_msg_ret("fs", ret);
-
-	ret = fs_read(file_path, addr, 0, 0, &len_read);
+	buf = map_sysmem(addr, file->size);
+	ret = fs_pread(file, buf, 0, file->size, &len_read);
+	unmap_sysmem(buf);
+	fs_closefile(file);
 	if (ret)
 		return ret;
 	*sizep = len_read;
@@ -30,9 +30,10 @@ U_BOOT_CMD(
 #ifdef CONFIG_CMDLINE
 /*
  * This does not use the U_BOOT_CMD macro as ? can't be used in symbol names
- * nor can we rely on the CONFIG_SYS_LONGHELP helper macro
+ * nor can we rely on the CONFIG_SYS_LONGHELP helper macro. It is sorted as
+ * "?" since find_cmd() relies on the command list being in name order.
  */
-ll_entry_declare(struct cmd_tbl, question_mark, cmd) = {
+ll_entry_declare_key(struct cmd_tbl, question_mark, "?", cmd) = {
 	"?",	CONFIG_SYS_MAXARGS, cmd_always_repeatable,	do_help,
 	"alias for 'help'",
 #ifdef  CONFIG_SYS_LONGHELP
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Show malloc() statistics
+ */
+
+#include <command.h>
+#include <display_options.h>
+#include <malloc.h>
+
+static int do_malloc_info(struct cmd_tbl *cmdtp, int flag, int argc,
+			  char *const argv[])
+{
+	struct malloc_slab_stats stats;
+	int i;
+
+	malloc_slab_get_stats(&stats);
+	if (!stats.size) {
+		printf("Slabs not in use\n");
+		return 0;
+	}
+
+	printf("slab region: ");
+	print_size(stats.size, "");
+	printf(", %u pages, %u free\n", stats.pages, stats.free_pages);
+	printf("in use:      %lu bytes\n", malloc_slab_in_use());
+	printf("overflows:   %lu\n", stats.overflows);
+	printf("size  pages    in use      allocs       frees\n");
+	for (i = 0; i < MALLOC_SLAB_CLASSES; i++) {
+		struct malloc_slab_class_stats *cls = &stats.cls[i];
+
+		printf("%4u  %5u  %8u  %10lu  %10lu\n", cls->size, cls->pages,
+		       cls->in_use, cls->allocs, cls->frees);
+	}
+
+	return 0;
+}
+
+U_BOOT_LONGHELP(malloc,
+	"info - show slab allocator statistics\n");
+
+U_BOOT_CMD_WITH_SUBCMDS(malloc, "malloc information", malloc_help_text,
+	U_BOOT_SUBCMD_MKENT(info, 1, 1, do_malloc_info));
@@ -119,6 +119,8 @@ static void mtd_show_parts(struct mtd_info *mtd, int level)
 
 static void mtd_show_device(struct mtd_info *mtd)
 {
+	struct mtd_cache_stats stats;
+
 	/* Device */
 	printf("* %s\n", mtd->name);
 #if defined(CONFIG_DM)
@@ -181,6 +183,10 @@ static void mtd_show_device(struct mtd_info *mtd)
 		       mtd->bitflip_threshold);
 	}
 
+	if (!mtd_is_partition(mtd) && !mtd_cache_get_stats(mtd, &stats))
+		printf("  - page cache: %lu hits, %lu misses, %lu pages read ahead\n",
+		       stats.hits, stats.misses, stats.readahead);
+
 	printf("  - 0x%012llx-0x%012llx : \"%s\"\n",
 	       mtd->offset, mtd->offset + mtd->size, mtd->name);
 
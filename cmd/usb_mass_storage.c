@@ -254,6 +254,7 @@ cleanup_ums_init:
 
 U_BOOT_CMD(ums, 4, 1, do_usb_mass_storage,
 	"Use the UMS [USB Mass Storage]",
-	"<USB_controller> [<devtype>] <dev[:part]>  e.g. ums 0 mmc 0\n"
+	"<USB_controller> [<devtype>] <dev[:part]>[,<dev[:part]>...]\n"
+	"    e.g. ums 0 mmc 0 or ums 0 mmc 0,1 for two LUNs\n"
 	"    devtype defaults to mmc"
 );
@@ -232,6 +232,8 @@ static int initr_dm(void)
 
 	/* Drop the pre-reloc driver model and start a new one */
 	gd->dm_root = NULL;
+	gd_set_dm_compat_index(NULL);
+	gd_set_dm_ofnode_map(NULL);
 #ifdef CONFIG_TIMER
 	gd->timer = NULL;
 #endif
@@ -235,6 +235,9 @@ struct child_prog {
 #endif
 	int sp;				/* number of SPECIAL_VAR_SYMBOL */
 	int type;
+#ifdef __U_BOOT__
+	struct cmd_tbl *cmdtp;		/* command, once it has been looked up */
+#endif
 };
 
 struct pipe {
@@ -1547,6 +1550,7 @@ static int run_pipe_real(struct pipe *pi)
 	int flag = do_repeat ? CMD_FLAG_REPEAT : 0;
 	struct child_prog *child;
 	char *p;
+	int sp;
 # if __GNUC__
 	/* Avoid longjmp clobbering */
 	(void) &i;
@@ -1613,6 +1617,8 @@ static int run_pipe_real(struct pipe *pi)
 			}
 			return EXIT_SUCCESS;   /* don't worry about errors in set_local_var() yet */
 		}
+		/* A parsed list may be run again, so leave child->sp alone */
+		sp = child->sp;
 		for (i = 0; is_assignment(child->argv[i]); i++) {
 			p = insert_var_value(child->argv[i]);
 #ifndef __U_BOOT__
@@ -1621,11 +1627,11 @@ static int run_pipe_real(struct pipe *pi)
 			set_local_var(p, 0);
 #endif
 			if (p != child->argv[i]) {
-				child->sp--;
+				sp--;
 				free(p);
 			}
 		}
-		if (child->sp) {
+		if (sp) {
 			char * str = NULL;
 
 			str = make_string(child->argv + i,
@@ -1668,9 +1674,11 @@ static int run_pipe_real(struct pipe *pi)
 					"'run' command\n", child->argv[i]);
 			return -1;
 		}
-		/* Process the command */
-		return cmd_process(flag, child->argc - i, child->argv + i,
-				   &flag_repeat, NULL);
+		/* Process the command, looking it up only once */
+		if (!child->cmdtp)
+			child->cmdtp = find_cmd(child->argv[i]);
+		return cmd_process_tbl(child->cmdtp, flag, child->argc - i,
+				       child->argv + i, &flag_repeat, NULL);
 #endif
 	}
 #ifndef __U_BOOT__
@@ -1757,6 +1765,7 @@ static int run_list_real(struct pipe *pi)
 	char *save_name = NULL;
 	char **list = NULL;
 	char **save_list = NULL;
+	struct pipe *save_pi = NULL;
 	struct pipe *rpipe;
 	int flag_rep = 0;
 #ifndef __U_BOOT__
@@ -1796,7 +1805,8 @@ static int run_list_real(struct pipe *pi)
 				/* check Ctrl-C */
 				ctrlc();
 				if ((had_ctrlc())) {
-					return 1;
+					rcode = 1;
+					goto out;
 				}
 #endif
 				flag_restore = 0;
@@ -1825,6 +1835,7 @@ static int run_list_real(struct pipe *pi)
 				list = make_list_in(pi->next->progs->argv,
 					pi->progs->argv[0]);
 				save_list = list;
+				save_pi = pi;
 				save_name = pi->progs->argv[0];
 				pi->progs->argv[0] = NULL;
 				flag_rep = 1;
@@ -1895,7 +1906,8 @@ static int run_list_real(struct pipe *pi)
 #else
 		if (rcode < -1) {
 			last_return_code = -rcode - 2;
-			return -2;	/* exit */
+			rcode = -2;	/* exit */
+			goto out;
 		}
 		last_return_code = rcode;
 #endif
@@ -1915,6 +1927,17 @@ static int run_list_real(struct pipe *pi)
 		checkjobs(NULL);
 #endif
 	}
+#ifdef __U_BOOT__
+out:
+	/* Leaving a "for" loop early: put back its variable name */
+	if (list) {
+		free(save_pi->progs->argv[0]);
+		while (*list)
+			free(*list++);
+		free(save_list);
+		save_pi->progs->argv[0] = save_name;
+	}
+#endif
 	return rcode;
 }
 
@@ -2571,6 +2594,9 @@ static int done_command(struct p_context *ctx)
 	prog->family = pi;
 #endif
 	prog->sp = 0;
+#ifdef __U_BOOT__
+	prog->cmdtp = NULL;
+#endif
 	ctx->child = prog;
 	prog->type = ctx->type;
 
@@ -3170,6 +3196,192 @@ static void update_ifs_map(void)
 	mapset(ifs, 2);            /* also flow through if quoted */
 }
 
+#ifdef __U_BOOT__
+/*
+ * Cache of parsed command strings
+ *
+ * bootcmd, boot scripts, the variables started with "run" and the commands
+ * in loop bodies are parsed again each time they run. Variables are only
+ * expanded when a command runs, so a parsed list can be kept and run again
+ * without going through the parser. Strings are looked up by their hash and
+ * then compared in full. Only strings which parsed without error are kept,
+ * and only while IFS is not set, since that changes how words are split.
+ * A string is kept the second time it is run, so commands which only run
+ * once do not take up memory.
+ */
+#define HUSH_CACHE_SIZE		32
+
+struct hush_script {
+	char *text;
+	uint hash;
+	int flag;
+	int busy;		/* number of runs in progress */
+	int failed;		/* parse error or exit, do not cache */
+	ulong used;		/* for LRU replacement */
+	int num_lines;
+	struct pipe **lines;	/* one parsed list per line */
+};
+
+static struct hush_script *hush_cache[HUSH_CACHE_SIZE];
+static ulong hush_cache_clock;
+/* Hashes of strings which have run once, replaced in turn */
+static uint hush_seen[HUSH_CACHE_SIZE * 2];
+static int hush_seen_next;
+/* Script to add parsed lines to in the next parse_stream_outer() */
+static struct hush_script *hush_fill;
+
+static uint hush_script_hash(const char *s, int flag)
+{
+	uint hash = 2166136261U ^ flag;
+
+	while (*s) {
+		hash ^= (uchar)*s++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void hush_script_free(struct hush_script *script)
+{
+	int i;
+
+	for (i = 0; i < script->num_lines; i++)
+		free_pipe_list(script->lines[i], 0);
+	free(script->lines);
+	free(script->text);
+	free(script);
+}
+
+static struct hush_script *hush_cache_find(const char *s, int flag)
+{
+	uint hash = hush_script_hash(s, flag);
+	struct hush_script *script;
+	int i;
+
+	for (i = 0; i < HUSH_CACHE_SIZE; i++) {
+		script = hush_cache[i];
+		if (script && script->hash == hash && script->flag == flag &&
+		    !strcmp(script->text, s)) {
+			script->used = ++hush_cache_clock;
+			return script;
+		}
+	}
+
+	return NULL;
+}
+
+/* Check whether a string has run before, noting it if not */
+static bool hush_cache_seen(uint hash)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(hush_seen); i++) {
+		if (hush_seen[i] == hash)
+			return true;
+	}
+	hush_seen[hush_seen_next] = hash;
+	hush_seen_next = (hush_seen_next + 1) % ARRAY_SIZE(hush_seen);
+
+	return false;
+}
+
+static struct hush_script *hush_script_new(const char *s, int flag)
+{
+	struct hush_script *script;
+
+	if (!hush_cache_seen(hush_script_hash(s, flag)))
+		return NULL;
+	script = calloc(1, sizeof(*script));
+	if (!script)
+		return NULL;
+	script->text = strdup(s);
+	if (!script->text) {
+		free(script);
+		return NULL;
+	}
+	script->hash = hush_script_hash(s, flag);
+	script->flag = flag;
+
+	return script;
+}
+
+/* Keep a list which has been run in the script being parsed, if any */
+static int hush_script_keep(struct hush_script *script, struct pipe *list)
+{
+	struct pipe **lines;
+
+	if (!script || script->failed)
+		return 0;
+
+	lines = realloc(script->lines,
+			(script->num_lines + 1) * sizeof(*lines));
+	if (!lines) {
+		script->failed = 1;
+		return 0;
+	}
+	lines[script->num_lines++] = list;
+	script->lines = lines;
+
+	return 1;
+}
+
+/* Add a parsed script to the cache, replacing the least recently used one */
+static void hush_cache_add(struct hush_script *script)
+{
+	struct hush_script **slot = NULL;
+	int i;
+
+	if (!script)
+		return;
+	if (script->failed || env_get("IFS") ||
+	    hush_cache_find(script->text, script->flag)) {
+		hush_script_free(script);
+		return;
+	}
+
+	for (i = 0; i < HUSH_CACHE_SIZE; i++) {
+		if (!hush_cache[i]) {
+			slot = &hush_cache[i];
+			break;
+		}
+		if (!hush_cache[i]->busy &&
+		    (!slot || hush_cache[i]->used < (*slot)->used))
+			slot = &hush_cache[i];
+	}
+	if (!slot) {
+		hush_script_free(script);
+		return;
+	}
+	if (*slot)
+		hush_script_free(*slot);
+	script->used = ++hush_cache_clock;
+	*slot = script;
+}
+
+/* Run a cached script, as parse_stream_outer() would after parsing it */
+static int hush_script_run(struct hush_script *script)
+{
+	int code = 1;
+	int i;
+
+	script->busy++;
+	for (i = 0; i < script->num_lines; i++) {
+		code = run_list_real(script->lines[i]);
+		if (code == -2)
+			break;
+		if (code == -1)
+			flag_repeat = 0;
+	}
+	script->busy--;
+
+	if (code == -2)
+		return -2;
+
+	return (code != 0) ? 1 : 0;
+}
+#endif /* __U_BOOT__ */
+
 /* most recursion does not come through here, the exeception is
  * from builtin_source() */
 static int parse_stream_outer(struct in_str *inp, int flag)
@@ -3179,7 +3391,10 @@ static int parse_stream_outer(struct in_str *inp, int flag)
 	o_string temp=NULL_O_STRING;
 	int rcode;
 #ifdef __U_BOOT__
+	struct hush_script *fill = hush_fill;
 	int code = 1;
+
+	hush_fill = NULL;
 #endif
 	do {
 		ctx.type = flag;
@@ -3204,7 +3419,16 @@ static int parse_stream_outer(struct in_str *inp, int flag)
 #ifndef __U_BOOT__
 			run_list(ctx.list_head);
 #else
-			code = run_list(ctx.list_head);
+			if (fill) {
+				/* Keep the list, as the string is being cached */
+				code = run_list_real(ctx.list_head);
+				if (code == -2)
+					fill->failed = 1;
+				if (!hush_script_keep(fill, ctx.list_head))
+					free_pipe_list(ctx.list_head, 0);
+			} else {
+				code = run_list(ctx.list_head);
+			}
 			if (code == -2) {	/* exit */
 				b_free(&temp);
 				code = 0;
@@ -3234,6 +3458,8 @@ static int parse_stream_outer(struct in_str *inp, int flag)
 #ifdef __U_BOOT__
 			if (inp->__promptme == 0) printf("<INTERRUPT>\n");
 			inp->__promptme = 1;
+			if (fill)
+				fill->failed = 1;
 #endif
 			temp.nonnull = 0;
 			temp.quote = 0;
@@ -3260,23 +3486,39 @@ int parse_string_outer(const char *s, int flag)
 	struct in_str input;
 	int rcode;
 #ifdef __U_BOOT__
+	struct hush_script *script = NULL;
 	char *p = NULL;
 	if (!s)
 		return 1;
 	if (!*s)
 		return 0;
+	if (CONFIG_IS_ENABLED(HUSH_CACHE) && !env_get("IFS")) {
+		script = hush_cache_find(s, flag);
+		if (script && !script->busy) {
+			rcode = hush_script_run(script);
+			return rcode == -2 ? last_return_code : rcode;
+		}
+		/* A script running itself is just parsed again */
+		script = script ? NULL : hush_script_new(s, flag);
+	}
 	if (!(p = strchr(s, '\n')) || *++p) {
 		p = xmalloc(strlen(s) + 2);
 		strcpy(p, s);
 		strcat(p, "\n");
 		setup_string_in_str(&input, p);
+		hush_fill = script;
 		rcode = parse_stream_outer(&input, flag);
 		free(p);
+		hush_cache_add(script);
 		return rcode == -2 ? last_return_code : rcode;
 	} else {
+		hush_fill = script;
 #endif
 	setup_string_in_str(&input, s);
 	rcode = parse_stream_outer(&input, flag);
+#ifdef __U_BOOT__
+	hush_cache_add(script);
+#endif
 	return rcode == -2 ? last_return_code : rcode;
 #ifdef __U_BOOT__
 	}
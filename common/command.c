@@ -126,11 +126,45 @@ struct cmd_tbl *find_cmd_tbl(const char *cmd, struct cmd_tbl *table,
 	return NULL;	/* not found or ambiguous command */
 }
 
+/*
+ * The linker sorts the entries of the command list by section name, which
+ * ends in the command name, so the list is in strcmp() order. All commands
+ * starting with a given prefix are next to each other and a full match is the
+ * first of them.
+ */
 struct cmd_tbl *find_cmd(const char *cmd)
 {
-	struct cmd_tbl *start = ll_entry_start(struct cmd_tbl, cmd);
-	const int len = ll_entry_count(struct cmd_tbl, cmd);
-	return find_cmd_tbl(cmd, start, len);
+#ifdef CONFIG_CMDLINE
+	struct cmd_tbl *table = ll_entry_start(struct cmd_tbl, cmd);
+	const int count = ll_entry_count(struct cmd_tbl, cmd);
+	int low = 0, high = count, mid;
+	const char *p;
+	int len;
+
+	if (!cmd)
+		return NULL;
+	/* compare command name only until first dot, as in find_cmd_tbl() */
+	len = ((p = strchr(cmd, '.')) == NULL) ? strlen(cmd) : (p - cmd);
+
+	/* Find the first command which does not sort before the prefix */
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (strncmp(table[mid].name, cmd, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == count || strncmp(table[low].name, cmd, len))
+		return NULL;
+	if (!table[low].name[len])
+		return &table[low];	/* full match */
+	if (low + 1 < count && !strncmp(table[low + 1].name, cmd, len))
+		return NULL;		/* ambiguous abbreviation */
+
+	return &table[low];
+#else
+	return NULL;
+#endif /* CONFIG_CMDLINE */
 }
 
 int cmd_usage(const struct cmd_tbl *cmdtp)
@@ -585,11 +619,11 @@ static int cmd_call(struct cmd_tbl *cmdtp, int flag, int argc,
 	return result;
 }
 
-enum command_ret_t cmd_process(int flag, int argc, char *const argv[],
-			       int *repeatable, ulong *ticks)
+enum command_ret_t cmd_process_tbl(struct cmd_tbl *cmdtp, int flag, int argc,
+				   char *const argv[], int *repeatable,
+				   ulong *ticks)
 {
 	enum command_ret_t rc = CMD_RET_SUCCESS;
-	struct cmd_tbl *cmdtp;
 
 #if defined(CONFIG_SYS_XTRACE)
 	char *xtrace;
@@ -605,8 +639,6 @@ enum command_ret_t cmd_process(int flag, int argc, char *const argv[],
 	}
 #endif
 
-	/* Look up command in command table */
-	cmdtp = find_cmd(argv[0]);
 	if (cmdtp == NULL) {
 		printf("Unknown command '%s' - try 'help'\n", argv[0]);
 		return 1;
@@ -644,6 +676,14 @@ enum command_ret_t cmd_process(int flag, int argc, char *const argv[],
 	return rc;
 }
 
+enum command_ret_t cmd_process(int flag, int argc, char *const argv[],
+			       int *repeatable, ulong *ticks)
+{
+	/* Look up command in command table */
+	return cmd_process_tbl(find_cmd(argv[0]), flag, argc, argv, repeatable,
+			       ticks);
+}
+
 int cmd_process_error(struct cmd_tbl *cmdtp, int err)
 {
 	if (err == CMD_RET_USAGE)
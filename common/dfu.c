@@ -103,6 +103,12 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 		if (dfu_reinit_needed)
 			goto exit;
 
+		ret = dfu_write_pending();
+		if (ret) {
+			pr_err("Deferred dfu_write() failed!");
+			goto exit;
+		}
+
 		schedule();
 		dm_usb_gadget_handle_interrupts(udc);
 	}
@@ -611,6 +611,7 @@ void mem_malloc_init(ulong start, ulong size)
 #if CONFIG_IS_ENABLED(SYS_MALLOC_CLEAR_ON_INIT)
 	memset((void *)mem_malloc_start, 0x0, size);
 #endif
+	malloc_slab_init(&mem_malloc_end, size);
 }
 
 /* field-extraction macros */
@@ -1276,6 +1277,14 @@ Void_t* mALLOc_impl(bytes) size_t bytes;
 
   if ((long)bytes < 0) return NULL;
 
+  if (CONFIG_IS_ENABLED(SYS_MALLOC_SLAB) && bytes <= MALLOC_SLAB_MAX)
+  {
+    Void_t *mem = malloc_slab_alloc(bytes);
+
+    if (mem)
+      return mem;
+  }
+
   nb = request2size(bytes);  /* padded request size; */
 
   /* Check for exact match in a bin */
@@ -1546,6 +1555,12 @@ void fREe_impl(mem) Void_t* mem;
   if (mem == NULL)                              /* free(0) has no effect */
     return;
 
+  if (malloc_slab_owns(mem))
+  {
+    malloc_slab_free(mem);
+    return;
+  }
+
   p = mem2chunk(mem);
   hd = p->size;
 
@@ -1699,6 +1714,19 @@ Void_t* rEALLOc_impl(oldmem, bytes) Void_t* oldmem; size_t bytes;
 	}
 #endif
 
+  if (malloc_slab_owns(oldmem))
+  {
+    oldsize = malloc_slab_usable_size(oldmem);
+    if (bytes <= oldsize)
+      return oldmem;
+    newmem = mALLOc_impl(bytes);
+    if (!newmem)
+      return NULL;
+    memcpy(newmem, oldmem, oldsize);
+    malloc_slab_free(oldmem);
+    return newmem;
+  }
+
   newp    = oldp    = mem2chunk(oldmem);
   newsize = oldsize = chunksize(oldp);
 
@@ -1926,7 +1954,9 @@ Void_t* mEMALIGn_impl(alignment, bytes) size_t alignment; size_t bytes;
   /* Call malloc with worst case padding to hit alignment. */
 
   nb = request2size(bytes);
-  m  = (char*)(mALLOc_impl(nb + alignment + MINSIZE));
+  /* The chunk is split below, so it must not be a slab object */
+  m  = (char*)(mALLOc_impl(max_t(size_t, nb + alignment + MINSIZE,
+                                 MALLOC_SLAB_MAX + 1)));
 
   /*
   * The attempt to over-allocate (with a size large enough to guarantee the
@@ -1953,7 +1983,8 @@ Void_t* mEMALIGn_impl(alignment, bytes) size_t alignment; size_t bytes;
     fREe_impl(m);
     /* Add in extra bytes to match misalignment of unexpanded allocation */
     extra = alignment - (((unsigned long)(m)) % alignment);
-    m  = (char*)(mALLOc_impl(bytes + extra));
+    m  = (char*)(mALLOc_impl(max_t(size_t, bytes + extra,
+                                   MALLOC_SLAB_MAX + 1)));
     /*
      * m might not be the same as before. Validate that the previous value of
      * extra still works for the current value of m.
@@ -2107,6 +2138,11 @@ Void_t* cALLOc_impl(n, elem_size) size_t n; size_t elem_size;
 		return mem;
 	}
 #endif
+    if (malloc_slab_owns(mem))
+    {
+      memset(mem, 0, sz);
+      return mem;
+    }
     p = mem2chunk(mem);
 
     /* Two optional cases in which clearing not necessary */
@@ -2334,6 +2370,8 @@ size_t malloc_usable_size(mem) Void_t* mem;
   mchunkptr p;
   if (mem == NULL)
     return 0;
+  else if (malloc_slab_owns(mem))
+    return malloc_slab_usable_size(mem);
   else
   {
     p = mem2chunk(mem);
@@ -2380,7 +2418,7 @@ static void malloc_update_mallinfo(void)
   }
 
   current_mallinfo.ordblks = navail;
-  current_mallinfo.uordblks = sbrked_mem - avail;
+  current_mallinfo.uordblks = sbrked_mem - avail + malloc_slab_in_use();
   current_mallinfo.fordblks = avail;
   current_mallinfo.hblks = n_mmaps;
   current_mallinfo.hblkhd = mmapped_mem;
@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Size-class slab allocator in front of dlmalloc
+ *
+ * Driver model, filesystems and the EFI loader make many small allocations
+ * which live for a short time: private data, names, directory entries. Each
+ * one is a dlmalloc chunk with a header, and they break up the heap between
+ * larger blocks. This serves requests of up to MALLOC_SLAB_MAX bytes from a
+ * region reserved at the end of the heap instead. The region is split into
+ * pages, and each page in use holds objects of a single size class, so
+ * allocating and freeing an object just takes it from or puts it on the
+ * page's free list. Pages which become empty go back to the region, to be
+ * used for any class.
+ *
+ * A pointer is known to be a slab object from its address, so free(),
+ * realloc() and malloc_usable_size() in dlmalloc.c pass slab objects here.
+ * When the region is full, small requests go to the heap as before.
+ */
+
+#include <log.h>
+#include <malloc.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <valgrind/memcheck.h>
+
+#define SLAB_PAGE_SHIFT		12
+#define SLAB_PAGE_SIZE		(1UL << SLAB_PAGE_SHIFT)
+
+/* Object sizes, all a multiple of the alignment which malloc() provides */
+static const u16 slab_sizes[MALLOC_SLAB_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256,
+};
+
+/**
+ * struct slab_page - information about one page of the slab region
+ *
+ * @node: link in the partial list of the page's class, or in the free pages
+ * @free: first freed object in the page, each holding a pointer to the next
+ * @used: number of objects allocated from the page
+ * @fresh: number of objects at the start of the page which have been handed
+ *	out at some point; objects from here on were never used
+ * @cls: size class of the page
+ */
+struct slab_page {
+	struct list_head node;
+	void **free;
+	u16 used;
+	u16 fresh;
+	u8 cls;
+};
+
+/**
+ * struct malloc_slab - state of the slab allocator
+ *
+ * @pages: information about each page, indexed by page number
+ * @first: number of the first page which holds objects; the ones before it
+ *	hold @pages
+ * @free_pages: pages not assigned to a class
+ * @partial: pages of each class with at least one free object
+ * @stats: statistics, updated as objects are allocated and freed
+ */
+struct malloc_slab {
+	struct slab_page *pages;
+	uint first;
+	struct list_head free_pages;
+	struct list_head partial[MALLOC_SLAB_CLASSES];
+	struct malloc_slab_stats stats;
+};
+
+ulong malloc_slab_base, malloc_slab_end;
+static struct malloc_slab slab;
+
+static int slab_class(size_t bytes)
+{
+	int cls;
+
+	for (cls = 0; slab_sizes[cls] < bytes; cls++)
+		;
+
+	return cls;
+}
+
+static struct slab_page *slab_page_of(const void *mem)
+{
+	return &slab.pages[((ulong)mem - malloc_slab_base) >> SLAB_PAGE_SHIFT];
+}
+
+static void *slab_page_addr(struct slab_page *page)
+{
+	return (void *)(malloc_slab_base +
+			((page - slab.pages) << SLAB_PAGE_SHIFT));
+}
+
+void malloc_slab_init(ulong *end, ulong size)
+{
+	ulong region = CONFIG_SYS_MALLOC_SLAB_SIZE;
+	uint count, i;
+
+	malloc_slab_base = 0;
+	malloc_slab_end = 0;
+	memset(&slab, '\0', sizeof(slab));
+
+	/* Leave most of a small heap to dlmalloc */
+	if (region > size / 4)
+		return;
+
+	malloc_slab_end = *end & ~(SLAB_PAGE_SIZE - 1);
+	malloc_slab_base = (malloc_slab_end - region) & ~(SLAB_PAGE_SIZE - 1);
+	*end = malloc_slab_base;
+
+	count = (malloc_slab_end - malloc_slab_base) >> SLAB_PAGE_SHIFT;
+	slab.pages = (struct slab_page *)malloc_slab_base;
+	slab.first = DIV_ROUND_UP(count * sizeof(struct slab_page),
+				  SLAB_PAGE_SIZE);
+	memset(slab.pages, '\0', slab.first * SLAB_PAGE_SIZE);
+
+	INIT_LIST_HEAD(&slab.free_pages);
+	for (i = 0; i < MALLOC_SLAB_CLASSES; i++) {
+		INIT_LIST_HEAD(&slab.partial[i]);
+		slab.stats.cls[i].size = slab_sizes[i];
+	}
+	for (i = slab.first; i < count; i++)
+		list_add_tail(&slab.pages[i].node, &slab.free_pages);
+
+	slab.stats.size = malloc_slab_end - malloc_slab_base;
+	slab.stats.pages = count - slab.first;
+	slab.stats.free_pages = slab.stats.pages;
+	debug("using memory %#lx-%#lx for slabs\n", malloc_slab_base,
+	      malloc_slab_end);
+}
+
+void *malloc_slab_alloc(size_t bytes)
+{
+	struct malloc_slab_class_stats *stats;
+	struct slab_page *page;
+	void **mem;
+	int cls;
+
+	if (!malloc_slab_end)
+		return NULL;
+
+	cls = slab_class(bytes);
+	stats = &slab.stats.cls[cls];
+	page = list_first_entry_or_null(&slab.partial[cls], struct slab_page,
+					node);
+	if (!page) {
+		page = list_first_entry_or_null(&slab.free_pages,
+						struct slab_page, node);
+		if (!page) {
+			slab.stats.overflows++;
+			return NULL;
+		}
+		list_move(&page->node, &slab.partial[cls]);
+		page->cls = cls;
+		page->free = NULL;
+		page->fresh = 0;
+		slab.stats.free_pages--;
+		stats->pages++;
+	}
+
+	if (page->free) {
+		mem = page->free;
+		page->free = *mem;
+	} else {
+		mem = slab_page_addr(page) + page->fresh++ * slab_sizes[cls];
+	}
+
+	/* Drop a full page from the partial list until an object is freed */
+	if (++page->used == SLAB_PAGE_SIZE / slab_sizes[cls])
+		list_del_init(&page->node);
+	stats->allocs++;
+	stats->in_use++;
+	VALGRIND_MALLOCLIKE_BLOCK(mem, bytes, 0, false);
+
+	return mem;
+}
+
+void malloc_slab_free(void *mem)
+{
+	struct slab_page *page = slab_page_of(mem);
+	struct malloc_slab_class_stats *stats = &slab.stats.cls[page->cls];
+	void **obj = mem;
+
+	if (page->used == SLAB_PAGE_SIZE / slab_sizes[page->cls])
+		list_add(&page->node, &slab.partial[page->cls]);
+	*obj = page->free;
+	page->free = obj;
+	stats->frees++;
+	stats->in_use--;
+	VALGRIND_FREELIKE_BLOCK(mem, 0);
+
+	if (!--page->used) {
+		list_move(&page->node, &slab.free_pages);
+		slab.stats.free_pages++;
+		stats->pages--;
+	}
+}
+
+size_t malloc_slab_usable_size(void *mem)
+{
+	return slab_sizes[slab_page_of(mem)->cls];
+}
+
+ulong malloc_slab_in_use(void)
+{
+	ulong total = 0;
+	int i;
+
+	for (i = 0; i < MALLOC_SLAB_CLASSES; i++)
+		total += (ulong)slab.stats.cls[i].in_use * slab_sizes[i];
+
+	return total;
+}
+
+void malloc_slab_get_stats(struct malloc_slab_stats *stats)
+{
+	*stats = slab.stats;
+}
+
+#define ARENA_BLOCK_SIZE	0x1000
+#define ARENA_ALIGN		(2 * sizeof(size_t))
+
+/**
+ * struct malloc_arena - an arena of memory freed all together
+ *
+ * @blocks: blocks obtained from malloc(), most recent first
+ * @block_size: size of each block, including its header
+ * @ptr: next free byte in the current block
+ * @left: number of bytes free in the current block
+ */
+struct malloc_arena {
+	struct arena_block *blocks;
+	size_t block_size;
+	char *ptr;
+	size_t left;
+};
+
+struct arena_block {
+	struct arena_block *next;
+	size_t pad;		/* keeps @data aligned to ARENA_ALIGN */
+	char data[];
+};
+
+struct malloc_arena *malloc_arena_new(size_t block_size)
+{
+	struct malloc_arena *arena;
+
+	arena = calloc(1, sizeof(*arena));
+	if (!arena)
+		return NULL;
+	arena->block_size = max_t(size_t, block_size ?: ARENA_BLOCK_SIZE,
+				  MALLOC_SLAB_MAX * 4);
+
+	return arena;
+}
+
+void *malloc_arena_alloc(struct malloc_arena *arena, size_t size)
+{
+	struct arena_block *block;
+	size_t len;
+	void *mem;
+
+	size = ALIGN(size, ARENA_ALIGN);
+	if (size > arena->left) {
+		/* Large requests get a block of their own */
+		len = max(arena->block_size, sizeof(*block) + size);
+		block = malloc(len);
+		if (!block)
+			return NULL;
+		if (len > arena->block_size && arena->blocks) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+			return block->data;
+		}
+		block->next = arena->blocks;
+		arena->blocks = block;
+		arena->ptr = block->data;
+		arena->left = len - sizeof(*block);
+	}
+	mem = arena->ptr;
+	arena->ptr += size;
+	arena->left -= size;
+
+	return mem;
+}
+
+void malloc_arena_free(struct malloc_arena *arena)
+{
+	struct arena_block *block, *next;
+
+	if (!arena)
+		return;
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
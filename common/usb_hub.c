@@ -21,6 +21,7 @@
  * Probes device for being a hub and configurate it
  */
 
+#include <bootstage.h>
 #include <command.h>
 #include <dm.h>
 #include <env.h>
@@ -49,16 +50,38 @@
 
 #define HUB_DEBOUNCE_TIMEOUT	CONFIG_USB_HUB_DEBOUNCE_TIMEOUT
 
+#define HUB_RESET_RECOVERY_TIME	10
+
 #define PORT_OVERCURRENT_MAX_SCAN_COUNT		3
 
+/**
+ * enum usb_scan_state - enumeration step a scanned port is in
+ *
+ * @USB_SCAN_CONNECT:	Waiting for power-good / a connection to show up
+ * @USB_SCAN_RESET:	Port reset issued, waiting for the port to be enabled
+ * @USB_SCAN_RECOVERY:	Reset done, waiting for the reset recovery time
+ */
+enum usb_scan_state {
+	USB_SCAN_CONNECT,
+	USB_SCAN_RESET,
+	USB_SCAN_RECOVERY,
+};
+
 struct usb_device_scan {
 	struct usb_device *dev;		/* USB hub device to scan */
 	struct usb_hub_device *hub;	/* USB hub struct */
 	int port;			/* USB port to scan */
+	enum usb_scan_state state;	/* Current enumeration step */
+	ulong deadline;			/* Timer value when the step is due */
+	int tries;			/* Number of port resets issued */
+	int speed;			/* Port speed once the reset is done */
+	unsigned short portstatus;	/* Port status seen on connection */
+	unsigned short portchange;	/* Port change seen on connection */
 	struct list_head list;
 };
 
 static LIST_HEAD(usb_scan_list);
+static bool usb_scan_deferred;
 
 __weak void usb_hub_reset_devices(struct usb_hub_device *hub, int port)
 {
@@ -343,11 +366,20 @@ static int usb_hub_port_reset(struct usb_device *dev, int port,
 	return 0;
 }
 
-int usb_hub_port_connect_change(struct usb_device *dev, int port)
+/**
+ * usb_hub_port_check_connect() - check for a device on a port
+ *
+ * Read the port status and acknowledge the connection change.
+ *
+ * @dev:	Hub device the port belongs to
+ * @port:	Port number to check (note ports are numbered from 0 here)
+ * Return: 0 if a device is connected, -ENOTCONN if not, other -ve on error
+ */
+static int usb_hub_port_check_connect(struct usb_device *dev, int port)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
-	int ret, speed;
+	int ret;
 
 	/* Check status */
 	ret = usb_get_port_status(dev, port + 1, portsts);
@@ -375,35 +407,37 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 			return -ENOTCONN;
 	}
 
-	/* Reset the port */
-	ret = usb_hub_port_reset(dev, port, &portstatus);
-	if (ret < 0) {
-		if (ret != -ENXIO)
-			printf("cannot reset port %i!?\n", port + 1);
-		return ret;
-	}
+	return 0;
+}
 
+static int usb_hub_port_speed(unsigned short portstatus)
+{
 	switch (portstatus & USB_PORT_STAT_SPEED_MASK) {
 	case USB_PORT_STAT_SUPER_SPEED:
-		speed = USB_SPEED_SUPER;
-		break;
+		return USB_SPEED_SUPER;
 	case USB_PORT_STAT_HIGH_SPEED:
-		speed = USB_SPEED_HIGH;
-		break;
+		return USB_SPEED_HIGH;
 	case USB_PORT_STAT_LOW_SPEED:
-		speed = USB_SPEED_LOW;
-		break;
+		return USB_SPEED_LOW;
 	default:
-		speed = USB_SPEED_FULL;
-		break;
+		return USB_SPEED_FULL;
 	}
+}
 
-	/*
-	 * USB 2.0 7.1.7.5: devices must be able to accept a SetAddress()
-	 * request (refer to Section 11.24.2 and Section 9.4 respectively)
-	 * after the reset recovery time 10 ms
-	 */
-	mdelay(10);
+/**
+ * usb_hub_port_new_device() - enumerate the device on a freshly reset port
+ *
+ * The port must have been reset and the reset recovery time must have
+ * elapsed. The port is disabled again if the device cannot be set up.
+ *
+ * @dev:	Hub device the port belongs to
+ * @port:	Port number (note ports are numbered from 0 here)
+ * @speed:	Speed of the device, USB_SPEED_...
+ * Return: 0 if OK, -ve on error
+ */
+static int usb_hub_port_new_device(struct usb_device *dev, int port, int speed)
+{
+	int ret;
 
 #if CONFIG_IS_ENABLED(DM_USB)
 	struct udevice *child;
@@ -438,7 +472,205 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 	return ret;
 }
 
-static int usb_scan_port(struct usb_device_scan *usb_scan)
+int usb_hub_port_connect_change(struct usb_device *dev, int port)
+{
+	unsigned short portstatus;
+	int ret;
+
+	ret = usb_hub_port_check_connect(dev, port);
+	if (ret)
+		return ret;
+
+	/* Reset the port */
+	ret = usb_hub_port_reset(dev, port, &portstatus);
+	if (ret < 0) {
+		if (ret != -ENXIO)
+			printf("cannot reset port %i!?\n", port + 1);
+		return ret;
+	}
+
+	/*
+	 * USB 2.0 7.1.7.5: devices must be able to accept a SetAddress()
+	 * request (refer to Section 11.24.2 and Section 9.4 respectively)
+	 * after the reset recovery time 10 ms
+	 */
+	mdelay(HUB_RESET_RECOVERY_TIME);
+
+	return usb_hub_port_new_device(dev, port, usb_hub_port_speed(portstatus));
+}
+
+/**
+ * usb_scan_deadline() - get the timer value at which a scan step is due
+ *
+ * @delay:	Delay in ms from now
+ * Return: get_timer() value after which the step should run
+ */
+static ulong usb_scan_deadline(ulong delay)
+{
+#ifdef CONFIG_SANDBOX
+	if (state_get_skip_delays())
+		return 0;
+#endif
+	return get_timer(0) + delay;
+}
+
+static void *usb_scan_controller(struct usb_device *dev)
+{
+#if CONFIG_IS_ENABLED(DM_USB)
+	return dev->controller_dev;
+#else
+	return dev->controller;
+#endif
+}
+
+/**
+ * usb_scan_bus_busy() - check if another port on the same bus is resetting
+ *
+ * After a port reset the attached device answers on address 0 until it is
+ * given its own address, so only one port per controller may be between
+ * reset and enumeration at any time. Ports on other controllers are not
+ * affected and can proceed in parallel.
+ *
+ * @usb_scan:	Port that wants to start its reset
+ * Return: true if the bus is in use by another port
+ */
+static bool usb_scan_bus_busy(struct usb_device_scan *usb_scan)
+{
+	void *controller = usb_scan_controller(usb_scan->dev);
+	struct usb_device_scan *other;
+
+	list_for_each_entry(other, &usb_scan_list, list) {
+		if (other != usb_scan && other->state != USB_SCAN_CONNECT &&
+		    usb_scan_controller(other->dev) == controller)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * usb_scan_port_mark() - record a bootstage mark for a port
+ *
+ * Each port gets a "usb_port_<devnum>.<port>_reset" mark when its reset
+ * starts and a "usb_port_<devnum>.<port>" mark once its device is enumerated,
+ * so the time taken by each port can be read from the report.
+ *
+ * @usb_scan:	Port to record
+ * @suffix:	Suffix for the mark name
+ */
+static void usb_scan_port_mark(struct usb_device_scan *usb_scan,
+			       const char *suffix)
+{
+#if CONFIG_IS_ENABLED(BOOTSTAGE)
+	/*
+	 * bootstage keeps a pointer to the name, so it must stay valid. It
+	 * cannot hold more records than this, so no mark is lost for want of
+	 * a name.
+	 */
+	static char names[CONFIG_VAL(BOOTSTAGE_RECORD_COUNT)][28];
+	static int count;
+
+	if (count == ARRAY_SIZE(names))
+		return;
+
+	snprintf(names[count], sizeof(names[count]), "usb_port_%d.%d%s",
+		 usb_scan->dev->devnum, usb_scan->port + 1, suffix);
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, names[count++]);
+#endif
+}
+
+/**
+ * usb_scan_port_done() - finish scanning a port
+ *
+ * Handle the remaining port status changes seen when the connection was
+ * detected, then drop the port from the scanning list unless it needs to
+ * be scanned again.
+ *
+ * @usb_scan:	Port to finish
+ */
+static void usb_scan_port_done(struct usb_device_scan *usb_scan)
+{
+	unsigned short portstatus = usb_scan->portstatus;
+	unsigned short portchange = usb_scan->portchange;
+	struct usb_device *dev = usb_scan->dev;
+	struct usb_hub_device *hub = usb_scan->hub;
+	int i = usb_scan->port;
+
+	usb_scan->state = USB_SCAN_CONNECT;
+
+	if (portchange & USB_PORT_STAT_C_ENABLE) {
+		debug("port %d enable change, status %x\n", i + 1, portstatus);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_ENABLE);
+		/*
+		 * EM interference sometimes causes bad shielded USB
+		 * devices to be shutdown by the hub, this hack enables
+		 * them again. Works at least with mouse driver
+		 */
+		if (!(portstatus & USB_PORT_STAT_ENABLE) &&
+		    (portstatus & USB_PORT_STAT_CONNECTION) &&
+		    usb_device_has_child_on_port(dev, i)) {
+			debug("already running port %i disabled by hub (EMI?), re-enabling...\n",
+			      i + 1);
+			usb_hub_port_connect_change(dev, i);
+		}
+	}
+
+	if (portstatus & USB_PORT_STAT_SUSPEND) {
+		debug("port %d suspend change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_SUSPEND);
+	}
+
+	if (portchange & USB_PORT_STAT_C_OVERCURRENT) {
+		debug("port %d over-current change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1,
+				       USB_PORT_FEAT_C_OVER_CURRENT);
+		/* Only power-on this one port */
+		usb_set_port_feature(dev, i + 1, USB_PORT_FEAT_POWER);
+		hub->overcurrent_count[i]++;
+
+		/*
+		 * If the max-scan-count is not reached, return without removing
+		 * the device from scan-list. This will re-issue a new scan.
+		 */
+		if (hub->overcurrent_count[i] <=
+		    PORT_OVERCURRENT_MAX_SCAN_COUNT)
+			return;
+
+		/* Otherwise the device will get removed */
+		printf("Port %d over-current occurred %d times\n", i + 1,
+		       hub->overcurrent_count[i]);
+	}
+
+	/*
+	 * We're done with this device, so let's remove this device from
+	 * scanning list
+	 */
+	list_del(&usb_scan->list);
+	free(usb_scan);
+}
+
+static void usb_scan_port_start_reset(struct usb_device_scan *usb_scan,
+				      int delay)
+{
+	int ret;
+
+	ret = usb_set_port_feature(usb_scan->dev, usb_scan->port + 1,
+				   USB_PORT_FEAT_RESET);
+	if (ret < 0) {
+		usb_scan_port_done(usb_scan);
+		return;
+	}
+
+	usb_scan->state = USB_SCAN_RESET;
+	usb_scan->deadline = usb_scan_deadline(delay);
+}
+
+/**
+ * usb_scan_port_connect() - wait for a connection on a port
+ *
+ * @usb_scan:	Port to check
+ */
+static void usb_scan_port_connect(struct usb_device_scan *usb_scan)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
@@ -457,7 +689,7 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 	 * This is needed for voltages to stabalize.
 	 */
 	if (get_timer(0) < hub->query_delay)
-		return 0;
+		return;
 
 	ret = usb_get_port_status(dev, i + 1, portsts);
 	if (ret < 0) {
@@ -468,9 +700,8 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 			/* Remove this device from scanning list */
 			list_del(&usb_scan->list);
 			free(usb_scan);
-			return 0;
 		}
-		return 0;
+		return;
 	}
 
 	portstatus = le16_to_cpu(portsts->wPortStatus);
@@ -492,11 +723,14 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 			/* Remove this device from scanning list */
 			list_del(&usb_scan->list);
 			free(usb_scan);
-			return 0;
 		}
-		return 0;
+		return;
 	}
 
+	/* Wait until no other device on this bus sits at address 0 */
+	if (usb_scan_bus_busy(usb_scan))
+		return;
+
 	if (portchange & USB_PORT_STAT_C_RESET) {
 		debug("port %d reset change\n", i + 1);
 		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_RESET);
@@ -511,59 +745,120 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 	/* A new USB device is ready at this point */
 	debug("devnum=%d port=%d: USB dev found\n", dev->devnum, i + 1);
 
-	usb_hub_port_connect_change(dev, i);
+	usb_scan->portstatus = portstatus;
+	usb_scan->portchange = portchange;
 
-	if (portchange & USB_PORT_STAT_C_ENABLE) {
-		debug("port %d enable change, status %x\n", i + 1, portstatus);
-		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_ENABLE);
-		/*
-		 * EM interference sometimes causes bad shielded USB
-		 * devices to be shutdown by the hub, this hack enables
-		 * them again. Works at least with mouse driver
-		 */
-		if (!(portstatus & USB_PORT_STAT_ENABLE) &&
-		    (portstatus & USB_PORT_STAT_CONNECTION) &&
-		    usb_device_has_child_on_port(dev, i)) {
-			debug("already running port %i disabled by hub (EMI?), re-enabling...\n",
-			      i + 1);
-			usb_hub_port_connect_change(dev, i);
-		}
+	if (usb_hub_port_check_connect(dev, i)) {
+		usb_scan_port_done(usb_scan);
+		return;
 	}
 
-	if (portstatus & USB_PORT_STAT_SUSPEND) {
-		debug("port %d suspend change\n", i + 1);
-		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_SUSPEND);
+#if CONFIG_IS_ENABLED(DM_USB)
+	debug("%s: resetting '%s' port %d...\n", __func__, dev->dev->name,
+	      i + 1);
+#else
+	debug("%s: resetting port %d...\n", __func__, i + 1);
+#endif
+	usb_scan_port_mark(usb_scan, "_reset");
+	usb_scan->tries = 0;
+	usb_scan_port_start_reset(usb_scan, HUB_SHORT_RESET_TIME);
+}
+
+/**
+ * usb_scan_port_reset() - check whether a port came out of reset
+ *
+ * This is the non-blocking equivalent of usb_hub_port_reset()
+ *
+ * @usb_scan:	Port being reset
+ */
+static void usb_scan_port_reset(struct usb_device_scan *usb_scan)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus, portchange;
+	struct usb_device *dev = usb_scan->dev;
+	int i = usb_scan->port;
+
+	if (get_timer(0) < usb_scan->deadline)
+		return;
+
+	if (usb_get_port_status(dev, i + 1, portsts) < 0) {
+		debug("get_port_status failed status %lX\n", dev->status);
+		printf("cannot reset port %i!?\n", i + 1);
+		usb_scan_port_done(usb_scan);
+		return;
 	}
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
 
-	if (portchange & USB_PORT_STAT_C_OVERCURRENT) {
-		debug("port %d over-current change\n", i + 1);
-		usb_clear_port_feature(dev, i + 1,
-				       USB_PORT_FEAT_C_OVER_CURRENT);
-		/* Only power-on this one port */
-		usb_set_port_feature(dev, i + 1, USB_PORT_FEAT_POWER);
-		hub->overcurrent_count[i]++;
+	debug("portstatus %x, change %x, %s\n", portstatus, portchange,
+	      portspeed(portstatus));
 
-		/*
-		 * If the max-scan-count is not reached, return without removing
-		 * the device from scan-list. This will re-issue a new scan.
-		 */
-		if (hub->overcurrent_count[i] <=
-		    PORT_OVERCURRENT_MAX_SCAN_COUNT)
-			return 0;
+	if (portstatus & USB_PORT_STAT_ENABLE) {
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_RESET);
+		usb_scan->speed = usb_hub_port_speed(portstatus);
 
-		/* Otherwise the device will get removed */
-		printf("Port %d over-current occurred %d times\n", i + 1,
-		       hub->overcurrent_count[i]);
+		/* Reset recovery time, see usb_hub_port_connect_change() */
+		usb_scan->state = USB_SCAN_RECOVERY;
+		usb_scan->deadline = usb_scan_deadline(HUB_RESET_RECOVERY_TIME);
+		return;
+	}
+
+	if (++usb_scan->tries == MAX_TRIES) {
+		debug("Cannot enable port %i after %i retries, " \
+		      "disabling port.\n", i + 1, MAX_TRIES);
+		debug("Maybe the USB cable is bad?\n");
+		printf("cannot reset port %i!?\n", i + 1);
+		usb_scan_port_done(usb_scan);
+		return;
 	}
 
+	/* Switch to long reset delay for the next round */
+	usb_scan_port_start_reset(usb_scan, HUB_LONG_RESET_TIME);
+}
+
+/**
+ * usb_scan_port_recovery() - enumerate a port once it has recovered
+ *
+ * @usb_scan:	Port to enumerate
+ */
+static void usb_scan_port_recovery(struct usb_device_scan *usb_scan)
+{
+	if (get_timer(0) < usb_scan->deadline)
+		return;
+
 	/*
-	 * We're done with this device, so let's remove this device from
-	 * scanning list
+	 * If the new device is a hub, its ports are added to the scanning
+	 * list here and are picked up by the running usb_device_list_scan()
 	 */
-	list_del(&usb_scan->list);
-	free(usb_scan);
+	if (!usb_hub_port_new_device(usb_scan->dev, usb_scan->port,
+				     usb_scan->speed))
+		usb_scan_port_mark(usb_scan, "");
 
-	return 0;
+	usb_scan_port_done(usb_scan);
+}
+
+/**
+ * usb_scan_port() - advance the enumeration of a port by one step
+ *
+ * Nothing in here waits: each step either completes immediately or records
+ * when it is due, so that the power-good, debounce, reset and recovery
+ * times of all ports on the scanning list overlap.
+ *
+ * @usb_scan:	Port to scan, removed from the scanning list once done
+ */
+static void usb_scan_port(struct usb_device_scan *usb_scan)
+{
+	switch (usb_scan->state) {
+	case USB_SCAN_CONNECT:
+		usb_scan_port_connect(usb_scan);
+		break;
+	case USB_SCAN_RESET:
+		usb_scan_port_reset(usb_scan);
+		break;
+	case USB_SCAN_RECOVERY:
+		usb_scan_port_recovery(usb_scan);
+		break;
+	}
 }
 
 static int usb_device_list_scan(void)
@@ -571,30 +866,21 @@ static int usb_device_list_scan(void)
 	struct usb_device_scan *usb_scan;
 	struct usb_device_scan *tmp;
 	static int running;
-	int ret = 0;
 
 	/* Only run this loop once for each controller */
-	if (running)
+	if (running || usb_scan_deferred)
 		return 0;
 
 	running = 1;
 
-	while (1) {
-		/* We're done, once the list is empty again */
-		if (list_empty(&usb_scan_list))
-			goto out;
-
+	/* We're done, once the list is empty again */
+	while (!list_empty(&usb_scan_list)) {
 		list_for_each_entry_safe(usb_scan, tmp, &usb_scan_list, list) {
-			int ret;
-
 			/* Scan this port */
-			ret = usb_scan_port(usb_scan);
-			if (ret)
-				goto out;
+			usb_scan_port(usb_scan);
 		}
 	}
 
-out:
 	/*
 	 * This USB controller has finished scanning all its connected
 	 * USB devices. Set "running" back to 0, so that other USB controllers
@@ -602,7 +888,19 @@ out:
 	 */
 	running = 0;
 
-	return ret;
+	return 0;
+}
+
+void usb_hub_defer_scan(void)
+{
+	usb_scan_deferred = true;
+}
+
+int usb_hub_flush_scan(void)
+{
+	usb_scan_deferred = false;
+
+	return usb_device_list_scan();
 }
 
 static struct usb_hub_device *usb_get_hub_device(struct usb_device *dev)
@@ -50,8 +50,17 @@ static int ata_io_flush(struct ahci_uc_priv *uc_priv, u8 port);
 #define WAIT_MS_DATAIO	10000
 #define WAIT_MS_FLUSH	5000
 #define WAIT_MS_LINKUP	200
+#define WAIT_MS_PORT_STOP	500
+
+/*
+ * READ/WRITE FPDMA QUEUED carry a 16-bit block count, 0 meaning 65536. That
+ * is 32 MiB, which the AHCI_MAX_SG entries of a command table can cover.
+ */
+#define AHCI_NCQ_MAX_BLOCKS	0x10000
 
 #define AHCI_CAP_S64A BIT(31)
+#define AHCI_CAP_SNCQ BIT(30)
+#define AHCI_CAP_NCS(cap)	((((cap) >> 8) & 0x1f) + 1)
 
 __weak void __iomem *ahci_port_base(void __iomem *base, u32 port)
 {
@@ -384,15 +393,22 @@ static int ahci_init_one(struct ahci_uc_priv *uc_priv, struct udevice *dev)
 
 #define MAX_DATA_BYTE_COUNT  (4*1024*1024)
 
-static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
+/* Each command slot has its own command table, following the first one */
+static ulong ahci_cmd_tbl(struct ahci_ioports *pp, int slot)
+{
+	return pp->cmd_tbl + slot * AHCI_CMD_TBL_SZ;
+}
+
+static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port, int slot,
 			unsigned char *buf, int buf_len)
 {
 	struct ahci_ioports *pp = &(uc_priv->port[port]);
-	struct ahci_sg *ahci_sg = pp->cmd_tbl_sg;
+	struct ahci_sg *ahci_sg;
 	phys_addr_t pa = virt_to_phys(buf);
 	u32 sg_count;
 	int i;
 
+	ahci_sg = (struct ahci_sg *)(ahci_cmd_tbl(pp, slot) + AHCI_CMD_TBL_HDR);
 	sg_count = ((buf_len - 1) / MAX_DATA_BYTE_COUNT) + 1;
 	if (sg_count > AHCI_MAX_SG) {
 		printf("Error:Too much sg!\n");
@@ -418,15 +434,16 @@ static int ahci_fill_sg(struct ahci_uc_priv *uc_priv, u8 port,
 	return sg_count;
 }
 
-static void ahci_fill_cmd_slot(struct ahci_ioports *pp, u32 opts)
+static void ahci_fill_cmd_slot(struct ahci_ioports *pp, int slot, u32 opts)
 {
-	phys_addr_t pa = virt_to_phys((void *)pp->cmd_tbl);
+	struct ahci_cmd_hdr *cmd_slot = pp->cmd_slot + slot;
+	phys_addr_t pa = virt_to_phys((void *)ahci_cmd_tbl(pp, slot));
 
-	pp->cmd_slot->opts = cpu_to_le32(opts);
-	pp->cmd_slot->status = 0;
-	pp->cmd_slot->tbl_addr = cpu_to_le32(lower_32_bits(pa));
+	cmd_slot->opts = cpu_to_le32(opts);
+	cmd_slot->status = 0;
+	cmd_slot->tbl_addr = cpu_to_le32(lower_32_bits(pa));
 #ifdef CONFIG_PHYS_64BIT
-	pp->cmd_slot->tbl_addr_hi = cpu_to_le32(upper_32_bits(pa));
+	cmd_slot->tbl_addr_hi = cpu_to_le32(upper_32_bits(pa));
 #endif
 }
 
@@ -461,13 +478,13 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 		return -1;
 	}
 
-	mem = memalign(2048, AHCI_PORT_PRIV_DMA_SZ);
+	mem = memalign(2048, AHCI_PORT_NCQ_DMA_SZ);
 	if (!mem) {
 		free(pp);
 		printf("%s: No mem for table!\n", __func__);
 		return -ENOMEM;
 	}
-	memset(mem, 0, AHCI_PORT_PRIV_DMA_SZ);
+	memset(mem, 0, AHCI_PORT_NCQ_DMA_SZ);
 
 	/*
 	 * First item in chunk of DMA memory: 32-slot command table,
@@ -476,7 +493,7 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 	pp->cmd_slot =
 		(struct ahci_cmd_hdr *)(uintptr_t)virt_to_phys((void *)mem);
 	debug("cmd_slot = %p\n", pp->cmd_slot);
-	mem += (AHCI_CMD_SLOT_SZ + 224);
+	mem += AHCI_CMD_SLOT_SZ * AHCI_MAX_CMD_SLOT;
 
 	/*
 	 * Second item: Received-FIS area
@@ -485,8 +502,8 @@ static int ahci_port_start(struct ahci_uc_priv *uc_priv, u8 port)
 	mem += AHCI_RX_FIS_SZ;
 
 	/*
-	 * Third item: data area for storing a single command
-	 * and its scatter-gather table
+	 * Third item: data area for storing the commands and their
+	 * scatter-gather tables, one for each command slot
 	 */
 	pp->cmd_tbl = virt_to_phys((void *)mem);
 	debug("cmd_tbl_dma = %lx\n", pp->cmd_tbl);
@@ -544,9 +561,9 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, fis_len);
 
-	sg_count = ahci_fill_sg(uc_priv, port, buf, buf_len);
+	sg_count = ahci_fill_sg(uc_priv, port, 0, buf, buf_len);
 	opts = (fis_len >> 2) | (sg_count << 16) | (is_write << 6);
-	ahci_fill_cmd_slot(pp, opts);
+	ahci_fill_cmd_slot(pp, 0, opts);
 
 	ahci_dcache_flush_sata_cmd(pp);
 	ahci_dcache_flush_range((unsigned long)buf, (unsigned long)buf_len);
@@ -567,6 +584,203 @@ static int ahci_device_data_io(struct ahci_uc_priv *uc_priv, u8 port, u8 *fis,
 	return 0;
 }
 
+/*
+ * Stop and restart the command list engine of a port, which drops all
+ * outstanding commands. This is needed to recover from an error while
+ * queued commands are in flight.
+ */
+static int ahci_port_restart(struct ahci_ioports *pp)
+{
+	void __iomem *port_mmio = pp->port_mmio;
+	u32 cmd;
+	int ret;
+
+	cmd = readl(port_mmio + PORT_CMD);
+	writel_with_flush(cmd & ~PORT_CMD_START, port_mmio + PORT_CMD);
+	ret = waiting_for_cmd_completed(port_mmio + PORT_CMD, WAIT_MS_PORT_STOP,
+					PORT_CMD_LIST_ON);
+
+	writel(readl(port_mmio + PORT_SCR_ERR), port_mmio + PORT_SCR_ERR);
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+	writel_with_flush(cmd | PORT_CMD_START, port_mmio + PORT_CMD);
+
+	return ret;
+}
+
+/*
+ * Recover from a failed queued command: restart the port and read the NCQ
+ * command error log, which the device requires before it accepts further
+ * commands. NCQ is not used on this port afterwards.
+ */
+static void ahci_ncq_recover(struct ahci_uc_priv *uc_priv, u8 port)
+{
+	struct ahci_ioports *pp = &uc_priv->port[port];
+	ALLOC_CACHE_ALIGN_BUFFER(u8, log, ATA_SECT_SIZE);
+	u8 fis[20];
+
+	if (ahci_port_restart(pp))
+		debug("scsi_ahci: port %d did not stop\n", port);
+
+	memset(fis, 0, sizeof(fis));
+	fis[0] = 0x27;		/* Host to device FIS. */
+	fis[1] = 1 << 7;	/* Command FIS. */
+	fis[2] = ATA_CMD_READ_LOG_EXT;
+	fis[4] = ATA_LOG_SATA_NCQ;
+	fis[12] = 1;		/* one sector */
+	if (ahci_device_data_io(uc_priv, port, fis, sizeof(fis), log,
+				ATA_SECT_SIZE, 0))
+		debug("scsi_ahci: cannot read NCQ error log on port %d\n", port);
+
+	printf("scsi_ahci: NCQ error on port %d, disabling NCQ\n", port);
+	pp->ncq_depth = 0;
+}
+
+/*
+ * Native Command Queueing READ/WRITE FPDMA QUEUED transfer.
+ *
+ * The transfer is split into commands of up to AHCI_NCQ_MAX_BLOCKS blocks,
+ * each described by a scatter-gather list of up to AHCI_MAX_SG entries, which
+ * are issued in all available command slots at once. Completed slots
+ * are found by polling SActive and are refilled straight away, so the device
+ * always has a full queue to work on.
+ */
+static int ahci_ncq_data_io(struct ahci_uc_priv *uc_priv, u8 port,
+			    lbaint_t lba, u32 blocks, u8 *buf, u8 is_write)
+{
+	struct ahci_ioports *pp = &uc_priv->port[port];
+	void __iomem *port_mmio = pp->port_mmio;
+	ulong slot_buf[AHCI_MAX_CMD_SLOT];
+	u32 slot_len[AHCI_MAX_CMD_SLOT];
+	u32 free_slots, issued = 0;
+	ulong start;
+
+	BUILD_BUG_ON(AHCI_NCQ_MAX_BLOCKS * ATA_SECT_SIZE >
+		     AHCI_MAX_SG * MAX_DATA_BYTE_COUNT);
+
+	free_slots = pp->ncq_depth == AHCI_MAX_CMD_SLOT ? ~0U :
+		     BIT(pp->ncq_depth) - 1;
+
+	/* Clear any stale status so that errors below are ours */
+	writel(readl(port_mmio + PORT_IRQ_STAT), port_mmio + PORT_IRQ_STAT);
+
+	start = get_timer(0);
+	while (blocks || issued) {
+		u32 new_slots = 0;
+		u32 sact, done, irq;
+
+		while (blocks && free_slots) {
+			int slot = ffs(free_slots) - 1;
+			u8 *fis = (u8 *)ahci_cmd_tbl(pp, slot);
+			u32 now_blocks, len;
+			int sg_count;
+
+			now_blocks = min_t(u32, AHCI_NCQ_MAX_BLOCKS, blocks);
+			len = now_blocks * ATA_SECT_SIZE;
+
+			memset(fis, 0, 20);
+			fis[0] = 0x27;		/* Host to device FIS. */
+			fis[1] = 1 << 7;	/* Command FIS. */
+			fis[2] = is_write ? ATA_CMD_FPDMA_WRITE :
+					    ATA_CMD_FPDMA_READ;
+			/*
+			 * The block count goes in the features fields, where
+			 * AHCI_NCQ_MAX_BLOCKS wraps to 0 as required
+			 */
+			fis[3] = now_blocks & 0xff;
+			fis[11] = (now_blocks >> 8) & 0xff;
+			fis[4] = (lba >> 0) & 0xff;
+			fis[5] = (lba >> 8) & 0xff;
+			fis[6] = (lba >> 16) & 0xff;
+			fis[7] = 1 << 6;	/* device reg: set LBA mode */
+			fis[8] = (lba >> 24) & 0xff;
+#ifdef CONFIG_SYS_64BIT_LBA
+			fis[9] = (lba >> 32) & 0xff;
+			fis[10] = (lba >> 40) & 0xff;
+#endif
+			/* ...and the tag in the sector count field */
+			fis[12] = slot << 3;
+
+			sg_count = ahci_fill_sg(uc_priv, port, slot, buf, len);
+			if (sg_count < 0)
+				break;
+			ahci_fill_cmd_slot(pp, slot, 5 | (sg_count << 16) |
+					   (is_write << 6));
+			/* Only the FIS and the PRDs in use need to go out */
+			ahci_dcache_flush_range(ahci_cmd_tbl(pp, slot),
+						ALIGN(AHCI_CMD_TBL_HDR + sg_count *
+						      sizeof(struct ahci_sg),
+						      ARCH_DMA_MINALIGN));
+			ahci_dcache_flush_range((ulong)buf, len);
+
+			slot_buf[slot] = (ulong)buf;
+			slot_len[slot] = len;
+			free_slots &= ~BIT(slot);
+			new_slots |= BIT(slot);
+			buf += len;
+			lba += now_blocks;
+			blocks -= now_blocks;
+		}
+
+		if (new_slots) {
+			/* The command list, but not the received FIS area */
+			ahci_dcache_flush_range((ulong)pp->cmd_slot,
+						AHCI_CMD_SLOT_SZ *
+						AHCI_MAX_CMD_SLOT);
+			writel(new_slots, port_mmio + PORT_SCR_ACT);
+			writel_with_flush(new_slots, port_mmio + PORT_CMD_ISSUE);
+			issued |= new_slots;
+		} else if (!issued) {
+			/* Could not set up a single command */
+			return -EIO;
+		}
+
+		irq = readl(port_mmio + PORT_IRQ_STAT);
+		if (irq & (PORT_IRQ_FATAL)) {
+			debug("scsi_ahci: NCQ error, irq status %x\n", irq);
+			ahci_ncq_recover(uc_priv, port);
+			return -EIO;
+		}
+
+		sact = readl(port_mmio + PORT_SCR_ACT);
+		done = issued & ~sact;
+		if (!done) {
+			if (get_timer(start) > WAIT_MS_DATAIO) {
+				printf("timeout exit!\n");
+				ahci_ncq_recover(uc_priv, port);
+				return -ETIMEDOUT;
+			}
+			continue;
+		}
+
+		while (done) {
+			int slot = ffs(done) - 1;
+
+			if (!is_write)
+				ahci_dcache_invalidate_range(slot_buf[slot],
+							     slot_len[slot]);
+			done &= ~BIT(slot);
+			issued &= ~BIT(slot);
+			free_slots |= BIT(slot);
+		}
+		start = get_timer(0);
+	}
+
+	return 0;
+}
+
+/* Work out how many command slots to use for NCQ on a port, 0 for none */
+static u32 ahci_ncq_depth(struct ahci_uc_priv *uc_priv, u8 port)
+{
+	u16 *id = uc_priv->ataid[port];
+
+	if (!IS_ENABLED(CONFIG_SCSI_AHCI_NCQ) || !(uc_priv->cap & AHCI_CAP_SNCQ))
+		return 0;
+	if (!id || !ata_id_has_ncq(id))
+		return 0;
+
+	return min_t(u32, ata_id_queue_depth(id), AHCI_CAP_NCS(uc_priv->cap));
+}
+
 static char *ata_id_strcpy(u16 *target, u16 *src, int len)
 {
 	int i;
@@ -635,6 +849,10 @@ static int ata_scsiop_inquiry(struct ahci_uc_priv *uc_priv,
 	memcpy(idbuf, tmpid, ATA_ID_WORDS * 2);
 	ata_swap_buf_le16(idbuf, ATA_ID_WORDS);
 
+	uc_priv->port[port].ncq_depth = ahci_ncq_depth(uc_priv, port);
+	debug("scsi_ahci: port %d NCQ depth %d\n", port,
+	      uc_priv->port[port].ncq_depth);
+
 	memcpy(&pccb->pdata[8], "ATA     ", 8);
 	ata_id_strcpy((u16 *)&pccb->pdata[16], &idbuf[ATA_ID_PROD], 16);
 	ata_id_strcpy((u16 *)&pccb->pdata[32], &idbuf[ATA_ID_FW_REV], 4);
@@ -686,6 +904,29 @@ static int ata_scsiop_read_write(struct ahci_uc_priv *uc_priv,
 	debug("scsi_ahci: %s %u blocks starting from lba 0x" LBAFU "\n",
 	      is_write ?  "write" : "read", blocks, lba);
 
+	if (uc_priv->port[pccb->target].ncq_depth) {
+		int ret;
+
+		if (blocks * ATA_SECT_SIZE > user_buffer_size) {
+			printf("scsi_ahci: Error: buffer too small.\n");
+			return -EIO;
+		}
+
+		ret = ahci_ncq_data_io(uc_priv, pccb->target, lba, blocks,
+				       user_buffer, is_write);
+		/* NCQ was turned off after an error, so retry without it */
+		if (ret && !uc_priv->port[pccb->target].ncq_depth)
+			goto no_ncq;
+		if (ret)
+			return -EIO;
+		if (is_write && ata_io_flush(uc_priv, pccb->target))
+			return -EIO;
+
+		return 0;
+	}
+
+no_ncq:
+
 	/* Preset the FIS */
 	memset(fis, 0, sizeof(fis));
 	fis[0] = 0x27;		 /* Host to device FIS. */
@@ -915,7 +1156,7 @@ static int ata_io_flush(struct ahci_uc_priv *uc_priv, u8 port)
 	fis[2] = ATA_CMD_FLUSH_EXT;
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, 20);
-	ahci_fill_cmd_slot(pp, cmd_fis_len);
+	ahci_fill_cmd_slot(pp, 0, cmd_fis_len);
 	ahci_dcache_flush_sata_cmd(pp);
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
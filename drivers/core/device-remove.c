@@ -109,6 +109,7 @@ int device_unbind(struct udevice *dev)
 		free(dev_get_parent_plat(dev));
 		dev_set_parent_plat(dev, NULL);
 	}
+	dev_ofnode_map_remove(dev);
 	ret = uclass_unbind_device(dev);
 	if (ret)
 		return log_msg_ret("uc", ret);
@@ -160,6 +160,7 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 		list_add_tail(&dev->sibling_node, &parent->child_head);
 	}
 
+	dev_ofnode_map_add(dev);
 	ret = uclass_bind_device(dev);
 	if (ret)
 		goto fail_uclass_bind;
@@ -208,6 +209,7 @@ fail_bind:
 		}
 	}
 fail_uclass_bind:
+	dev_ofnode_map_remove(dev);
 	if (CONFIG_IS_ENABLED(DM_DEVICE_REMOVE)) {
 		list_del(&dev->sibling_node);
 		if (dev_get_flags(dev) & DM_FLAG_ALLOC_PARENT_PDATA) {
@@ -895,9 +897,19 @@ static struct udevice *_device_find_global_by_ofnode(struct udevice *parent,
 	return NULL;
 }
 
+static struct udevice *device_find_global(ofnode ofnode)
+{
+	struct udevice *dev;
+
+	if (!dev_ofnode_map_find(ofnode, NULL, &dev))
+		return dev;
+
+	return _device_find_global_by_ofnode(gd->dm_root, ofnode);
+}
+
 int device_find_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 {
-	*devp = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	*devp = device_find_global(ofnode);
 
 	return *devp ? 0 : -ENOENT;
 }
@@ -906,7 +918,7 @@ int device_get_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 {
 	struct udevice *dev;
 
-	dev = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	dev = device_find_global(ofnode);
 	return device_get_device_tail(dev, dev ? 0 : -ENOENT, devp);
 }
 
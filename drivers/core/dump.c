@@ -296,6 +296,11 @@ void dm_dump_mem(struct dm_stats *stats)
 	printf("Memory: device %x:%x, device names %x, uclass %x:%x\n",
 	       stats->dev_count, stats->dev_size, stats->dev_name_size,
 	       stats->uc_count, stats->uc_size);
+	printf("Live tree: %x (%d)\n", stats->of_live_size,
+	       stats->of_live_size);
+	printf("Lookups: phandle %x (walks %x), ofnode %x (walks %x)\n",
+	       stats->phandle_lookups, stats->phandle_scans,
+	       stats->ofnode_lookups, stats->ofnode_scans);
 	printf("\n");
 	printf("%-15s  %5s  %5s  %5s  %5s  %5s\n", "Attached type", "Count",
 	       "Size", "Cur", "Tags", "Save");
@@ -11,6 +11,8 @@
 #include <debug_uart.h>
 #include <errno.h>
 #include <log.h>
+#include <malloc.h>
+#include <sort.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -19,6 +21,7 @@
 #include <dm/util.h>
 #include <fdtdec.h>
 #include <linux/compiler.h>
+#include <linux/err.h>
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -196,11 +199,213 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
-		   struct driver *drv, bool pre_reloc_only)
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * struct dm_compat_entry - one compatible string of one driver
+ *
+ * @hash: hash of the compatible string
+ * @drv: index of the driver in the driver linker list
+ * @id: index of the string in the driver's of_match table
+ */
+struct dm_compat_entry {
+	u32 hash;
+	u16 drv;
+	u16 id;
+};
+
+/**
+ * struct dm_compat_index - all driver compatible strings, sorted
+ *
+ * Entries are sorted by hash, then by driver and of_match index, so the
+ * first entry for a string is the one a walk through the driver list finds.
+ *
+ * @count: number of entries
+ * @entries: the entries
+ */
+struct dm_compat_index {
+	int count;
+	struct dm_compat_entry entries[];
+};
+
+static u32 compat_hash(const char *str)
+{
+	u32 hash = 2166136261U;
+
+	while (*str)
+		hash = (hash ^ (u8)*str++) * 16777619U;
+
+	return hash;
+}
+
+static int compat_entry_cmp(const void *a, const void *b)
+{
+	const struct dm_compat_entry *ea = a, *eb = b;
+
+	if (ea->hash != eb->hash)
+		return ea->hash < eb->hash ? -1 : 1;
+	if (ea->drv != eb->drv)
+		return ea->drv - eb->drv;
+
+	return ea->id - eb->id;
+}
+
+/* Count the driver compatible strings, or return -1 if they cannot be indexed */
+static int compat_index_count(struct driver *driver, int n_ents)
+{
+	const struct udevice_id *of_match;
+	int drv, id, count = 0;
+
+	if (n_ents > U16_MAX)
+		return -1;
+
+	for (drv = 0; drv < n_ents; drv++) {
+		of_match = driver[drv].of_match;
+		for (id = 0; of_match && of_match[id].compatible; id++) {
+			if (id > U16_MAX)
+				break;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void compat_index_fill(struct dm_compat_index *index,
+			      struct driver *driver, int n_ents)
+{
+	const struct udevice_id *of_match;
+	int drv, id;
+
+	index->count = 0;
+	for (drv = 0; drv < n_ents; drv++) {
+		of_match = driver[drv].of_match;
+		for (id = 0; of_match && of_match[id].compatible; id++) {
+			struct dm_compat_entry *entry;
+
+			if (id > U16_MAX)
+				break;
+			entry = &index->entries[index->count++];
+			entry->hash = compat_hash(of_match[id].compatible);
+			entry->drv = drv;
+			entry->id = id;
+		}
+	}
+	qsort(index->entries, index->count, sizeof(index->entries[0]),
+	      compat_entry_cmp);
+	gd_set_dm_compat_index(index);
+}
+
+static ulong compat_index_size(int count)
+{
+	return sizeof(struct dm_compat_index) +
+	       count * sizeof(struct dm_compat_entry);
+}
+
+/* Check whether the index fits in the pre-relocation heap */
+static bool compat_index_fits(ulong size)
+{
+#if CONFIG_IS_ENABLED(SYS_MALLOC_F)
+	/* Leave at least half of what is left to the drivers bound next */
+	if (!(gd->flags & GD_FLG_RELOC) &&
+	    size > (gd->malloc_limit - gd->malloc_ptr) / 2) {
+		log_debug("No room for %#lx byte compat index before relocation\n",
+			  size);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+static struct dm_compat_index *compat_index_get(struct driver *driver,
+						int n_ents)
+{
+	struct dm_compat_index *index = gd_dm_compat_index();
+	int count;
+
+	/*
+	 * The index is built for the first node bound. If that failed, walk
+	 * the driver list instead; initr_dm() clears the error so that it is
+	 * tried once more after relocation.
+	 */
+	if (IS_ERR(index))
+		return NULL;
+	if (index)
+		return index;
+
+	count = compat_index_count(driver, n_ents);
+	if (count < 0 || !compat_index_fits(compat_index_size(count))) {
+		gd_set_dm_compat_index(ERR_PTR(-ENOSPC));
+		return NULL;
+	}
+
+	index = malloc(compat_index_size(count));
+	if (!index) {
+		gd_set_dm_compat_index(ERR_PTR(-ENOMEM));
+		return NULL;
+	}
+	compat_index_fill(index, driver, n_ents);
+
+	return index;
+}
+
+static struct driver *compat_index_lookup(struct dm_compat_index *index,
+					  struct driver *driver,
+					  const char *compat,
+					  const struct udevice_id **idp)
+{
+	u32 hash = compat_hash(compat);
+	int lo = 0, hi = index->count;
+
+	/* Find the first entry with this hash */
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (index->entries[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < index->count && index->entries[lo].hash == hash; lo++) {
+		struct dm_compat_entry *entry = &index->entries[lo];
+		const struct udevice_id *id;
+
+		id = &driver[entry->drv].of_match[entry->id];
+		if (!strcmp(id->compatible, compat)) {
+			*idp = id;
+			return &driver[entry->drv];
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+struct driver *lists_driver_match_compat(const char *compat,
+					 const struct udevice_id **idp)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry;
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	struct dm_compat_index *index = compat_index_get(driver, n_ents);
+
+	if (index)
+		return compat_index_lookup(index, driver, compat, idp);
+#endif
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
+		   struct driver *drv, bool pre_reloc_only)
+{
 	const struct udevice_id *id;
 	struct driver *entry;
 	struct udevice *dev;
@@ -238,20 +443,16 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 			  compat);
 
 		id = NULL;
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			if (drv) {
-				if (drv != entry)
-					continue;
-				if (!entry->of_match)
-					break;
-			}
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if (!ret)
-				break;
+		if (drv) {
+			entry = drv;
+			if (entry->of_match &&
+			    driver_check_compatible(entry->of_match, &id, compat))
+				continue;
+		} else {
+			entry = lists_driver_match_compat(compat, &id);
+			if (!entry)
+				continue;
 		}
-		if (entry == driver + n_ents)
-			continue;
 
 		if (pre_reloc_only) {
 			if (!ofnode_pre_reloc(node) &&
@@ -25,10 +25,12 @@
 #include <linux/bug.h>
 #include <linux/libfdt.h>
 #include <dm/of_access.h>
+#include <dm/root.h>
 #include <dm/util.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
+#include <linux/log2.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -44,6 +46,15 @@ static struct device_node *of_chosen;
 /* node pointed to by the stdout-path alias */
 static struct device_node *of_stdout;
 
+/* phandle -> node cache for the control tree, indexed by phandle & mask */
+static struct device_node **phandle_cache;
+static struct device_node *phandle_cache_root;
+static u32 phandle_cache_mask;
+
+/* lookup counters, reported by 'dm mem' */
+static int phandle_lookups;
+static int phandle_scans;
+
 /* pointer to options given after the alias (separated by :) or NULL if none */
 static const char *of_stdout_options;
 
@@ -445,22 +456,70 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 	return np;
 }
 
+int of_phandle_cache_init(struct device_node *root)
+{
+	struct device_node *np, **slot;
+	u32 count = 0;
+
+	free(phandle_cache);
+	phandle_cache = NULL;
+	phandle_cache_root = root;
+
+	for_each_of_allnodes(np)
+		if (np->phandle)
+			count++;
+
+	/*
+	 * dtc numbers phandles from 1 upwards, so with one slot per phandle
+	 * (plus slot 0) there are normally no collisions
+	 */
+	phandle_cache_mask = roundup_pow_of_two(count + 1) - 1;
+	phandle_cache = calloc(phandle_cache_mask + 1, sizeof(*phandle_cache));
+	if (!phandle_cache)
+		return -ENOMEM;
+
+	for_each_of_allnodes(np) {
+		slot = &phandle_cache[np->phandle & phandle_cache_mask];
+		if (np->phandle && !*slot)
+			*slot = np;
+	}
+
+	return 0;
+}
+
 struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle)
 {
-	struct device_node *np;
+	struct device_node *np, **slot = NULL;
 
 	if (!handle)
 		return NULL;
 
+	phandle_lookups++;
+	if (!root && phandle_cache && gd->of_root == phandle_cache_root) {
+		slot = &phandle_cache[handle & phandle_cache_mask];
+		np = *slot;
+		if (np && np->phandle == handle)
+			return of_node_get(np);
+	}
+
+	phandle_scans++;
 	for_each_of_allnodes_from(root, np)
 		if (np->phandle == handle)
 			break;
 	(void)of_node_get(np);
+	if (np && slot)
+		*slot = np;
 
 	return np;
 }
 
+void of_phandle_collect_stats(struct dm_stats *stats)
+{
+	stats->phandle_lookups = phandle_lookups;
+	stats->phandle_scans = phandle_scans;
+}
+
 /**
  * of_find_property_value_of_size() - find property of given size
  *
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Hash table of devices keyed by device tree node
+ *
+ * uclass_find_device_by_ofnode() and device_find_global_by_ofnode() are
+ * called for every clock, regulator, pinctrl or PHY reference a driver
+ * follows, and each call used to walk a whole uclass or the whole device tree.
+ * This keeps every device which is in a uclass list in a hash bucket chosen by
+ * its node, so a lookup only looks at a few devices.
+ *
+ * The map holds exactly the devices which are in a uclass list. When a device
+ * changes its node after being added, the map is marked stale and rebuilt from
+ * the uclass lists on the next lookup. Lookups which match more than one device
+ * are left to the caller, since the order of its list decides which is found.
+ */
+
+#define LOG_CATEGORY	LOGC_DM
+
+#include <errno.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+#include <dm/device.h>
+#include <dm/device-internal.h>
+#include <dm/root.h>
+#include <dm/uclass.h>
+#include <dm/uclass-internal.h>
+#include <linux/list.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Number of buckets, before and after relocation */
+#define OFNODE_MAP_BUCKETS_F	32
+#define OFNODE_MAP_BUCKETS	256
+
+/**
+ * struct dm_ofnode_map - devices hashed by node
+ *
+ * @mask: number of buckets - 1
+ * @stale: true if a device has changed its node, so the map must be rebuilt
+ * @lookups: number of lookups
+ * @scans: number of lookups which the caller had to do by walking a list
+ * @buckets: first device in each bucket, linked through udevice->ofnode_next_
+ */
+struct dm_ofnode_map {
+	u32 mask;
+	bool stale;
+	int lookups;
+	int scans;
+	struct udevice *buckets[];
+};
+
+static struct udevice **ofnode_map_bucket(struct dm_ofnode_map *map,
+					  ofnode node)
+{
+	u64 key = (ulong)node.of_offset;
+
+	key = (key ^ (key >> 32)) * 0x9e3779b97f4a7c15ULL;
+
+	return &map->buckets[(key >> 32) & map->mask];
+}
+
+static void ofnode_map_insert(struct dm_ofnode_map *map, struct udevice *dev)
+{
+	struct udevice **bucket;
+
+	if (!ofnode_valid(dev_ofnode(dev)))
+		return;
+	bucket = ofnode_map_bucket(map, dev_ofnode(dev));
+	dev->ofnode_next_ = *bucket;
+	*bucket = dev;
+}
+
+static void ofnode_map_rebuild(struct dm_ofnode_map *map)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+
+	/* The uclass list is not valid, e.g. dm_test_uclass_before_ready() */
+	if (!gd->uclass_root)
+		return;
+
+	memset(map->buckets, '\0', (map->mask + 1) * sizeof(map->buckets[0]));
+	list_for_each_entry(uc, gd->uclass_root, sibling_node) {
+		list_for_each_entry(dev, &uc->dev_head, uclass_node)
+			ofnode_map_insert(map, dev);
+	}
+	map->stale = false;
+}
+
+void dev_ofnode_map_init(void)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+	int count;
+
+	if (!map) {
+		count = gd->flags & GD_FLG_RELOC ? OFNODE_MAP_BUCKETS :
+			OFNODE_MAP_BUCKETS_F;
+		map = calloc(1, sizeof(*map) + count * sizeof(map->buckets[0]));
+		if (!map) {
+			/* Lookups just walk the lists instead */
+			log_debug("Cannot allocate ofnode map\n");
+			return;
+		}
+		map->mask = count - 1;
+		gd_set_dm_ofnode_map(map);
+	}
+	memset(map->buckets, '\0', (map->mask + 1) * sizeof(map->buckets[0]));
+	map->stale = false;
+}
+
+void dev_ofnode_map_invalidate(void)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+
+	if (map)
+		map->stale = true;
+}
+
+void dev_ofnode_map_add(struct udevice *dev)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+
+	dev_or_flags(dev, DM_FLAG_OFNODE_MAP);
+	if (map && !map->stale)
+		ofnode_map_insert(map, dev);
+}
+
+void dev_ofnode_map_remove(struct udevice *dev)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+	struct udevice **linkp;
+
+	if (!(dev_get_flags(dev) & DM_FLAG_OFNODE_MAP))
+		return;
+	dev_bic_flags(dev, DM_FLAG_OFNODE_MAP);
+
+	/* A stale map is rebuilt from the uclass lists, which drop @dev */
+	if (!map || map->stale || !ofnode_valid(dev_ofnode(dev)))
+		return;
+
+	for (linkp = ofnode_map_bucket(map, dev_ofnode(dev)); *linkp;
+	     linkp = &(*linkp)->ofnode_next_) {
+		if (*linkp == dev) {
+			*linkp = dev->ofnode_next_;
+			break;
+		}
+	}
+}
+
+static bool ofnode_map_in_tree(struct udevice *dev)
+{
+	while (dev->parent)
+		dev = dev->parent;
+
+	return dev == gd->dm_root;
+}
+
+int dev_ofnode_map_find(ofnode node, struct uclass *uc, struct udevice **devp)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+	struct udevice *dev, *found = NULL;
+
+	if (!map)
+		return -ENOSYS;
+
+	map->lookups++;
+	if (map->stale)
+		ofnode_map_rebuild(map);
+	if (map->stale || !ofnode_valid(node)) {
+		map->scans++;
+		return -EAGAIN;
+	}
+
+	for (dev = *ofnode_map_bucket(map, node); dev; dev = dev->ofnode_next_) {
+		if (!ofnode_equal(dev_ofnode(dev), node))
+			continue;
+		if (uc ? dev->uclass != uc : !ofnode_map_in_tree(dev))
+			continue;
+		if (found) {
+			map->scans++;
+			return -EAGAIN;
+		}
+		found = dev;
+	}
+	*devp = found;
+
+	return 0;
+}
+
+void dev_ofnode_map_collect_stats(struct dm_stats *stats)
+{
+	struct dm_ofnode_map *map = gd_dm_ofnode_map();
+
+	if (map) {
+		stats->ofnode_lookups = map->lookups;
+		stats->ofnode_scans = map->scans;
+	}
+}
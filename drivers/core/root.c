@@ -12,6 +12,7 @@
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <of_live.h>
 #include <asm-generic/sections.h>
 #include <asm/global_data.h>
 #include <linux/libfdt.h>
@@ -105,6 +106,7 @@ int dm_init(bool of_live)
 		gd->uclass_root = &DM_UCLASS_ROOT_S_NON_CONST;
 		INIT_LIST_HEAD(DM_UCLASS_ROOT_NON_CONST);
 	}
+	dev_ofnode_map_init();
 
 	if (CONFIG_IS_ENABLED(OF_PLATDATA_INST)) {
 		ret = dm_setup_inst();
@@ -420,6 +422,12 @@ void dm_get_mem(struct dm_stats *stats)
 	dev_collect_stats(stats, gd->dm_root);
 	uclass_collect_stats(stats);
 	dev_tag_collect_stats(stats);
+	if (CONFIG_IS_ENABLED(OF_LIVE)) {
+		of_live_collect_stats(stats);
+		of_phandle_collect_stats(stats);
+	}
+	if (CONFIG_IS_ENABLED(DM_OFNODE_MAP))
+		dev_ofnode_map_collect_stats(stats);
 
 	stats->total_size = stats->dev_size + stats->uc_size +
 		stats->attach_size_total + stats->uc_attach_size +
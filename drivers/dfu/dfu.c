@@ -6,6 +6,7 @@
  * author: Lukasz Majewski <l.majewski@samsung.com>
  */
 
+#include <display_options.h>
 #include <env.h>
 #include <errno.h>
 #include <log.h>
@@ -14,7 +15,9 @@
 #include <fat.h>
 #include <dfu.h>
 #include <hash.h>
+#include <time.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/compiler.h>
 #include <linux/printk.h>
 
@@ -182,11 +185,41 @@ done:
 static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 static enum dfu_device_type dfu_buf_device_type;
+/* Number of segments of dfu_buf_size bytes each in dfu_buf */
+static unsigned int dfu_buf_segs;
+
+/* Filled segments waiting to be written to the medium, oldest first */
+static struct dfu_entity *dfu_seg_dfu;
+static unsigned int dfu_seg_first;
+static unsigned int dfu_seg_pending;
+static long dfu_seg_len[CONFIG_DFU_BUF_SEGMENTS];
+
+/* Transfer statistics */
+static ulong dfu_time_start;
+static ulong dfu_time_medium;
+
+static unsigned long dfu_seg_stride(void)
+{
+	return ALIGN(dfu_buf_size, CONFIG_SYS_CACHELINE_SIZE);
+}
+
+static u8 *dfu_seg_buf(unsigned int seg)
+{
+	return dfu_buf + (seg % dfu_buf_segs) * dfu_seg_stride();
+}
+
+static bool dfu_buf_contains(const void *buf)
+{
+	return (u8 *)buf >= dfu_buf &&
+	       (u8 *)buf < dfu_buf + dfu_seg_stride() * dfu_buf_segs;
+}
 
 unsigned char *dfu_free_buf(void)
 {
 	free(dfu_buf);
 	dfu_buf = NULL;
+	dfu_buf_segs = 0;
+	dfu_seg_pending = 0;
 	return dfu_buf;
 }
 
@@ -216,7 +249,14 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 	if (dfu->max_buf_size && dfu_buf_size > dfu->max_buf_size)
 		dfu_buf_size = dfu->max_buf_size;
 
-	dfu_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
+	/* Fall back to fewer segments if memory is short */
+	for (dfu_buf_segs = CONFIG_DFU_BUF_SEGMENTS; dfu_buf_segs;
+	     dfu_buf_segs--) {
+		dfu_buf = memalign(CONFIG_SYS_CACHELINE_SIZE,
+				   dfu_seg_stride() * dfu_buf_segs);
+		if (dfu_buf)
+			break;
+	}
 	if (dfu_buf == NULL)
 		printf("%s: Could not memalign 0x%lx bytes\n",
 		       __func__, dfu_buf_size);
@@ -242,27 +282,21 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+static int dfu_write_buffer(struct dfu_entity *dfu, u8 *buf, long w_size)
 {
-	long w_size;
+	ulong start;
 	int ret;
 
-	/* flush size? */
-	w_size = dfu->i_buf - dfu->i_buf_start;
-	if (w_size == 0)
-		return 0;
-
 	if (dfu_hash_algo)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
-					   dfu->i_buf_start, w_size, 0);
+					   buf, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
+	start = get_timer(0);
+	ret = dfu->write_medium(dfu, dfu->offset, buf, &w_size);
+	dfu_time_medium += get_timer(start);
 	if (ret)
 		debug("%s: Write error!\n", __func__);
 
-	/* point back */
-	dfu->i_buf = dfu->i_buf_start;
-
 	/* update offset */
 	dfu->offset += w_size;
 
@@ -271,6 +305,88 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 	return ret;
 }
 
+static int dfu_write_oldest_segment(struct dfu_entity *dfu)
+{
+	unsigned int seg = dfu_seg_first;
+
+	dfu_seg_first = (dfu_seg_first + 1) % dfu_buf_segs;
+	dfu_seg_pending--;
+
+	return dfu_write_buffer(dfu, dfu_seg_buf(seg), dfu_seg_len[seg]);
+}
+
+static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+{
+	long w_size;
+	int ret = 0;
+
+	while (dfu_seg_pending) {
+		ret = dfu_write_oldest_segment(dfu);
+		if (ret)
+			return ret;
+	}
+
+	/* flush size? */
+	w_size = dfu->i_buf - dfu->i_buf_start;
+	if (w_size)
+		ret = dfu_write_buffer(dfu, dfu->i_buf_start, w_size);
+
+	/* point back to the first segment */
+	dfu_seg_first = 0;
+	dfu->i_buf_start = dfu_seg_buf(0);
+	dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size;
+	dfu->i_buf = dfu->i_buf_start;
+
+	return ret;
+}
+
+/*
+ * Queue the filled segment for dfu_write_pending() and continue with the
+ * next one. The oldest segment is written right away if no free segment is
+ * left.
+ */
+static int dfu_write_buffer_next(struct dfu_entity *dfu)
+{
+	unsigned int seg = (dfu_seg_first + dfu_seg_pending) % dfu_buf_segs;
+	int ret;
+
+	if (dfu->i_buf == dfu->i_buf_start)
+		return 0;
+
+	dfu_seg_len[seg] = dfu->i_buf - dfu->i_buf_start;
+	dfu_seg_dfu = dfu;
+	dfu_seg_pending++;
+
+	if (dfu_seg_pending == dfu_buf_segs) {
+		ret = dfu_write_oldest_segment(dfu);
+		if (ret)
+			return ret;
+	}
+
+	dfu->i_buf_start = dfu_seg_buf(seg + 1);
+	dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size;
+	dfu->i_buf = dfu->i_buf_start;
+
+	return 0;
+}
+
+int dfu_write_pending(void)
+{
+	struct dfu_entity *dfu = dfu_seg_dfu;
+	int ret;
+
+	if (!dfu_seg_pending)
+		return 0;
+
+	ret = dfu_write_oldest_segment(dfu);
+	if (ret) {
+		dfu_transaction_cleanup(dfu);
+		dfu_error_callback(dfu, "DFU write error");
+	}
+
+	return ret;
+}
+
 void dfu_transaction_cleanup(struct dfu_entity *dfu)
 {
 	/* clear everything */
@@ -284,6 +400,9 @@ void dfu_transaction_cleanup(struct dfu_entity *dfu)
 	dfu->b_left = 0;
 	dfu->bad_skip = 0;
 
+	dfu_seg_first = 0;
+	dfu_seg_pending = 0;
+
 	dfu->inited = 0;
 }
 
@@ -308,6 +427,9 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 		debug("%s: %s %lld [B]\n", __func__, dfu->name, dfu->r_left);
 	}
 
+	dfu_time_start = get_timer(0);
+	dfu_time_medium = 0;
+
 	dfu->inited = 1;
 	dfu_initiated_callback(dfu);
 
@@ -316,6 +438,7 @@ int dfu_transaction_initiate(struct dfu_entity *dfu, bool read)
 
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
+	ulong time;
 	int ret = 0;
 
 	ret = dfu_write_buffer_drain(dfu);
@@ -329,6 +452,13 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		printf("\nDFU complete %s: 0x%08x\n", dfu_hash_algo->name,
 		       dfu->crc);
 
+	time = get_timer(dfu_time_start);
+	if (dfu->offset && time > 0) {
+		printf("\nDFU %s: %llu bytes in %lu ms, medium %lu ms, ",
+		       dfu->name, dfu->offset, time, dfu_time_medium);
+		print_size(div_u64(dfu->offset * 1000, time), "/s\n");
+	}
+
 	dfu_flush_callback(dfu);
 
 	dfu_transaction_cleanup(dfu);
@@ -372,9 +502,9 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	/* handle rollover */
 	dfu->i_blk_seq_num = (dfu->i_blk_seq_num + 1) & 0xffff;
 
-	/* flush buffer if overflow */
+	/* continue with the next segment if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_next(dfu);
 		if (ret) {
 			dfu_transaction_cleanup(dfu);
 			dfu_error_callback(dfu, "DFU write error");
@@ -394,14 +524,21 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	memcpy(dfu->i_buf, buf, size);
 	dfu->i_buf += size;
 
-	/* if end or if buffer full flush */
-	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
+	/*
+	 * if end or if the caller reuses our buffer flush, as the data
+	 * would overwrite pending segments
+	 */
+	if (size == 0 || dfu_buf_contains(buf))
 		ret = dfu_write_buffer_drain(dfu);
-		if (ret) {
-			dfu_transaction_cleanup(dfu);
-			dfu_error_callback(dfu, "DFU write error");
-			return ret;
-		}
+	/* if buffer full continue with the next segment */
+	else if ((dfu->i_buf + size) > dfu->i_buf_end)
+		ret = dfu_write_buffer_next(dfu);
+	else
+		ret = 0;
+	if (ret) {
+		dfu_transaction_cleanup(dfu);
+		dfu_error_callback(dfu, "DFU write error");
+		return ret;
 	}
 
 	return 0;
@@ -5,6 +5,7 @@
 
 #include <command.h>
 #include <console.h>
+#include <display_options.h>
 #include <env.h>
 #include <fastboot.h>
 #include <fastboot-internal.h>
@@ -12,7 +13,9 @@
 #include <fb_nand.h>
 #include <part.h>
 #include <stdlib.h>
+#include <time.h>
 #include <vsprintf.h>
+#include <linux/math64.h>
 #include <linux/printk.h>
 
 /**
@@ -30,6 +33,11 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * fastboot_download_start - timer value at the start of the current download
+ */
+static ulong fastboot_download_start;
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -249,6 +257,7 @@ static void download(char *cmd_parameter, char *response)
 	} else {
 		printf("Starting download of %d bytes\n",
 		       fastboot_bytes_expected);
+		fastboot_download_start = get_timer(0);
 		fastboot_response("DATA", response, "%s", cmd_parameter);
 	}
 }
@@ -263,6 +272,16 @@ u32 fastboot_data_remaining(void)
 	return fastboot_bytes_expected - fastboot_bytes_received;
 }
 
+/**
+ * fastboot_data_buffer() - return where the next downloaded data goes
+ *
+ * Return: Pointer into fastboot_buf_addr at the current transfer offset
+ */
+void *fastboot_data_buffer(void)
+{
+	return fastboot_buf_addr + fastboot_bytes_received;
+}
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -272,7 +291,8 @@ u32 fastboot_data_remaining(void)
  *
  * Copies image data from fastboot_data to fastboot_buf_addr. Writes to
  * response. fastboot_bytes_received is updated to indicate the number
- * of bytes that have been transferred.
+ * of bytes that have been transferred.  Data which the transport already
+ * placed at fastboot_data_buffer() is not copied.
  *
  * On completion sets image_size and ${filesize} to the total size of the
  * downloaded image.
@@ -292,8 +312,9 @@ void fastboot_data_download(const void *fastboot_data,
 		return;
 	}
 	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (fastboot_data != fastboot_data_buffer())
+		memcpy(fastboot_data_buffer(), fastboot_data,
+		       fastboot_data_len);
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -312,13 +333,21 @@ void fastboot_data_download(const void *fastboot_data,
  *
  * @response: Pointer to fastboot response buffer
  *
- * Set image_size and ${filesize} to the total size of the downloaded image.
+ * Set image_size and ${filesize} to the total size of the downloaded image
+ * and print the transfer rate.
  */
 void fastboot_data_complete(char *response)
 {
+	ulong time = get_timer(fastboot_download_start);
+
 	/* Download complete. Respond with "OKAY" */
 	fastboot_okay(NULL, response);
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
+	if (time > 0) {
+		printf("%lu ms, ", time);
+		print_size(div_u64((u64)fastboot_bytes_received * 1000, time),
+			   "/s\n");
+	}
 	image_size = fastboot_bytes_received;
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Page cache with read-ahead for NAND MTD devices
+ *
+ * UBI and UBIFS keep re-reading the same NAND pages (headers, index nodes,
+ * small data nodes) and often read a LEB in small sequential pieces. Each of
+ * those used to be a full page load plus ECC correction. This keeps a few
+ * lines of consecutive pages per master device. A line is filled in one go
+ * when the reader is moving sequentially, so the controller gets a single
+ * multi-page request instead of one request per page.
+ *
+ * The cache holds ECC-corrected main area data only; raw and OOB accesses go
+ * straight to the driver. The number of bitflips reported when a page was
+ * read is kept with the page and reported again on every hit, so callers
+ * such as UBI still see -EUCLEAN and scrub. Pages that failed ECC are never
+ * cached. Any write, erase or bad block marking through the MTD API drops
+ * the overlapping lines.
+ */
+
+#include <log.h>
+#include <malloc.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mtd/mtd.h>
+
+#define MTD_CACHE_LINES		CONFIG_MTD_PAGE_CACHE_LINES
+#define MTD_CACHE_MAX_PAGES	32
+
+/**
+ * struct mtd_cache_line - a run of consecutive pages of a master device
+ *
+ * @addr: offset of the first page in the master device, -1 if unused
+ * @valid: bitmap of the pages holding valid data
+ * @age: value of the cache clock when the line was last used
+ * @bitflips: bitflips reported by the driver when each page was read
+ * @data: page data, line_pages * writesize bytes
+ */
+struct mtd_cache_line {
+	loff_t addr;
+	u32 valid;
+	unsigned int age;
+	u8 bitflips[MTD_CACHE_MAX_PAGES];
+	u8 *data;
+};
+
+/**
+ * struct mtd_page_cache - page cache of a master MTD device
+ *
+ * @line_pages: number of pages per line, a power of two
+ * @line_size: line_pages * writesize, lines are aligned to it
+ * @next: offset of the page a sequential reader would want next
+ * @clock: incremented on each access, used for LRU replacement
+ * @stats: hit/miss counters
+ * @lines: the cache lines
+ */
+struct mtd_page_cache {
+	unsigned int line_pages;
+	u32 line_size;
+	loff_t next;
+	unsigned int clock;
+	struct mtd_cache_stats stats;
+	struct mtd_cache_line lines[MTD_CACHE_LINES];
+};
+
+static struct mtd_info *mtd_cache_master(struct mtd_info *mtd, loff_t *ofs)
+{
+	while (mtd->parent) {
+		*ofs += mtd->offset;
+		mtd = mtd->parent;
+	}
+
+	return mtd;
+}
+
+static struct mtd_page_cache *mtd_cache_get(struct mtd_info *master)
+{
+	struct mtd_page_cache *cache = master->cache;
+	unsigned int pages;
+	int i;
+
+	if (cache)
+		return cache;
+
+	pages = min_t(u32, CONFIG_MTD_READAHEAD_PAGES,
+		      master->erasesize / master->writesize);
+	pages = min_t(u32, pages, MTD_CACHE_MAX_PAGES);
+	pages = rounddown_pow_of_two(max(pages, 1U));
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	cache->line_pages = pages;
+	cache->line_size = pages * master->writesize;
+	cache->next = -1;
+	for (i = 0; i < MTD_CACHE_LINES; i++) {
+		cache->lines[i].addr = -1;
+		cache->lines[i].data = malloc(cache->line_size);
+		if (!cache->lines[i].data)
+			goto err;
+	}
+	master->cache = cache;
+
+	return cache;
+
+err:
+	while (i--)
+		free(cache->lines[i].data);
+	free(cache);
+
+	return NULL;
+}
+
+bool mtd_cache_can_read(struct mtd_info *mtd, struct mtd_oob_ops *ops)
+{
+	loff_t ofs = 0;
+	struct mtd_info *master = mtd_cache_master(mtd, &ofs);
+
+	return ops->datbuf && !ops->oobbuf && ops->mode != MTD_OPS_RAW &&
+	       mtd_type_is_nand(master) && master->_read_oob &&
+	       master->writesize > 1;
+}
+
+/*
+ * Find the line for @addr, or recycle the least recently used one for it.
+ */
+static struct mtd_cache_line *mtd_cache_line(struct mtd_page_cache *cache,
+					     loff_t addr)
+{
+	struct mtd_cache_line *line, *victim = NULL;
+	int i;
+
+	for (i = 0; i < MTD_CACHE_LINES; i++) {
+		line = &cache->lines[i];
+		if (line->addr == addr)
+			return line;
+		if (!victim || line->addr == -1 ||
+		    (victim->addr != -1 && line->age < victim->age))
+			victim = line;
+	}
+
+	victim->addr = addr;
+	victim->valid = 0;
+
+	return victim;
+}
+
+static int mtd_cache_fill(struct mtd_info *master, struct mtd_cache_line *line,
+			  unsigned int first, unsigned int count)
+{
+	struct mtd_oob_ops ops = {
+		.mode = MTD_OPS_PLACE_OOB,
+		.len = count * master->writesize,
+		.datbuf = line->data + first * master->writesize,
+	};
+	int ret;
+
+	ret = master->_read_oob(master, line->addr + first * master->writesize,
+				&ops);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * We only get the maximum for the whole request, which is an upper
+	 * bound for each page.
+	 */
+	line->valid |= GENMASK(first + count - 1, first);
+	memset(&line->bitflips[first], ret, count);
+
+	return ret;
+}
+
+/*
+ * Make page @idx of @line available, reading @want pages from it on a miss,
+ * or the rest of the line if the reader is moving sequentially. Returns the
+ * bitflips of the page or a negative error; on -EBADMSG the page data is in
+ * the line but the page is not marked valid.
+ */
+static int mtd_cache_load(struct mtd_info *master, struct mtd_page_cache *cache,
+			  struct mtd_cache_line *line, unsigned int idx,
+			  unsigned int want, bool sequential)
+{
+	unsigned int count = 1;
+	int ret;
+
+	if (line->valid & BIT(idx)) {
+		cache->stats.hits++;
+		return line->bitflips[idx];
+	}
+
+	cache->stats.misses++;
+	if (sequential)
+		want = cache->line_pages - idx;
+	while (count < want && !(line->valid & BIT(idx + count)))
+		count++;
+
+	ret = mtd_cache_fill(master, line, idx, count);
+	if (ret >= 0) {
+		cache->stats.readahead += count - 1;
+		return ret;
+	}
+	if (!mtd_is_eccerr(ret) || count == 1)
+		return ret;
+
+	/* Pinpoint the page(s) which failed ECC, keep the good ones */
+	ret = mtd_cache_fill(master, line, idx, 1);
+	for (count--; count; count--)
+		mtd_cache_fill(master, line, idx + count, 1);
+
+	return ret;
+}
+
+int mtd_cache_read(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops)
+{
+	loff_t ofs = from;
+	struct mtd_info *master = mtd_cache_master(mtd, &ofs);
+	struct mtd_page_cache *cache = mtd_cache_get(master);
+	unsigned int max_bitflips = 0;
+	bool ecc_failed = false;
+	bool sequential;
+	loff_t end;
+	int ret;
+
+	/* Large reads gain nothing from an extra copy through the cache */
+	if (!cache || ops->len >= cache->line_size)
+		return mtd->_read_oob(mtd, from, ops);
+
+	/* Only read ahead if this request carries on where the last one ended */
+	sequential = ofs - mtd_mod_by_ws(ofs, master) == cache->next;
+	end = ofs + ops->len;
+
+	while (ops->retlen < ops->len) {
+		loff_t pos = ofs + ops->retlen;
+		loff_t page = pos - mtd_mod_by_ws(pos, master);
+		loff_t addr = page & ~(loff_t)(cache->line_size - 1);
+		unsigned int idx = mtd_div_by_ws(page - addr, master);
+		unsigned int want = min_t(u32, cache->line_pages - idx,
+					  mtd_div_by_ws(end - page +
+							master->writesize - 1,
+							master));
+		size_t col = pos - page;
+		size_t len = min_t(size_t, master->writesize - col,
+				   ops->len - ops->retlen);
+		struct mtd_cache_line *line = mtd_cache_line(cache, addr);
+
+		line->age = ++cache->clock;
+		ret = mtd_cache_load(master, cache, line, idx, want, sequential);
+		if (mtd_is_eccerr(ret))
+			ecc_failed = true;
+		else if (ret < 0)
+			return ret;
+		else
+			max_bitflips = max_t(unsigned int, max_bitflips, ret);
+
+		memcpy(ops->datbuf + ops->retlen,
+		       line->data + idx * master->writesize + col, len);
+		ops->retlen += len;
+	}
+
+	cache->next = end + master->writesize - 1;
+	cache->next -= mtd_mod_by_ws(cache->next, master);
+
+	return ecc_failed ? -EBADMSG : max_bitflips;
+}
+
+void mtd_cache_invalidate(struct mtd_info *mtd, loff_t ofs, uint64_t len)
+{
+	struct mtd_info *master = mtd_cache_master(mtd, &ofs);
+	struct mtd_page_cache *cache = master->cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < MTD_CACHE_LINES; i++) {
+		struct mtd_cache_line *line = &cache->lines[i];
+
+		if (line->addr != -1 && line->addr < ofs + len &&
+		    line->addr + cache->line_size > ofs) {
+			line->addr = -1;
+			line->valid = 0;
+		}
+	}
+}
+
+void mtd_cache_free(struct mtd_info *mtd)
+{
+	struct mtd_page_cache *cache = mtd->cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < MTD_CACHE_LINES; i++)
+		free(cache->lines[i].data);
+	free(cache);
+	mtd->cache = NULL;
+}
+
+int mtd_cache_get_stats(struct mtd_info *mtd, struct mtd_cache_stats *stats)
+{
+	loff_t ofs = 0;
+	struct mtd_info *master = mtd_cache_master(mtd, &ofs);
+
+	if (!master->cache)
+		return -ENOENT;
+
+	*stats = master->cache->stats;
+
+	return 0;
+}
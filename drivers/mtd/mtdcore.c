@@ -558,6 +558,7 @@ int del_mtd_device(struct mtd_info *mtd)
 #endif
 
 		idr_remove(&mtd_idr, mtd->index);
+		mtd_cache_free(mtd);
 
 		module_put(THIS_MODULE);
 		ret = 0;
@@ -915,6 +916,7 @@ int mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 		instr->state = MTD_ERASE_DONE;
 		return 0;
 	}
+	mtd_cache_invalidate(mtd, instr->addr, instr->len);
 	return mtd->_erase(mtd, instr);
 }
 EXPORT_SYMBOL_GPL(mtd_erase);
@@ -973,6 +975,10 @@ EXPORT_SYMBOL_GPL(mtd_get_unmapped_area);
 int mtd_read(struct mtd_info *mtd, loff_t from, size_t len, size_t *retlen,
 	     u_char *buf)
 {
+	struct mtd_oob_ops ops = {
+		.len = len,
+		.datbuf = buf,
+	};
 	int ret_code;
 	*retlen = 0;
 	if (from < 0 || from > mtd->size || len > mtd->size - from)
@@ -985,14 +991,12 @@ int mtd_read(struct mtd_info *mtd, loff_t from, size_t len, size_t *retlen,
 	 * representing the maximum number of bitflips that were corrected on
 	 * any one ecc region (if applicable; zero otherwise).
 	 */
-	if (mtd->_read) {
+	if (mtd->_read_oob && mtd_cache_can_read(mtd, &ops)) {
+		ret_code = mtd_cache_read(mtd, from, &ops);
+		*retlen = ops.retlen;
+	} else if (mtd->_read) {
 		ret_code = mtd->_read(mtd, from, len, retlen, buf);
 	} else if (mtd->_read_oob) {
-		struct mtd_oob_ops ops = {
-			.len = len,
-			.datbuf = buf,
-		};
-
 		ret_code = mtd->_read_oob(mtd, from, &ops);
 		*retlen = ops.retlen;
 	} else {
@@ -1019,6 +1023,8 @@ int mtd_write(struct mtd_info *mtd, loff_t to, size_t len, size_t *retlen,
 	if (!len)
 		return 0;
 
+	mtd_cache_invalidate(mtd, to, len);
+
 	if (!mtd->_write) {
 		struct mtd_oob_ops ops = {
 			.len = len,
@@ -1054,6 +1060,7 @@ int mtd_panic_write(struct mtd_info *mtd, loff_t to, size_t len, size_t *retlen,
 		return -EROFS;
 	if (!len)
 		return 0;
+	mtd_cache_invalidate(mtd, to, len);
 	return mtd->_panic_write(mtd, to, len, retlen, buf);
 }
 EXPORT_SYMBOL_GPL(mtd_panic_write);
@@ -1104,7 +1111,9 @@ int mtd_read_oob(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops)
 	if (!mtd->_read_oob && (!mtd->_read || ops->oobbuf))
 		return -EOPNOTSUPP;
 
-	if (mtd->_read_oob)
+	if (mtd->_read_oob && mtd_cache_can_read(mtd, ops))
+		ret_code = mtd_cache_read(mtd, from, ops);
+	else if (mtd->_read_oob)
 		ret_code = mtd->_read_oob(mtd, from, ops);
 	else
 		ret_code = mtd->_read(mtd, from, ops->len, &ops->retlen,
@@ -1142,6 +1151,12 @@ int mtd_write_oob(struct mtd_info *mtd, loff_t to,
 	if (!mtd->_write_oob && (!mtd->_write || ops->oobbuf))
 		return -EOPNOTSUPP;
 
+	/* OOB only writes may still cover several pages, drop everything */
+	if (ops->len)
+		mtd_cache_invalidate(mtd, to, ops->len);
+	else
+		mtd_cache_invalidate(mtd, 0, mtd->size);
+
 	if (mtd->_write_oob)
 		return mtd->_write_oob(mtd, to, ops);
 	else
@@ -1658,6 +1673,7 @@ int mtd_block_markbad(struct mtd_info *mtd, loff_t ofs)
 		return -EINVAL;
 	if (!(mtd->flags & MTD_WRITEABLE))
 		return -EROFS;
+	mtd_cache_invalidate(mtd, ofs - mtd_mod_by_eb(ofs, mtd), mtd->erasesize);
 	return mtd->_block_markbad(mtd, ofs);
 }
 EXPORT_SYMBOL_GPL(mtd_block_markbad);
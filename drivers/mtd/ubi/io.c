@@ -96,6 +96,10 @@ static int self_check_vid_hdr(const struct ubi_device *ubi, int pnum,
 			      const struct ubi_vid_hdr *vid_hdr);
 static int self_check_write(struct ubi_device *ubi, const void *buf, int pnum,
 			    int offset, int len);
+static int check_ec_hdr(struct ubi_device *ubi, int pnum,
+			struct ubi_ec_hdr *ec_hdr, int read_err, int verbose);
+static int check_vid_hdr(struct ubi_device *ubi, int pnum,
+			 struct ubi_vid_hdr *vid_hdr, int read_err, int verbose);
 
 /**
  * ubi_io_read - read data from a physical eraseblock.
@@ -715,13 +719,32 @@ bad:
 int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 		       struct ubi_ec_hdr *ec_hdr, int verbose)
 {
-	int err, read_err;
-	uint32_t crc, magic, hdr_crc;
+	int read_err;
 
 	dbg_io("read EC header from PEB %d", pnum);
 	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
 
 	read_err = ubi_io_read(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
+
+	return check_ec_hdr(ubi, pnum, ec_hdr, read_err, verbose);
+}
+
+/**
+ * check_ec_hdr - check an erase counter header which has just been read.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock the header was read from
+ * @ec_hdr: the erase counter header to check
+ * @read_err: the value returned by 'ubi_io_read()' for the header
+ * @verbose: be verbose if the header is corrupted or was not found
+ *
+ * Returns the same codes as 'ubi_io_read_ec_hdr()'.
+ */
+static int check_ec_hdr(struct ubi_device *ubi, int pnum,
+			struct ubi_ec_hdr *ec_hdr, int read_err, int verbose)
+{
+	int err;
+	uint32_t crc, magic, hdr_crc;
+
 	if (read_err) {
 		if (read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 			return read_err;
@@ -988,8 +1011,7 @@ bad:
 int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_hdr *vid_hdr, int verbose)
 {
-	int err, read_err;
-	uint32_t crc, magic, hdr_crc;
+	int read_err;
 	void *p;
 
 	dbg_io("read VID header from PEB %d", pnum);
@@ -998,6 +1020,26 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	p = (char *)vid_hdr - ubi->vid_hdr_shift;
 	read_err = ubi_io_read(ubi, p, pnum, ubi->vid_hdr_aloffset,
 			  ubi->vid_hdr_alsize);
+
+	return check_vid_hdr(ubi, pnum, vid_hdr, read_err, verbose);
+}
+
+/**
+ * check_vid_hdr - check a volume identifier header which has just been read.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock the header was read from
+ * @vid_hdr: the volume identifier header to check
+ * @read_err: the value returned by 'ubi_io_read()' for the header
+ * @verbose: be verbose if the header is corrupted or wasn't found
+ *
+ * Returns the same codes as 'ubi_io_read_vid_hdr()'.
+ */
+static int check_vid_hdr(struct ubi_device *ubi, int pnum,
+			 struct ubi_vid_hdr *vid_hdr, int read_err, int verbose)
+{
+	int err;
+	uint32_t crc, magic, hdr_crc;
+
 	if (read_err && read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 		return read_err;
 
@@ -1054,6 +1096,60 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	return read_err ? UBI_IO_BITFLIPS : 0;
 }
 
+/**
+ * ubi_io_read_hdrs - read and check both UBI headers of a PEB at once.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock number to read from
+ * @ec_hdr: a &struct ubi_ec_hdr object where to store the EC header
+ * @vid_hdr: a &struct ubi_vid_hdr object where to store the VID header
+ * @vid_err: the VID header status is returned here
+ *
+ * This is what attaching by scanning uses instead of a pair of
+ * 'ubi_io_read_ec_hdr()' and 'ubi_io_read_vid_hdr()' calls: both headers are
+ * fetched with a single MTD read, which saves a flash command, a page load
+ * and the ECC set-up per PEB. If the read reports a data integrity error, we
+ * fall back to separate reads so that the error is charged to the right
+ * header. The EC header status is returned, the VID header status is stored
+ * in @vid_err; both use the codes documented at 'ubi_io_read_ec_hdr()'.
+ * @vid_err is only valid if the EC header status is not negative.
+ */
+int ubi_io_read_hdrs(struct ubi_device *ubi, int pnum,
+		     struct ubi_ec_hdr *ec_hdr, struct ubi_vid_hdr *vid_hdr,
+		     int *vid_err)
+{
+	int len = ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize;
+	int read_err, err;
+
+	dbg_io("read EC and VID headers from PEB %d", pnum);
+	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
+
+	mutex_lock(&ubi->buf_mutex);
+	read_err = ubi_io_read(ubi, ubi->peb_buf, pnum, 0, len);
+	if (mtd_is_eccerr(read_err)) {
+		mutex_unlock(&ubi->buf_mutex);
+		err = ubi_io_read_ec_hdr(ubi, pnum, ec_hdr, 0);
+		if (err >= 0)
+			*vid_err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 0);
+		return err;
+	}
+
+	if (read_err && read_err != UBI_IO_BITFLIPS) {
+		mutex_unlock(&ubi->buf_mutex);
+		return read_err;
+	}
+
+	memcpy(ec_hdr, ubi->peb_buf, UBI_EC_HDR_SIZE);
+	memcpy((char *)vid_hdr - ubi->vid_hdr_shift,
+	       ubi->peb_buf + ubi->vid_hdr_aloffset, ubi->vid_hdr_alsize);
+	mutex_unlock(&ubi->buf_mutex);
+
+	err = check_ec_hdr(ubi, pnum, ec_hdr, read_err, 0);
+	if (err >= 0)
+		*vid_err = check_vid_hdr(ubi, pnum, vid_hdr, read_err, 0);
+
+	return err;
+}
+
 /**
  * ubi_io_write_vid_hdr - write a volume identifier header.
  * @ubi: UBI device description object
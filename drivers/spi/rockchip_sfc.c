@@ -8,14 +8,18 @@
  *	   Jon Lin <Jon.lin@rock-chips.com>
  */
 
+#include <asm/cache.h>
 #include <asm/io.h>
 #include <bouncebuf.h>
 #include <clk.h>
+#include <cpu_func.h>
 #include <dm.h>
 #include <dm/device_compat.h>
 #include <linux/bitops.h>
 #include <linux/delay.h>
 #include <linux/iopoll.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
 #include <spi.h>
 #include <spi-mem.h>
 
@@ -164,6 +168,9 @@
 /* DMA is only enabled for large data transmission */
 #define SFC_DMA_TRANS_THRETHOLD		(0x40)
 
+/* Large DMA reads are split into chunks of this size for pipelining */
+#define SFC_DMA_READ_CHUNK		SZ_64K
+
 /* Maximum clock values from datasheet suggest keeping clock value under
  * 150MHz. No minimum or average value is suggested.
  */
@@ -555,6 +562,73 @@ static int rockchip_sfc_xfer_done(struct rockchip_sfc *sfc, u32 timeout_us)
 	return ret;
 }
 
+/*
+ * Reads with an address phase into a cache-aligned buffer below 4GiB can be
+ * DMA'd straight into the destination, without going through a bounce buffer.
+ */
+static bool rockchip_sfc_can_dma_read(struct rockchip_sfc *sfc,
+				      const struct spi_mem_op *op)
+{
+	ulong buf = (ulong)op->data.buf.in;
+
+	if (!sfc->use_dma || op->data.dir != SPI_MEM_DATA_IN ||
+	    !op->addr.nbytes)
+		return false;
+
+	if (op->data.nbytes < max(SFC_DMA_TRANS_THRETHOLD, ARCH_DMA_MINALIGN))
+		return false;
+
+	if (!IS_ALIGNED(buf, ARCH_DMA_MINALIGN) ||
+	    upper_32_bits((u64)buf + op->data.nbytes - 1))
+		return false;
+
+	return true;
+}
+
+static int rockchip_sfc_read_dma_direct(struct rockchip_sfc *sfc,
+					struct spi_slave *mem,
+					const struct spi_mem_op *op)
+{
+	u32 chunk = min_t(u32, sfc->max_iosize, SFC_DMA_READ_CHUNK);
+	ulong buf = (ulong)op->data.buf.in;
+	struct spi_mem_op sub = *op;
+	u32 done = 0, prev_len = 0;
+	ulong prev = buf;
+	int ret;
+
+	/* Make sure no dirty line gets written back on top of the DMA data */
+	invalidate_dcache_range(buf, buf + op->data.nbytes);
+
+	while (done < op->data.nbytes) {
+		u32 len = min_t(u32, op->data.nbytes - done, chunk);
+
+		sub.addr.val = op->addr.val + done;
+		sub.data.nbytes = len;
+		rockchip_sfc_xfer_setup(sfc, mem, &sub, len);
+		rockchip_sfc_fifo_transfer_dma(sfc, buf + done, len);
+
+		/* Invalidate the previous chunk while this one is in flight */
+		if (prev_len)
+			invalidate_dcache_range(prev, prev + prev_len);
+
+		ret = rockchip_sfc_wait_for_dma_finished(sfc, len * 10);
+		if (ret)
+			return ret;
+
+		ret = rockchip_sfc_xfer_done(sfc, 100000);
+		if (ret)
+			return ret;
+
+		prev = buf + done;
+		prev_len = len;
+		done += len;
+	}
+
+	invalidate_dcache_range(prev, prev + prev_len);
+
+	return 0;
+}
+
 static int rockchip_sfc_exec_op(struct spi_slave *mem,
 				const struct spi_mem_op *op)
 {
@@ -563,6 +637,10 @@ static int rockchip_sfc_exec_op(struct spi_slave *mem,
 	int ret;
 
 	rockchip_sfc_adjust_op_work((struct spi_mem_op *)op);
+	if (rockchip_sfc_can_dma_read(sfc, op) &&
+	    IS_ALIGNED(op->data.nbytes, ARCH_DMA_MINALIGN))
+		return rockchip_sfc_read_dma_direct(sfc, mem, op);
+
 	rockchip_sfc_xfer_setup(sfc, mem, op, len);
 	if (len) {
 		if (likely(sfc->use_dma) && len >= SFC_DMA_TRANS_THRETHOLD)
@@ -584,11 +662,31 @@ static int rockchip_sfc_adjust_op_size(struct spi_slave *mem, struct spi_mem_op
 {
 	struct rockchip_sfc *sfc = dev_get_plat(mem->dev->parent);
 
+	/*
+	 * Direct DMA reads are split into chunks by exec_op itself; only
+	 * leave the unaligned tail to a following FIFO transfer.
+	 */
+	if (rockchip_sfc_can_dma_read(sfc, op)) {
+		op->data.nbytes = round_down(op->data.nbytes, ARCH_DMA_MINALIGN);
+		return 0;
+	}
+
 	op->data.nbytes = min(op->data.nbytes, sfc->max_iosize);
 
 	return 0;
 }
 
+static bool rockchip_sfc_supports_op(struct spi_slave *mem,
+				     const struct spi_mem_op *op)
+{
+	/* Each phase has a 2-bit line width field: x1, x2 or x4 only */
+	if (op->cmd.buswidth > 4 || op->addr.buswidth > 4 ||
+	    op->dummy.buswidth > 4 || op->data.buswidth > 4)
+		return false;
+
+	return spi_mem_default_supports_op(mem, op);
+}
+
 static int rockchip_sfc_set_speed(struct udevice *bus, uint speed)
 {
 	struct rockchip_sfc *sfc = dev_get_plat(bus);
@@ -621,6 +719,7 @@ static int rockchip_sfc_set_mode(struct udevice *bus, uint mode)
 
 static const struct spi_controller_mem_ops rockchip_sfc_mem_ops = {
 	.adjust_op_size	= rockchip_sfc_adjust_op_size,
+	.supports_op	= rockchip_sfc_supports_op,
 	.exec_op	= rockchip_sfc_exec_op,
 };
 
@@ -38,12 +38,22 @@
  * that expect bulk OUT requests to be divisible by maxpacket size.
  */
 
+/*
+ * Downloads keep up to RX_DL_REQUESTS requests of RX_DL_BUFFER_SIZE bytes
+ * queued, so that the controller can receive the next packets while the
+ * data of a completed request is copied to the download buffer.
+ */
+#define RX_DL_REQUESTS			4
+#define RX_DL_BUFFER_SIZE		(4 * EP_BUFFER_SIZE)
+
 struct f_fastboot {
 	struct usb_function usb_function;
 
 	/* IN/OUT EP's and corresponding requests */
 	struct usb_ep *in_ep, *out_ep;
 	struct usb_request *in_req, *out_req;
+	/* OUT requests for downloads */
+	struct usb_request *dl_req[RX_DL_REQUESTS];
 };
 
 static char fb_ext_prop_name[] = "DeviceInterfaceGUID";
@@ -72,6 +82,9 @@ static inline struct f_fastboot *func_to_fastboot(struct usb_function *f)
 
 static struct f_fastboot *fastboot_func;
 
+/* Bytes asked for by the queued download requests */
+static unsigned int rx_dl_queued;
+
 static struct usb_endpoint_descriptor fs_ep_in = {
 	.bLength            = USB_DT_ENDPOINT_SIZE,
 	.bDescriptorType    = USB_DT_ENDPOINT,
@@ -194,6 +207,7 @@ static struct usb_gadget_strings *fastboot_strings[] = {
 };
 
 static void rx_handler_command(struct usb_ep *ep, struct usb_request *req);
+static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req);
 
 static void fastboot_complete(struct usb_ep *ep, struct usb_request *req)
 {
@@ -278,6 +292,7 @@ static void fastboot_unbind(struct usb_configuration *c, struct usb_function *f)
 static void fastboot_disable(struct usb_function *f)
 {
 	struct f_fastboot *f_fb = func_to_fastboot(f);
+	int i;
 
 	usb_ep_disable(f_fb->out_ep);
 	usb_ep_disable(f_fb->in_ep);
@@ -292,9 +307,17 @@ static void fastboot_disable(struct usb_function *f)
 		usb_ep_free_request(f_fb->in_ep, f_fb->in_req);
 		f_fb->in_req = NULL;
 	}
+	for (i = 0; i < RX_DL_REQUESTS; i++) {
+		if (!f_fb->dl_req[i])
+			continue;
+		free(f_fb->dl_req[i]->buf);
+		usb_ep_free_request(f_fb->out_ep, f_fb->dl_req[i]);
+		f_fb->dl_req[i] = NULL;
+	}
 }
 
-static struct usb_request *fastboot_start_ep(struct usb_ep *ep)
+static struct usb_request *fastboot_start_ep(struct usb_ep *ep,
+					     unsigned int size)
 {
 	struct usb_request *req;
 
@@ -302,8 +325,8 @@ static struct usb_request *fastboot_start_ep(struct usb_ep *ep)
 	if (!req)
 		return NULL;
 
-	req->length = EP_BUFFER_SIZE;
-	req->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, EP_BUFFER_SIZE);
+	req->length = size;
+	req->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, size);
 	if (!req->buf) {
 		usb_ep_free_request(ep, req);
 		return NULL;
@@ -316,7 +339,7 @@ static struct usb_request *fastboot_start_ep(struct usb_ep *ep)
 static int fastboot_set_alt(struct usb_function *f,
 			    unsigned interface, unsigned alt)
 {
-	int ret;
+	int i, ret;
 	struct usb_composite_dev *cdev = f->config->cdev;
 	struct usb_gadget *gadget = cdev->gadget;
 	struct f_fastboot *f_fb = func_to_fastboot(f);
@@ -332,7 +355,7 @@ static int fastboot_set_alt(struct usb_function *f,
 		return ret;
 	}
 
-	f_fb->out_req = fastboot_start_ep(f_fb->out_ep);
+	f_fb->out_req = fastboot_start_ep(f_fb->out_ep, EP_BUFFER_SIZE);
 	if (!f_fb->out_req) {
 		puts("failed to alloc out req\n");
 		ret = -EINVAL;
@@ -340,6 +363,20 @@ static int fastboot_set_alt(struct usb_function *f,
 	}
 	f_fb->out_req->complete = rx_handler_command;
 
+	/* Downloads work with fewer requests if memory is short */
+	for (i = 0; i < RX_DL_REQUESTS; i++) {
+		f_fb->dl_req[i] = fastboot_start_ep(f_fb->out_ep,
+						    RX_DL_BUFFER_SIZE);
+		if (!f_fb->dl_req[i])
+			break;
+		f_fb->dl_req[i]->complete = rx_handler_dl_image;
+	}
+	if (!f_fb->dl_req[0]) {
+		puts("failed to alloc download req\n");
+		ret = -EINVAL;
+		goto err;
+	}
+
 	d = fb_ep_desc(gadget, &fs_ep_in, &hs_ep_in, &ss_ep_in);
 	ret = usb_ep_enable(f_fb->in_ep, d);
 	if (ret) {
@@ -347,7 +384,7 @@ static int fastboot_set_alt(struct usb_function *f,
 		goto err;
 	}
 
-	f_fb->in_req = fastboot_start_ep(f_fb->in_ep);
+	f_fb->in_req = fastboot_start_ep(f_fb->in_ep, EP_BUFFER_SIZE);
 	if (!f_fb->in_req) {
 		puts("failed alloc req in\n");
 		ret = -EINVAL;
@@ -427,14 +464,17 @@ static void compl_do_reset(struct usb_ep *ep, struct usb_request *req)
 
 static unsigned int rx_bytes_expected(struct usb_ep *ep)
 {
-	int rx_remain = fastboot_data_remaining();
+	u32 remaining = fastboot_data_remaining();
+	int rx_remain;
 	unsigned int rem;
 	unsigned int maxpacket = usb_endpoint_maxp(ep->desc);
 
-	if (rx_remain <= 0)
+	/* Bytes not asked for by any queued request yet */
+	if (remaining <= rx_dl_queued)
 		return 0;
-	else if (rx_remain > EP_BUFFER_SIZE)
-		return EP_BUFFER_SIZE;
+	rx_remain = remaining - rx_dl_queued;
+	if (rx_remain > RX_DL_BUFFER_SIZE)
+		return RX_DL_BUFFER_SIZE;
 
 	/*
 	 * Some controllers e.g. DWC3 don't like OUT transfers to be
@@ -449,6 +489,51 @@ static unsigned int rx_bytes_expected(struct usb_ep *ep)
 	return rx_remain;
 }
 
+static void rx_dl_queue(struct usb_ep *ep, struct usb_request *req)
+{
+	unsigned int length = rx_bytes_expected(ep);
+
+	if (!length)
+		return;
+
+	req->length = length;
+	req->actual = 0;
+	rx_dl_queued += length;
+	usb_ep_queue(ep, req, 0);
+}
+
+static void rx_dl_start(struct usb_ep *ep)
+{
+	int i;
+
+	rx_dl_queued = 0;
+	for (i = 0; i < RX_DL_REQUESTS && fastboot_func->dl_req[i]; i++)
+		rx_dl_queue(ep, fastboot_func->dl_req[i]);
+}
+
+static void rx_dl_stop(struct usb_ep *ep)
+{
+	struct usb_request *req;
+	int i;
+
+	for (i = 0; i < RX_DL_REQUESTS && fastboot_func->dl_req[i]; i++) {
+		req = fastboot_func->dl_req[i];
+		if (req->status == -EINPROGRESS)
+			usb_ep_dequeue(ep, req);
+	}
+	rx_dl_queued = 0;
+}
+
+static void rx_command_queue(struct usb_ep *ep)
+{
+	struct usb_request *req = fastboot_func->out_req;
+
+	*(char *)req->buf = '\0';
+	req->length = EP_BUFFER_SIZE;
+	req->actual = 0;
+	usb_ep_queue(ep, req, 0);
+}
+
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
 	char response[FASTBOOT_RESPONSE_LEN] = {0};
@@ -457,32 +542,29 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 	unsigned int buffer_size = req->actual;
 
 	if (req->status != 0) {
-		printf("Bad status: %d\n", req->status);
+		/* requests dequeued by rx_dl_stop() */
+		if (req->status != -ECONNRESET)
+			printf("Bad status: %d\n", req->status);
 		return;
 	}
+	rx_dl_queued -= req->length;
 
 	if (buffer_size < transfer_size)
 		transfer_size = buffer_size;
 
+	/* Requests complete in the order they were queued */
 	fastboot_data_download(buffer, transfer_size, response);
 	if (response[0]) {
+		rx_dl_stop(ep);
 		fastboot_tx_write_str(response);
+		rx_command_queue(ep);
 	} else if (!fastboot_data_remaining()) {
 		fastboot_data_complete(response);
-
-		/*
-		 * Reset global transfer variable
-		 */
-		req->complete = rx_handler_command;
-		req->length = EP_BUFFER_SIZE;
-
 		fastboot_tx_write_str(response);
+		rx_command_queue(ep);
 	} else {
-		req->length = rx_bytes_expected(ep);
+		rx_dl_queue(ep, req);
 	}
-
-	req->actual = 0;
-	usb_ep_queue(ep, req, 0);
 }
 
 static void do_exit_on_complete(struct usb_ep *ep, struct usb_request *req)
@@ -553,8 +635,10 @@ static void rx_handler_command(struct usb_ep *ep, struct usb_request *req)
 	}
 
 	if (!strncmp("DATA", response, 4)) {
-		req->complete = rx_handler_dl_image;
-		req->length = rx_bytes_expected(ep);
+		/* The command request is queued again after the download */
+		rx_dl_start(ep);
+		fastboot_tx_write_str(response);
+		return;
 	}
 
 	if (!strncmp("OKAY", response, 4)) {
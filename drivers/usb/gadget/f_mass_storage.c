@@ -240,16 +240,19 @@
 /* #define DUMP_MSGS */
 
 #include <config.h>
+#include <display_options.h>
 #include <div64.h>
 #include <hexdump.h>
 #include <log.h>
 #include <malloc.h>
 #include <console.h>
 #include <g_dnl.h>
+#include <time.h>
 #include <dm/devres.h>
 #include <linux/bug.h>
 
 #include <linux/err.h>
+#include <linux/math64.h>
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
 #include <usb_mass_storage.h>
@@ -290,6 +293,13 @@ struct completion {int x; };
 struct fsg_dev;
 struct fsg_common;
 
+/* What the spare buffer of struct fsg_common holds */
+enum fsg_spare_state {
+	SPARE_STATE_EMPTY = 0,
+	SPARE_STATE_READ_AHEAD,		/* Data following the last READ */
+	SPARE_STATE_WRITE_BEHIND,	/* Tail of the last WRITE, unwritten */
+};
+
 /* Data shared by all the FSG instances. */
 struct fsg_common {
 	struct usb_gadget	*gadget;
@@ -302,6 +312,25 @@ struct fsg_common {
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
 	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	unsigned int		fsg_num_buffers;
+
+	/* Spare buffer for read-ahead and write-behind, may be NULL */
+	void			*spare_buf;
+	enum fsg_spare_state	spare_state;
+	unsigned int		spare_lun;
+	loff_t			spare_offset;
+	unsigned int		spare_amount;
+
+	/* Where the last READ ended, to detect sequential READs */
+	unsigned int		ra_lun;
+	loff_t			ra_offset;
+	unsigned int		ra_wanted:1;
+
+	/* Transfer statistics of the session */
+	u64			bytes_read;
+	u64			bytes_written;
+	ulong			read_time;
+	ulong			write_time;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -690,6 +719,92 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/* Exchange the data buffer of a buffer head with the spare buffer */
+static void swap_spare_buffer(struct fsg_common *common,
+			      struct fsg_buffhd *bh)
+{
+	void *buf = bh->buf;
+
+	bh->buf = common->spare_buf;
+	bh->inreq->buf = bh->buf;
+	bh->outreq->buf = bh->buf;
+	common->spare_buf = buf;
+}
+
+/*
+ * Write the tail of the last WRITE which was acknowledged to the host
+ * before it reached the medium.  A failure is reported as a unit attention
+ * condition with the next command for the LUN.
+ */
+static void do_write_behind(struct fsg_common *common)
+{
+	struct fsg_lun	*curlun = &common->luns[common->spare_lun];
+	struct ums	*ums_dev = &ums[common->spare_lun];
+	ulong		start;
+	int		rc;
+
+	if (common->spare_state != SPARE_STATE_WRITE_BEHIND)
+		return;
+	common->spare_state = SPARE_STATE_EMPTY;
+
+	start = get_timer(0);
+	rc = ums_dev->write_sector(ums_dev,
+				   lldiv(common->spare_offset, curlun->blksize),
+				   common->spare_amount >> curlun->blkbits,
+				   common->spare_buf);
+	common->write_time += get_timer(start);
+
+	VLDBG(curlun, "write-behind %u @ %llu -> %d\n", common->spare_amount,
+	      (unsigned long long)common->spare_offset, rc);
+
+	if (rc < 0 || (rc << curlun->blkbits) < common->spare_amount) {
+		printf("write-behind failed at offset %llu\n",
+		       (unsigned long long)common->spare_offset);
+		curlun->unit_attention_data = SS_WRITE_ERROR;
+	}
+}
+
+/*
+ * Read the data following a sequential READ into the spare buffer while
+ * the host has not yet sent its next command.
+ */
+static void do_read_ahead(struct fsg_common *common)
+{
+	struct fsg_lun	*curlun = &common->luns[common->ra_lun];
+	struct ums	*ums_dev = &ums[common->ra_lun];
+	unsigned int	amount;
+	ulong		start;
+	int		rc;
+
+	if (!common->ra_wanted ||
+	    common->spare_state == SPARE_STATE_WRITE_BEHIND)
+		return;
+	common->ra_wanted = 0;
+	common->spare_state = SPARE_STATE_EMPTY;
+
+	if (common->ra_offset >= curlun->file_length)
+		return;
+	amount = min_t(loff_t, curlun->file_length - common->ra_offset,
+		       FSG_BUFLEN);
+
+	start = get_timer(0);
+	rc = ums_dev->read_sector(ums_dev,
+				  lldiv(common->ra_offset, curlun->blksize),
+				  amount >> curlun->blkbits,
+				  common->spare_buf);
+	common->read_time += get_timer(start);
+	if (rc <= 0)
+		return;
+
+	common->spare_state = SPARE_STATE_READ_AHEAD;
+	common->spare_lun = common->ra_lun;
+	common->spare_offset = common->ra_offset;
+	common->spare_amount = min_t(unsigned int, amount,
+				     rc << curlun->blkbits);
+}
+
+/*-------------------------------------------------------------------------*/
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
@@ -701,6 +816,8 @@ static int do_read(struct fsg_common *common)
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nread;
+	ulong			start, time;
+	int			sequential;
 
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
@@ -728,6 +845,10 @@ static int do_read(struct fsg_common *common)
 	if (unlikely(amount_left == 0)) {
 		return -EIO;		/* No default reply */
 	}
+	sequential = common->lun == common->ra_lun &&
+		     file_offset == common->ra_offset;
+	start = get_timer(0);
+	time = common->read_time;
 
 	for (;;) {
 
@@ -764,15 +885,24 @@ static int do_read(struct fsg_common *common)
 			break;
 		}
 
-		/* Perform the read */
-		rc = ums[common->lun].read_sector(&ums[common->lun],
-				      lldiv(file_offset, curlun->blksize),
-				      lldiv(amount, curlun->blksize),
-				      (char __user *)bh->buf);
-		if (!rc)
-			return -EIO;
+		/* Use the data read ahead, or perform the read */
+		if (common->spare_state == SPARE_STATE_READ_AHEAD &&
+		    common->spare_lun == common->lun &&
+		    common->spare_offset == file_offset) {
+			amount = min(amount, common->spare_amount);
+			swap_spare_buffer(common, bh);
+			common->spare_state = SPARE_STATE_EMPTY;
+			nread = amount;
+		} else {
+			rc = ums[common->lun].read_sector(&ums[common->lun],
+					      lldiv(file_offset, curlun->blksize),
+					      lldiv(amount, curlun->blksize),
+					      (char __user *)bh->buf);
+			if (!rc)
+				return -EIO;
 
-		nread = rc * curlun->blksize;
+			nread = rc * curlun->blksize;
+		}
 
 		VLDBG(curlun, "file read %u @ %llu -> %d\n", amount,
 				(unsigned long long) file_offset,
@@ -813,6 +943,14 @@ static int do_read(struct fsg_common *common)
 		common->next_buffhd_to_fill = bh->next;
 	}
 
+	/* Read ahead once the host sends a second sequential READ */
+	common->ra_lun = common->lun;
+	common->ra_offset = file_offset;
+	common->ra_wanted = sequential && !amount_left && common->spare_buf;
+
+	common->bytes_read += common->data_size_from_cmnd - amount_left;
+	common->read_time = time + get_timer(start);
+
 	return -EIO;		/* No default reply */
 }
 
@@ -830,6 +968,8 @@ static int do_write(struct fsg_common *common)
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	ulong			start, time;
+	int			fua = 0;
 
 	if (curlun->ro) {
 		curlun->sense_data = SS_WRITE_PROTECTED;
@@ -851,12 +991,20 @@ static int do_write(struct fsg_common *common)
 			curlun->sense_data = SS_INVALID_FIELD_IN_CDB;
 			return -EINVAL;
 		}
+		fua = !curlun->nofua && (common->cmnd[1] & 0x08);
 	}
 	if (lba >= curlun->num_sectors) {
 		curlun->sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
 		return -EINVAL;
 	}
 
+	/* Data read ahead may be overwritten */
+	if (common->spare_state == SPARE_STATE_READ_AHEAD)
+		common->spare_state = SPARE_STATE_EMPTY;
+	common->ra_wanted = 0;
+	start = get_timer(0);
+	time = common->write_time;
+
 	/* Carry out the file writes */
 	get_some_more = 1;
 	file_offset = usb_offset = ((loff_t)lba) << curlun->blkbits;
@@ -921,6 +1069,12 @@ static int do_write(struct fsg_common *common)
 			continue;
 		}
 
+		/* Write the tail of the previous WRITE while data arrives */
+		if (common->spare_state == SPARE_STATE_WRITE_BEHIND) {
+			do_write_behind(common);
+			continue;
+		}
+
 		/* Write the received data to the backing file */
 		bh = common->next_buffhd_to_drain;
 		if (bh->state == BUF_STATE_EMPTY && !get_some_more)
@@ -938,6 +1092,24 @@ static int do_write(struct fsg_common *common)
 
 			amount = bh->outreq->actual;
 
+			/*
+			 * Keep the last buffer back unless FUA is set, so
+			 * that the status is sent before it is written.
+			 */
+			if (amount == amount_left_to_write && !fua &&
+			    common->spare_buf &&
+			    common->spare_state == SPARE_STATE_EMPTY) {
+				swap_spare_buffer(common, bh);
+				common->spare_state = SPARE_STATE_WRITE_BEHIND;
+				common->spare_lun = common->lun;
+				common->spare_offset = file_offset;
+				common->spare_amount = amount;
+				file_offset += amount;
+				amount_left_to_write -= amount;
+				common->residue -= amount;
+				continue;
+			}
+
 			/* Perform the write */
 			rc = ums[common->lun].write_sector(&ums[common->lun],
 					       lldiv(file_offset, curlun->blksize),
@@ -988,6 +1160,10 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	common->bytes_written += common->data_size_from_cmnd -
+				 amount_left_to_write;
+	common->write_time = time + get_timer(start);
+
 	return -EIO;		/* No default reply */
 }
 
@@ -1746,9 +1922,10 @@ static int check_command(struct fsg_common *common, int cmnd_size,
 			return -EINVAL;
 		}
 	}
-#if 0
-	/* If a unit attention condition exists, only INQUIRY and
-	 * REQUEST SENSE commands are allowed; anything else must fail. */
+
+	/* If a unit attention condition exists, e.g. after a failed
+	 * write-behind, only INQUIRY and REQUEST SENSE commands are
+	 * allowed; anything else must fail. */
 	if (curlun && curlun->unit_attention_data != SS_NO_SENSE &&
 			common->cmnd[0] != SC_INQUIRY &&
 			common->cmnd[0] != SC_REQUEST_SENSE) {
@@ -1756,7 +1933,7 @@ static int check_command(struct fsg_common *common, int cmnd_size,
 		curlun->unit_attention_data = SS_NO_SENSE;
 		return -EINVAL;
 	}
-#endif
+
 	/* Check that only command bytes listed in the mask are non-zero */
 	common->cmnd[1] &= 0x1f;			/* Mask away the LUN */
 	for (i = 1; i < cmnd_size; ++i) {
@@ -1791,6 +1968,12 @@ static int do_scsi_command(struct fsg_common *common)
 
 	dump_cdb(common);
 
+	/* Any command but a WRITE waits for the write-behind, which makes
+	 * SYNCHRONIZE CACHE a barrier; a WRITE does it while data arrives. */
+	if (common->cmnd[0] != SC_WRITE_6 && common->cmnd[0] != SC_WRITE_10 &&
+	    common->cmnd[0] != SC_WRITE_12)
+		do_write_behind(common);
+
 	/* Wait for the next buffer to become available for data or status */
 	bh = common->next_buffhd_to_fill;
 	common->next_buffhd_to_drain = bh;
@@ -2139,6 +2322,9 @@ static int get_next_command(struct fsg_common *common)
 	 * can reuse it for the next filling.  No need to advance
 	 * next_buffhd_to_fill. */
 
+	/* Use the time until the CBW arrives to read ahead */
+	do_read_ahead(common);
+
 	/* Wait for the CBW to arrive */
 	while (bh->state != BUF_STATE_FULL) {
 		rc = sleep_thread(common);
@@ -2191,7 +2377,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->fsg_num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2244,7 +2430,7 @@ reset:
 	generic_clear_bit(IGNORE_BULK_OUT, &fsg->atomic_bitflags);
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->fsg_num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2293,7 +2479,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (common->fsg) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->fsg_num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2305,7 +2491,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->fsg_num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2325,7 +2511,7 @@ static void handle_exception(struct fsg_common *common)
 	/* Reset the I/O buffer states and pointers, the SCSI
 	 * state, and the exception.  Then invoke the handler. */
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->fsg_num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2491,30 +2677,31 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	for (i = 0; i < nluns; i++) {
 		common->luns[i].removable = 1;
 
-		rc = fsg_lun_open(&common->luns[i], ums[i].num_sectors, ums->block_dev.blksz, "");
+		rc = fsg_lun_open(&common->luns[i], ums[i].num_sectors, ums[i].block_dev.blksz, "");
 		if (rc)
 			goto error_luns;
 	}
 	common->lun = 0;
 
-	/* Data buffers cyclic list */
-	bh = common->buffhds;
-
-	i = FSG_NUM_BUFFERS;
-	goto buffhds_first_it;
-	do {
-		bh->next = bh + 1;
-		++bh;
-buffhds_first_it:
+	/* Data buffers cyclic list, shorter if memory is short */
+	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		bh = &common->buffhds[i];
 		bh->inreq_busy = 0;
 		bh->outreq_busy = 0;
 		bh->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, FSG_BUFLEN);
-		if (unlikely(!bh->buf)) {
-			rc = -ENOMEM;
-			goto error_release;
-		}
-	} while (--i);
-	bh->next = common->buffhds;
+		if (unlikely(!bh->buf))
+			break;
+		bh->next = bh + 1;
+	}
+	if (i < 2) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+	common->fsg_num_buffers = i;
+	common->buffhds[i - 1].next = common->buffhds;
+
+	/* Without the spare buffer there is no read-ahead or write-behind */
+	common->spare_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, FSG_BUFLEN);
 
 	snprintf(common->inquiry_string, sizeof common->inquiry_string,
 		 "%-8s%-16s%04x",
@@ -2581,6 +2768,7 @@ static void fsg_common_release(struct kref *ref)
 			kfree(bh->buf);
 		} while (++bh, --i);
 	}
+	kfree(common->spare_buf);
 
 	if (common->free_storage_on_release)
 		kfree(common);
@@ -2637,11 +2825,31 @@ usb_copy_descriptors(struct usb_descriptor_header **src)
 	return ret;
 }
 
+/* Complete pending writes and print the transfer rates of the session */
+static void fsg_session_end(struct fsg_common *common)
+{
+	do_write_behind(common);
+
+	if (common->bytes_read) {
+		printf("UMS: read %llu bytes in %lu ms, ",
+		       common->bytes_read, common->read_time);
+		print_size(div_u64(common->bytes_read * 1000,
+				   max(common->read_time, 1UL)), "/s\n");
+	}
+	if (common->bytes_written) {
+		printf("UMS: written %llu bytes in %lu ms, ",
+		       common->bytes_written, common->write_time);
+		print_size(div_u64(common->bytes_written * 1000,
+				   max(common->write_time, 1UL)), "/s\n");
+	}
+}
+
 static void fsg_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct fsg_dev		*fsg = fsg_from_func(f);
 
 	DBG(fsg, "unbind\n");
+	fsg_session_end(fsg->common);
 	if (fsg->common->fsg == fsg) {
 		fsg->common->new_fsg = NULL;
 		raise_exception(fsg->common, FSG_STATE_CONFIG_CHANGE);
@@ -306,8 +306,11 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define EP0_BUFSIZE	256
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
-/* Number of buffers we will use.  2 is enough for double-buffering */
-#define FSG_NUM_BUFFERS	2
+/*
+ * Maximal number of buffers we will use.  2 is enough for double-buffering,
+ * more let the host queue further transfers while the medium is accessed.
+ */
+#define FSG_NUM_BUFFERS	CONFIG_USB_FUNCTION_MASS_STORAGE_BUFFERS
 
 /* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)131072)
@@ -221,25 +221,51 @@ int usb_stop(void)
 	return err;
 }
 
-static void usb_scan_bus(struct udevice *bus, bool recurse)
+/**
+ * usb_scan_buses() - Scan the root hubs of all active controllers
+ *
+ * The ports of all root hubs are queued first and then enumerated together,
+ * so the power-good and debounce times of the controllers overlap rather
+ * than adding up.
+ *
+ * @uc:		USB uclass
+ * @companion:	true to scan companion controllers, false for the others
+ */
+static void usb_scan_buses(struct uclass *uc, bool companion)
 {
 	struct usb_bus_priv *priv;
-	struct udevice *dev;
-	int ret;
+	struct udevice *bus, *dev;
 
-	priv = dev_get_uclass_priv(bus);
+	usb_hub_defer_scan();
+	uclass_foreach_dev(bus, uc) {
+		if (!device_active(bus))
+			continue;
 
-	assert(recurse);	/* TODO: Support non-recusive */
+		priv = dev_get_uclass_priv(bus);
+		if (priv->companion != companion)
+			continue;
 
-	printf("scanning bus %s for devices... ", bus->name);
-	debug("\n");
-	ret = usb_scan_device(bus, 0, USB_SPEED_FULL, &dev);
-	if (ret)
-		printf("failed, error %d\n", ret);
-	else if (priv->next_addr == 0)
-		printf("No USB Device found\n");
-	else
-		printf("%d USB Device(s) found\n", priv->next_addr);
+		debug("queueing bus %s\n", bus->name);
+		priv->scan_err = usb_scan_device(bus, 0, USB_SPEED_FULL, &dev);
+	}
+	usb_hub_flush_scan();
+
+	uclass_foreach_dev(bus, uc) {
+		if (!device_active(bus))
+			continue;
+
+		priv = dev_get_uclass_priv(bus);
+		if (priv->companion != companion)
+			continue;
+
+		printf("scanning bus %s for devices... ", bus->name);
+		if (priv->scan_err)
+			printf("failed, error %d\n", priv->scan_err);
+		else if (priv->next_addr == 0)
+			printf("No USB Device found\n");
+		else
+			printf("%d USB Device(s) found\n", priv->next_addr);
+	}
 }
 
 static void remove_inactive_children(struct uclass *uc, struct udevice *bus)
@@ -291,7 +317,6 @@ int usb_init(void)
 {
 	int controllers_initialized = 0;
 	struct usb_uclass_priv *uc_priv;
-	struct usb_bus_priv *priv;
 	struct udevice *bus;
 	struct uclass *uc;
 	int ret;
@@ -350,30 +375,15 @@ int usb_init(void)
 	 * lowlevel init done, now scan the bus for devices i.e. search HUBs
 	 * and configure them, first scan primary controllers.
 	 */
-	uclass_foreach_dev(bus, uc) {
-		if (!device_active(bus))
-			continue;
-
-		priv = dev_get_uclass_priv(bus);
-		if (!priv->companion)
-			usb_scan_bus(bus, true);
-	}
+	usb_scan_buses(uc, false);
 
 	/*
 	 * Now that the primary controllers have been scanned and have handed
 	 * over any devices they do not understand to their companions, scan
 	 * the companions if necessary.
 	 */
-	if (uc_priv->companion_device_count) {
-		uclass_foreach_dev(bus, uc) {
-			if (!device_active(bus))
-				continue;
-
-			priv = dev_get_uclass_priv(bus);
-			if (priv->companion)
-				usb_scan_bus(bus, true);
-		}
-	}
+	if (uc_priv->companion_device_count)
+		usb_scan_buses(uc, true);
 
 	debug("scan end\n");
 
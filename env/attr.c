@@ -11,6 +11,7 @@
 #else
 #include <slre.h>
 #include <vsprintf.h>
+#include <linux/ctype.h>
 #endif
 
 #include <env_attr.h>
@@ -38,47 +39,27 @@ int env_attr_walk(const char *attr_list,
 
 	entry = attr_list;
 	do {
-		char *entry_cpy = NULL;
+		int entry_len;
 
 		entry_end = strchr(entry, ENV_ATTR_LIST_DELIM);
 		/* check if this is the last entry in the list */
-		if (entry_end == NULL) {
-			int entry_len = strlen(entry);
-
-			if (entry_len) {
-				/*
-				 * allocate memory to copy the entry into since
-				 * we will need to inject '\0' chars and squash
-				 * white-space before calling the callback
-				 */
-				entry_cpy = malloc(entry_len + 1);
-				if (entry_cpy)
-					/* copy the rest of the list */
-					strcpy(entry_cpy, entry);
-				else
-					return -ENOMEM;
-			}
-		} else {
-			int entry_len = entry_end - entry;
-
-			if (entry_len) {
-				/*
-				 * allocate memory to copy the entry into since
-				 * we will need to inject '\0' chars and squash
-				 * white-space before calling the callback
-				 */
-				entry_cpy = malloc(entry_len + 1);
-				if (entry_cpy) {
-					/* copy just this entry and null term */
-					strncpy(entry_cpy, entry, entry_len);
-					entry_cpy[entry_len] = '\0';
-				} else
-					return -ENOMEM;
-			}
-		}
+		if (entry_end == NULL)
+			entry_len = strlen(entry);
+		else
+			entry_len = entry_end - entry;
 
 		/* check if there is anything to process (e.g. not ",,,") */
-		if (entry_cpy != NULL) {
+		if (entry_len) {
+			/*
+			 * copy the entry since we will need to inject '\0'
+			 * chars and squash white-space before calling the
+			 * callback; entries are short, so use the stack
+			 */
+			char entry_cpy[entry_len + 1];
+
+			memcpy(entry_cpy, entry, entry_len);
+			entry_cpy[entry_len] = '\0';
+
 			attributes = strchr(entry_cpy, ENV_ATTR_SEP);
 			/* check if there is a ':' */
 			if (attributes != NULL) {
@@ -95,14 +76,11 @@ int env_attr_walk(const char *attr_list,
 				int retval = 0;
 
 				retval = callback(name, attributes, priv);
-				if (retval) {
-					free(entry_cpy);
+				if (retval)
 					return retval;
-				}
 			}
 		}
 
-		free(entry_cpy);
 		entry = entry_end + 1;
 	} while (entry_end != NULL);
 
@@ -116,47 +94,94 @@ struct regex_callback_priv {
 	char *attributes;
 };
 
+/*
+ * Copy the literal text at the start of a regex, which anything it matches
+ * must start with. Return true if the whole regex is literal text.
+ */
+static bool regex_literal(const char *regex, char *literal)
+{
+	const char *p = regex;
+	char *q = literal;
+
+	/* An alternative may start with anything */
+	if (!strchr(regex, '|')) {
+		while (*p) {
+			const char *next = p + 1;
+			char c = *p;
+
+			if (c == '\\' && p[1] && !isalnum(p[1]))
+				c = *next++;
+			else if (strchr("^$.[]()*+?\\", c))
+				break;
+			/* stop at a character which may be left out */
+			if (*next && strchr("*+?", *next))
+				break;
+			*q++ = c;
+			p = next;
+		}
+	}
+	*q = '\0';
+
+	return !*p;
+}
+
 static int regex_callback(const char *name, const char *attributes, void *priv)
 {
 	int retval = 0;
 	struct regex_callback_priv *cbp = (struct regex_callback_priv *)priv;
 	struct slre slre;
 	char regex[strlen(name) + 3];
+	char literal[strlen(name) + 1];
+	int found;
+
+	/*
+	 * This is called for each name in the list whenever a variable is
+	 * created, e.g. for every variable imported, and most names are plain
+	 * variable names. Only compile a regex if the literal text it starts
+	 * with does not already rule out a match.
+	 */
+	if (regex_literal(name, literal)) {
+		found = !strcmp(literal, cbp->searched_for);
+	} else if (strncmp(literal, cbp->searched_for, strlen(literal))) {
+		found = 0;
+	} else {
+		/* Require the whole string to be described by the regex */
+		sprintf(regex, "^%s$", name);
+		if (!slre_compile(&slre, regex)) {
+			printf("Error compiling regex: %s\n", slre.err_str);
+			return -EINVAL;
+		}
 
-	/* Require the whole string to be described by the regex */
-	sprintf(regex, "^%s$", name);
-	if (slre_compile(&slre, regex)) {
 		struct cap caps[slre.num_caps + 2];
 
-		if (slre_match(&slre, cbp->searched_for,
-			       strlen(cbp->searched_for), caps)) {
-			free(cbp->regex);
-			if (!attributes) {
-				retval = -EINVAL;
-				goto done;
-			}
-			cbp->regex = malloc(strlen(regex) + 1);
-			if (cbp->regex) {
-				strcpy(cbp->regex, regex);
-			} else {
-				retval = -ENOMEM;
-				goto done;
-			}
+		found = slre_match(&slre, cbp->searched_for,
+				   strlen(cbp->searched_for), caps);
+	}
 
-			free(cbp->attributes);
-			cbp->attributes = malloc(strlen(attributes) + 1);
-			if (cbp->attributes) {
-				strcpy(cbp->attributes, attributes);
-			} else {
-				retval = -ENOMEM;
-				free(cbp->regex);
-				cbp->regex = NULL;
-				goto done;
-			}
+	if (found) {
+		free(cbp->regex);
+		if (!attributes) {
+			retval = -EINVAL;
+			goto done;
+		}
+		cbp->regex = malloc(strlen(name) + 1);
+		if (cbp->regex) {
+			strcpy(cbp->regex, name);
+		} else {
+			retval = -ENOMEM;
+			goto done;
+		}
+
+		free(cbp->attributes);
+		cbp->attributes = malloc(strlen(attributes) + 1);
+		if (cbp->attributes) {
+			strcpy(cbp->attributes, attributes);
+		} else {
+			retval = -ENOMEM;
+			free(cbp->regex);
+			cbp->regex = NULL;
+			goto done;
 		}
-	} else {
-		printf("Error compiling regex: %s\n", slre.err_str);
-		retval = -EINVAL;
 	}
 done:
 	return retval;
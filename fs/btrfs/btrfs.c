@@ -6,6 +6,7 @@
  */
 
 #include <config.h>
+#include <fs.h>
 #include <malloc.h>
 #include <uuid.h>
 #include <linux/time.h>
@@ -179,27 +180,15 @@ int btrfs_exists(const char *file)
 	return 0;
 }
 
-int btrfs_size(const char *file, loff_t *size)
+/* Get the size of an inode */
+static int btrfs_inode_get_size(struct btrfs_root *root, u64 ino,
+				loff_t *size)
 {
-	struct btrfs_fs_info *fs_info = current_fs_info;
 	struct btrfs_inode_item *ii;
-	struct btrfs_root *root;
 	struct btrfs_path path;
 	struct btrfs_key key;
-	u64 ino;
-	u8 type;
 	int ret;
 
-	ret = btrfs_lookup_path(fs_info->fs_root, BTRFS_FIRST_FREE_OBJECTID,
-				file, &root, &ino, &type, 40);
-	if (ret < 0) {
-		printf("Cannot lookup file %s\n", file);
-		return ret;
-	}
-	if (type != BTRFS_FT_REG_FILE) {
-		printf("Not a regular file: %s\n", file);
-		return -ENOENT;
-	}
 	btrfs_init_path(&path);
 	key.objectid = ino;
 	key.type = BTRFS_INODE_ITEM_KEY;
@@ -223,6 +212,28 @@ out:
 	return ret;
 }
 
+int btrfs_size(const char *file, loff_t *size)
+{
+	struct btrfs_fs_info *fs_info = current_fs_info;
+	struct btrfs_root *root;
+	u64 ino;
+	u8 type;
+	int ret;
+
+	ret = btrfs_lookup_path(fs_info->fs_root, BTRFS_FIRST_FREE_OBJECTID,
+				file, &root, &ino, &type, 40);
+	if (ret < 0) {
+		printf("Cannot lookup file %s\n", file);
+		return ret;
+	}
+	if (type != BTRFS_FT_REG_FILE) {
+		printf("Not a regular file: %s\n", file);
+		return -ENOENT;
+	}
+
+	return btrfs_inode_get_size(root, ino, size);
+}
+
 int btrfs_read(const char *file, void *buf, loff_t offset, loff_t len,
 	       loff_t *actread)
 {
@@ -265,6 +276,69 @@ int btrfs_read(const char *file, void *buf, loff_t offset, loff_t len,
 	return 0;
 }
 
+/**
+ * struct btrfs_file - a file opened with btrfs_openfile()
+ *
+ * @root:	subvolume holding the file
+ * @ino:	inode number of the file
+ */
+struct btrfs_file {
+	struct btrfs_root *root;
+	u64 ino;
+};
+
+int btrfs_openfile(const char *file, struct fs_file *fsfile)
+{
+	struct btrfs_fs_info *fs_info = current_fs_info;
+	struct btrfs_file *bf;
+	struct btrfs_root *root;
+	u64 ino;
+	u8 type;
+	int ret;
+
+	ret = btrfs_lookup_path(fs_info->fs_root, BTRFS_FIRST_FREE_OBJECTID,
+				file, &root, &ino, &type, 40);
+	if (ret < 0) {
+		error("Cannot lookup file %s", file);
+		return ret;
+	}
+	if (type != BTRFS_FT_REG_FILE) {
+		error("Not a regular file: %s", file);
+		return -EINVAL;
+	}
+	ret = btrfs_inode_get_size(root, ino, &fsfile->size);
+	if (ret)
+		return ret;
+
+	bf = malloc(sizeof(*bf));
+	if (!bf)
+		return -ENOMEM;
+	bf->root = root;
+	bf->ino = ino;
+	fsfile->priv = bf;
+
+	return 0;
+}
+
+int btrfs_readfile(struct fs_file *fsfile, void *buf, loff_t offset,
+		   loff_t len, loff_t *actread)
+{
+	struct btrfs_file *bf = fsfile->priv;
+	int ret;
+
+	ret = btrfs_file_read(bf->root, bf->ino, offset, len, buf);
+	if (ret < 0)
+		return ret;
+	*actread = len;
+
+	return 0;
+}
+
+void btrfs_closefile(struct fs_file *fsfile)
+{
+	free(fsfile->priv);
+}
+
 void btrfs_close(void)
 {
 	if (current_fs_info) {
@@ -23,6 +23,7 @@
 #include <blk.h>
 #include <ext_common.h>
 #include <ext4fs.h>
+#include <fs.h>
 #include "ext4_common.h"
 #include <div64.h>
 #include <malloc.h>
@@ -261,6 +262,33 @@ int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	return ext4fs_read(buf, offset, len, len_read);
 }
 
+int ext4fs_openfile(const char *filename, struct fs_file *file)
+{
+	int ret;
+
+	ret = ext4fs_open(filename, &file->size);
+	if (ret < 0)
+		return -ENOENT;
+
+	/* The node belongs to the file now, not to ext4fs_close() */
+	file->priv = ext4fs_file;
+	ext4fs_file = NULL;
+
+	return 0;
+}
+
+int ext4fs_readfile(struct fs_file *file, void *buf, loff_t offset,
+		    loff_t len, loff_t *actread)
+{
+	return ext4fs_read_file(file->priv, offset, len, buf, actread);
+}
+
+void ext4fs_closefile(struct fs_file *file)
+{
+	/* A regular file is never the root node, so just free it */
+	free(file->priv);
+}
+
 int ext4fs_uuid(char *uuid_str)
 {
 	if (ext4fs_root == NULL)
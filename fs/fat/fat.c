@@ -308,6 +308,17 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/**
+ * struct fat_pos - a cluster of a file
+ *
+ * @offset:	offset of the start of the cluster in the file
+ * @clust:	cluster number, 0 if not known
+ */
+struct fat_pos {
+	loff_t offset;
+	__u32 clust;
+};
+
 /**
  * get_contents() - read from file
  *
@@ -321,10 +332,13 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
  * @buffer:	buffer into which to read
  * @maxsize:	maximum number of bytes to read
  * @gotsize:	number of bytes actually read
+ * @hint:	if not NULL, a cluster to start looking for 'pos' from if it is
+ *		not after 'pos'; updated to the cluster holding 'pos'
  * Return:	-1 on error, otherwise 0
  */
 static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
-			__u8 *buffer, loff_t maxsize, loff_t *gotsize)
+			__u8 *buffer, loff_t maxsize, loff_t *gotsize,
+			struct fat_pos *hint)
 {
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
@@ -346,6 +360,10 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 	debug("%llu bytes\n", filesize);
 
 	actsize = bytesperclust;
+	if (hint && hint->clust && hint->offset <= pos) {
+		curclust = hint->clust;
+		actsize += hint->offset;
+	}
 
 	/* go to cluster at pos */
 	while (actsize <= pos) {
@@ -357,6 +375,10 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		}
 		actsize += bytesperclust;
 	}
+	if (hint) {
+		hint->offset = actsize - bytesperclust;
+		hint->clust = curclust;
+	}
 
 	/* actsize > pos */
 	actsize -= bytesperclust;
@@ -1325,7 +1347,7 @@ int fat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 	/* For saving default max clustersize memory allocated to malloc pool */
 	dir_entry *dentptr = itr->dent;
 
-	ret = get_contents(&fsdata, dentptr, offset, buf, len, actread);
+	ret = get_contents(&fsdata, dentptr, offset, buf, len, actread, NULL);
 
 out_free_both:
 	free(fsdata.fatbuf);
@@ -1419,6 +1441,79 @@ void fat_closedir(struct fs_dir_stream *dirs)
 	free(dir);
 }
 
+/**
+ * typedef fat_file - a file opened with fat_openfile()
+ *
+ * @fsdata:	file system description, with the FAT buffer
+ * @dent:	directory entry of the file
+ * @pos:	cluster read last, so that sequential reads need not follow
+ *		the cluster chain from the start of the file
+ */
+typedef struct {
+	fsdata fsdata;
+	dir_entry dent;
+	struct fat_pos pos;
+} fat_file;
+
+int fat_openfile(const char *filename, struct fs_file *file)
+{
+	fat_file *ff;
+	fat_itr *itr;
+	int ret;
+
+	itr = malloc_cache_aligned(sizeof(fat_itr));
+	if (!itr)
+		return -ENOMEM;
+	ff = calloc(1, sizeof(*ff));
+	if (!ff) {
+		ret = -ENOMEM;
+		goto out_free_itr;
+	}
+	ret = fat_itr_root(itr, &ff->fsdata);
+	if (ret)
+		goto out_free_file;
+
+	ret = fat_itr_resolve(itr, filename, TYPE_FILE);
+	if (ret) {
+		free(ff->fsdata.fatbuf);
+		goto out_free_file;
+	}
+
+	ff->dent = *itr->dent;
+	file->size = FAT2CPU32(ff->dent.size);
+	file->priv = ff;
+	free(itr);
+
+	return 0;
+
+out_free_file:
+	free(ff);
+out_free_itr:
+	free(itr);
+	return ret;
+}
+
+int fat_readfile(struct fs_file *file, void *buf, loff_t offset, loff_t len,
+		 loff_t *actread)
+{
+	fat_file *ff = file->priv;
+
+	debug("reading at pos %llu\n", offset);
+
+	return get_contents(&ff->fsdata, &ff->dent, offset, buf, len, actread,
+			    &ff->pos);
+}
+
+void fat_closefile(struct fs_file *file)
+{
+	fat_file *ff = file->priv;
+
+	if (ff) {
+		free(ff->fsdata.fatbuf);
+		free(ff);
+	}
+}
+
 void fat_close(void)
 {
 }
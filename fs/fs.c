@@ -39,6 +39,24 @@ static int fs_dev_part;
 static struct disk_partition fs_partition;
 static int fs_type = FS_TYPE_ANY;
 
+/**
+ * struct fs_mount - filesystem kept mounted for open files
+ *
+ * @type: filesystem type
+ * @desc: block device
+ * @part: partition number
+ * @users: number of files opened on the mount, 0 if it is not kept
+ * @gen: incremented each time a kept mount is unmounted, so that files which
+ *	were opened on it know to look themselves up again
+ */
+static struct fs_mount {
+	int type;
+	struct blk_desc *desc;
+	int part;
+	int users;
+	uint gen;
+} fs_mount;
+
 void fs_set_type(int type)
 {
 	fs_type = type;
@@ -182,8 +200,47 @@ struct fstype_info {
 	int (*unlink)(const char *filename);
 	int (*mkdir)(const char *dirname);
 	int (*ln)(const char *filename, const char *target);
+	/*
+	 * Look up a file.  On success return 0 with the file's size and any
+	 * state needed to read it in 'file'.  On error return -errno.  See
+	 * fs_openfile().
+	 */
+	int (*openfile)(const char *filename, struct fs_file *file);
+	/*
+	 * Read from a file.  'offset' and 'len' are within the file and 'len'
+	 * is not 0.  See fs_pread().
+	 */
+	int (*readfile)(struct fs_file *file, void *buf, loff_t offset,
+			loff_t len, loff_t *actread);
+	/*
+	 * Free the state of a file.  This must not access the filesystem,
+	 * which may have been unmounted since the file was opened.
+	 */
+	void (*closefile)(struct fs_file *file);
 };
 
+static struct fstype_info *fs_get_info(int fstype);
+
+/*
+ * generic implementation of open files in terms of size/read, for
+ * filesystems which cannot keep a file looked up
+ */
+static int fs_openfile_generic(const char *filename, struct fs_file *file)
+{
+	return fs_get_info(fs_type)->size(filename, &file->size);
+}
+
+static int fs_readfile_generic(struct fs_file *file, void *buf,
+			       loff_t offset, loff_t len, loff_t *actread)
+{
+	return fs_get_info(fs_type)->read(file->name, buf, offset, len,
+					  actread);
+}
+
+static inline void fs_closefile_generic(struct fs_file *file)
+{
+}
+
 static struct fstype_info fstypes[] = {
 #if CONFIG_IS_ENABLED(FS_FAT)
 	{
@@ -210,6 +267,9 @@ static struct fstype_info fstypes[] = {
 		.readdir = fat_readdir,
 		.closedir = fat_closedir,
 		.ln = fs_ln_unsupported,
+		.openfile = fat_openfile,
+		.readfile = fat_readfile,
+		.closefile = fat_closefile,
 	},
 #endif
 
@@ -235,6 +295,9 @@ static struct fstype_info fstypes[] = {
 		.opendir = fs_opendir_unsupported,
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
+		.openfile = ext4fs_openfile,
+		.readfile = ext4fs_readfile,
+		.closefile = ext4fs_closefile,
 	},
 #endif
 #if IS_ENABLED(CONFIG_SANDBOX) && !IS_ENABLED(CONFIG_SPL_BUILD)
@@ -254,6 +317,9 @@ static struct fstype_info fstypes[] = {
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
+		.openfile = fs_openfile_generic,
+		.readfile = fs_readfile_generic,
+		.closefile = fs_closefile_generic,
 	},
 #endif
 #if CONFIG_IS_ENABLED(SEMIHOSTING)
@@ -273,6 +339,9 @@ static struct fstype_info fstypes[] = {
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
+		.openfile = fs_openfile_generic,
+		.readfile = fs_readfile_generic,
+		.closefile = fs_closefile_generic,
 	},
 #endif
 #ifndef CONFIG_SPL_BUILD
@@ -293,6 +362,9 @@ static struct fstype_info fstypes[] = {
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
+		.openfile = fs_openfile_generic,
+		.readfile = fs_readfile_generic,
+		.closefile = fs_closefile_generic,
 	},
 #endif
 #endif
@@ -314,6 +386,9 @@ static struct fstype_info fstypes[] = {
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
+		.openfile = btrfs_openfile,
+		.readfile = btrfs_readfile,
+		.closefile = btrfs_closefile,
 	},
 #endif
 #endif
@@ -336,6 +411,9 @@ static struct fstype_info fstypes[] = {
 		.ln = fs_ln_unsupported,
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
+		.openfile = fs_openfile_generic,
+		.readfile = fs_readfile_generic,
+		.closefile = fs_closefile_generic,
 	},
 #endif
 #if IS_ENABLED(CONFIG_FS_EROFS)
@@ -357,6 +435,9 @@ static struct fstype_info fstypes[] = {
 		.ln = fs_ln_unsupported,
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
+		.openfile = erofs_openfile,
+		.readfile = erofs_readfile,
+		.closefile = erofs_closefile,
 	},
 #endif
 	{
@@ -375,6 +456,9 @@ static struct fstype_info fstypes[] = {
 		.unlink = fs_unlink_unsupported,
 		.mkdir = fs_mkdir_unsupported,
 		.ln = fs_ln_unsupported,
+		.openfile = fs_openfile_generic,
+		.readfile = fs_readfile_generic,
+		.closefile = fs_closefile_generic,
 	},
 };
 
@@ -418,6 +502,45 @@ const char *fs_get_type_name(void)
 	return fs_get_info(fs_type)->name;
 }
 
+/*
+ * Check whether the filesystem kept mounted can be used for a partition.
+ * Only filesystems on a block device are kept mounted: "hostfs" and "ubi"
+ * both come without one and could not be told apart.
+ */
+static bool fs_mount_matches(struct blk_desc *desc, int part, int fstype)
+{
+	if (!fs_mount.users || !desc || fs_mount.desc != desc ||
+	    fs_mount.part != part)
+		return false;
+
+	return fstype == FS_TYPE_ANY || fstype == fs_mount.type;
+}
+
+/* Stop keeping the filesystem mounted, leaving fs_close() to unmount it */
+static void fs_mount_forget(void)
+{
+	if (fs_mount.users) {
+		fs_mount.users = 0;
+		fs_mount.gen++;
+	}
+}
+
+void fs_unmount(struct blk_desc *desc)
+{
+	if (!fs_mount.users || (desc && fs_mount.desc != desc))
+		return;
+
+	fs_mount_forget();
+	/*
+	 * A block write by the filesystem itself must not unmount it under
+	 * the operation in progress, which leaves that to fs_close()
+	 */
+	if (desc && fs_type == fs_mount.type && fs_dev_desc == desc)
+		return;
+	fs_get_info(fs_mount.type)->close();
+	fs_type = FS_TYPE_ANY;
+}
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -428,6 +551,13 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (fs_mount_matches(fs_dev_desc, part, fstype)) {
+		fs_type = fs_mount.type;
+		fs_dev_part = part;
+		return 0;
+	}
+	fs_unmount(NULL);
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -452,6 +582,14 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part)
 	struct fstype_info *info;
 	int ret, i;
 
+	if (fs_mount_matches(desc, part, FS_TYPE_ANY)) {
+		fs_dev_desc = desc;
+		fs_type = fs_mount.type;
+		fs_dev_part = part;
+		return 0;
+	}
+	fs_unmount(NULL);
+
 	if (part >= 1)
 		ret = part_get_info(desc, part, &fs_partition);
 	else
@@ -475,7 +613,9 @@ void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
-	info->close();
+	/* Keep the filesystem mounted while files are open on it */
+	if (!fs_mount.users)
+		info->close();
 
 	fs_type = FS_TYPE_ANY;
 }
@@ -613,6 +753,8 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 		log_err("** Unable to write file %s **\n", filename);
 		ret = -1;
 	}
+	/* Files open on the filesystem may have changed */
+	fs_mount_forget();
 	fs_close();
 
 	return ret;
@@ -670,6 +812,129 @@ void fs_closedir(struct fs_dir_stream *dirs)
 	fs_close();
 }
 
+struct fs_file *fs_openfile(const char *filename)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	struct fs_file *file;
+	int ret;
+
+	file = calloc(1, sizeof(*file));
+	if (!file) {
+		fs_close();
+		errno = ENOMEM;
+		return NULL;
+	}
+	file->name = strdup(filename);
+	ret = file->name ? info->openfile(filename, file) : -ENOMEM;
+	if (ret) {
+		fs_close();
+		free(file->name);
+		free(file);
+		errno = ret < 0 ? -ret : EIO;
+		return NULL;
+	}
+
+	file->type = fs_type;
+	file->desc = fs_dev_desc;
+	file->part = fs_dev_part;
+	/* Filesystems without a block device need no mount to be kept */
+	if (fs_dev_desc) {
+		if (!fs_mount.users) {
+			fs_mount.type = fs_type;
+			fs_mount.desc = fs_dev_desc;
+			fs_mount.part = fs_dev_part;
+		}
+		fs_mount.users++;
+		file->gen = fs_mount.gen;
+	}
+	fs_close();
+
+	return file;
+}
+
+/* Mount the filesystem of a file, looking the file up again if needed */
+static int fs_file_mount(struct fs_file *file)
+{
+	struct fstype_info *info;
+	int ret;
+
+	/* A filesystem without a block device stays available */
+	if (!file->desc) {
+		fs_dev_desc = NULL;
+		fs_dev_part = file->part;
+		fs_type = file->type;
+		return 0;
+	}
+	if (file->gen == fs_mount.gen) {
+		fs_dev_desc = file->desc;
+		fs_dev_part = file->part;
+		fs_type = fs_mount.type;
+		return 0;
+	}
+
+	ret = fs_set_blk_dev_with_part(file->desc, file->part);
+	if (ret)
+		return ret;
+
+	log_debug("Looking up %s again\n", file->name);
+	fs_get_info(file->type)->closefile(file);
+	file->priv = NULL;
+	info = fs_get_info(fs_type);
+	ret = info->openfile(file->name, file);
+	if (ret)
+		return ret;
+	file->type = fs_type;
+	if (!fs_mount.users) {
+		fs_mount.type = fs_type;
+		fs_mount.desc = file->desc;
+		fs_mount.part = file->part;
+	}
+	fs_mount.users++;
+	file->gen = fs_mount.gen;
+
+	return 0;
+}
+
+int fs_pread(struct fs_file *file, void *buf, loff_t offset, loff_t len,
+	     loff_t *actread)
+{
+	struct fstype_info *info;
+	int ret;
+
+	*actread = 0;
+	ret = fs_file_mount(file);
+	if (ret) {
+		fs_close();
+		return ret < 0 ? ret : -EIO;
+	}
+
+	if (offset < file->size && len) {
+		info = fs_get_info(fs_type);
+		ret = info->readfile(file, buf, offset,
+				  min(len, file->size - offset), actread);
+		if (ret > 0)
+			ret = -EIO;
+	}
+	fs_close();
+
+	return ret;
+}
+
+void fs_closefile(struct fs_file *file)
+{
+	if (!file)
+		return;
+
+	fs_get_info(file->type)->closefile(file);
+	/* A file from an earlier mount does not keep the current one */
+	if (file->desc && file->gen == fs_mount.gen && !--fs_mount.users) {
+		fs_mount.gen++;
+		fs_get_info(fs_mount.type)->close();
+	}
+	free(file->name);
+	free(file);
+}
+
 int fs_unlink(const char *filename)
 {
 	int ret;
@@ -678,6 +943,8 @@ int fs_unlink(const char *filename)
 
 	ret = info->unlink(filename);
 
+	/* Files open on the filesystem may have changed */
+	fs_mount_forget();
 	fs_close();
 
 	return ret;
@@ -691,6 +958,8 @@ int fs_mkdir(const char *dirname)
 
 	ret = info->mkdir(dirname);
 
+	/* Files open on the filesystem may have changed */
+	fs_mount_forget();
 	fs_close();
 
 	return ret;
@@ -707,6 +976,8 @@ int fs_ln(const char *fname, const char *target)
 		log_err("** Unable to create link %s -> %s **\n", fname, target);
 		ret = -1;
 	}
+	/* Files open on the filesystem may have changed */
+	fs_mount_forget();
 	fs_close();
 
 	return ret;
@@ -1020,10 +1291,35 @@ int fs_read_alloc(const char *fname, ulong size, uint align, void **bufp)
 	return 0;
 }
 
+int fs_pread_alloc(struct fs_file *file, uint align, void **bufp)
+{
+	loff_t bytes_read;
+	char *buf;
+	int ret;
+
+	buf = memalign(align, file->size + 1);
+	if (!buf)
+		return log_msg_ret("buf", -ENOMEM);
+
+	ret = fs_pread(file, buf, 0, file->size, &bytes_read);
+	if (!ret && bytes_read != file->size)
+		ret = -EIO;
+	if (ret) {
+		free(buf);
+		return log_msg_ret("read", ret);
+	}
+	buf[bytes_read] = '\0';
+
+	*bufp = buf;
+
+	return 0;
+}
+
 int fs_load_alloc(const char *ifname, const char *dev_part_str,
 		  const char *fname, ulong max_size, ulong align, void **bufp,
 		  ulong *sizep)
 {
+	struct fs_file *file;
 	loff_t size;
 	void *buf;
 	int ret;
@@ -1031,17 +1327,18 @@ int fs_load_alloc(const char *ifname, const char *dev_part_str,
 	if (fs_set_blk_dev(ifname, dev_part_str, FS_TYPE_ANY))
 		return log_msg_ret("set", -ENOMEDIUM);
 
-	ret = fs_size(fname, &size);
-	if (ret)
+	file = fs_openfile(fname);
+	if (!file)
 		return log_msg_ret("sz", -ENOENT);
 
-	if (size >= (max_size ?: SZ_1G))
+	size = file->size;
+	if (size >= (max_size ?: SZ_1G)) {
+		fs_closefile(file);
 		return log_msg_ret("sz", -E2BIG);
+	}
 
-	if (fs_set_blk_dev(ifname, dev_part_str, FS_TYPE_ANY))
-		return log_msg_ret("set", -ENOMEDIUM);
-
-	ret = fs_read_alloc(fname, size, align, &buf);
+	ret = fs_pread_alloc(file, align, &buf);
+	fs_closefile(file);
 	if (ret)
 		return log_msg_ret("al", ret);
 	*sizep = size;
@@ -213,6 +213,20 @@ struct global_data {
 	 * @uclass_root_s.
 	 */
 	struct list_head *uclass_root;
+#if CONFIG_IS_ENABLED(DM_OFNODE_MAP)
+	/**
+	 * @dm_ofnode_map: hash table of devices by device tree node
+	 */
+	struct dm_ofnode_map *dm_ofnode_map;
+#endif
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/**
+	 * @dm_compat_index: table of driver compatible strings, used when
+	 * binding device tree nodes, or an error pointer if it could not be
+	 * built
+	 */
+	struct dm_compat_index *dm_compat_index;
+#endif
 # if CONFIG_IS_ENABLED(OF_PLATDATA_DRIVER_RT)
 	/** @dm_driver_rt: Dynamic info about the driver */
 	struct driver_rt *dm_driver_rt;
@@ -518,6 +532,22 @@ static_assert(sizeof(struct global_data) == GD_SIZE);
 #define gd_set_of_root(_root)
 #endif
 
+#if CONFIG_IS_ENABLED(DM_OFNODE_MAP)
+#define gd_dm_ofnode_map()		gd->dm_ofnode_map
+#define gd_set_dm_ofnode_map(map)	gd->dm_ofnode_map = (map)
+#else
+#define gd_dm_ofnode_map()		NULL
+#define gd_set_dm_ofnode_map(map)
+#endif
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+#define gd_dm_compat_index()		gd->dm_compat_index
+#define gd_set_dm_compat_index(idx)	gd->dm_compat_index = (idx)
+#else
+#define gd_dm_compat_index()		NULL
+#define gd_set_dm_compat_index(idx)
+#endif
+
 #if CONFIG_IS_ENABLED(OF_PLATDATA_DRIVER_RT)
 #define gd_set_dm_driver_rt(dyn)	gd->dm_driver_rt = dyn
 #define gd_dm_driver_rt()		gd->dm_driver_rt
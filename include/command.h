@@ -279,6 +279,25 @@ enum command_ret_t {
 enum command_ret_t cmd_process(int flag, int argc, char *const argv[],
 			       int *repeatable, unsigned long *ticks);
 
+/**
+ * cmd_process_tbl() - Process a command which has already been looked up
+ *
+ * This is cmd_process() for callers which keep the result of find_cmd(), e.g.
+ * a parsed command line which is run many times.
+ *
+ * @cmdtp:	Command to run, as returned by find_cmd(argv[0]); NULL to report
+ *		an unknown command
+ * @flag:	Some flags normally 0 (see CMD_FLAG_.. above)
+ * @argc:	Number of arguments (arg 0 must be the command text)
+ * @argv:	Arguments
+ * @repeatable:	Set to 0 if the command is not repeatable, else left unchanged
+ * @ticks:	If not NULL, set to the number of ticks the command took
+ * Return: 0 if command succeeded, else non-zero (CMD_RET_...)
+ */
+enum command_ret_t cmd_process_tbl(struct cmd_tbl *cmdtp, int flag, int argc,
+				   char *const argv[], int *repeatable,
+				   ulong *ticks);
+
 void fixup_cmdtable(struct cmd_tbl *cmdtp, int size);
 
 /**
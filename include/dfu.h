@@ -360,6 +360,19 @@ int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
  */
 int dfu_flush(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 
+/**
+ * dfu_write_pending() - write a buffered segment to the medium
+ *
+ * dfu_write() collects the data in a ring of CONFIG_DFU_BUF_SEGMENTS
+ * segments and only writes filled segments itself when no free segment is
+ * left. Calling this function from the main loop, outside of USB request
+ * completion, writes the oldest filled segment while the host is free to
+ * send the next one.
+ *
+ * Return:	0 for success, a negative error code otherwise
+ */
+int dfu_write_pending(void);
+
 /**
  * dfu_initiated_callback() - weak callback called on DFU transaction start
  *
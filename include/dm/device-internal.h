@@ -15,7 +15,9 @@
 #include <dm/ofnode.h>
 
 struct device_node;
+struct dm_stats;
 struct driver_info;
+struct uclass;
 struct udevice;
 
 /*
@@ -429,6 +431,69 @@ static inline void devres_release_all(struct udevice *dev)
 
 #endif /* DEVRES */
 
+#if CONFIG_IS_ENABLED(DM_OFNODE_MAP)
+/**
+ * dev_ofnode_map_init() - Set up an empty ofnode map
+ *
+ * This is called by dm_init() when the uclass list is reset.
+ */
+void dev_ofnode_map_init(void);
+
+/**
+ * dev_ofnode_map_add() - Add a device to the ofnode map
+ *
+ * This is called when a device is added to its uclass.
+ *
+ * @dev: Device to add
+ */
+void dev_ofnode_map_add(struct udevice *dev);
+
+/**
+ * dev_ofnode_map_remove() - Remove a device from the ofnode map
+ *
+ * This is called when a device is removed from its uclass.
+ *
+ * @dev: Device to remove
+ */
+void dev_ofnode_map_remove(struct udevice *dev);
+
+/**
+ * dev_ofnode_map_find() - Look up a device by node in the ofnode map
+ *
+ * This finds the only device with the given node, either in uclass @uc or, if
+ * @uc is NULL, in the device tree below the root device. If several devices
+ * match, the caller must walk the list itself, since it defines which of them
+ * comes first.
+ *
+ * @node: Node to look up
+ * @uc: Uclass to look in, or NULL to look in all devices
+ * @devp: Returns the device, or NULL if there is none
+ * Return: 0 if OK, -EAGAIN if the caller must walk its list, -ENOSYS if there
+ *	is no map
+ */
+int dev_ofnode_map_find(ofnode node, struct uclass *uc,
+			struct udevice **devp);
+
+/**
+ * dev_ofnode_map_collect_stats() - Report ofnode lookup counts
+ *
+ * @stats: Updated with the number of lookups and list walks
+ */
+void dev_ofnode_map_collect_stats(struct dm_stats *stats);
+#else
+static inline void dev_ofnode_map_init(void) {}
+static inline void dev_ofnode_map_add(struct udevice *dev) {}
+static inline void dev_ofnode_map_remove(struct udevice *dev) {}
+
+static inline int dev_ofnode_map_find(ofnode node, struct uclass *uc,
+				      struct udevice **devp)
+{
+	return -ENOSYS;
+}
+
+static inline void dev_ofnode_map_collect_stats(struct dm_stats *stats) {}
+#endif
+
 static inline int device_notify(const struct udevice *dev, enum event_t type)
 {
 #if CONFIG_IS_ENABLED(DM_EVENT)
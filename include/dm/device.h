@@ -84,6 +84,9 @@ struct driver_info;
 /* Device must be probed after it was bound */
 #define DM_FLAG_PROBE_AFTER_BIND	(1 << 15)
 
+/* Device is tracked by the ofnode map (CONFIG_DM_OFNODE_MAP) */
+#define DM_FLAG_OFNODE_MAP		(1 << 16)
+
 /*
  * One or multiple of these flags are passed to device_remove() so that
  * a selective device removal as specified by the remove-stage and the
@@ -166,6 +169,8 @@ enum {
  * @dma_offset: Offset between the physical address space (CPU's) and the
  *		device's bus address space
  * @iommu: IOMMU device associated with this device
+ * @ofnode_next_: Next device in the same ofnode map bucket (do not access
+ *	outside driver model)
  */
 struct udevice {
 	const struct driver *driver;
@@ -198,6 +203,9 @@ struct udevice {
 #if CONFIG_IS_ENABLED(IOMMU)
 	struct udevice *iommu;
 #endif
+#if CONFIG_IS_ENABLED(DM_OFNODE_MAP)
+	struct udevice *ofnode_next_;
+#endif
 };
 
 static inline int dm_udevice_size(void)
@@ -295,11 +303,22 @@ static inline __attribute_const__ bool dev_has_ofnode(const struct udevice *dev)
 #endif
 }
 
+/**
+ * dev_ofnode_map_invalidate() - Note that a device has changed its node
+ *
+ * This causes the ofnode map to be rebuilt before its next use.
+ */
+void dev_ofnode_map_invalidate(void);
+
 static inline void dev_set_ofnode(struct udevice *dev, ofnode node)
 {
 #if CONFIG_IS_ENABLED(OF_REAL)
 	dev->node_ = node;
 #endif
+#if CONFIG_IS_ENABLED(DM_OFNODE_MAP)
+	if (dev_get_flags(dev) & DM_FLAG_OFNODE_MAP)
+		dev_ofnode_map_invalidate();
+#endif
 }
 
 static inline int dev_seq(const struct udevice *dev)
@@ -12,6 +12,8 @@
 #include <dm/ofnode.h>
 #include <dm/uclass-id.h>
 
+struct udevice_id;
+
 /**
  * lists_driver_lookup_name() - Return u_boot_driver corresponding to name
  *
@@ -45,6 +47,19 @@ struct uclass_driver *lists_uclass_lookup(enum uclass_id id);
  */
 int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 
+/**
+ * lists_driver_match_compat() - find the driver for a compatible string
+ *
+ * This returns the first driver in the driver list which has @compat in its
+ * of_match table, which is the one lists_bind_fdt() binds.
+ *
+ * @compat: compatible string to look up
+ * @idp: returns the matching entry of the driver's of_match table
+ * Return: the driver, or NULL if none matches
+ */
+struct driver *lists_driver_match_compat(const char *compat,
+					 const struct udevice_id **idp);
+
 /**
  * lists_bind_fdt() - bind a device tree node
  *
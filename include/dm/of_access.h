@@ -19,6 +19,8 @@
 
 #include <dm/of.h>
 
+struct dm_stats;
+
 /**
  * of_find_all_nodes - Get next node in global list
  * @prev:	Previous node or NULL to start iteration
@@ -255,6 +257,18 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 					       const char *propname,
 					       const void *propval,
 					       int proplen);
+/**
+ * of_phandle_cache_init() - Set up the phandle cache for the control tree
+ *
+ * This records the node for each phandle in @root, so that
+ * of_find_node_by_phandle() does not need to walk the whole tree. Lookups in
+ * other trees, or phandles missing from the cache, fall back to a tree walk.
+ *
+ * @root:	root node of the control tree (gd->of_root)
+ * Return: 0 if OK, -ENOMEM if not enough memory
+ */
+int of_phandle_cache_init(struct device_node *root);
+
 /**
  * of_find_node_by_phandle() - Find a node given a phandle
  *
@@ -266,6 +280,13 @@ struct device_node *of_find_node_by_prop_value(struct device_node *from,
 struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle);
 
+/**
+ * of_phandle_collect_stats() - Report phandle lookup counts
+ *
+ * @stats:	Updated with the number of lookups and tree walks
+ */
+void of_phandle_collect_stats(struct dm_stats *stats);
+
 /**
  * of_read_u8() - Find and read a 8-bit integer from a property
  *
@@ -34,6 +34,11 @@ extern struct list_head uclass_head;
  * @attach_size_total: Total number of bytes of attached data
  * @attach_count: Number of devices with attached, for each type
  * @attach_size: Total number of bytes of attached data, for each type
+ * @of_live_size: Bytes used by the live tree (0 if the flat tree is used)
+ * @phandle_lookups: Number of live-tree phandle lookups
+ * @phandle_scans: Number of those which had to walk the tree
+ * @ofnode_lookups: Number of device lookups by ofnode
+ * @ofnode_scans: Number of those which had to walk a device list
  */
 struct dm_stats {
 	int total_size;
@@ -50,6 +55,11 @@ struct dm_stats {
 	int attach_size_total;
 	int attach_count[DM_TAG_ATTACH_COUNT];
 	int attach_size[DM_TAG_ATTACH_COUNT];
+	int of_live_size;
+	int phandle_lookups;
+	int phandle_scans;
+	int ofnode_lookups;
+	int ofnode_scans;
 };
 
 /**
@@ -13,6 +13,7 @@
 #include <log.h>
 #include <part_efi.h>
 #include <efi_api.h>
+#include <hash.h>
 #include <image.h>
 #include <pe.h>
 #include <linux/list.h>
@@ -274,6 +275,8 @@ extern const efi_guid_t efi_guid_host_dev;
 #endif
 /* GUID of the EFI_BLOCK_IO_PROTOCOL */
 extern const efi_guid_t efi_block_io_guid;
+/* GUID of the EFI_BLOCK_IO2_PROTOCOL */
+extern const efi_guid_t efi_block_io2_guid;
 extern const efi_guid_t efi_global_variable_guid;
 extern const efi_guid_t efi_guid_console_control;
 extern const efi_guid_t efi_guid_device_path;
@@ -458,6 +461,7 @@ struct efi_loaded_image_obj {
  * @trigger_time:	Period of the timer
  * @trigger_next:	Next time to trigger the timer
  * @trigger_type:	Type of timer, see efi_set_timer
+ * @timer_link:		Link to the list of armed timers
  * @is_signaled:	The event occurred. The event is in the signaled state.
  */
 struct efi_event {
@@ -471,6 +475,7 @@ struct efi_event {
 	u64 trigger_next;
 	u64 trigger_time;
 	enum efi_timer_delay trigger_type;
+	struct list_head timer_link;
 	bool is_signaled;
 };
 
@@ -954,11 +959,17 @@ efi_status_t efi_bootmgr_load(efi_handle_t *handle, void **load_options);
  *
  * @max:	Maximum number of regions
  * @num:	Number of regions
+ * @hash_algo:	algorithm of @hash, NULL if not calculated yet
+ * @hash_len:	length of @hash
+ * @hash:	cached message digest of the regions
  * @reg:	array of regions
  */
 struct efi_image_regions {
 	int			max;
 	int			num;
+	const char		*hash_algo;
+	int			hash_len;
+	u8			hash[HASH_MAX_DIGEST_SIZE];
 	struct image_region	reg[];
 };
 
@@ -972,12 +983,15 @@ struct efi_image_regions {
  * @owner:	Signature owner
  * @data:	Pointer to signature data
  * @size:	Size of signature data
+ * @cert:	x509 certificate parsed from @data, an error pointer if
+ *		parsing failed, NULL if not parsed yet
  */
 struct efi_sig_data {
 	struct efi_sig_data *next;
 	efi_guid_t owner;
 	void *data;
 	size_t size;
+	struct x509_certificate *cert;
 };
 
 /**
@@ -988,11 +1002,19 @@ struct efi_sig_data {
  * @next:		Pointer to next entry
  * @sig_type:		Signature type
  * @sig_data_list:	Pointer to signature list
+ * @sig_data_index:	Entries of @sig_data_list sorted by their data,
+ *			NULL for x509 certificates
+ * @sig_data_num:	Number of entries in @sig_data_index
+ * @refcnt:		Number of additional users of a cached database,
+ *			only used in the first entry
  */
 struct efi_signature_store {
 	struct efi_signature_store *next;
 	efi_guid_t sig_type;
 	struct efi_sig_data *sig_data_list;
+	struct efi_sig_data **sig_data_index;
+	size_t sig_data_num;
+	int refcnt;
 };
 
 struct x509_certificate;
@@ -1016,6 +1038,8 @@ struct eficonfig_media_boot_option {
 
 bool efi_hash_regions(struct image_region *regs, int count,
 		      void **hash, const char *hash_algo, int *len);
+bool efi_image_regions_hash(struct efi_image_regions *regs,
+			    const char *hash_algo, void **hash, int *len);
 bool efi_signature_lookup_digest(struct efi_image_regions *regs,
 				 struct efi_signature_store *db,
 				 bool dbx);
@@ -214,7 +214,8 @@ void efi_var_mem_del(struct efi_var_entry *var);
  * efi_var_mem_ins() - append a variable to the list of variables
  *
  * The variable is appended without checking if a variable of the same name
- * already exists. The two data buffers are concatenated.
+ * already exists. The two data buffers are concatenated. If @old is given,
+ * it is deleted once the new variable has been added; on error it is kept.
  *
  * @variable_name:	variable name
  * @vendor:		GUID
@@ -224,13 +225,14 @@ void efi_var_mem_del(struct efi_var_entry *var);
  * @size2:		size of the second data field
  * @data2:		second data buffer
  * @time:		time of authentication (as seconds since start of epoch)
+ * @old:		variable replaced by the new one or NULL
  * Result:		status code
  */
 efi_status_t efi_var_mem_ins(const u16 *variable_name,
 			     const efi_guid_t *vendor, u32 attributes,
 			     const efi_uintn_t size1, const void *data1,
 			     const efi_uintn_t size2, const void *data2,
-			     const u64 time);
+			     const u64 time, struct efi_var_entry *old);
 
 /**
  * efi_var_mem_free() - determine free memory for variables
@@ -3,6 +3,7 @@
 #define _EROFS_H_
 
 struct disk_partition;
+struct fs_file;
 
 int erofs_opendir(const char *filename, struct fs_dir_stream **dirsp);
 int erofs_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp);
@@ -11,6 +12,10 @@ int erofs_probe(struct blk_desc *fs_dev_desc,
 int erofs_read(const char *filename, void *buf, loff_t offset,
 	       loff_t len, loff_t *actread);
 int erofs_size(const char *filename, loff_t *size);
+int erofs_openfile(const char *filename, struct fs_file *file);
+int erofs_readfile(struct fs_file *file, void *buf, loff_t offset,
+		   loff_t len, loff_t *actread);
+void erofs_closefile(struct fs_file *file);
 int erofs_exists(const char *filename);
 void erofs_close(void);
 void erofs_closedir(struct fs_dir_stream *dirs);
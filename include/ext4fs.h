@@ -29,6 +29,7 @@
 #include <ext_common.h>
 
 struct disk_partition;
+struct fs_file;
 
 #define EXT4_INDEX_FL		0x00001000 /* Inode uses hash tree index */
 #define EXT4_TOPDIR_FL		0x00020000 /* Top of directory hierarchies*/
@@ -162,6 +163,10 @@ int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
 		   loff_t *actread);
+int ext4fs_openfile(const char *filename, struct fs_file *file);
+int ext4fs_readfile(struct fs_file *file, void *buf, loff_t offset,
+		    loff_t len, loff_t *actread);
+void ext4fs_closefile(struct fs_file *file);
 int ext4_read_superblock(char *buffer);
 int ext4fs_uuid(char *uuid_str);
 void ext_cache_init(struct ext_block_cache *cache);
@@ -163,6 +163,16 @@ int fastboot_handle_command(char *cmd_string, char *response);
  */
 u32 fastboot_data_remaining(void);
 
+/**
+ * fastboot_data_buffer() - return where the next downloaded data goes
+ *
+ * Transports which receive data out of order can store it beyond this
+ * position and pass it to fastboot_data_download() once it is contiguous.
+ *
+ * Return: Pointer into fastboot_buf_addr at the current transfer offset
+ */
+void *fastboot_data_buffer(void);
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -172,7 +182,8 @@ u32 fastboot_data_remaining(void);
  *
  * Copies image data from fastboot_data to fastboot_buf_addr. Writes to
  * response. fastboot_bytes_received is updated to indicate the number
- * of bytes that have been transferred.
+ * of bytes that have been transferred.  Data which the transport already
+ * placed at fastboot_data_buffer() is not copied.
  */
 void fastboot_data_download(const void *fastboot_data,
 			    unsigned int fastboot_data_len, char *response);
@@ -182,7 +193,8 @@ void fastboot_data_download(const void *fastboot_data,
  *
  * @response: Pointer to fastboot response buffer
  *
- * Set image_size and ${filesize} to the total size of the downloaded image.
+ * Set image_size and ${filesize} to the total size of the downloaded image
+ * and print the transfer rate.
  */
 void fastboot_data_complete(char *response);
 
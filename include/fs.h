@@ -87,6 +87,9 @@ int fs_set_blk_dev_with_part(struct blk_desc *desc, int part);
  * Many file functions implicitly call fs_close(), e.g. fs_closedir(),
  * fs_exist(), fs_ln(), fs_ls(), fs_mkdir(), fs_read(), fs_size(), fs_write(),
  * fs_unlink().
+ *
+ * While any file opened with fs_openfile() is open, the filesystem itself is
+ * left mounted.
  */
 void fs_close(void);
 
@@ -236,6 +239,89 @@ struct fs_dirent *fs_readdir(struct fs_dir_stream *dirs);
  */
 void fs_closedir(struct fs_dir_stream *dirs);
 
+/**
+ * struct fs_file - an open file
+ *
+ * Note: fs_file should be treated as opaque to the user of fs layer, apart
+ * from @size
+ *
+ * @size: size of the file in bytes
+ * @type: filesystem type (private to fs layer)
+ * @desc: block device holding the file (private to fs layer)
+ * @part: partition number (private to fs layer)
+ * @gen: generation of the mount the file was opened on (private to fs layer)
+ * @name: full path of the file (private to fs layer)
+ * @priv: state of the filesystem driver, e.g. the file's inode
+ */
+struct fs_file {
+	loff_t size;
+	int type;
+	struct blk_desc *desc;
+	int part;
+	uint gen;
+	char *name;
+	void *priv;
+};
+
+/**
+ * fs_openfile() - Open a file for reading
+ *
+ * This looks up a file on the partition previously set by fs_set_blk_dev(),
+ * once. While any file is open, the filesystem stays mounted, so that
+ * fs_pread() and any other operation on the same partition need not probe it
+ * again. Writing to the filesystem or using another partition unmounts it,
+ * in which case fs_pread() looks up the file again. Filesystems without a
+ * block device, such as hostfs and ubi, are not kept mounted since they need
+ * no probing.
+ *
+ * @filename:	full path of the file to open
+ * Return:	the open file, to be closed with fs_closefile(), or NULL on
+ *		error with errno set appropriately
+ */
+struct fs_file *fs_openfile(const char *filename);
+
+/**
+ * fs_pread() - Read from an open file
+ *
+ * The filesystem need not be set with fs_set_blk_dev() before calling this.
+ *
+ * @file:	the open file
+ * @buf:	buffer to read into
+ * @offset:	offset in the file from where to start reading
+ * @len:	maximum number of bytes to read; nothing is read at or beyond
+ *		the end of the file
+ * @actread:	returns the actual number of bytes read
+ * Return:	0 if OK with valid *actread, negative on error
+ */
+int fs_pread(struct fs_file *file, void *buf, loff_t offset, loff_t len,
+	     loff_t *actread);
+
+/**
+ * fs_closefile() - Close a file
+ *
+ * When the last open file is closed, the filesystem is unmounted.
+ *
+ * @file:	the open file, or NULL to do nothing
+ */
+void fs_closefile(struct fs_file *file);
+
+/**
+ * fs_unmount() - Stop keeping a filesystem mounted for open files
+ *
+ * This must be called before using a filesystem driver directly, or when a
+ * block device is written to or goes away. Files which are still open are
+ * looked up again by fs_pread().
+ *
+ * @desc:	only unmount a filesystem on this block device, or NULL for any
+ */
+#if !defined(CONFIG_SPL_BUILD) || IS_ENABLED(CONFIG_FS_LOADER)
+void fs_unmount(struct blk_desc *desc);
+#else
+static inline void fs_unmount(struct blk_desc *desc)
+{
+}
+#endif
+
 /*
  * fs_unlink - delete a file or directory
  *
@@ -316,6 +402,19 @@ int do_fs_types(struct cmd_tbl *cmdtp, int flag, int argc, char * const argv[]);
  */
 int fs_read_alloc(const char *fname, ulong size, uint align, void **bufp);
 
+/**
+ * fs_pread_alloc() - Allocate space for an open file and read it
+ *
+ * The file is terminated with a nul character
+ *
+ * @file: File to read, from fs_openfile()
+ * @align: Alignment to use for memory allocation (0 for default)
+ * @bufp: On success, returns the allocated buffer with the nul-terminated file
+ *	in it
+ * Return: 0 if OK, -ENOMEM if out of memory, -EIO if read failed
+ */
+int fs_pread_alloc(struct fs_file *file, uint align, void **bufp);
+
 /**
  * fs_load_alloc() - Load a file into allocated space
  *
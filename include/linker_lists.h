@@ -72,6 +72,30 @@
 			__attribute__((unused))				\
 			__section("__u_boot_list_2_"#_list"_2_"#_name)
 
+/**
+ * ll_entry_declare_key() - Declare an entry sorted under a different key
+ * @_type:	Data type of the entry
+ * @_name:	Name of the entry
+ * @_key:	String to sort the entry by, in place of @_name
+ * @_list:	name of the list. Should contain only characters allowed
+ *		in a C variable name!
+ *
+ * Entries are sorted by their section name, which normally ends in @_name.
+ * This is like ll_entry_declare() but uses @_key in the section name, so
+ * that the entry can be sorted by a string which is not a valid C name, such
+ * as "?" for a command.
+ *
+ * ::
+ *
+ *   ll_entry_declare_key(struct cmd_tbl, question_mark, "?", cmd) = {
+ *           ...
+ *   };
+ */
+#define ll_entry_declare_key(_type, _name, _key, _list)		\
+	_type _u_boot_list_2_##_list##_2_##_name __aligned(4)		\
+			__attribute__((unused))				\
+			__section("__u_boot_list_2_"#_list"_2_"_key)
+
 /**
  * ll_entry_declare_list() - Declare a list of link-generated array entries
  * @_type:	Data type of each entry
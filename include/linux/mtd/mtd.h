@@ -311,6 +311,11 @@ struct mtd_info {
 #endif
 	int usecount;
 
+#if IS_ENABLED(CONFIG_MTD_PAGE_CACHE)
+	/* Page cache, only used on master devices */
+	struct mtd_page_cache *cache;
+#endif
+
 	/* MTD devices do not have any parent. MTD partitions do. */
 	struct mtd_info *parent;
 
@@ -633,5 +638,47 @@ bool mtd_dev_list_updated(void);
 int mtd_search_alternate_name(const char *mtdname, char *altname,
 			      unsigned int max_len);
 
+/* drivers/mtd/mtdcache.c */
+struct mtd_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long readahead;
+};
+
+#if IS_ENABLED(CONFIG_MTD_PAGE_CACHE)
+bool mtd_cache_can_read(struct mtd_info *mtd, struct mtd_oob_ops *ops);
+int mtd_cache_read(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops);
+void mtd_cache_invalidate(struct mtd_info *mtd, loff_t ofs, uint64_t len);
+void mtd_cache_free(struct mtd_info *mtd);
+int mtd_cache_get_stats(struct mtd_info *mtd, struct mtd_cache_stats *stats);
+#else
+static inline bool mtd_cache_can_read(struct mtd_info *mtd,
+				      struct mtd_oob_ops *ops)
+{
+	return false;
+}
+
+static inline int mtd_cache_read(struct mtd_info *mtd, loff_t from,
+				 struct mtd_oob_ops *ops)
+{
+	return -ENOSYS;
+}
+
+static inline void mtd_cache_invalidate(struct mtd_info *mtd, loff_t ofs,
+					uint64_t len)
+{
+}
+
+static inline void mtd_cache_free(struct mtd_info *mtd)
+{
+}
+
+static inline int mtd_cache_get_stats(struct mtd_info *mtd,
+				      struct mtd_cache_stats *stats)
+{
+	return -ENOSYS;
+}
+#endif
+
 #endif
 #endif /* __MTD_MTD_H__ */
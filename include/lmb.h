@@ -41,33 +41,45 @@ struct lmb_property {
  *
  * case 1. CONFIG_LMB_USE_MAX_REGIONS is defined (legacy mode)
  *         => CONFIG_LMB_MAX_REGIONS is used to configure the region size,
- *         directly in the array lmb_region.region[], with the same
- *         configuration for memory and reserved regions.
+ *         with the same configuration for memory and reserved regions.
  *
  * case 2. CONFIG_LMB_USE_MAX_REGIONS is not defined, the size of each
  *         region is configurated *independently* with
  *         => CONFIG_LMB_MEMORY_REGIONS: struct lmb.memory_regions
  *         => CONFIG_LMB_RESERVED_REGIONS: struct lmb.reserved_regions
- *         lmb_region.region is only a pointer to the correct buffer,
- *         initialized in lmb_init(). This configuration is useful to manage
- *         more reserved memory regions with CONFIG_LMB_RESERVED_REGIONS.
+ *         This configuration is useful to manage more reserved memory
+ *         regions with CONFIG_LMB_RESERVED_REGIONS.
+ *
+ * In both cases lmb_region.region points to the array in struct lmb after
+ * lmb_init(). If lmb_enable_grow() is called, a full array is moved to the
+ * heap and grown instead, so there is no fixed limit on the number of regions.
+ *
+ * Each array is kept sorted by base address, with no two regions
+ * overlapping, so that lookups can use a binary search.
  */
+#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
+#define LMB_MEMORY_REGIONS	CONFIG_LMB_MAX_REGIONS
+#define LMB_RESERVED_REGIONS	CONFIG_LMB_MAX_REGIONS
+#else
+#define LMB_MEMORY_REGIONS	CONFIG_LMB_MEMORY_REGIONS
+#define LMB_RESERVED_REGIONS	CONFIG_LMB_RESERVED_REGIONS
+#endif
 
 /**
  * struct lmb_region - Description of a set of region.
  *
  * @cnt: Number of regions.
  * @max: Size of the region array, max value of cnt.
- * @region: Array of the region properties
+ * @region: Array of the region properties, sorted by base address
+ * @grow: Move @region to the heap and enlarge it when it is full
+ * @allocated: @region is on the heap and is freed by lmb_release()
  */
 struct lmb_region {
 	unsigned long cnt;
 	unsigned long max;
-#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
-	struct lmb_property region[CONFIG_LMB_MAX_REGIONS];
-#else
 	struct lmb_property *region;
-#endif
+	bool grow;
+	bool allocated;
 };
 
 /**
@@ -86,13 +98,33 @@ struct lmb_region {
 struct lmb {
 	struct lmb_region memory;
 	struct lmb_region reserved;
-#if !IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
-	struct lmb_property memory_regions[CONFIG_LMB_MEMORY_REGIONS];
-	struct lmb_property reserved_regions[CONFIG_LMB_RESERVED_REGIONS];
-#endif
+	struct lmb_property memory_regions[LMB_MEMORY_REGIONS];
+	struct lmb_property reserved_regions[LMB_RESERVED_REGIONS];
 };
 
 void lmb_init(struct lmb *lmb);
+
+/**
+ * lmb_enable_grow() - lift the limit on the number of regions
+ *
+ * Without this, adding a region fails once LMB_MEMORY_REGIONS memory or
+ * LMB_RESERVED_REGIONS reserved regions are in use. Afterwards a full array
+ * is moved to the heap and doubled in size instead. The caller must then call
+ * lmb_release() when it is done with @lmb.
+ *
+ * @lmb:	the logical memory block struct
+ */
+void lmb_enable_grow(struct lmb *lmb);
+
+/**
+ * lmb_release() - free the region arrays which were moved to the heap
+ *
+ * This empties @lmb and sets it up again as lmb_init() does. It may also be
+ * called on a zeroed struct lmb.
+ *
+ * @lmb:	the logical memory block struct
+ */
+void lmb_release(struct lmb *lmb);
 void lmb_init_and_reserve(struct lmb *lmb, struct bd_info *bd, void *fdt_blob);
 void lmb_init_and_reserve_range(struct lmb *lmb, phys_addr_t base,
 				phys_size_t size, void *fdt_blob);
@@ -879,6 +879,149 @@ void malloc_enable_testing(int max_allocs);
 /** malloc_disable_testing() - Put malloc() into normal mode */
 void malloc_disable_testing(void);
 
+/* Number of slab size classes and the largest request they serve */
+#define MALLOC_SLAB_CLASSES	8
+#define MALLOC_SLAB_MAX		256
+
+/**
+ * struct malloc_slab_class_stats - statistics for one slab size class
+ *
+ * @size: size of each object in the class
+ * @pages: number of pages holding objects of this size
+ * @in_use: number of objects currently allocated
+ * @allocs: number of allocations since start-up
+ * @frees: number of frees since start-up
+ */
+struct malloc_slab_class_stats {
+	uint size;
+	uint pages;
+	uint in_use;
+	ulong allocs;
+	ulong frees;
+};
+
+/**
+ * struct malloc_slab_stats - statistics for the slab allocator
+ *
+ * @size: size of the region reserved for slabs, 0 if not in use
+ * @pages: number of pages in the region which can hold objects
+ * @free_pages: number of pages not assigned to a size class
+ * @overflows: small requests passed to the heap as no page was free
+ * @cls: statistics for each size class
+ */
+struct malloc_slab_stats {
+	ulong size;
+	uint pages;
+	uint free_pages;
+	ulong overflows;
+	struct malloc_slab_class_stats cls[MALLOC_SLAB_CLASSES];
+};
+
+struct malloc_arena;
+
+#if CONFIG_IS_ENABLED(SYS_MALLOC_SLAB)
+/**
+ * malloc_slab_init() - Reserve the slab region at the end of the heap
+ *
+ * Called by mem_malloc_init(). Small allocations are served from this region
+ * from then on.
+ *
+ * @end: end of the heap; updated to exclude the slab region
+ * @size: size of the heap
+ */
+void malloc_slab_init(ulong *end, ulong size);
+
+/**
+ * malloc_slab_alloc() - Allocate a small object from a slab
+ *
+ * @bytes: number of bytes needed, at most MALLOC_SLAB_MAX
+ * Return: pointer to the object, or NULL if there is no room, in which case
+ * the caller should use the heap
+ */
+void *malloc_slab_alloc(size_t bytes);
+
+/**
+ * malloc_slab_free() - Free an object allocated by malloc_slab_alloc()
+ *
+ * @mem: object to free
+ */
+void malloc_slab_free(void *mem);
+
+/**
+ * malloc_slab_usable_size() - Get the usable size of a slab object
+ *
+ * @mem: object to check
+ * Return: size of the object's class
+ */
+size_t malloc_slab_usable_size(void *mem);
+
+/**
+ * malloc_slab_in_use() - Get the number of bytes allocated from slabs
+ *
+ * Return: total size of all slab objects currently allocated
+ */
+ulong malloc_slab_in_use(void);
+
+/**
+ * malloc_slab_get_stats() - Get statistics for the slab allocator
+ *
+ * @stats: returns the statistics
+ */
+void malloc_slab_get_stats(struct malloc_slab_stats *stats);
+
+/* Region holding the slabs, used to tell slab objects from heap chunks */
+extern ulong malloc_slab_base, malloc_slab_end;
+
+/**
+ * malloc_slab_owns() - Check whether memory was allocated from a slab
+ *
+ * @mem: pointer returned by malloc() and friends
+ * Return: true if @mem is a slab object
+ */
+static inline bool malloc_slab_owns(const void *mem)
+{
+	return (ulong)mem >= malloc_slab_base && (ulong)mem < malloc_slab_end;
+}
+
+/**
+ * malloc_arena_new() - Create an arena for allocations freed all together
+ *
+ * An arena hands out memory from large blocks obtained from malloc(). The
+ * memory cannot be freed piecemeal; malloc_arena_free() releases all of it in
+ * one call. This suits subsystems which build up many small objects and then
+ * drop them all, e.g. when a device is removed.
+ *
+ * @block_size: size of the blocks to obtain from malloc(); 0 for a default
+ * Return: new arena, or NULL if out of memory
+ */
+struct malloc_arena *malloc_arena_new(size_t block_size);
+
+/**
+ * malloc_arena_alloc() - Allocate memory from an arena
+ *
+ * The memory is aligned like memory returned by malloc() and is not cleared.
+ *
+ * @arena: arena to allocate from
+ * @size: number of bytes needed
+ * Return: pointer to the memory, or NULL if out of memory
+ */
+void *malloc_arena_alloc(struct malloc_arena *arena, size_t size);
+
+/**
+ * malloc_arena_free() - Free an arena and all memory allocated from it
+ *
+ * @arena: arena to free; may be NULL
+ */
+void malloc_arena_free(struct malloc_arena *arena);
+#else
+static inline void malloc_slab_init(ulong *end, ulong size) {}
+static inline void *malloc_slab_alloc(size_t bytes) { return NULL; }
+static inline void malloc_slab_free(void *mem) {}
+static inline size_t malloc_slab_usable_size(void *mem) { return 0; }
+static inline ulong malloc_slab_in_use(void) { return 0; }
+static inline bool malloc_slab_owns(const void *mem) { return false; }
+#endif
+
 #if CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
 #define malloc malloc_simple
 #define realloc realloc_simple
@@ -86,7 +86,7 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_8	0x08
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
-#define TCP_SCALE	0x01		/* Scale			*/
+#define TCP_SCALE	0x05		/* Scale, windows up to 2 MiB	*/
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -298,6 +298,7 @@ typedef void rxhand_tcp(uchar *pkt, u16 dport,
 			u32 tcp_seq_num, u32 tcp_ack_num,
 			u8 action, unsigned int len);
 void tcp_set_tcp_handler(rxhand_tcp *f);
+void tcp_set_rx_window(u32 size);
 
 void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int len);
 
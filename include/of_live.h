@@ -11,6 +11,7 @@
 
 struct abuf;
 struct device_node;
+struct dm_stats;
 
 /**
  * of_live_build() - build a live (hierarchical) tree from a flat DT
@@ -47,6 +48,13 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes);
  */
 void of_live_free(struct device_node *root);
 
+/**
+ * of_live_collect_stats() - Report the memory used by the control live tree
+ *
+ * @stats: Updated with the size of the live tree
+ */
+void of_live_collect_stats(struct dm_stats *stats);
+
 /**
  * of_live_create_empty() - Create a new, empty tree
  *
@@ -666,11 +666,14 @@ struct usb_dev_plat {
  *		so this will be false.
  * @companion:  True if this is a companion controller to another USB
  *		controller
+ * @scan_err:	Result of scanning the root hub, reported once all buses
+ *		have been enumerated
  */
 struct usb_bus_priv {
 	int next_addr;
 	bool desc_before_addr;
 	bool companion;
+	int scan_err;
 };
 
 /**
@@ -949,6 +952,26 @@ bool usb_device_has_child_on_port(struct usb_device *parent, int port);
 int usb_hub_probe(struct usb_device *dev, int ifnum);
 void usb_hub_reset(void);
 
+/**
+ * usb_hub_defer_scan() - Queue hub ports without scanning them
+ *
+ * Hubs configured after this call only add their ports to the scanning
+ * list. This allows the ports of several controllers to be enumerated
+ * together, so that their power-good and debounce times overlap.
+ * usb_hub_flush_scan() must be called to scan the queued ports.
+ */
+void usb_hub_defer_scan(void);
+
+/**
+ * usb_hub_flush_scan() - Scan all queued hub ports
+ *
+ * This ends the deferral started by usb_hub_defer_scan() and enumerates
+ * all ports on the scanning list, including those of hubs found on the way.
+ *
+ * Return: 0 if OK, -ve on error
+ */
+int usb_hub_flush_scan(void);
+
 /*
  * usb_find_usb2_hub_address_port() - Get hub address and port for TT setting
  *
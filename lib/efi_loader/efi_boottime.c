@@ -36,6 +36,9 @@ __efi_runtime_data LIST_HEAD(efi_events);
 /* List of queued events */
 static LIST_HEAD(efi_event_queue);
 
+/* List of armed timer events, ordered by their next trigger time */
+static LIST_HEAD(efi_timers);
+
 /* Flag to disable timer activity in ExitBootServices() */
 static bool timers_enabled = true;
 
@@ -764,6 +767,7 @@ efi_status_t efi_create_event(uint32_t type, efi_uintn_t notify_tpl,
 	evt->group = group;
 	/* Disable timers on boot up */
 	evt->trigger_next = -1ULL;
+	INIT_LIST_HEAD(&evt->timer_link);
 	list_add_tail(&evt->link, &efi_events);
 	*event = evt;
 	return EFI_SUCCESS;
@@ -845,6 +849,25 @@ static efi_status_t EFIAPI efi_create_event_ext(
 					 notify_context, NULL, event));
 }
 
+/**
+ * efi_timer_arm() - add a timer event to the list of armed timers
+ * @event: timer event with its next trigger time set
+ *
+ * The list is kept ordered by the next trigger time, so that checking for
+ * expired timers only has to look at its head.
+ */
+static void efi_timer_arm(struct efi_event *event)
+{
+	struct efi_event *evt;
+
+	list_del_init(&event->timer_link);
+	list_for_each_entry(evt, &efi_timers, timer_link) {
+		if (event->trigger_next < evt->trigger_next)
+			break;
+	}
+	list_add_tail(&event->timer_link, &evt->timer_link);
+}
+
 /**
  * efi_timer_check() - check if a timer event has occurred
  *
@@ -858,18 +881,31 @@ void efi_timer_check(void)
 {
 	struct efi_event *evt;
 	u64 now = timer_get_us();
+	LIST_HEAD(expired);
 
-	list_for_each_entry(evt, &efi_events, link) {
-		if (!timers_enabled)
-			continue;
-		if (!(evt->type & EVT_TIMER) || now < evt->trigger_next)
-			continue;
+	/*
+	 * Collect the expired timers first. A periodic timer which is re-armed
+	 * below may already be due again but is only signaled once per call.
+	 */
+	while (timers_enabled && !list_empty(&efi_timers)) {
+		evt = list_first_entry(&efi_timers, struct efi_event,
+				       timer_link);
+		if (now < evt->trigger_next)
+			break;
+		list_move_tail(&evt->timer_link, &expired);
+	}
+
+	/* Notification functions may close or set any of these timers */
+	while (!list_empty(&expired)) {
+		evt = list_first_entry(&expired, struct efi_event, timer_link);
+		list_del_init(&evt->timer_link);
 		switch (evt->trigger_type) {
 		case EFI_TIMER_RELATIVE:
 			evt->trigger_type = EFI_TIMER_STOP;
 			break;
 		case EFI_TIMER_PERIODIC:
 			evt->trigger_next += evt->trigger_time;
+			efi_timer_arm(evt);
 			break;
 		default:
 			continue;
@@ -919,6 +955,10 @@ efi_status_t efi_set_timer(struct efi_event *event, enum efi_timer_delay type,
 	event->trigger_type = type;
 	event->trigger_time = trigger_time;
 	event->is_signaled = false;
+	if (type == EFI_TIMER_STOP)
+		list_del_init(&event->timer_link);
+	else
+		efi_timer_arm(event);
 	return EFI_SUCCESS;
 }
 
@@ -1065,6 +1105,7 @@ static efi_status_t EFIAPI efi_close_event(struct efi_event *event)
 	if (efi_event_is_queued(event))
 		list_del(&event->queue_link);
 
+	list_del(&event->timer_link);
 	list_del(&event->link);
 	efi_free_pool(event);
 	return EFI_EXIT(EFI_SUCCESS);
@@ -2199,8 +2240,16 @@ static efi_status_t EFIAPI efi_exit_boot_services(efi_handle_t image_handle,
 		}
 	}
 
-	/* Stop all timer related activities */
+	/*
+	 * Stop all timer related activities. Each timer is unlinked, so that
+	 * notification functions may still set or close it.
+	 */
 	timers_enabled = false;
+	list_for_each_entry_safe(evt, next_event, &efi_timers, timer_link) {
+		list_del_init(&evt->timer_link);
+		evt->trigger_type = EFI_TIMER_STOP;
+		evt->trigger_next = -1ULL;
+	}
 
 	/* Add related events to the event group */
 	list_for_each_entry(evt, &efi_events, link) {
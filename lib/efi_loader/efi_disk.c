@@ -18,12 +18,15 @@
 #include <log.h>
 #include <part.h>
 #include <malloc.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
 
 struct efi_system_partition efi_system_partition = {
 	.uclass_id = UCLASS_INVALID,
 };
 
 const efi_guid_t efi_block_io_guid = EFI_BLOCK_IO_PROTOCOL_GUID;
+const efi_guid_t efi_block_io2_guid = EFI_BLOCK_IO2_PROTOCOL_GUID;
 const efi_guid_t efi_system_partition_guid = PARTITION_SYSTEM_GUID;
 
 /**
@@ -31,6 +34,7 @@ const efi_guid_t efi_system_partition_guid = PARTITION_SYSTEM_GUID;
  *
  * @header:	EFI object header
  * @ops:	EFI disk I/O protocol interface
+ * @ops2:	EFI block I/O 2 protocol interface
  * @media:	block I/O media information
  * @dp:		device path to the block device
  * @volume:	simple file system protocol of the partition
@@ -38,6 +42,7 @@ const efi_guid_t efi_system_partition_guid = PARTITION_SYSTEM_GUID;
 struct efi_disk_obj {
 	struct efi_object header;
 	struct efi_block_io ops;
+	struct efi_block_io2 ops2;
 	struct efi_block_io_media media;
 	struct efi_device_path *dp;
 	struct efi_simple_file_system_protocol *volume;
@@ -97,25 +102,57 @@ enum efi_disk_direction {
 	EFI_DISK_WRITE,
 };
 
-static efi_status_t efi_disk_rw_blocks(struct efi_block_io *this,
-			u32 media_id, u64 lba, unsigned long buffer_size,
-			void *buffer, enum efi_disk_direction direction)
-{
+/*
+ * Number of bytes transferred for a queued block I/O 2 request in each timer
+ * cycle
+ */
+#define EFI_DISK_IO2_CHUNK	SZ_128K
+
+/**
+ * struct efi_disk_io2_req - queued request of the block I/O 2 protocol
+ *
+ * @link:	link in efi_disk_io2_queue
+ * @diskobj:	disk object to read from or write to
+ * @token:	token to signal when the request is complete
+ * @lba:	next block to transfer
+ * @blocks:	number of blocks left to transfer
+ * @buffer:	buffer for the next block
+ * @direction:	direction of the transfer
+ */
+struct efi_disk_io2_req {
+	struct list_head link;
 	struct efi_disk_obj *diskobj;
-	int blksz;
-	int blocks;
-	unsigned long n;
+	struct efi_block_io2_token *token;
+	u64 lba;
+	ulong blocks;
+	void *buffer;
+	enum efi_disk_direction direction;
+};
 
-	diskobj = container_of(this, struct efi_disk_obj, ops);
-	blksz = diskobj->media.block_size;
-	blocks = buffer_size / blksz;
+/* Queued block I/O 2 requests, served in order */
+static LIST_HEAD(efi_disk_io2_queue);
 
-	EFI_PRINT("blocks=%x lba=%llx blksz=%x dir=%d\n",
-		  blocks, lba, blksz, direction);
+/* Timer event serving efi_disk_io2_queue */
+static struct efi_event *efi_disk_io2_timer;
 
-	/* We only support full block access */
-	if (buffer_size & (blksz - 1))
-		return EFI_BAD_BUFFER_SIZE;
+/* Event finishing the queued requests at ExitBootServices() */
+static struct efi_event *efi_disk_io2_exit_event;
+
+/**
+ * efi_disk_transfer() - read or write blocks of a disk object
+ *
+ * @diskobj:	disk object
+ * @lba:	first block to transfer
+ * @blocks:	number of blocks to transfer
+ * @buffer:	buffer to read into or write from
+ * @direction:	direction of the transfer
+ * Return:	number of blocks transferred
+ */
+static ulong efi_disk_transfer(struct efi_disk_obj *diskobj, u64 lba,
+			       ulong blocks, void *buffer,
+			       enum efi_disk_direction direction)
+{
+	ulong n;
 
 	if (CONFIG_IS_ENABLED(PARTITIONS) &&
 	    device_get_uclass_id(diskobj->header.dev) == UCLASS_PARTITION) {
@@ -136,6 +173,241 @@ static efi_status_t efi_disk_rw_blocks(struct efi_block_io *this,
 			n = blk_dwrite(desc, lba, blocks, buffer);
 	}
 
+	return n;
+}
+
+/**
+ * efi_disk_io2_transfer() - transfer blocks of a queued request
+ *
+ * The request is advanced past the blocks which are transferred.
+ *
+ * @req:	block I/O 2 request
+ * @blocks:	number of blocks to transfer
+ * Return:	true if all @blocks were transferred
+ */
+static bool efi_disk_io2_transfer(struct efi_disk_io2_req *req, ulong blocks)
+{
+	u32 blksz = req->diskobj->media.block_size;
+	void *real_buffer = req->buffer;
+	ulong n;
+
+#ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
+	blocks = min_t(ulong, blocks, EFI_LOADER_BOUNCE_BUFFER_SIZE / blksz);
+	real_buffer = efi_bounce_buffer;
+	if (req->direction == EFI_DISK_WRITE)
+		memcpy(real_buffer, req->buffer, blocks * blksz);
+#endif
+	n = efi_disk_transfer(req->diskobj, req->lba, blocks, real_buffer,
+			      req->direction);
+	if (real_buffer != req->buffer && req->direction == EFI_DISK_READ)
+		memcpy(req->buffer, real_buffer, n * blksz);
+
+	req->lba += n;
+	req->blocks -= n;
+	req->buffer += n * blksz;
+
+	return n == blocks;
+}
+
+/**
+ * efi_disk_io2_complete() - complete a block I/O 2 request
+ *
+ * The request must already be removed from the queue, as signaling the
+ * token's event may start new requests.
+ *
+ * @req:	block I/O 2 request, freed by this function
+ * @status:	status of the transaction
+ */
+static void efi_disk_io2_complete(struct efi_disk_io2_req *req,
+				  efi_status_t status)
+{
+	struct efi_block_io2_token *token = req->token;
+
+	free(req);
+	token->transaction_status = status;
+	efi_signal_event(token->event);
+}
+
+/**
+ * efi_disk_io2_first() - find the first queued request of a disk
+ *
+ * @diskobj:	disk object, NULL for all disks
+ * Return:	block I/O 2 request or NULL
+ */
+static struct efi_disk_io2_req *efi_disk_io2_first(struct efi_disk_obj *diskobj)
+{
+	struct efi_disk_io2_req *req;
+
+	list_for_each_entry(req, &efi_disk_io2_queue, link) {
+		if (!diskobj || req->diskobj == diskobj)
+			return req;
+	}
+
+	return NULL;
+}
+
+/**
+ * efi_disk_io2_finish() - finish the queued requests of a disk
+ *
+ * Pending requests are either carried out completely or aborted.
+ *
+ * @diskobj:	disk object, NULL for all disks
+ * @abort:	true to abort the requests instead of carrying them out
+ */
+static void efi_disk_io2_finish(struct efi_disk_obj *diskobj, bool abort)
+{
+	struct efi_disk_io2_req *req;
+	efi_status_t status;
+
+	/* Completing a request may change the queue, so start over each time */
+	while ((req = efi_disk_io2_first(diskobj))) {
+		list_del(&req->link);
+		if (abort) {
+			status = EFI_ABORTED;
+		} else {
+			while (req->blocks &&
+			       efi_disk_io2_transfer(req, req->blocks))
+				;
+			status = req->blocks ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+		}
+		efi_disk_io2_complete(req, status);
+	}
+}
+
+/**
+ * efi_disk_io2_notify() - serve the first queued block I/O 2 request
+ *
+ * This notification function is called in every timer cycle while requests
+ * are queued. Each call transfers up to EFI_DISK_IO2_CHUNK bytes, so that
+ * an application which checks its events between other work gets its data in
+ * the meantime.
+ *
+ * @event:	the event for which this notification function is registered
+ * @context:	event context - not used in this function
+ */
+static void EFIAPI efi_disk_io2_notify(struct efi_event *event, void *context)
+{
+	struct efi_disk_io2_req *req;
+	ulong blocks;
+
+	EFI_ENTRY("%p, %p", event, context);
+
+	req = list_first_entry_or_null(&efi_disk_io2_queue,
+				       struct efi_disk_io2_req, link);
+	if (req) {
+		blocks = max(EFI_DISK_IO2_CHUNK / req->diskobj->media.block_size,
+			     1U);
+		blocks = min(blocks, req->blocks);
+		if (!efi_disk_io2_transfer(req, blocks)) {
+			list_del(&req->link);
+			efi_disk_io2_complete(req, EFI_DEVICE_ERROR);
+		} else if (!req->blocks) {
+			list_del(&req->link);
+			efi_disk_io2_complete(req, EFI_SUCCESS);
+		}
+	}
+	if (list_empty(&efi_disk_io2_queue))
+		efi_set_timer(event, EFI_TIMER_STOP, 0);
+
+	EFI_EXIT(EFI_SUCCESS);
+}
+
+/**
+ * efi_disk_io2_exit_notify() - finish queued requests at ExitBootServices()
+ *
+ * @event:	the event for which this notification function is registered
+ * @context:	event context - not used in this function
+ */
+static void EFIAPI efi_disk_io2_exit_notify(struct efi_event *event,
+					    void *context)
+{
+	EFI_ENTRY("%p, %p", event, context);
+	efi_disk_io2_finish(NULL, false);
+	EFI_EXIT(EFI_SUCCESS);
+}
+
+/**
+ * efi_disk_io2_start() - start the timer serving queued requests
+ *
+ * Return:	status code
+ */
+static efi_status_t efi_disk_io2_start(void)
+{
+	efi_status_t ret;
+
+	if (!efi_disk_io2_exit_event) {
+		ret = efi_create_event(EVT_SIGNAL_EXIT_BOOT_SERVICES,
+				       TPL_CALLBACK, efi_disk_io2_exit_notify,
+				       NULL, NULL, &efi_disk_io2_exit_event);
+		if (ret != EFI_SUCCESS)
+			return ret;
+	}
+	if (!efi_disk_io2_timer) {
+		ret = efi_create_event(EVT_TIMER | EVT_NOTIFY_SIGNAL,
+				       TPL_CALLBACK, efi_disk_io2_notify,
+				       NULL, NULL, &efi_disk_io2_timer);
+		if (ret != EFI_SUCCESS)
+			return ret;
+	}
+
+	return efi_set_timer(efi_disk_io2_timer, EFI_TIMER_PERIODIC, 0);
+}
+
+/**
+ * efi_disk_check_blocks() - check the parameters of a block transfer
+ *
+ * @media:		block I/O media information
+ * @media_id:		id of the medium to be accessed
+ * @lba:		starting logical block
+ * @buffer_size:	size of the buffer
+ * @buffer:		buffer to read into or write from
+ * Return:		status code
+ */
+static efi_status_t efi_disk_check_blocks(struct efi_block_io_media *media,
+					  u32 media_id, u64 lba,
+					  efi_uintn_t buffer_size, void *buffer)
+{
+	/* TODO: check for media changes */
+	if (media_id != media->media_id)
+		return EFI_MEDIA_CHANGED;
+	if (!media->media_present)
+		return EFI_NO_MEDIA;
+	/* media->io_align is a power of 2 or 0 */
+	if (media->io_align &&
+	    (uintptr_t)buffer & (media->io_align - 1))
+		return EFI_INVALID_PARAMETER;
+	if (lba * media->block_size + buffer_size >
+	    (media->last_block + 1) * media->block_size)
+		return EFI_INVALID_PARAMETER;
+
+	return EFI_SUCCESS;
+}
+
+static efi_status_t efi_disk_rw_blocks(struct efi_block_io *this,
+			u32 media_id, u64 lba, unsigned long buffer_size,
+			void *buffer, enum efi_disk_direction direction)
+{
+	struct efi_disk_obj *diskobj;
+	int blksz;
+	int blocks;
+	unsigned long n;
+
+	diskobj = container_of(this, struct efi_disk_obj, ops);
+	blksz = diskobj->media.block_size;
+	blocks = buffer_size / blksz;
+
+	EFI_PRINT("blocks=%x lba=%llx blksz=%x dir=%d\n",
+		  blocks, lba, blksz, direction);
+
+	/* We only support full block access */
+	if (buffer_size & (blksz - 1))
+		return EFI_BAD_BUFFER_SIZE;
+
+	/* Blocking transfers see the data of earlier queued requests */
+	efi_disk_io2_finish(diskobj, false);
+
+	n = efi_disk_transfer(diskobj, lba, blocks, buffer, direction);
+
 	/* We don't do interrupts, so check for timers cooperatively */
 	efi_timer_check();
 
@@ -171,18 +443,10 @@ static efi_status_t EFIAPI efi_disk_read_blocks(struct efi_block_io *this,
 
 	if (!this)
 		return EFI_INVALID_PARAMETER;
-	/* TODO: check for media changes */
-	if (media_id != this->media->media_id)
-		return EFI_MEDIA_CHANGED;
-	if (!this->media->media_present)
-		return EFI_NO_MEDIA;
-	/* media->io_align is a power of 2 or 0 */
-	if (this->media->io_align &&
-	    (uintptr_t)buffer & (this->media->io_align - 1))
-		return EFI_INVALID_PARAMETER;
-	if (lba * this->media->block_size + buffer_size >
-	    (this->media->last_block + 1) * this->media->block_size)
-		return EFI_INVALID_PARAMETER;
+	r = efi_disk_check_blocks(this->media, media_id, lba, buffer_size,
+				  buffer);
+	if (r != EFI_SUCCESS)
+		return r;
 
 #ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
 	if (buffer_size > EFI_LOADER_BOUNCE_BUFFER_SIZE) {
@@ -239,18 +503,10 @@ static efi_status_t EFIAPI efi_disk_write_blocks(struct efi_block_io *this,
 		return EFI_INVALID_PARAMETER;
 	if (this->media->read_only)
 		return EFI_WRITE_PROTECTED;
-	/* TODO: check for media changes */
-	if (media_id != this->media->media_id)
-		return EFI_MEDIA_CHANGED;
-	if (!this->media->media_present)
-		return EFI_NO_MEDIA;
-	/* media->io_align is a power of 2 or 0 */
-	if (this->media->io_align &&
-	    (uintptr_t)buffer & (this->media->io_align - 1))
-		return EFI_INVALID_PARAMETER;
-	if (lba * this->media->block_size + buffer_size >
-	    (this->media->last_block + 1) * this->media->block_size)
-		return EFI_INVALID_PARAMETER;
+	r = efi_disk_check_blocks(this->media, media_id, lba, buffer_size,
+				  buffer);
+	if (r != EFI_SUCCESS)
+		return r;
 
 #ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
 	if (buffer_size > EFI_LOADER_BOUNCE_BUFFER_SIZE) {
@@ -286,7 +542,8 @@ static efi_status_t EFIAPI efi_disk_write_blocks(struct efi_block_io *this,
  * This function implements the FlushBlocks service of the
  * EFI_BLOCK_IO_PROTOCOL.
  *
- * As we always write synchronously nothing is done here.
+ * As we always write synchronously only requests queued via the
+ * EFI_BLOCK_IO2_PROTOCOL have to be completed.
  *
  * See the Unified Extensible Firmware Interface (UEFI) specification for
  * details.
@@ -297,6 +554,11 @@ static efi_status_t EFIAPI efi_disk_write_blocks(struct efi_block_io *this,
 static efi_status_t EFIAPI efi_disk_flush_blocks(struct efi_block_io *this)
 {
 	EFI_ENTRY("%p", this);
+
+	if (this)
+		efi_disk_io2_finish(container_of(this, struct efi_disk_obj,
+						 ops), false);
+
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
@@ -307,6 +569,210 @@ static const struct efi_block_io block_io_disk_template = {
 	.flush_blocks = &efi_disk_flush_blocks,
 };
 
+/**
+ * efi_disk_reset_ex() - reset block device
+ *
+ * This function implements the Reset service of the EFI_BLOCK_IO2_PROTOCOL.
+ *
+ * Requests which are still queued are aborted.
+ *
+ * See the Unified Extensible Firmware Interface (UEFI) specification for
+ * details.
+ *
+ * @this:			pointer to the BLOCK_IO2_PROTOCOL
+ * @extended_verification:	extended verification
+ * Return:			status code
+ */
+static efi_status_t EFIAPI efi_disk_reset_ex(struct efi_block_io2 *this,
+					     bool extended_verification)
+{
+	EFI_ENTRY("%p, %x", this, extended_verification);
+
+	if (!this)
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+	efi_disk_io2_finish(container_of(this, struct efi_disk_obj, ops2),
+			    true);
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+/**
+ * efi_disk_queue_blocks() - queue a request of the block I/O 2 protocol
+ *
+ * @diskobj:		disk object
+ * @media_id:		id of the medium to be accessed
+ * @lba:		starting logical block
+ * @token:		token to signal when the request is complete
+ * @buffer_size:	size of the buffer
+ * @buffer:		buffer to read into or write from
+ * @direction:		direction of the transfer
+ * Return:		status code
+ */
+static efi_status_t efi_disk_queue_blocks(struct efi_disk_obj *diskobj,
+			u32 media_id, u64 lba,
+			struct efi_block_io2_token *token,
+			efi_uintn_t buffer_size, void *buffer,
+			enum efi_disk_direction direction)
+{
+	struct efi_disk_io2_req *req;
+	efi_status_t ret;
+
+	ret = efi_disk_check_blocks(&diskobj->media, media_id, lba,
+				    buffer_size, buffer);
+	if (ret != EFI_SUCCESS)
+		return ret;
+	if (buffer_size & (diskobj->media.block_size - 1))
+		return EFI_BAD_BUFFER_SIZE;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return EFI_OUT_OF_RESOURCES;
+	req->diskobj = diskobj;
+	req->token = token;
+	req->lba = lba;
+	req->blocks = buffer_size / diskobj->media.block_size;
+	req->buffer = buffer;
+	req->direction = direction;
+	list_add_tail(&req->link, &efi_disk_io2_queue);
+
+	/* Without a timer the request is carried out at once */
+	if (efi_disk_io2_start() != EFI_SUCCESS)
+		efi_disk_io2_finish(diskobj, false);
+
+	return EFI_SUCCESS;
+}
+
+/**
+ * efi_disk_read_blocks_ex() - reads blocks from device
+ *
+ * This function implements the ReadBlocksEx service of the
+ * EFI_BLOCK_IO2_PROTOCOL.
+ *
+ * If a token with an event is passed, the request is queued and carried out
+ * in the following timer cycles. Otherwise the blocks are read at once.
+ *
+ * See the Unified Extensible Firmware Interface (UEFI) specification for
+ * details.
+ *
+ * @this:			pointer to the BLOCK_IO2_PROTOCOL
+ * @media_id:			id of the medium to be read from
+ * @lba:			starting logical block for reading
+ * @token:			token signaled when the read is complete
+ * @buffer_size:		size of the read buffer
+ * @buffer:			pointer to the destination buffer
+ * Return:			status code
+ */
+static efi_status_t EFIAPI efi_disk_read_blocks_ex(struct efi_block_io2 *this,
+			u32 media_id, u64 lba,
+			struct efi_block_io2_token *token,
+			efi_uintn_t buffer_size, void *buffer)
+{
+	struct efi_disk_obj *diskobj;
+	efi_status_t ret;
+
+	if (!this)
+		return EFI_INVALID_PARAMETER;
+	diskobj = container_of(this, struct efi_disk_obj, ops2);
+	if (!token || !token->event)
+		return efi_disk_read_blocks(&diskobj->ops, media_id, lba,
+					    buffer_size, buffer);
+
+	EFI_ENTRY("%p, %x, %llx, %p, %zx, %p", this, media_id, lba, token,
+		  buffer_size, buffer);
+
+	ret = efi_disk_queue_blocks(diskobj, media_id, lba, token, buffer_size,
+				    buffer, EFI_DISK_READ);
+
+	return EFI_EXIT(ret);
+}
+
+/**
+ * efi_disk_write_blocks_ex() - writes blocks to device
+ *
+ * This function implements the WriteBlocksEx service of the
+ * EFI_BLOCK_IO2_PROTOCOL.
+ *
+ * If a token with an event is passed, the request is queued and carried out
+ * in the following timer cycles. Otherwise the blocks are written at once.
+ *
+ * See the Unified Extensible Firmware Interface (UEFI) specification for
+ * details.
+ *
+ * @this:			pointer to the BLOCK_IO2_PROTOCOL
+ * @media_id:			id of the medium to be written to
+ * @lba:			starting logical block for writing
+ * @token:			token signaled when the write is complete
+ * @buffer_size:		size of the write buffer
+ * @buffer:			pointer to the source buffer
+ * Return:			status code
+ */
+static efi_status_t EFIAPI efi_disk_write_blocks_ex(struct efi_block_io2 *this,
+			u32 media_id, u64 lba,
+			struct efi_block_io2_token *token,
+			efi_uintn_t buffer_size, void *buffer)
+{
+	struct efi_disk_obj *diskobj;
+	efi_status_t ret;
+
+	if (!this)
+		return EFI_INVALID_PARAMETER;
+	diskobj = container_of(this, struct efi_disk_obj, ops2);
+	if (!token || !token->event)
+		return efi_disk_write_blocks(&diskobj->ops, media_id, lba,
+					     buffer_size, buffer);
+
+	EFI_ENTRY("%p, %x, %llx, %p, %zx, %p", this, media_id, lba, token,
+		  buffer_size, buffer);
+
+	if (this->media->read_only)
+		ret = EFI_WRITE_PROTECTED;
+	else
+		ret = efi_disk_queue_blocks(diskobj, media_id, lba, token,
+					    buffer_size, buffer,
+					    EFI_DISK_WRITE);
+
+	return EFI_EXIT(ret);
+}
+
+/**
+ * efi_disk_flush_blocks_ex() - flushes modified data to the device
+ *
+ * This function implements the FlushBlocksEx service of the
+ * EFI_BLOCK_IO2_PROTOCOL.
+ *
+ * The requests queued for the device are completed before returning.
+ *
+ * See the Unified Extensible Firmware Interface (UEFI) specification for
+ * details.
+ *
+ * @this:			pointer to the BLOCK_IO2_PROTOCOL
+ * @token:			token signaled when the flush is complete
+ * Return:			status code
+ */
+static efi_status_t EFIAPI efi_disk_flush_blocks_ex(struct efi_block_io2 *this,
+			struct efi_block_io2_token *token)
+{
+	EFI_ENTRY("%p, %p", this, token);
+
+	if (!this)
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+	efi_disk_io2_finish(container_of(this, struct efi_disk_obj, ops2),
+			    false);
+	if (token && token->event) {
+		token->transaction_status = EFI_SUCCESS;
+		efi_signal_event(token->event);
+	}
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static const struct efi_block_io2 block_io2_disk_template = {
+	.reset = &efi_disk_reset_ex,
+	.read_blocks_ex = &efi_disk_read_blocks_ex,
+	.write_blocks_ex = &efi_disk_write_blocks_ex,
+	.flush_blocks_ex = &efi_disk_flush_blocks_ex,
+};
+
 /**
  * efi_fs_from_path() - retrieve simple file system protocol
  *
@@ -475,6 +941,7 @@ static efi_status_t efi_disk_add_dev(
 					&handle,
 					&efi_guid_device_path, diskobj->dp,
 					&efi_block_io_guid, &diskobj->ops,
+					&efi_block_io2_guid, &diskobj->ops2,
 					/*
 					 * esp_guid must be last entry as it
 					 * can be NULL. Its interface is NULL.
@@ -504,6 +971,7 @@ static efi_status_t efi_disk_add_dev(
 			goto error;
 	}
 	diskobj->ops = block_io_disk_template;
+	diskobj->ops2 = block_io2_disk_template;
 
 	/* Fill in EFI IO Media info (for read/write callbacks) */
 	diskobj->media.removable_media = desc->removable;
@@ -518,6 +986,7 @@ static efi_status_t efi_disk_add_dev(
 	if (part)
 		diskobj->media.logical_partition = 1;
 	diskobj->ops.media = &diskobj->media;
+	diskobj->ops2.media = &diskobj->media;
 	if (disk)
 		*disk = diskobj;
 
@@ -754,6 +1223,7 @@ int efi_disk_remove(void *ctx, struct event *event)
 	dp = diskobj->dp;
 	volume = diskobj->volume;
 
+	efi_disk_io2_finish(diskobj, false);
 	ret = efi_delete_handle(handle);
 	/* Do not delete DM device if there are still EFI drivers attached. */
 	if (ret != EFI_SUCCESS)
@@ -38,6 +38,9 @@ struct file_handle {
 	struct fs_dir_stream *dirs;
 	struct fs_dirent *dent;
 
+	/* for reading a file, opened on the first read: */
+	struct fs_file *file;
+
 	char path[0];
 };
 #define to_fh(x) container_of(x, struct file_handle, base)
@@ -366,6 +369,7 @@ out:
 static efi_status_t file_close(struct file_handle *fh)
 {
 	fs_closedir(fh->dirs);
+	fs_closefile(fh->file);
 	free(fh);
 	return EFI_SUCCESS;
 }
@@ -460,25 +464,28 @@ static efi_status_t file_read(struct file_handle *fh, u64 *buffer_size,
 {
 	loff_t actread;
 	efi_status_t ret;
-	loff_t file_size;
 
 	if (!buffer) {
 		ret = EFI_INVALID_PARAMETER;
 		return ret;
 	}
 
-	ret = efi_get_file_size(fh, &file_size);
-	if (ret != EFI_SUCCESS)
-		return ret;
-	if (file_size < fh->offset) {
-		ret = EFI_DEVICE_ERROR;
-		return ret;
+	/*
+	 * Keep the file open, so that each read does not need to probe the
+	 * file system and look up the file again
+	 */
+	if (!fh->file) {
+		if (set_blk_dev(fh))
+			return EFI_DEVICE_ERROR;
+		fh->file = fs_openfile(fh->path);
+		if (!fh->file)
+			return EFI_DEVICE_ERROR;
 	}
 
-	if (set_blk_dev(fh))
+	if (fs_pread(fh->file, buffer, fh->offset, *buffer_size, &actread))
 		return EFI_DEVICE_ERROR;
-	if (fs_read(fh->path, map_to_sysmem(buffer), fh->offset,
-		    *buffer_size, &actread))
+	/* The size is only up to date after reading */
+	if (fh->file->size < fh->offset)
 		return EFI_DEVICE_ERROR;
 
 	*buffer_size = actread;
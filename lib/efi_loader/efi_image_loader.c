@@ -15,10 +15,14 @@
 #include <malloc.h>
 #include <pe.h>
 #include <sort.h>
+#include <linux/sizes.h>
 #include <crypto/mscode.h>
 #include <crypto/pkcs7_parser.h>
 #include <linux/err.h>
 
+/* Amount of data digested before copying it while it is still cached */
+#define EFI_IMAGE_HASH_CHUNK	SZ_32K
+
 const efi_guid_t efi_global_variable_guid = EFI_GLOBAL_VARIABLE_GUID;
 const efi_guid_t efi_guid_device_path = EFI_DEVICE_PATH_PROTOCOL_GUID;
 const efi_guid_t efi_guid_loaded_image = EFI_LOADED_IMAGE_PROTOCOL_GUID;
@@ -456,9 +460,13 @@ bool efi_image_parse(void *efi, size_t len, struct efi_image_regions **regp,
 			continue;
 
 		size = (sorted[i]->SizeOfRawData + align - 1) & ~(align - 1);
-		efi_image_region_add(regs, efi + sorted[i]->PointerToRawData,
-				     efi + sorted[i]->PointerToRawData + size,
-				     0);
+		/* The section is still loaded, but it is not hashed */
+		if (efi_image_region_add(regs,
+					 efi + sorted[i]->PointerToRawData,
+					 efi + sorted[i]->PointerToRawData + size,
+					 0) != EFI_SUCCESS)
+			log_warning("%s: section %.8s not hashed\n", __func__,
+				    sorted[i]->Name);
 		log_debug("section[%d](%s): raw: 0x%x-0x%x, virt: %x-%x\n",
 			  i, sorted[i]->Name,
 			  sorted[i]->PointerToRawData,
@@ -510,6 +518,65 @@ err:
 	return false;
 }
 
+/**
+ * struct efi_image_auth - PE image prepared for authentication
+ *
+ * @efi:		8-byte aligned image, a copy if the image is not aligned
+ * @regs:		regions of @efi to digest, NULL if not parsed
+ * @wincerts:		certificate table in @efi
+ * @wincerts_len:	size of @wincerts
+ */
+struct efi_image_auth {
+	void *efi;
+	struct efi_image_regions *regs;
+	WIN_CERTIFICATE *wincerts;
+	size_t wincerts_len;
+};
+
+/**
+ * efi_image_auth_prepare() - prepare an image for authentication
+ * @image:	on return data for authenticating the image
+ * @efi:	Pointer to image
+ * @efi_size:	Size of @efi
+ *
+ * Parse the regions of the image to digest if secure boot is enabled.
+ * Digesting them is left to efi_load_pe(), which hashes the sections
+ * while copying them.
+ */
+static void efi_image_auth_prepare(struct efi_image_auth *image, void *efi,
+				   size_t efi_size)
+{
+	u64 new_efi_size = efi_size;
+
+	memset(image, 0, sizeof(*image));
+	image->efi = efi;
+
+	if (!IS_ENABLED(CONFIG_EFI_SECURE_BOOT) || !efi_secure_boot_enabled())
+		return;
+
+	image->efi = efi_prepare_aligned_image(efi, &new_efi_size);
+	if (!image->efi) {
+		image->efi = efi;
+		return;
+	}
+
+	if (!efi_image_parse(image->efi, new_efi_size, &image->regs,
+			     &image->wincerts, &image->wincerts_len))
+		log_err("Parsing PE executable image failed\n");
+}
+
+/**
+ * efi_image_auth_free() - release data for authenticating an image
+ * @image:	data prepared by efi_image_auth_prepare()
+ * @efi:	Pointer to image
+ */
+static void efi_image_auth_free(struct efi_image_auth *image, void *efi)
+{
+	free(image->regs);
+	if (image->efi != efi)
+		free(image->efi);
+}
+
 #ifdef CONFIG_EFI_SECURE_BOOT
 /**
  * efi_image_verify_digest - verify image's message digest
@@ -544,9 +611,7 @@ static bool efi_image_verify_digest(struct efi_image_regions *regs,
 		return false;
 
 	/* calculate a hash value of PE image */
-	hash = NULL;
-	if (!efi_hash_regions(regs->reg, regs->num, &hash, ctx.digest_algo,
-			      &hash_len))
+	if (!efi_image_regions_hash(regs, ctx.digest_algo, &hash, &hash_len))
 		return false;
 
 	/* match the digest */
@@ -558,8 +623,7 @@ static bool efi_image_verify_digest(struct efi_image_regions *regs,
 
 /**
  * efi_image_authenticate() - verify a signature of signed image
- * @efi:	Pointer to image
- * @efi_size:	Size of @efi
+ * @auth:	Image prepared by efi_image_auth_prepare()
  *
  * A signed image should have its signature stored in a table of its PE header.
  * So if an image is signed and only if if its signature is verified using
@@ -577,16 +641,14 @@ static bool efi_image_verify_digest(struct efi_image_regions *regs,
  *
  * Return:	true if authenticated, false if not
  */
-static bool efi_image_authenticate(void *efi, size_t efi_size)
+static bool efi_image_authenticate(struct efi_image_auth *image)
 {
-	struct efi_image_regions *regs = NULL;
-	WIN_CERTIFICATE *wincerts = NULL, *wincert;
-	size_t wincerts_len;
+	struct efi_image_regions *regs = image->regs;
+	WIN_CERTIFICATE *wincerts = image->wincerts, *wincert;
+	size_t wincerts_len = image->wincerts_len;
 	struct pkcs7_message *msg = NULL;
 	struct efi_signature_store *db = NULL, *dbx = NULL;
-	void *new_efi = NULL;
 	u8 *auth, *wincerts_end;
-	u64 new_efi_size = efi_size;
 	size_t auth_size;
 	bool ret = false;
 
@@ -595,16 +657,9 @@ static bool efi_image_authenticate(void *efi, size_t efi_size)
 	if (!efi_secure_boot_enabled())
 		return true;
 
-	new_efi = efi_prepare_aligned_image(efi, &new_efi_size);
-	if (!new_efi)
+	if (!regs)
 		return false;
 
-	if (!efi_image_parse(new_efi, new_efi_size, &regs, &wincerts,
-			     &wincerts_len)) {
-		log_err("Parsing PE executable image failed\n");
-		goto out;
-	}
-
 	/*
 	 * verify signature using db and dbx
 	 */
@@ -746,15 +801,12 @@ out:
 	efi_sigstore_free(db);
 	efi_sigstore_free(dbx);
 	pkcs7_free_message(msg);
-	free(regs);
-	if (new_efi != efi)
-		free(new_efi);
 
 	log_debug("%s: Exit, %d\n", __func__, ret);
 	return ret;
 }
 #else
-static bool efi_image_authenticate(void *efi, size_t efi_size)
+static bool efi_image_authenticate(struct efi_image_auth *image)
 {
 	return true;
 }
@@ -816,11 +868,195 @@ static u32 section_size(IMAGE_SECTION_HEADER *sec)
 		return sec->SizeOfRawData;
 }
 
+/**
+ * efi_image_hash_copy() - add data to a digest and copy it
+ *
+ * The data is processed in chunks, so that each chunk is copied while it is
+ * still in the cache after hashing it.
+ *
+ * @algo:	hash algorithm
+ * @ctx:	hash context
+ * @dst:	destination, NULL to only hash the data
+ * @src:	source
+ * @size:	number of bytes
+ * Return:	0 on success, negative error code otherwise
+ */
+static int efi_image_hash_copy(struct hash_algo *algo, void *ctx, void *dst,
+			       const void *src, size_t size)
+{
+	size_t len;
+	int ret;
+
+	for (; size; size -= len, src += len) {
+		len = min_t(size_t, size, EFI_IMAGE_HASH_CHUNK);
+		ret = algo->hash_update(algo, ctx, src, len, 0);
+		if (ret)
+			return ret;
+		if (dst) {
+			memcpy(dst, src, len);
+			dst += len;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * efi_image_region_starts() - check if a region starts at an address
+ *
+ * @regs:	regions
+ * @data:	address
+ * Return:	true if a region starts at @data
+ */
+static bool efi_image_region_starts(struct efi_image_regions *regs,
+				    const void *data)
+{
+	int i;
+
+	for (i = 0; i < regs->num; i++) {
+		if (regs->reg[i].data == data)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * efi_image_hash_sections() - copy sections and digest the image in one pass
+ *
+ * The regions of the image are hashed in order. The raw data of each section
+ * is copied to its place while it is hashed. Sections without a region of
+ * their own are copied afterwards. On success the SHA-256 digest is cached in
+ * @regs.
+ *
+ * @efi_reloc:		memory the image is loaded to
+ * @efi:		image
+ * @sections:		section headers
+ * @num_sections:	number of sections
+ * @regs:		regions of @efi to digest
+ * Return:		true on success
+ */
+static bool efi_image_hash_sections(void *efi_reloc, void *efi,
+				    IMAGE_SECTION_HEADER *sections,
+				    int num_sections,
+				    struct efi_image_regions *regs)
+{
+	const char *hash_algo = "sha256";
+	struct hash_algo *algo;
+	void *ctx;
+	int i, j, ret;
+
+	if (hash_progressive_lookup_algo(hash_algo, &algo) ||
+	    algo->digest_size > sizeof(regs->hash) ||
+	    algo->hash_init(algo, &ctx))
+		return false;
+
+	for (i = 0; i < regs->num; i++) {
+		const void *data = regs->reg[i].data;
+		size_t size = regs->reg[i].size;
+		IMAGE_SECTION_HEADER *sec = NULL;
+		u32 copy_size = 0;
+
+		for (j = 0; j < num_sections; j++) {
+			if (sections[j].SizeOfRawData &&
+			    efi + sections[j].PointerToRawData == data) {
+				sec = &sections[j];
+				copy_size = min(section_size(sec),
+						sec->SizeOfRawData);
+				break;
+			}
+		}
+
+		ret = efi_image_hash_copy(algo, ctx,
+					  sec ? efi_reloc + sec->VirtualAddress
+					      : NULL,
+					  data, copy_size);
+		if (!ret)
+			ret = efi_image_hash_copy(algo, ctx, NULL,
+						  data + copy_size,
+						  size - copy_size);
+		if (ret) {
+			free(ctx);
+			return false;
+		}
+
+		/* Sections sharing their raw data */
+		for (j++; sec && j < num_sections; j++) {
+			if (sections[j].PointerToRawData ==
+			    sec->PointerToRawData)
+				memcpy(efi_reloc + sections[j].VirtualAddress,
+				       data, min(section_size(&sections[j]),
+						 sections[j].SizeOfRawData));
+		}
+	}
+
+	/* Sections whose region was rejected when parsing the image */
+	for (j = 0; j < num_sections; j++) {
+		IMAGE_SECTION_HEADER *sec = &sections[j];
+
+		if (sec->SizeOfRawData &&
+		    !efi_image_region_starts(regs, efi + sec->PointerToRawData))
+			memcpy(efi_reloc + sec->VirtualAddress,
+			       efi + sec->PointerToRawData,
+			       min(section_size(sec), sec->SizeOfRawData));
+	}
+
+	if (algo->hash_finish(algo, ctx, regs->hash, algo->digest_size))
+		return false;
+	regs->hash_algo = hash_algo;
+	regs->hash_len = algo->digest_size;
+
+	return true;
+}
+
+/**
+ * efi_image_load_sections() - load the sections of an image into memory
+ *
+ * If @regs is provided, the image is digested while its sections are copied.
+ *
+ * @efi_reloc:		memory the image is loaded to
+ * @efi:		image
+ * @sections:		section headers
+ * @num_sections:	number of sections
+ * @regs:		regions of @efi to digest or NULL
+ */
+static void efi_image_load_sections(void *efi_reloc, void *efi,
+				    IMAGE_SECTION_HEADER *sections,
+				    int num_sections,
+				    struct efi_image_regions *regs)
+{
+	int i;
+
+	/* Zero the parts of sections not backed by raw data */
+	for (i = num_sections - 1; i >= 0; i--) {
+		IMAGE_SECTION_HEADER *sec = &sections[i];
+		u32 copy_size = min(section_size(sec), sec->SizeOfRawData);
+
+		if (sec->Misc.VirtualSize > copy_size)
+			memset(efi_reloc + sec->VirtualAddress + copy_size, 0,
+			       sec->Misc.VirtualSize - copy_size);
+	}
+
+	if (regs && efi_image_hash_sections(efi_reloc, efi, sections,
+					    num_sections, regs))
+		return;
+
+	for (i = num_sections - 1; i >= 0; i--) {
+		IMAGE_SECTION_HEADER *sec = &sections[i];
+
+		memcpy(efi_reloc + sec->VirtualAddress,
+		       efi + sec->PointerToRawData,
+		       min(section_size(sec), sec->SizeOfRawData));
+	}
+}
+
 /**
  * efi_load_pe() - relocate EFI binary
  *
  * This function loads all sections from a PE binary into a newly reserved
  * piece of memory. On success the entry point is returned as handle->entry.
+ * If secure boot is enabled, the image is digested while loading its
+ * sections and authenticated afterwards.
  *
  * @handle:		loaded image handle
  * @efi:		pointer to the EFI binary
@@ -835,6 +1071,7 @@ efi_status_t efi_load_pe(struct efi_loaded_image_obj *handle,
 	IMAGE_NT_HEADERS32 *nt;
 	IMAGE_DOS_HEADER *dos;
 	IMAGE_SECTION_HEADER *sections;
+	struct efi_image_auth auth;
 	int num_sections;
 	void *efi_reloc;
 	int i;
@@ -874,13 +1111,7 @@ efi_status_t efi_load_pe(struct efi_loaded_image_obj *handle,
 		return EFI_LOAD_ERROR;
 	}
 
-	/* Authenticate an image */
-	if (efi_image_authenticate(efi, efi_size)) {
-		handle->auth_status = EFI_IMAGE_AUTH_PASSED;
-	} else {
-		handle->auth_status = EFI_IMAGE_AUTH_FAILED;
-		log_err("Image not authenticated\n");
-	}
+	efi_image_auth_prepare(&auth, efi, efi_size);
 
 	/* Calculate upper virtual address boundary */
 	for (i = num_sections - 1; i >= 0; i--) {
@@ -953,19 +1184,8 @@ efi_status_t efi_load_pe(struct efi_loaded_image_obj *handle,
 		 + num_sections * sizeof(IMAGE_SECTION_HEADER));
 
 	/* Load sections into RAM */
-	for (i = num_sections - 1; i >= 0; i--) {
-		IMAGE_SECTION_HEADER *sec = &sections[i];
-		u32 copy_size = section_size(sec);
-
-		if (copy_size > sec->SizeOfRawData) {
-			copy_size = sec->SizeOfRawData;
-			memset(efi_reloc + sec->VirtualAddress, 0,
-			       sec->Misc.VirtualSize);
-		}
-		memcpy(efi_reloc + sec->VirtualAddress,
-		       efi + sec->PointerToRawData,
-		       copy_size);
-	}
+	efi_image_load_sections(efi_reloc, auth.efi, sections, num_sections,
+				auth.regs);
 
 	/* Run through relocations */
 	if (efi_loader_relocate(rel, rel_size, efi_reloc,
@@ -991,11 +1211,17 @@ efi_status_t efi_load_pe(struct efi_loaded_image_obj *handle,
 	loaded_image_info->image_base = efi_reloc;
 	loaded_image_info->image_size = virt_size;
 
-	if (handle->auth_status == EFI_IMAGE_AUTH_PASSED)
-		return EFI_SUCCESS;
-	else
-		return EFI_SECURITY_VIOLATION;
+	/* Authenticate an image */
+	if (efi_image_authenticate(&auth)) {
+		handle->auth_status = EFI_IMAGE_AUTH_PASSED;
+		ret = EFI_SUCCESS;
+	} else {
+		handle->auth_status = EFI_IMAGE_AUTH_FAILED;
+		log_err("Image not authenticated\n");
+		ret = EFI_SECURITY_VIOLATION;
+	}
 
 err:
+	efi_image_auth_free(&auth, efi);
 	return ret;
 }
@@ -16,6 +16,7 @@
 #include <asm/cache.h>
 #include <asm/global_data.h>
 #include <asm/sections.h>
+#include <linux/bitops.h>
 #include <linux/list_sort.h>
 #include <linux/sizes.h>
 
@@ -50,9 +51,10 @@ void *efi_bounce_buffer;
  * @checksum:	checksum
  * @data:	allocated pool memory
  *
- * U-Boot services each UEFI AllocatePool() request as a separate
- * (multiple) page allocation. We have to track the number of pages
- * to be able to free the correct amount later.
+ * U-Boot services each UEFI AllocatePool() request which is too large for
+ * the pool pages (see struct efi_pool_page) as a separate (multiple) page
+ * allocation. We have to track the number of pages to be able to free the
+ * correct amount later.
  *
  * The checksum calculated in function checksum() is used in FreePool() to avoid
  * freeing memory not allocated by AllocatePool() and duplicate freeing.
@@ -628,6 +630,254 @@ void *efi_alloc_aligned_pages(u64 len, int memory_type, size_t align)
 	return (void *)(uintptr_t)aligned_mem;
 }
 
+/*
+ * Small pool allocations are carved out of pool pages rather than taking a
+ * page allocation, and so a memory map entry, each. Every memory type has its
+ * own arena, which gets pages from efi_allocate_pages() in runs of
+ * EFI_POOL_RUN_PAGES, so that a run shows up as one entry in the memory map.
+ * A page in use holds objects of a single size class.
+ */
+#define EFI_POOL_RUN_PAGES	16
+#define EFI_POOL_CLASSES	5
+#define EFI_POOL_MIN_SIZE	64
+#define EFI_POOL_MAX_SIZE	(EFI_POOL_MIN_SIZE << (EFI_POOL_CLASSES - 1))
+
+/**
+ * struct efi_pool_page - header of a page holding pool objects
+ *
+ * @num_pages:	always 0, which tells a pool page apart from a page
+ *		allocation; it shares its layout with struct efi_pool_allocation
+ * @checksum:	checksum of the header, see checksum()
+ * @link:	link in the arena's list of partially used or of empty pages
+ * @used:	bitmap of the objects in use
+ * @run:	address of the first page of the run holding this page
+ * @run_pages:	number of pages in the run, only set in its first page
+ * @run_free:	number of empty pages in the run, only set in its first page
+ * @cls:	size class of the objects
+ * @type:	memory type of the page, which selects the arena
+ */
+struct efi_pool_page {
+	u64 num_pages;
+	u64 checksum;
+	struct list_head link;
+	u64 used;
+	u64 run;
+	u16 run_pages;
+	u16 run_free;
+	u8 cls;
+	u32 type;
+};
+
+/* Offset of the first object in a pool page */
+#define EFI_POOL_PAGE_HDR	ALIGN(sizeof(struct efi_pool_page), \
+				      ARCH_DMA_MINALIGN)
+
+/**
+ * struct efi_pool_arena - pool pages of one memory type
+ *
+ * @partial:	pages of each size class with at least one free object
+ * @free_pages:	pages not holding any object
+ * @free_count:	number of pages in @free_pages
+ */
+struct efi_pool_arena {
+	struct list_head partial[EFI_POOL_CLASSES];
+	struct list_head free_pages;
+	uint free_count;
+};
+
+static struct efi_pool_arena efi_pool[EFI_PERSISTENT_MEMORY_TYPE];
+
+/* Objects are aligned like the data of struct efi_pool_allocation */
+static efi_uintn_t efi_pool_size(uint cls)
+{
+	return ALIGN(EFI_POOL_MIN_SIZE << cls, ARCH_DMA_MINALIGN);
+}
+
+static uint efi_pool_count(uint cls)
+{
+	return (EFI_PAGE_SIZE - EFI_POOL_PAGE_HDR) / efi_pool_size(cls);
+}
+
+static u64 efi_pool_full(uint cls)
+{
+	return GENMASK_ULL(efi_pool_count(cls) - 1, 0);
+}
+
+static struct efi_pool_page *efi_pool_run(struct efi_pool_page *page)
+{
+	return (struct efi_pool_page *)(uintptr_t)page->run;
+}
+
+/**
+ * efi_pool_arena() - get the arena for a memory type
+ *
+ * @type:	memory type
+ * Return:	arena, or NULL if pool allocations of @type take whole pages
+ */
+static struct efi_pool_arena *efi_pool_arena(enum efi_memory_type type)
+{
+	struct efi_pool_arena *arena;
+	int i;
+
+	if (type >= EFI_PERSISTENT_MEMORY_TYPE ||
+	    type == EFI_CONVENTIONAL_MEMORY)
+		return NULL;
+
+	arena = &efi_pool[type];
+	if (!arena->free_pages.next) {
+		for (i = 0; i < EFI_POOL_CLASSES; i++)
+			INIT_LIST_HEAD(&arena->partial[i]);
+		INIT_LIST_HEAD(&arena->free_pages);
+	}
+
+	return arena;
+}
+
+/**
+ * efi_pool_grow() - add a run of empty pages to an arena
+ *
+ * @arena:	arena
+ * @type:	memory type of the arena
+ * Return:	status code
+ */
+static efi_status_t efi_pool_grow(struct efi_pool_arena *arena,
+				  enum efi_memory_type type)
+{
+	struct efi_pool_page *page, *run;
+	uint pages = EFI_POOL_RUN_PAGES;
+	efi_status_t ret;
+	u64 addr;
+	uint i;
+
+	ret = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES, type, pages, &addr);
+	if (ret != EFI_SUCCESS) {
+		/* Memory is short, so make do with a single page */
+		pages = 1;
+		ret = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES, type, pages,
+					 &addr);
+		if (ret != EFI_SUCCESS)
+			return ret;
+	}
+
+	for (i = 0; i < pages; i++) {
+		page = (struct efi_pool_page *)(uintptr_t)
+			(addr + ((u64)i << EFI_PAGE_SHIFT));
+		page->num_pages = 0;
+		page->checksum = checksum((struct efi_pool_allocation *)page);
+		page->run = addr;
+		page->type = type;
+		list_add_tail(&page->link, &arena->free_pages);
+	}
+	run = (struct efi_pool_page *)(uintptr_t)addr;
+	run->run_pages = pages;
+	run->run_free = pages;
+	arena->free_count += pages;
+
+	return EFI_SUCCESS;
+}
+
+/**
+ * efi_pool_alloc() - allocate a small object from pool pages
+ *
+ * @arena:	arena of the memory type
+ * @type:	memory type
+ * @size:	number of bytes to be allocated, at most EFI_POOL_MAX_SIZE
+ * Return:	allocated memory or NULL
+ */
+static void *efi_pool_alloc(struct efi_pool_arena *arena,
+			    enum efi_memory_type type, efi_uintn_t size)
+{
+	struct efi_pool_page *page;
+	uint cls, idx;
+
+	for (cls = 0; efi_pool_size(cls) < size; cls++)
+		;
+
+	page = list_first_entry_or_null(&arena->partial[cls],
+					struct efi_pool_page, link);
+	if (!page) {
+		if (list_empty(&arena->free_pages) &&
+		    efi_pool_grow(arena, type) != EFI_SUCCESS)
+			return NULL;
+		page = list_first_entry(&arena->free_pages,
+					struct efi_pool_page, link);
+		list_move(&page->link, &arena->partial[cls]);
+		page->cls = cls;
+		page->used = 0;
+		efi_pool_run(page)->run_free--;
+		arena->free_count--;
+	}
+
+	idx = __ffs64(~page->used);
+	page->used |= BIT_ULL(idx);
+
+	/* Drop a full page from the partial list until an object is freed */
+	if (page->used == efi_pool_full(cls))
+		list_del_init(&page->link);
+
+	return (void *)page + EFI_POOL_PAGE_HDR + idx * efi_pool_size(cls);
+}
+
+/**
+ * efi_pool_release() - give an empty run back to the memory map
+ *
+ * @arena:	arena holding the run
+ * @run:	first page of the run
+ */
+static void efi_pool_release(struct efi_pool_arena *arena,
+			     struct efi_pool_page *run)
+{
+	struct efi_pool_page *page;
+	uint i, pages = run->run_pages;
+
+	for (i = 0; i < pages; i++) {
+		page = (void *)run + ((ulong)i << EFI_PAGE_SHIFT);
+		list_del(&page->link);
+		page->checksum = 0;
+	}
+	arena->free_count -= pages;
+	efi_free_pages((uintptr_t)run, pages);
+}
+
+/**
+ * efi_pool_free() - free an object in a pool page
+ *
+ * Once all pages of a run are empty, the run is given back unless it is all
+ * that the arena has left, so that a caller allocating and freeing a single
+ * object does not change the memory map each time.
+ *
+ * @page:	pool page holding @buffer
+ * @buffer:	object to be freed
+ * Return:	status code
+ */
+static efi_status_t efi_pool_free(struct efi_pool_page *page, void *buffer)
+{
+	struct efi_pool_arena *arena = &efi_pool[page->type];
+	ulong offset = buffer - (void *)page - EFI_POOL_PAGE_HDR;
+	efi_uintn_t size = efi_pool_size(page->cls);
+	struct efi_pool_page *run;
+	uint idx = offset / size;
+
+	if (buffer < (void *)page + EFI_POOL_PAGE_HDR || offset % size ||
+	    idx >= efi_pool_count(page->cls) || !(page->used & BIT_ULL(idx)))
+		return EFI_INVALID_PARAMETER;
+
+	if (page->used == efi_pool_full(page->cls))
+		list_add(&page->link, &arena->partial[page->cls]);
+	page->used &= ~BIT_ULL(idx);
+	if (page->used)
+		return EFI_SUCCESS;
+
+	list_move(&page->link, &arena->free_pages);
+	arena->free_count++;
+	run = efi_pool_run(page);
+	if (++run->run_free == run->run_pages &&
+	    arena->free_count > run->run_pages)
+		efi_pool_release(arena, run);
+
+	return EFI_SUCCESS;
+}
+
 /**
  * efi_allocate_pool - allocate memory from pool
  *
@@ -641,6 +891,7 @@ efi_status_t efi_allocate_pool(enum efi_memory_type pool_type, efi_uintn_t size,
 	efi_status_t r;
 	u64 addr;
 	struct efi_pool_allocation *alloc;
+	struct efi_pool_arena *arena;
 	u64 num_pages = efi_size_in_pages(size +
 					  sizeof(struct efi_pool_allocation));
 
@@ -652,6 +903,13 @@ efi_status_t efi_allocate_pool(enum efi_memory_type pool_type, efi_uintn_t size,
 		return EFI_SUCCESS;
 	}
 
+	arena = efi_pool_arena(pool_type);
+	if (arena && size <= EFI_POOL_MAX_SIZE) {
+		*buffer = efi_pool_alloc(arena, pool_type, size);
+
+		return *buffer ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+	}
+
 	r = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES, pool_type, num_pages,
 			       &addr);
 	if (r == EFI_SUCCESS) {
@@ -704,6 +962,15 @@ efi_status_t efi_free_pool(void *buffer)
 	if (ret != EFI_SUCCESS)
 		return ret;
 
+	/* Small objects live in a pool page, whose header has no page count */
+	alloc = (void *)((uintptr_t)buffer & ~EFI_PAGE_MASK);
+	if (!alloc->num_pages && alloc->checksum == checksum(alloc)) {
+		ret = efi_pool_free((struct efi_pool_page *)alloc, buffer);
+		if (ret != EFI_SUCCESS)
+			printf("%s: illegal free 0x%p\n", __func__, buffer);
+		return ret;
+	}
+
 	alloc = container_of(buffer, struct efi_pool_allocation, data);
 
 	/* Check that this memory was allocated by efi_allocate_pool() */
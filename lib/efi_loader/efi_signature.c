@@ -10,6 +10,7 @@
 #include <image.h>
 #include <hexdump.h>
 #include <malloc.h>
+#include <sort.h>
 #include <crypto/pkcs7.h>
 #include <crypto/pkcs7_parser.h>
 #include <crypto/public_key.h>
@@ -158,6 +159,42 @@ bool efi_hash_regions(struct image_region *regs, int count,
 	return true;
 }
 
+/**
+ * efi_image_regions_hash - get the hash value of image regions
+ * @regs:	List of regions
+ * @hash_algo:	Hash algorithm
+ * @hash:	Pointer to a pointer to buffer holding a hash value
+ * @len:	Size of the hash value to be returned
+ *
+ * The hash value is calculated only once per algorithm and kept in @regs.
+ * The returned buffer belongs to @regs and must not be freed.
+ *
+ * Return:	true on success, false on error
+ */
+bool efi_image_regions_hash(struct efi_image_regions *regs,
+			    const char *hash_algo, void **hash, int *len)
+{
+	void *buf = regs->hash;
+
+	if (!hash_algo)
+		return false;
+
+	if (!regs->hash_algo || strcmp(regs->hash_algo, hash_algo)) {
+		regs->hash_algo = NULL;
+		if (algo_to_len(hash_algo) > sizeof(regs->hash) ||
+		    !efi_hash_regions(regs->reg, regs->num, &buf, hash_algo,
+				      &regs->hash_len))
+			return false;
+		regs->hash_algo = hash_algo;
+	}
+
+	*hash = regs->hash;
+	if (len)
+		*len = regs->hash_len;
+
+	return true;
+}
+
 /**
  * hash_algo_supported - check if the requested hash algorithm is supported
  * @guid: guid of the algorithm
@@ -182,6 +219,66 @@ static bool hash_algo_supported(const efi_guid_t guid)
 	return true;
 }
 
+/**
+ * efi_sigstore_find - search for a digest in a signature list
+ * @siglist:	Signature list
+ * @hash:	Digest to search for
+ * @len:	Size of @hash
+ *
+ * Search the sorted index of @siglist for an entry whose data starts with
+ * @hash. All entries of a signature list have the same size.
+ *
+ * Return:	matching entry, NULL if not found
+ */
+static struct efi_sig_data *
+efi_sigstore_find(struct efi_signature_store *siglist, const void *hash,
+		  size_t len)
+{
+	struct efi_sig_data *sig_data;
+	size_t low = 0, high = siglist->sig_data_num, mid;
+	int cmp;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		sig_data = siglist->sig_data_index[mid];
+		if (sig_data->size < len)
+			return NULL;
+
+		cmp = memcmp(sig_data->data, hash, len);
+		if (!cmp)
+			return sig_data;
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return NULL;
+}
+
+/**
+ * efi_sig_data_cert - get the x509 certificate of a signature
+ * @sig_data:	Signature of type EFI_CERT_X509_GUID
+ *
+ * The certificate is parsed on first use and kept until the signature
+ * store is freed.
+ *
+ * Return:	certificate, NULL if it cannot be parsed
+ */
+static struct x509_certificate *efi_sig_data_cert(struct efi_sig_data *sig_data)
+{
+	if (!sig_data->cert) {
+		sig_data->cert = x509_cert_parse(sig_data->data,
+						 sig_data->size);
+		if (!sig_data->cert)
+			sig_data->cert = ERR_PTR(-EINVAL);
+	}
+	if (IS_ERR(sig_data->cert))
+		return NULL;
+
+	return sig_data->cert;
+}
+
 /**
  * efi_signature_lookup_digest - search for an image's digest in sigdb
  * @regs:	List of regions to be authenticated
@@ -201,9 +298,8 @@ bool efi_signature_lookup_digest(struct efi_image_regions *regs,
 {
 	struct efi_signature_store *siglist;
 	struct efi_sig_data *sig_data;
-	void *hash = NULL;
+	void *hash;
 	bool found = false;
-	bool hash_done = false;
 
 	EFI_PRINT("%s: Enter, %p, %p\n", __func__, regs, db);
 
@@ -233,31 +329,16 @@ bool efi_signature_lookup_digest(struct efi_image_regions *regs,
 		 * We could check size and hash_algo but efi_hash_regions()
 		 * will do that for us
 		 */
-		if (!hash_done &&
-		    !efi_hash_regions(regs->reg, regs->num, &hash, hash_algo,
-				      &len)) {
+		if (!efi_image_regions_hash(regs, hash_algo, &hash, &len)) {
 			EFI_PRINT("Digesting an image failed\n");
 			break;
 		}
-		hash_done = true;
 
-		for (sig_data = siglist->sig_data_list; sig_data;
-		     sig_data = sig_data->next) {
-#ifdef DEBUG
-			EFI_PRINT("Msg digest in database:\n");
-			print_hex_dump("    ", DUMP_PREFIX_OFFSET, 16, 1,
-				       sig_data->data, sig_data->size, false);
-#endif
-			if (sig_data->size == len &&
-			    !memcmp(sig_data->data, hash, len)) {
-				found = true;
-				free(hash);
-				goto out;
-			}
+		sig_data = efi_sigstore_find(siglist, hash, len);
+		if (sig_data && sig_data->size == len) {
+			found = true;
+			goto out;
 		}
-
-		free(hash);
-		hash = NULL;
 	}
 
 out:
@@ -280,30 +361,15 @@ static bool efi_lookup_certificate(struct x509_certificate *cert,
 {
 	struct efi_signature_store *siglist;
 	struct efi_sig_data *sig_data;
-	struct image_region reg[1];
-	void *hash = NULL, *hash_tmp = NULL;
-	int len = 0;
+	struct x509_certificate *cert_tmp;
 	bool found = false;
-	const char *hash_algo = NULL;
 
 	EFI_PRINT("%s: Enter, %p, %p\n", __func__, cert, db);
 
 	if (!cert || !db || !db->sig_data_list)
 		goto out;
 
-	/*
-	 * TODO: identify a certificate using sha256 digest
-	 * Is there any better way?
-	 */
-	/* calculate hash of TBSCertificate */
-	reg[0].data = cert->tbs;
-	reg[0].size = cert->tbs_size;
-
-	/* We just need any sha256 algo to start the matching */
-	hash_algo = guid_to_sha_str(&efi_guid_sha256);
-	if (!efi_hash_regions(reg, 1, &hash, hash_algo, &len))
-		goto out;
-
+	/* identify a certificate by its TBSCertificate */
 	EFI_PRINT("%s: searching for %s\n", __func__, cert->subject);
 	for (siglist = db; siglist; siglist = siglist->next) {
 		/* only with x509 certificate */
@@ -312,33 +378,20 @@ static bool efi_lookup_certificate(struct x509_certificate *cert,
 
 		for (sig_data = siglist->sig_data_list; sig_data;
 		     sig_data = sig_data->next) {
-			struct x509_certificate *cert_tmp;
-
-			cert_tmp = x509_cert_parse(sig_data->data,
-						   sig_data->size);
-			if (IS_ERR_OR_NULL(cert_tmp))
+			cert_tmp = efi_sig_data_cert(sig_data);
+			if (!cert_tmp)
 				continue;
 
 			EFI_PRINT("%s: against %s\n", __func__,
 				  cert_tmp->subject);
-			reg[0].data = cert_tmp->tbs;
-			reg[0].size = cert_tmp->tbs_size;
-			if (!efi_hash_regions(reg, 1, &hash_tmp, hash_algo,
-					      NULL))
-				goto out;
-
-			x509_free_certificate(cert_tmp);
-
-			if (!memcmp(hash, hash_tmp, len)) {
+			if (cert_tmp->tbs_size == cert->tbs_size &&
+			    !memcmp(cert_tmp->tbs, cert->tbs, cert->tbs_size)) {
 				found = true;
 				goto out;
 			}
 		}
 	}
 out:
-	free(hash);
-	free(hash_tmp);
-
 	EFI_PRINT("%s: Exit, found: %d\n", __func__, found);
 	return found;
 }
@@ -347,7 +400,7 @@ out:
  * efi_verify_certificate - verify certificate's signature with database
  * @signer:	Certificate
  * @db:		Signature database
- * @root:	Certificate to verify @signer
+ * @root:	Certificate to verify @signer, owned by @db
  *
  * Determine if certificate pointed to by @signer may be verified
  * by one of certificates in signature database pointed to by @db.
@@ -376,8 +429,8 @@ static bool efi_verify_certificate(struct x509_certificate *signer,
 
 		for (sig_data = siglist->sig_data_list; sig_data;
 		     sig_data = sig_data->next) {
-			cert = x509_cert_parse(sig_data->data, sig_data->size);
-			if (IS_ERR_OR_NULL(cert)) {
+			cert = efi_sig_data_cert(sig_data);
+			if (!cert) {
 				EFI_PRINT("Cannot parse x509 certificate\n");
 				continue;
 			}
@@ -388,11 +441,8 @@ static bool efi_verify_certificate(struct x509_certificate *signer,
 				verified = true;
 				if (root)
 					*root = cert;
-				else
-					x509_free_certificate(cert);
 				goto out;
 			}
-			x509_free_certificate(cert);
 		}
 	}
 
@@ -427,7 +477,7 @@ static bool efi_signature_check_revocation(struct pkcs7_signed_info *sinfo,
 	int len = 0;
 	time64_t revoc_time;
 	bool revoked = false;
-	const char *hash_algo = NULL;
+	const char *hash_algo, *hashed_algo = NULL;
 
 	EFI_PRINT("%s: Enter, %p, %p, %p\n", __func__, sinfo, cert, dbx);
 
@@ -440,48 +490,40 @@ static bool efi_signature_check_revocation(struct pkcs7_signed_info *sinfo,
 		if (!hash_algo)
 			continue;
 
-		/* calculate hash of TBSCertificate */
-		reg[0].data = cert->tbs;
-		reg[0].size = cert->tbs_size;
-		if (!efi_hash_regions(reg, 1, &hash, hash_algo, &len))
-			goto out;
+		/* calculate hash of TBSCertificate once per algorithm */
+		if (!hashed_algo || strcmp(hash_algo, hashed_algo)) {
+			free(hash);
+			hash = NULL;
+			hashed_algo = NULL;
+			reg[0].data = cert->tbs;
+			reg[0].size = cert->tbs_size;
+			if (!efi_hash_regions(reg, 1, &hash, hash_algo, &len))
+				goto out;
+			hashed_algo = hash_algo;
+		}
 
-		for (sig_data = siglist->sig_data_list; sig_data;
-		     sig_data = sig_data->next) {
-			/*
-			 * struct efi_cert_x509_sha256 {
-			 *	u8 tbs_hash[256/8];
-			 *	time64_t revocation_time;
-			 * };
-			 */
-#ifdef DEBUG
-			if (sig_data->size >= len) {
-				EFI_PRINT("hash in db:\n");
-				print_hex_dump("    ", DUMP_PREFIX_OFFSET,
-					       16, 1,
-					       sig_data->data, len, false);
-			}
-#endif
-			if ((sig_data->size < len + sizeof(time64_t)) ||
-			    memcmp(sig_data->data, hash, len))
-				continue;
+		/*
+		 * struct efi_cert_x509_sha256 {
+		 *	u8 tbs_hash[256/8];
+		 *	time64_t revocation_time;
+		 * };
+		 */
+		sig_data = efi_sigstore_find(siglist, hash, len);
+		if (!sig_data || sig_data->size < len + sizeof(time64_t))
+			continue;
 
-			memcpy(&revoc_time, sig_data->data + len,
-			       sizeof(revoc_time));
-			EFI_PRINT("revocation time: 0x%llx\n", revoc_time);
-			/*
-			 * TODO: compare signing timestamp in sinfo
-			 * with revocation time
-			 */
+		memcpy(&revoc_time, sig_data->data + len, sizeof(revoc_time));
+		EFI_PRINT("revocation time: 0x%llx\n", revoc_time);
+		/*
+		 * TODO: compare signing timestamp in sinfo
+		 * with revocation time
+		 */
 
-			revoked = true;
-			free(hash);
-			goto out;
-		}
-		free(hash);
-		hash = NULL;
+		revoked = true;
+		goto out;
 	}
 out:
+	free(hash);
 	EFI_PRINT("%s: Exit, revoked: %d\n", __func__, revoked);
 	return !revoked;
 }
@@ -555,7 +597,6 @@ bool efi_signature_verify(struct efi_image_regions *regs,
 
 			check = efi_signature_check_revocation(sinfo, root,
 							       dbx);
-			x509_free_certificate(root);
 			if (check)
 				break;
 		}
@@ -609,28 +650,84 @@ out:
  *
  * Feee all the memories held in signature store and itself,
  * which were allocated by efi_sigstore_parse_sigdb().
+ * A cached signature store is only released by its last user.
  */
 void efi_sigstore_free(struct efi_signature_store *sigstore)
 {
 	struct efi_signature_store *sigstore_next;
 	struct efi_sig_data *sig_data, *sig_data_next;
 
+	if (sigstore && sigstore->refcnt) {
+		sigstore->refcnt--;
+		return;
+	}
+
 	while (sigstore) {
 		sigstore_next = sigstore->next;
 
 		sig_data = sigstore->sig_data_list;
 		while (sig_data) {
 			sig_data_next = sig_data->next;
+			if (!IS_ERR_OR_NULL(sig_data->cert))
+				x509_free_certificate(sig_data->cert);
 			free(sig_data->data);
 			free(sig_data);
 			sig_data = sig_data_next;
 		}
 
+		free(sigstore->sig_data_index);
 		free(sigstore);
 		sigstore = sigstore_next;
 	}
 }
 
+/**
+ * efi_sig_data_cmp - compare the data of two signatures
+ * @arg1:	Pointer to a pointer to the first signature
+ * @arg2:	Pointer to a pointer to the second signature
+ *
+ * Return:	negative, zero or positive value as memcmp()
+ */
+static int efi_sig_data_cmp(const void *arg1, const void *arg2)
+{
+	const struct efi_sig_data *sig1 = *(const struct efi_sig_data **)arg1;
+	const struct efi_sig_data *sig2 = *(const struct efi_sig_data **)arg2;
+
+	return memcmp(sig1->data, sig2->data, min(sig1->size, sig2->size));
+}
+
+/**
+ * efi_sigstore_index - sort the signatures of a signature list
+ * @siglist:	Signature list
+ *
+ * Build the index used by efi_sigstore_find() to search for a digest.
+ *
+ * Return:	0 on success, -ENOMEM if out of memory
+ */
+static int efi_sigstore_index(struct efi_signature_store *siglist)
+{
+	struct efi_sig_data *sig_data;
+	size_t num = 0;
+
+	for (sig_data = siglist->sig_data_list; sig_data;
+	     sig_data = sig_data->next)
+		num++;
+	if (!num)
+		return 0;
+
+	siglist->sig_data_index = calloc(num, sizeof(*siglist->sig_data_index));
+	if (!siglist->sig_data_index)
+		return -ENOMEM;
+
+	for (sig_data = siglist->sig_data_list; sig_data;
+	     sig_data = sig_data->next)
+		siglist->sig_data_index[siglist->sig_data_num++] = sig_data;
+	qsort(siglist->sig_data_index, num, sizeof(*siglist->sig_data_index),
+	      efi_sig_data_cmp);
+
+	return 0;
+}
+
 /**
  * efi_sigstore_parse_siglist - parse a signature list
  * @name:	Pointer to signature list
@@ -701,8 +798,7 @@ efi_sigstore_parse_siglist(struct efi_signature_list *esl)
 			goto err;
 		}
 
-		sig_data = calloc(esl->signature_size
-					- sizeof(esd->signature_owner), 1);
+		sig_data = calloc(sizeof(*sig_data), 1);
 		if (!sig_data) {
 			EFI_PRINT("Out of memory\n");
 			goto err;
@@ -730,6 +826,13 @@ efi_sigstore_parse_siglist(struct efi_signature_list *esl)
 	}
 	siglist->sig_data_list = sig_data_next;
 
+	/* Digests are looked up, certificates are walked */
+	if (guidcmp(&siglist->sig_type, &efi_guid_cert_x509) &&
+	    efi_sigstore_index(siglist)) {
+		EFI_PRINT("Out of memory\n");
+		goto err;
+	}
+
 	return siglist;
 
 err:
@@ -795,6 +898,27 @@ err:
 	return NULL;
 }
 
+/**
+ * struct efi_sigstore_cache - parsed signature database
+ *
+ * @name:	Variable's name
+ * @value:	Value of the variable @sigstore was parsed from
+ * @size:	Size of @value
+ * @sigstore:	Parsed signature database
+ */
+struct efi_sigstore_cache {
+	const u16 *name;
+	void *value;
+	efi_uintn_t size;
+	struct efi_signature_store *sigstore;
+};
+
+/* Signature databases read for each image to authenticate */
+static struct efi_sigstore_cache efi_sigstore_cache[] = {
+	{ .name = u"db" },
+	{ .name = u"dbx" },
+};
+
 /**
  * efi_sigstore_parse_sigdb - parse a signature database variable
  * @name:	Variable's name
@@ -802,13 +926,20 @@ err:
  * Read in a value of signature database variable pointed to by
  * @name, parse it and instantiate a signature store structure.
  *
+ * The databases db and dbx are kept parsed until the value of their
+ * variable changes. The returned signature store must be released with
+ * efi_sigstore_free() in any case.
+ *
  * Return:	Pointer to signature store on success, NULL on error
  */
 struct efi_signature_store *efi_sigstore_parse_sigdb(u16 *name)
 {
+	struct efi_sigstore_cache *cache = NULL;
+	struct efi_signature_store *sigstore;
 	const efi_guid_t *vendor;
-	void *db;
+	void *db, *value;
 	efi_uintn_t db_size;
+	int i;
 
 	vendor = efi_auth_var_get_guid(name);
 	db = efi_get_var(name, vendor, &db_size);
@@ -817,5 +948,39 @@ struct efi_signature_store *efi_sigstore_parse_sigdb(u16 *name)
 		return calloc(sizeof(struct efi_signature_store), 1);
 	}
 
-	return efi_build_signature_store(db, db_size);
+	for (i = 0; i < ARRAY_SIZE(efi_sigstore_cache); i++) {
+		if (!u16_strcmp(name, efi_sigstore_cache[i].name)) {
+			cache = &efi_sigstore_cache[i];
+			break;
+		}
+	}
+	if (!cache)
+		return efi_build_signature_store(db, db_size);
+
+	if (cache->sigstore && cache->size == db_size &&
+	    !memcmp(cache->value, db, db_size)) {
+		free(db);
+		cache->sigstore->refcnt++;
+		return cache->sigstore;
+	}
+
+	value = malloc(db_size);
+	if (!value)
+		return efi_build_signature_store(db, db_size);
+	memcpy(value, db, db_size);
+
+	sigstore = efi_build_signature_store(db, db_size);
+	if (!sigstore) {
+		free(value);
+		return NULL;
+	}
+
+	efi_sigstore_free(cache->sigstore);
+	free(cache->value);
+	cache->value = value;
+	cache->size = db_size;
+	cache->sigstore = sigstore;
+	sigstore->refcnt++;
+
+	return sigstore;
 }
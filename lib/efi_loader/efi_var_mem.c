@@ -7,8 +7,21 @@
 
 #include <efi_loader.h>
 #include <efi_variable.h>
+#include <linux/log2.h>
 #include <u-boot/crc.h>
 
+/*
+ * Variables are kept in the order they were added in the buffer efi_var_buf,
+ * which has the format of the file storing them. A hash table of entry
+ * offsets, using open addressing with linear probing, finds a variable by
+ * GUID and name. Deleted variables are marked by clearing their attributes
+ * and the buffer is compacted when the deleted entries take up as much space
+ * as is left free at its end.
+ */
+
+/* Number of bytes of the buffer per slot of the hash table */
+#define EFI_VAR_INDEX_RATIO	32
+
 /*
  * The variables efi_var_file and efi_var_entry must be static to avoid
  * referencing them via the global offset table (section .got). The GOT
@@ -16,7 +29,30 @@
  * relocation during SetVirtualAddressMap().
  */
 static struct efi_var_file __efi_runtime_data *efi_var_buf;
-static struct efi_var_entry __efi_runtime_data *efi_current_var;
+static u32 __efi_runtime_data *efi_var_index;
+static u32 __efi_runtime_data efi_var_index_mask;
+static u32 __efi_runtime_data efi_var_dead;
+
+/**
+ * efi_var_hash() - hash GUID and name of a variable
+ *
+ * @guid:	GUID of the variable
+ * @name:	name of the variable
+ * Return:	hash value
+ */
+static u32 __efi_runtime efi_var_hash(const efi_guid_t *guid, const u16 *name)
+{
+	const u8 *p = (const u8 *)guid;
+	u32 hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < sizeof(efi_guid_t); ++i)
+		hash = (hash ^ p[i]) * 16777619U;
+	for (; *name; ++name)
+		hash = (hash ^ *name) * 16777619U;
+
+	return hash;
+}
 
 /**
  * efi_var_mem_compare() - compare GUID and name with a variable
@@ -24,41 +60,182 @@ static struct efi_var_entry __efi_runtime_data *efi_current_var;
  * @var:	variable to compare
  * @guid:	GUID to compare
  * @name:	variable name to compare
- * @next:	pointer to next variable
  * Return:	true if match
  */
 static bool __efi_runtime
 efi_var_mem_compare(struct efi_var_entry *var, const efi_guid_t *guid,
-		    const u16 *name, struct efi_var_entry **next)
+		    const u16 *name)
 {
+	const u8 *guid1 = (u8 *)&var->guid, *guid2 = (u8 *)guid;
+	const u16 *var_name = var->name;
 	int i;
-	u8 *guid1, *guid2;
-	const u16 *data, *var_name;
-	bool match = true;
-
-	for (guid1 = (u8 *)&var->guid, guid2 = (u8 *)guid, i = 0;
-	     i < sizeof(efi_guid_t) && match; ++i)
-		match = (guid1[i] == guid2[i]);
-
-	for (data = var->name, var_name = name;; ++data) {
-		if (match)
-			match = (*data == *var_name);
-		if (!*data)
+
+	for (i = 0; i < sizeof(efi_guid_t); ++i) {
+		if (guid1[i] != guid2[i])
+			return false;
+	}
+	for (; *var_name == *name; ++var_name, ++name) {
+		if (!*name)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * efi_var_at() - get the variable at an offset into efi_var_buf
+ *
+ * @offset:	offset of the variable
+ * Return:	variable
+ */
+static struct efi_var_entry __efi_runtime *efi_var_at(u32 offset)
+{
+	return (struct efi_var_entry *)((uintptr_t)efi_var_buf + offset);
+}
+
+/**
+ * efi_var_home() - get the first slot of the hash table to probe for a variable
+ *
+ * @var:	variable
+ * Return:	slot
+ */
+static u32 __efi_runtime efi_var_home(struct efi_var_entry *var)
+{
+	return efi_var_hash(&var->guid, var->name) & efi_var_index_mask;
+}
+
+/**
+ * efi_var_index_add() - add a variable to the hash table
+ *
+ * @var:	variable in efi_var_buf
+ */
+static void __efi_runtime efi_var_index_add(struct efi_var_entry *var)
+{
+	u32 slot;
+
+	for (slot = efi_var_home(var); efi_var_index[slot];
+	     slot = (slot + 1) & efi_var_index_mask)
+		;
+	efi_var_index[slot] = (uintptr_t)var - (uintptr_t)efi_var_buf;
+}
+
+/**
+ * efi_var_index_remove() - remove a variable from the hash table
+ *
+ * The entries following the slot of the variable are moved up, so that each
+ * of them can still be reached from its home slot.
+ *
+ * @var:	variable in efi_var_buf
+ */
+static void __efi_runtime efi_var_index_remove(struct efi_var_entry *var)
+{
+	u32 offset = (uintptr_t)var - (uintptr_t)efi_var_buf;
+	u32 slot, next, home;
+
+	for (slot = efi_var_home(var); efi_var_index[slot] != offset;
+	     slot = (slot + 1) & efi_var_index_mask) {
+		if (!efi_var_index[slot])
+			return;
+	}
+
+	for (next = slot;;) {
+		next = (next + 1) & efi_var_index_mask;
+		if (!efi_var_index[next])
 			break;
-		if (*var_name)
-			++var_name;
+		home = efi_var_home(efi_var_at(efi_var_index[next]));
+		/* Keep the entry if its home lies in (slot, next] */
+		if (slot <= next ? slot < home && home <= next :
+				   slot < home || home <= next)
+			continue;
+		efi_var_index[slot] = efi_var_index[next];
+		slot = next;
 	}
+	efi_var_index[slot] = 0;
+}
 
-	++data;
+/**
+ * efi_var_index_rebuild() - fill the hash table from efi_var_buf
+ */
+static void __efi_runtime efi_var_index_rebuild(void)
+{
+	struct efi_var_entry *var, *last;
+	u32 i;
 
-	if (next)
-		*next = (struct efi_var_entry *)
-			ALIGN((uintptr_t)data + var->length, 8);
+	for (i = 0; i <= efi_var_index_mask; ++i)
+		efi_var_index[i] = 0;
 
-	if (match)
-		efi_current_var = var;
+	last = efi_var_at(efi_var_buf->length);
+	for (var = efi_var_buf->var; var < last;
+	     var = (void *)var + efi_var_entry_len(var)) {
+		if (var->attr)
+			efi_var_index_add(var);
+	}
+}
 
-	return match;
+/**
+ * efi_var_mem_compact() - drop deleted variables from efi_var_buf
+ *
+ * Compacting moves variables. Pointers to them held by the caller are
+ * stale afterwards, except for the one passed as @keep which is updated.
+ *
+ * @keep:	pointer to a variable to keep track of, or NULL
+ */
+static void __efi_runtime efi_var_mem_compact(struct efi_var_entry **keep)
+{
+	struct efi_var_entry *var, *to, *last;
+	u32 len;
+
+	last = efi_var_at(efi_var_buf->length);
+	for (var = efi_var_buf->var, to = var; var < last;
+	     var = (void *)var + len) {
+		len = efi_var_entry_len(var);
+		if (!var->attr)
+			continue;
+		if (keep && *keep == var)
+			*keep = to;
+		/* efi_memcpy_runtime() can be used because var >= to. */
+		if (to != var)
+			efi_memcpy_runtime(to, var, len);
+		to = (void *)to + len;
+	}
+	efi_var_buf->length = (uintptr_t)to - (uintptr_t)efi_var_buf;
+	efi_var_dead = 0;
+	efi_var_index_rebuild();
+}
+
+/**
+ * efi_var_mem_contains() - check if data lies in efi_var_buf
+ *
+ * @data:	data
+ * @size:	size of the data
+ * Return:	true if the data overlaps efi_var_buf
+ */
+static bool __efi_runtime efi_var_mem_contains(const void *data,
+					       efi_uintn_t size)
+{
+	uintptr_t start = (uintptr_t)efi_var_buf;
+
+	return size && (uintptr_t)data + size > start &&
+	       (uintptr_t)data < start + EFI_VAR_BUF_SIZE;
+}
+
+/**
+ * efi_var_mem_next() - get the first variable which is not deleted
+ *
+ * @var:	variable to start at
+ * Return:	variable or NULL
+ */
+static struct efi_var_entry __efi_runtime
+*efi_var_mem_next(struct efi_var_entry *var)
+{
+	struct efi_var_entry *last = efi_var_at(efi_var_buf->length);
+
+	for (; var < last; var = (void *)var + efi_var_entry_len(var)) {
+		if (var->attr)
+			return var;
+	}
+
+	return NULL;
 }
 
 /**
@@ -82,41 +259,23 @@ struct efi_var_entry __efi_runtime
 *efi_var_mem_find(const efi_guid_t *guid, const u16 *name,
 		  struct efi_var_entry **next)
 {
-	struct efi_var_entry *var, *last;
-
-	last = (struct efi_var_entry *)
-	       ((uintptr_t)efi_var_buf + efi_var_buf->length);
+	struct efi_var_entry *var;
+	u32 slot;
 
 	if (!*name) {
-		if (next) {
-			*next = efi_var_buf->var;
-			if (*next >= last)
-				*next = NULL;
-		}
+		if (next)
+			*next = efi_var_mem_next(efi_var_buf->var);
 		return NULL;
 	}
-	if (efi_current_var &&
-	    efi_var_mem_compare(efi_current_var, guid, name, next)) {
-		if (next && *next >= last)
-			*next = NULL;
-		return efi_current_var;
-	}
 
-	var = efi_var_buf->var;
-	if (var < last) {
-		for (; var;) {
-			struct efi_var_entry *pos;
-			bool match;
-
-			match = efi_var_mem_compare(var, guid, name, &pos);
-			if (pos >= last)
-				pos = NULL;
-			if (match) {
-				if (next)
-					*next = pos;
-				return var;
-			}
-			var = pos;
+	for (slot = efi_var_hash(guid, name) & efi_var_index_mask;
+	     efi_var_index[slot]; slot = (slot + 1) & efi_var_index_mask) {
+		var = efi_var_at(efi_var_index[slot]);
+		if (efi_var_mem_compare(var, guid, name)) {
+			if (next)
+				*next = efi_var_mem_next((void *)var +
+							 efi_var_entry_len(var));
+			return var;
 		}
 	}
 	if (next)
@@ -126,26 +285,22 @@ struct efi_var_entry __efi_runtime
 
 void __efi_runtime efi_var_mem_del(struct efi_var_entry *var)
 {
-	u16 *data;
-	struct efi_var_entry *next, *last;
+	u32 len;
 
 	if (!var)
 		return;
 
-	last = (struct efi_var_entry *)
-	       ((uintptr_t)efi_var_buf + efi_var_buf->length);
-	if (var <= efi_current_var)
-		efi_current_var = NULL;
-
-	for (data = var->name; *data; ++data)
-		;
-	++data;
-	next = (struct efi_var_entry *)
-	       ALIGN((uintptr_t)data + var->length, 8);
-	efi_var_buf->length -= (uintptr_t)next - (uintptr_t)var;
+	efi_var_index_remove(var);
+	len = efi_var_entry_len(var);
+	if ((uintptr_t)var + len == (uintptr_t)efi_var_at(efi_var_buf->length)) {
+		efi_var_buf->length -= len;
+	} else {
+		var->attr = 0;
+		efi_var_dead += len;
+		if (efi_var_dead >= EFI_VAR_BUF_SIZE - efi_var_buf->length)
+			efi_var_mem_compact(NULL);
+	}
 
-	/* efi_memcpy_runtime() can be used because next >= var. */
-	efi_memcpy_runtime(var, next, (uintptr_t)last - (uintptr_t)next);
 	efi_var_buf->crc32 = crc32(0, (u8 *)efi_var_buf->var,
 				   efi_var_buf->length -
 				   sizeof(struct efi_var_file));
@@ -156,21 +311,33 @@ efi_status_t __efi_runtime efi_var_mem_ins(
 				const efi_guid_t *vendor, u32 attributes,
 				const efi_uintn_t size1, const void *data1,
 				const efi_uintn_t size2, const void *data2,
-				const u64 time)
+				const u64 time, struct efi_var_entry *old)
 {
 	u16 *data;
 	struct efi_var_entry *var;
 	u32 var_name_len;
+	u32 len;
 
-	var = (struct efi_var_entry *)
-	      ((uintptr_t)efi_var_buf + efi_var_buf->length);
 	var_name_len = u16_strlen(variable_name) + 1;
-	data = var->name + var_name_len;
+	len = sizeof(struct efi_var_entry) + sizeof(u16) * var_name_len +
+	      size1 + size2;
 
-	if ((uintptr_t)data - (uintptr_t)efi_var_buf + size1 + size2 >
-	    EFI_VAR_BUF_SIZE)
+	/*
+	 * Deleted variables can only be dropped if the data to copy does not
+	 * lie in the buffer, e.g. when appending to an existing variable. The
+	 * variable to replace stays valid until the new one has been added.
+	 */
+	if (efi_var_buf->length + len > EFI_VAR_BUF_SIZE && efi_var_dead &&
+	    !efi_var_mem_contains(data1, size1) &&
+	    !efi_var_mem_contains(data2, size2))
+		efi_var_mem_compact(&old);
+
+	if (efi_var_buf->length + len > EFI_VAR_BUF_SIZE)
 		return EFI_OUT_OF_RESOURCES;
 
+	var = efi_var_at(efi_var_buf->length);
+	data = var->name + var_name_len;
+
 	var->attr = attributes;
 	var->length = size1 + size2;
 	var->time = time;
@@ -180,6 +347,7 @@ efi_status_t __efi_runtime efi_var_mem_ins(
 			   sizeof(u16) * var_name_len);
 	efi_memcpy_runtime(data, data1, size1);
 	efi_memcpy_runtime((u8 *)data + size1, data2, size2);
+	efi_var_index_add(var);
 
 	var = (struct efi_var_entry *)
 	      ALIGN((uintptr_t)data + var->length, 8);
@@ -188,17 +356,19 @@ efi_status_t __efi_runtime efi_var_mem_ins(
 				   efi_var_buf->length -
 				   sizeof(struct efi_var_file));
 
+	efi_var_mem_del(old);
+
 	return EFI_SUCCESS;
 }
 
 u64 __efi_runtime efi_var_mem_free(void)
 {
-	if (efi_var_buf->length + sizeof(struct efi_var_entry) >=
-	    EFI_VAR_BUF_SIZE)
+	u32 used = efi_var_buf->length - efi_var_dead;
+
+	if (used + sizeof(struct efi_var_entry) >= EFI_VAR_BUF_SIZE)
 		return 0;
 
-	return EFI_VAR_BUF_SIZE - efi_var_buf->length -
-	       sizeof(struct efi_var_entry);
+	return EFI_VAR_BUF_SIZE - used - sizeof(struct efi_var_entry);
 }
 
 /**
@@ -211,7 +381,7 @@ static void EFIAPI __efi_runtime
 efi_var_mem_notify_virtual_address_map(struct efi_event *event, void *context)
 {
 	efi_convert_pointer(0, (void **)&efi_var_buf);
-	efi_current_var = NULL;
+	efi_convert_pointer(0, (void **)&efi_var_index);
 }
 
 efi_status_t efi_var_mem_init(void)
@@ -219,6 +389,7 @@ efi_status_t efi_var_mem_init(void)
 	u64 memory;
 	efi_status_t ret;
 	struct efi_event *event;
+	u32 slots;
 
 	ret = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES,
 				 EFI_RUNTIME_SERVICES_DATA,
@@ -232,6 +403,17 @@ efi_status_t efi_var_mem_init(void)
 	efi_var_buf->length = (uintptr_t)efi_var_buf->var -
 			      (uintptr_t)efi_var_buf;
 
+	slots = roundup_pow_of_two(EFI_VAR_BUF_SIZE / EFI_VAR_INDEX_RATIO);
+	ret = efi_allocate_pages(EFI_ALLOCATE_ANY_PAGES,
+				 EFI_RUNTIME_SERVICES_DATA,
+				 efi_size_in_pages(slots * sizeof(u32)),
+				 &memory);
+	if (ret != EFI_SUCCESS)
+		return ret;
+	efi_var_index = (u32 *)(uintptr_t)memory;
+	efi_var_index_mask = slots - 1;
+	memset(efi_var_index, 0, slots * sizeof(u32));
+
 	ret = efi_create_event(EVT_SIGNAL_VIRTUAL_ADDRESS_CHANGE, TPL_CALLBACK,
 			       efi_var_mem_notify_virtual_address_map, NULL,
 			       NULL, &event);
@@ -269,7 +451,7 @@ efi_var_collect_mem(struct efi_var_file *buf, efi_uintn_t *lenp, u32 mask)
 	while (var < last) {
 		u32 len = efi_var_entry_len(var);
 
-		if ((var->attr & mask) != mask) {
+		if (!var->attr || (var->attr & mask) != mask) {
 			var = (void *)((uintptr_t)var + len);
 			continue;
 		}
@@ -396,4 +578,6 @@ skip:
 void efi_var_buf_update(struct efi_var_file *var_buf)
 {
 	memcpy(efi_var_buf, var_buf, EFI_VAR_BUF_SIZE);
+	efi_var_dead = 0;
+	efi_var_index_rebuild();
 }
@@ -366,6 +366,7 @@ efi_status_t efi_set_variable_int(const u16 *variable_name,
 	if (delete) {
 		/* EFI_NOT_FOUND has been handled before */
 		attributes = var->attr;
+		efi_var_mem_del(var);
 		ret = EFI_SUCCESS;
 	} else if (append && var) {
 		/*
@@ -380,17 +381,16 @@ efi_status_t efi_set_variable_int(const u16 *variable_name,
 		ret = efi_var_mem_ins(variable_name, vendor,
 				      attributes & ~EFI_VARIABLE_APPEND_WRITE,
 				      var->length, old_data, data_size, data,
-				      time);
+				      time, var);
 	} else {
 		ret = efi_var_mem_ins(variable_name, vendor, attributes,
-				      data_size, data, 0, NULL, time);
+				      data_size, data, 0, NULL, time, var);
 	}
 
+	/* The old variable, if any, has been deleted on success */
 	if (ret != EFI_SUCCESS)
 		return ret;
 
-	efi_var_mem_del(var);
-
 	if (var_type == EFI_AUTH_VAR_PK)
 		ret = efi_init_secure_state();
 	else
@@ -545,6 +545,7 @@ efi_set_variable_runtime(u16 *variable_name, const efi_guid_t *vendor,
 	if (delete) {
 		/* EFI_NOT_FOUND has been handled before */
 		attributes = var->attr;
+		efi_var_mem_del(var);
 		ret = EFI_SUCCESS;
 	} else if (append && var) {
 		u16 *old_data = (void *)((uintptr_t)var->name +
@@ -552,18 +553,17 @@ efi_set_variable_runtime(u16 *variable_name, const efi_guid_t *vendor,
 
 		ret = efi_var_mem_ins(variable_name, vendor, attributes,
 				      var->length, old_data, data_size, data,
-				      time);
+				      time, var);
 	} else {
+		/*
+		 * We are always inserting new variables, the old copy is
+		 * deleted once the new one is in place.
+		 */
 		ret = efi_var_mem_ins(variable_name, vendor, attributes,
-				      data_size, data, 0, NULL, time);
+				      data_size, data, 0, NULL, time, var);
 	}
 
-	if (ret != EFI_SUCCESS)
-		return ret;
-	/* We are always inserting new variables, get rid of the old copy */
-	efi_var_mem_del(var);
-
-	return EFI_SUCCESS;
+	return ret;
 }
 
 /**
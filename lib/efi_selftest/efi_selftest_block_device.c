@@ -12,7 +12,8 @@
  * file protocol.
  * A known file is read from the file system and verified.
  * The same block is read via the EFI_BLOCK_IO_PROTOCOL and compared to the file
- * contents.
+ * contents. It is read once more via the EFI_BLOCK_IO2_PROTOCOL, waiting for
+ * the token to be signaled.
  */
 
 #include <efi_selftest.h>
@@ -28,6 +29,7 @@
 static struct efi_boot_services *boottime;
 
 static const efi_guid_t block_io_protocol_guid = EFI_BLOCK_IO_PROTOCOL_GUID;
+static const efi_guid_t block_io2_protocol_guid = EFI_BLOCK_IO2_PROTOCOL_GUID;
 static const efi_guid_t guid_device_path = EFI_DEVICE_PATH_PROTOCOL_GUID;
 static const efi_guid_t guid_simple_file_system_protocol =
 					EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
@@ -304,6 +306,8 @@ static int execute(void)
 	efi_handle_t handle_partition = NULL;
 	struct efi_device_path *dp_partition;
 	struct efi_block_io *block_io_protocol;
+	struct efi_block_io2 *block_io2_protocol;
+	struct efi_block_io2_token token;
 	struct efi_simple_file_system_protocol *file_system;
 	struct efi_file_handle *root, *file;
 	struct {
@@ -476,6 +480,55 @@ static int execute(void)
 		return EFI_ST_FAILURE;
 	}
 
+	/* Read the block again with ReadBlocksEx() */
+	ret = boottime->open_protocol(handle_partition,
+				      &block_io2_protocol_guid,
+				      (void **)&block_io2_protocol, NULL, NULL,
+				      EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("Failed to open block IO 2 protocol\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->create_event(0, TPL_CALLBACK, NULL, NULL,
+				     &token.event);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("Failed to create event\n");
+		return EFI_ST_FAILURE;
+	}
+	token.transaction_status = EFI_NOT_READY;
+	boottime->set_mem(block_io_aligned, sizeof(block_io_aligned), 0);
+	ret = block_io2_protocol->read_blocks_ex(block_io2_protocol,
+				      block_io2_protocol->media->media_id,
+				      (0x5000 >> LB_BLOCK_SIZE) - 1, &token,
+				      block_io2_protocol->media->block_size,
+				      block_io_aligned);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("ReadBlocksEx failed\n");
+		return EFI_ST_FAILURE;
+	}
+	for (i = 0; i < 1000; ++i) {
+		ret = boottime->check_event(token.event);
+		if (ret != EFI_NOT_READY)
+			break;
+	}
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("Token of ReadBlocksEx not signaled\n");
+		return EFI_ST_FAILURE;
+	}
+	if (token.transaction_status != EFI_SUCCESS) {
+		efi_st_error("ReadBlocksEx transaction failed\n");
+		return EFI_ST_FAILURE;
+	}
+	if (memcmp(block_io_aligned + 1, buf, 11)) {
+		efi_st_error("Unexpected block content from ReadBlocksEx\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->close_event(token.event);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("Failed to close event\n");
+		return EFI_ST_FAILURE;
+	}
+
 #ifdef CONFIG_FAT_WRITE
 	/* Write file */
 	ret = root->open(root, &file, u"u-boot.txt", EFI_FILE_MODE_READ |
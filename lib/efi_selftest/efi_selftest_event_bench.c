@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * efi_selftest_event_bench
+ *
+ * This unit test measures the overhead of boot service calls which check
+ * for expired timers while many timer events are armed.
+ *
+ * The test is only executed on request: bootefi selftest with the
+ * environment variable efi_selftest set to 'event benchmark'.
+ */
+
+#include <efi_selftest.h>
+
+/* Number of armed timer events which do not expire during the test */
+#define EFI_ST_BENCH_TIMERS 64
+/* Duration of each measurement in multiples of 100 ns: 100 ms */
+#define EFI_ST_BENCH_PERIOD 1000000
+
+static struct efi_event *efi_st_timers[EFI_ST_BENCH_TIMERS];
+static struct efi_event *efi_st_event_wait;
+static struct efi_event *efi_st_event_check;
+static struct efi_boot_services *boottime;
+
+/*
+ * Setup unit test.
+ *
+ * Create the timer events and arm them with a period of one hour.
+ *
+ * @handle:	handle of the loaded image
+ * @systable:	system table
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int setup(const efi_handle_t handle,
+		 const struct efi_system_table *systable)
+{
+	efi_status_t ret;
+	int i;
+
+	boottime = systable->boottime;
+
+	for (i = 0; i < EFI_ST_BENCH_TIMERS; ++i) {
+		ret = boottime->create_event(EVT_TIMER, TPL_CALLBACK, NULL,
+					     NULL, &efi_st_timers[i]);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("could not create event\n");
+			return EFI_ST_FAILURE;
+		}
+		ret = boottime->set_timer(efi_st_timers[i], EFI_TIMER_PERIODIC,
+					  36000000000ULL + i);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("Could not set timer\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	ret = boottime->create_event(EVT_TIMER, TPL_CALLBACK, NULL, NULL,
+				     &efi_st_event_wait);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("could not create event\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->create_event(EVT_TIMER, TPL_CALLBACK, NULL, NULL,
+				     &efi_st_event_check);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("could not create event\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/*
+ * Tear down unit test.
+ *
+ * Close the events created in setup.
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int teardown(void)
+{
+	int ret = EFI_ST_SUCCESS;
+	int i;
+
+	for (i = 0; i < EFI_ST_BENCH_TIMERS; ++i) {
+		if (!efi_st_timers[i])
+			continue;
+		if (boottime->close_event(efi_st_timers[i]) != EFI_SUCCESS) {
+			efi_st_error("could not close event\n");
+			ret = EFI_ST_FAILURE;
+		}
+		efi_st_timers[i] = NULL;
+	}
+	if (efi_st_event_wait) {
+		if (boottime->close_event(efi_st_event_wait) != EFI_SUCCESS) {
+			efi_st_error("could not close event\n");
+			ret = EFI_ST_FAILURE;
+		}
+		efi_st_event_wait = NULL;
+	}
+	if (efi_st_event_check) {
+		if (boottime->close_event(efi_st_event_check) != EFI_SUCCESS) {
+			efi_st_error("could not close event\n");
+			ret = EFI_ST_FAILURE;
+		}
+		efi_st_event_check = NULL;
+	}
+
+	return ret;
+}
+
+/*
+ * Execute unit test.
+ *
+ * Count the CheckEvent() calls on an event which is never signaled until a
+ * 100 ms timer expires and print the resulting time per call.
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int execute(void)
+{
+	efi_status_t ret;
+	unsigned int count;
+
+	ret = boottime->set_timer(efi_st_event_wait, EFI_TIMER_RELATIVE,
+				  EFI_ST_BENCH_PERIOD);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("Could not set timer\n");
+		return EFI_ST_FAILURE;
+	}
+	for (count = 0;; ++count) {
+		ret = boottime->check_event(efi_st_event_check);
+		if (ret != EFI_NOT_READY) {
+			efi_st_error("CheckEvent returned %u\n",
+				     (unsigned int)ret);
+			return EFI_ST_FAILURE;
+		}
+		ret = boottime->check_event(efi_st_event_wait);
+		if (ret == EFI_SUCCESS)
+			break;
+		if (ret != EFI_NOT_READY) {
+			efi_st_error("Could not check event\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	if (!count) {
+		efi_st_error("Timer expired immediately\n");
+		return EFI_ST_FAILURE;
+	}
+	/* Each iteration makes two calls */
+	efi_st_printf("%u CheckEvent calls with %u armed timers in 100 ms, %u ns per call\n",
+		      2 * count, EFI_ST_BENCH_TIMERS,
+		      100000000U / (2 * count));
+
+	return EFI_ST_SUCCESS;
+}
+
+EFI_UNIT_TEST(event_bench) = {
+	.name = "event benchmark",
+	.phase = EFI_EXECUTE_BEFORE_BOOTTIME_EXIT,
+	.setup = setup,
+	.execute = execute,
+	.teardown = teardown,
+	.on_request = true,
+};
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * efi_selftest_pool
+ *
+ * This unit test checks the following boottime services:
+ * AllocatePool, FreePool
+ *
+ * Many small allocations of different memory types are made. They must not
+ * overlap, must be correctly typed in the memory map and must not add an
+ * entry to the memory map each.
+ */
+
+#include <efi_selftest.h>
+
+#define EFI_ST_POOL_COUNT 1000
+
+static struct efi_boot_services *boottime;
+static u8 **buffers;
+
+/**
+ * setup() - setup unit test
+ *
+ * @handle:	handle of the loaded image
+ * @systable:	system table
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int setup(const efi_handle_t handle,
+		 const struct efi_system_table *systable)
+{
+	efi_status_t ret;
+
+	boottime = systable->boottime;
+
+	ret = boottime->allocate_pool(EFI_LOADER_DATA,
+				      EFI_ST_POOL_COUNT * sizeof(*buffers),
+				      (void **)&buffers);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePool did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * teardown() - tear down unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int teardown(void)
+{
+	efi_status_t ret;
+
+	if (buffers) {
+		ret = boottime->free_pool(buffers);
+		buffers = NULL;
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("FreePool did not return EFI_SUCCESS\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/**
+ * get_memory_map() - get a copy of the memory map
+ *
+ * @map_size:	size of the memory map
+ * @desc_size:	size of a memory map entry
+ * Return:	memory map, to be freed with FreePool(), or NULL
+ */
+static struct efi_mem_desc *get_memory_map(efi_uintn_t *map_size,
+					   efi_uintn_t *desc_size)
+{
+	struct efi_mem_desc *memory_map;
+	efi_uintn_t map_key;
+	u32 desc_version;
+	efi_status_t ret;
+
+	*map_size = 0;
+	ret = boottime->get_memory_map(map_size, NULL, &map_key, desc_size,
+				       &desc_version);
+	if (ret != EFI_BUFFER_TOO_SMALL) {
+		efi_st_error
+			("GetMemoryMap did not return EFI_BUFFER_TOO_SMALL\n");
+		return NULL;
+	}
+	/* Allocate extra space for newly allocated memory */
+	*map_size += 2 * *desc_size;
+	ret = boottime->allocate_pool(EFI_BOOT_SERVICES_DATA, *map_size,
+				      (void **)&memory_map);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePool did not return EFI_SUCCESS\n");
+		return NULL;
+	}
+	ret = boottime->get_memory_map(map_size, memory_map, &map_key,
+				       desc_size, &desc_version);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("GetMemoryMap did not return EFI_SUCCESS\n");
+		boottime->free_pool(memory_map);
+		return NULL;
+	}
+
+	return memory_map;
+}
+
+/**
+ * memory_type() - get the type of the memory map entry holding an address
+ *
+ * @map_size:	size of the memory map
+ * @memory_map:	memory map
+ * @desc_size:	size of a memory map entry
+ * @addr:	address to look up
+ * Return:	memory type, -1 if not found
+ */
+static int memory_type(efi_uintn_t map_size, struct efi_mem_desc *memory_map,
+		       efi_uintn_t desc_size, void *addr)
+{
+	struct efi_mem_desc *entry;
+
+	for (; map_size >= desc_size; map_size -= desc_size) {
+		entry = memory_map;
+		memory_map = (void *)memory_map + desc_size;
+		if ((uintptr_t)addr >= entry->physical_start &&
+		    (uintptr_t)addr < entry->physical_start +
+				      (entry->num_pages << EFI_PAGE_SHIFT))
+			return entry->type;
+	}
+
+	return -1;
+}
+
+/* Memory type and size of the i-th allocation */
+static enum efi_memory_type pool_type(int i)
+{
+	return i % 4 ? EFI_LOADER_DATA : EFI_RUNTIME_SERVICES_DATA;
+}
+
+static efi_uintn_t pool_size(int i)
+{
+	return 1 + (i * 37) % 1024;
+}
+
+/*
+ * execute() - execute unit test
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int execute(void)
+{
+	struct efi_mem_desc *memory_map;
+	efi_uintn_t map_size, desc_size, entries;
+	efi_status_t ret;
+	int i, type;
+	u8 *extra;
+
+	memory_map = get_memory_map(&map_size, &desc_size);
+	if (!memory_map)
+		return EFI_ST_FAILURE;
+	entries = map_size / desc_size;
+	boottime->free_pool(memory_map);
+
+	for (i = 0; i < EFI_ST_POOL_COUNT; i++) {
+		ret = boottime->allocate_pool(pool_type(i), pool_size(i),
+					      (void **)&buffers[i]);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("AllocatePool did not return EFI_SUCCESS\n");
+			return EFI_ST_FAILURE;
+		}
+		if ((uintptr_t)buffers[i] & 7) {
+			efi_st_error("Pool memory is not 8 byte aligned\n");
+			return EFI_ST_FAILURE;
+		}
+		boottime->set_mem(buffers[i], pool_size(i), i & 0xff);
+	}
+
+	memory_map = get_memory_map(&map_size, &desc_size);
+	if (!memory_map)
+		return EFI_ST_FAILURE;
+	for (i = 0; i < EFI_ST_POOL_COUNT; i++) {
+		if (buffers[i][0] != (i & 0xff) ||
+		    buffers[i][pool_size(i) - 1] != (i & 0xff)) {
+			efi_st_error("Pool allocations overlap\n");
+			return EFI_ST_FAILURE;
+		}
+		type = memory_type(map_size, memory_map, desc_size,
+				   buffers[i]);
+		if (type != pool_type(i)) {
+			efi_st_error("Wrong memory type %d, expected %d\n",
+				     type, pool_type(i));
+			return EFI_ST_FAILURE;
+		}
+	}
+	boottime->free_pool(memory_map);
+	if (map_size / desc_size > entries + 16) {
+		efi_st_error("Memory map grew from %u to %u entries\n",
+			     (unsigned int)entries,
+			     (unsigned int)(map_size / desc_size));
+		return EFI_ST_FAILURE;
+	}
+
+	/* Check that a pointer is only freed once */
+	ret = boottime->allocate_pool(EFI_LOADER_DATA, 16, (void **)&extra);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePool did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->free_pool(extra + 8);
+	if (ret != EFI_INVALID_PARAMETER) {
+		efi_st_error("FreePool accepted an interior pointer\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->free_pool(extra);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("FreePool did not return EFI_SUCCESS\n");
+		return EFI_ST_FAILURE;
+	}
+	ret = boottime->free_pool(extra);
+	if (ret == EFI_SUCCESS) {
+		efi_st_error("FreePool accepted a double free\n");
+		return EFI_ST_FAILURE;
+	}
+
+	for (i = 0; i < EFI_ST_POOL_COUNT; i++) {
+		ret = boottime->free_pool(buffers[i]);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("FreePool did not return EFI_SUCCESS\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+EFI_UNIT_TEST(pool) = {
+	.name = "pool",
+	.phase = EFI_EXECUTE_BEFORE_BOOTTIME_EXIT,
+	.setup = setup,
+	.execute = execute,
+	.teardown = teardown,
+};
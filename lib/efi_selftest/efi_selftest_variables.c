@@ -6,12 +6,19 @@
  *
  * This unit test checks the runtime services for variables:
  * GetVariable, GetNextVariableName, SetVariable, QueryVariableInfo.
+ *
+ * Many variables are rewritten and deleted to check that the variable store
+ * stays consistent when it reuses the space of deleted variables, also when
+ * it is full and a variable is replaced.
  */
 
 #include <efi_selftest.h>
 
 #define EFI_ST_MAX_DATA_SIZE 16
 #define EFI_ST_MAX_VARNAME_SIZE 80
+#define EFI_ST_MANY_COUNT 100
+#define EFI_ST_MANY_SIZE 512
+#define EFI_ST_FILL_MAX 10000
 
 static struct efi_boot_services *boottime;
 static struct efi_runtime_services *runtime;
@@ -37,6 +44,236 @@ static int setup(const efi_handle_t img_handle,
 	return EFI_ST_SUCCESS;
 }
 
+/*
+ * Set the name of the i-th of many variables.
+ *
+ * @name	buffer for the name
+ * @prefix	start of the name
+ * @i		index of the variable
+ */
+static void many_name(u16 *name, const char *prefix, int i)
+{
+	for (; *prefix; ++prefix)
+		*name++ = *prefix;
+	*name++ = '0' + i / 1000 % 10;
+	*name++ = '0' + i / 100 % 10;
+	*name++ = '0' + i / 10 % 10;
+	*name++ = '0' + i % 10;
+	*name = 0;
+}
+
+/*
+ * Rewrite and delete many variables.
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int many_variables(void)
+{
+	u8 data[EFI_ST_MANY_SIZE];
+	u16 varname[EFI_ST_MAX_VARNAME_SIZE];
+	efi_guid_t guid;
+	efi_status_t ret;
+	efi_uintn_t len;
+	int i, round, count;
+
+	for (round = 0; round < 4; ++round) {
+		for (i = 0; i < EFI_ST_MANY_COUNT; ++i) {
+			many_name(varname, "efi_st_many", i);
+			boottime->set_mem(data, sizeof(data), i + round);
+			ret = runtime->set_variable(varname, &guid_vendor1,
+					EFI_VARIABLE_BOOTSERVICE_ACCESS,
+					sizeof(data), data);
+			if (ret != EFI_SUCCESS) {
+				efi_st_error("SetVariable failed\n");
+				return EFI_ST_FAILURE;
+			}
+		}
+	}
+	/* Delete every other variable */
+	for (i = 0; i < EFI_ST_MANY_COUNT; i += 2) {
+		many_name(varname, "efi_st_many", i);
+		ret = runtime->set_variable(varname, &guid_vendor1, 0, 0, NULL);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	for (i = 0; i < EFI_ST_MANY_COUNT; ++i) {
+		many_name(varname, "efi_st_many", i);
+		len = sizeof(data);
+		ret = runtime->get_variable(varname, &guid_vendor1, NULL,
+					    &len, data);
+		if (i & 1) {
+			if (ret != EFI_SUCCESS || len != sizeof(data) ||
+			    data[0] != i + 3 || data[sizeof(data) - 1] != i + 3) {
+				efi_st_error("GetVariable returned wrong value\n");
+				return EFI_ST_FAILURE;
+			}
+		} else if (ret != EFI_NOT_FOUND) {
+			efi_st_error("Variable was not deleted\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	/* Each remaining variable must be listed once */
+	boottime->set_mem(&guid, sizeof(guid), 0);
+	*varname = 0;
+	count = 0;
+	for (;;) {
+		len = sizeof(varname);
+		ret = runtime->get_next_variable_name(&len, varname, &guid);
+		if (ret == EFI_NOT_FOUND)
+			break;
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("GetNextVariableName failed\n");
+			return EFI_ST_FAILURE;
+		}
+		if (!memcmp(&guid, &guid_vendor1, sizeof(efi_guid_t)) &&
+		    !memcmp(varname, u"efi_st_many", 22))
+			++count;
+	}
+	if (count != EFI_ST_MANY_COUNT / 2) {
+		efi_st_error("GetNextVariableName listed %d variables, expected %d\n",
+			     count, EFI_ST_MANY_COUNT / 2);
+		return EFI_ST_FAILURE;
+	}
+	for (i = 1; i < EFI_ST_MANY_COUNT; i += 2) {
+		many_name(varname, "efi_st_many", i);
+		ret = runtime->set_variable(varname, &guid_vendor1, 0, 0, NULL);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+
+	return EFI_ST_SUCCESS;
+}
+
+/*
+ * Replace a variable in a full store with deleted variables before it.
+ *
+ * The new value only fits if the store drops the deleted variables, which
+ * moves the variable being replaced. All other variables must be kept.
+ *
+ * Return:	EFI_ST_SUCCESS for success
+ */
+static int full_store(void)
+{
+	u8 data[EFI_ST_MANY_SIZE];
+	u16 varname[EFI_ST_MAX_VARNAME_SIZE];
+	u64 max_storage, remaining, max_size;
+	efi_status_t ret;
+	efi_uintn_t len, size;
+	u8 *buf;
+	int i, count, result = EFI_ST_FAILURE;
+
+	/* Two variables in front of the one to replace */
+	boottime->set_mem(data, sizeof(data), 0);
+	for (i = 0; i < 2; ++i) {
+		many_name(varname, "efi_st_fill", i);
+		ret = runtime->set_variable(varname, &guid_vendor1,
+					    EFI_VARIABLE_BOOTSERVICE_ACCESS,
+					    EFI_ST_MANY_SIZE >> i, data);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			return EFI_ST_FAILURE;
+		}
+	}
+	ret = runtime->set_variable(u"efi_st_full", &guid_vendor1,
+				    EFI_VARIABLE_BOOTSERVICE_ACCESS, 1, data);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("SetVariable failed\n");
+		return EFI_ST_FAILURE;
+	}
+	/* Fill the store */
+	for (count = 2; count < EFI_ST_FILL_MAX; ++count) {
+		many_name(varname, "efi_st_fill", count);
+		boottime->set_mem(data, sizeof(data), count);
+		ret = runtime->set_variable(varname, &guid_vendor1,
+					    EFI_VARIABLE_BOOTSERVICE_ACCESS,
+					    sizeof(data), data);
+		if (ret == EFI_OUT_OF_RESOURCES)
+			break;
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			goto out;
+		}
+	}
+	if (count == EFI_ST_FILL_MAX) {
+		efi_st_printf("Variable store too large to fill\n");
+		result = EFI_ST_SUCCESS;
+		goto out;
+	}
+	/*
+	 * Deleting the first variable compacts the full store, the second
+	 * one is left as a deleted entry in front of efi_st_full.
+	 */
+	for (i = 0; i < 2; ++i) {
+		many_name(varname, "efi_st_fill", i);
+		ret = runtime->set_variable(varname, &guid_vendor1, 0, 0, NULL);
+		if (ret != EFI_SUCCESS) {
+			efi_st_error("SetVariable failed\n");
+			goto out;
+		}
+	}
+	ret = runtime->query_variable_info(EFI_VARIABLE_BOOTSERVICE_ACCESS,
+					   &max_storage, &remaining, &max_size);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("QueryVariableInfo failed\n");
+		goto out;
+	}
+	/* Use all space, counting the deleted entry and the old value */
+	size = (remaining - sizeof(u"efi_st_full")) & ~7;
+	ret = boottime->allocate_pool(EFI_LOADER_DATA, size, (void **)&buf);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("AllocatePool failed\n");
+		goto out;
+	}
+	boottime->set_mem(buf, size, 0xa5);
+	ret = runtime->set_variable(u"efi_st_full", &guid_vendor1,
+				    EFI_VARIABLE_BOOTSERVICE_ACCESS, size, buf);
+	if (ret != EFI_SUCCESS) {
+		efi_st_error("SetVariable failed to replace variable\n");
+		boottime->free_pool(buf);
+		goto out;
+	}
+	len = size;
+	boottime->set_mem(buf, size, 0);
+	ret = runtime->get_variable(u"efi_st_full", &guid_vendor1, NULL,
+				    &len, buf);
+	if (ret != EFI_SUCCESS || len != size || buf[0] != 0xa5 ||
+	    buf[size - 1] != 0xa5) {
+		efi_st_error("GetVariable returned wrong value\n");
+		boottime->free_pool(buf);
+		goto out;
+	}
+	boottime->free_pool(buf);
+	for (i = 0; i < count; ++i) {
+		many_name(varname, "efi_st_fill", i);
+		len = sizeof(data);
+		ret = runtime->get_variable(varname, &guid_vendor1, NULL,
+					    &len, data);
+		if (i < 2) {
+			if (ret != EFI_NOT_FOUND) {
+				efi_st_error("Variable was not deleted\n");
+				goto out;
+			}
+		} else if (ret != EFI_SUCCESS || len != sizeof(data) ||
+			   data[0] != (u8)i || data[sizeof(data) - 1] != (u8)i) {
+			efi_st_error("Variable %d was lost\n", i);
+			goto out;
+		}
+	}
+	result = EFI_ST_SUCCESS;
+out:
+	for (i = 2; i < count; ++i) {
+		many_name(varname, "efi_st_fill", i);
+		runtime->set_variable(varname, &guid_vendor1, 0, 0, NULL);
+	}
+	runtime->set_variable(u"efi_st_full", &guid_vendor1, 0, 0, NULL);
+
+	return result;
+}
+
 /*
  * Execute unit test.
  */
@@ -277,7 +514,10 @@ static int execute(void)
 		return EFI_ST_FAILURE;
 	}
 
-	return EFI_ST_SUCCESS;
+	if (many_variables() != EFI_ST_SUCCESS)
+		return EFI_ST_FAILURE;
+
+	return full_store();
 }
 
 EFI_UNIT_TEST(variables) = {
@@ -55,9 +55,22 @@
 
 struct env_entry_node {
 	int used;
+	unsigned int hash;
 	struct env_entry entry;
 };
 
+/*
+ * Strings imported by himport_r() are not copied one by one: the import
+ * buffer is kept as an arena and the entries point into it. The arena is
+ * freed when the last string in it is dropped.
+ */
+struct env_arena {
+	struct env_arena *next;
+	unsigned int refs;
+	size_t size;
+	char buf[];
+};
+
 static void _hdelete(const char *key, struct hsearch_data *htab,
 		     struct env_entry *ep, int idx);
 
@@ -83,6 +96,16 @@ static int isprime(unsigned int number)
 	return number % div != 0;
 }
 
+/* Change nel to the first prime number not smaller as nel. */
+static size_t hprime(size_t nel)
+{
+	nel |= 1;		/* make odd */
+	while (!isprime(nel))
+		nel += 2;
+
+	return nel;
+}
+
 /*
  * Before using the hash table we must allocate memory for it.
  * Test for an existing table are done. We allocate one element
@@ -90,6 +113,9 @@ static int isprime(unsigned int number)
  * indexing as explained in the comment for the hsearch function.
  * The contents of the table is zeroed, especially the field used
  * becomes zero.
+ *
+ * The table grows when it fills up, so nel is only a hint for the number
+ * of entries which will be stored.
  */
 
 int hcreate_r(size_t nel, struct hsearch_data *htab)
@@ -106,13 +132,9 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 		return 0;
 	}
 
-	/* Change nel to the first prime number not smaller as nel. */
-	nel |= 1;		/* make odd */
-	while (!isprime(nel))
-		nel += 2;
-
-	htab->size = nel;
+	htab->size = hprime(nel);
 	htab->filled = 0;
+	htab->deleted = 0;
 
 	/* allocate memory and zero out */
 	htab->table = (struct env_entry_node *)calloc(htab->size + 1,
@@ -126,6 +148,37 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 	return 1;
 }
 
+/*
+ * Copy a string for storing in the table. Strings which are in an import
+ * arena are not copied, they just take a reference on the arena.
+ */
+static char *hstrdup(const char *str, struct env_arena *arena)
+{
+	if (arena) {
+		arena->refs++;
+		return (char *)str;
+	}
+
+	return strdup(str);
+}
+
+/* Drop a string stored in the table */
+static void hfree_str(struct hsearch_data *htab, const char *str)
+{
+	struct env_arena **linkp, *arena;
+
+	for (linkp = &htab->arena; (arena = *linkp); linkp = &arena->next) {
+		if (str >= arena->buf && str < arena->buf + arena->size) {
+			if (!--arena->refs) {
+				*linkp = arena->next;
+				free(arena);
+			}
+			return;
+		}
+	}
+	free((void *)str);
+}
+
 /*
  * hdestroy()
  */
@@ -137,6 +190,7 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 
 void hdestroy_r(struct hsearch_data *htab)
 {
+	struct env_arena *arena;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -150,16 +204,120 @@ void hdestroy_r(struct hsearch_data *htab)
 		if (htab->table[i].used > 0) {
 			struct env_entry *ep = &htab->table[i].entry;
 
-			free((void *)ep->key);
-			free(ep->data);
+			hfree_str(htab, ep->key);
+			hfree_str(htab, ep->data);
 		}
 	}
 	free(htab->table);
 
+	/* Any arena still here is held by an import in progress */
+	while ((arena = htab->arena)) {
+		htab->arena = arena->next;
+		free(arena);
+	}
+
 	/* the sign for an existing table is an value != NULL in htable */
 	htab->table = NULL;
 }
 
+/*
+ * hresize()
+ */
+
+/*
+ * The key is hashed once and the full hash value is kept in the table,
+ * which is used both to skip most strcmp() calls when searching and to move
+ * the entries when the table grows.
+ */
+static unsigned int hhash(const char *key)
+{
+	unsigned int hash = 2166136261U;
+
+	/* FNV-1a */
+	while (*key) {
+		hash ^= (unsigned char)*key++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* First hash function: simply take the modulus but prevent zero. */
+static unsigned int hfirst(unsigned int hash, unsigned int size)
+{
+	hash %= size;
+
+	return hash ? hash : 1;
+}
+
+/*
+ * Move all entries to a new table of (at least) nel slots. Keys are not
+ * hashed or compared again, and deleted slots are dropped on the way.
+ */
+static int hresize(struct hsearch_data *htab, size_t nel)
+{
+	struct env_entry_node *table;
+	unsigned int i;
+
+	nel = hprime(nel);
+	if (nel <= htab->filled)
+		return -EINVAL;
+	table = calloc(nel + 1, sizeof(struct env_entry_node));
+	if (!table)
+		return -ENOMEM;
+
+	for (i = 1; i <= htab->size; ++i) {
+		struct env_entry_node *node = &htab->table[i];
+		unsigned int hval, hval2, idx;
+
+		if (node->used <= 0)
+			continue;
+
+		/* Same probe sequence as hsearch_r() */
+		hval = hfirst(node->hash, nel);
+		hval2 = 1 + hval % (nel - 2);
+		for (idx = hval; table[idx].used;) {
+			if (idx <= hval2)
+				idx = nel + idx - hval2;
+			else
+				idx -= hval2;
+		}
+		table[idx] = *node;
+		table[idx].used = hval;
+	}
+	debug("hresize: %u -> %u slots for %u entries\n", htab->size,
+	      (unsigned int)nel, htab->filled);
+
+	free(htab->table);
+	htab->table = table;
+	htab->size = nel;
+	htab->deleted = 0;
+
+	return 0;
+}
+
+/*
+ * Make room for count more entries, keeping the table at most 3/4 full
+ * (counting deleted slots, since they lengthen the searches too). This is
+ * not done while a callback is running, as the caller may hold an index into
+ * the table. If the table cannot grow, the existing one is used until it is
+ * full.
+ */
+static void hgrow(struct hsearch_data *htab, unsigned int count)
+{
+	size_t need = htab->filled + count;
+	size_t nel = htab->size;
+
+	if (htab->busy || (need + htab->deleted) * 4 <= htab->size * 3)
+		return;
+
+	/* Just drop the deleted slots, unless the table is half full */
+	if (need * 2 > htab->size)
+		nel = need * 2 > 2 * nel ? need * 2 : 2 * nel;
+	if (hresize(htab, nel))
+		debug("hgrow: cannot resize table to %lu slots\n", (ulong)nel);
+}
+
 /*
  * hsearch()
  */
@@ -167,17 +325,16 @@ void hdestroy_r(struct hsearch_data *htab)
 /*
  * This is the search function. It uses double hashing with open addressing.
  * The argument item.key has to be a pointer to an zero terminated, most
- * probably strings of chars. The function for generating a number of the
- * strings is simple but fast. It can be replaced by a more complex function
- * like ajw (see [Aho,Sethi,Ullman]) if the needs are shown.
+ * probably strings of chars. The string is hashed with FNV-1a, which is
+ * simple but fast and spreads short similar keys well.
  *
  * We use an trick to speed up the lookup. The table is created by hcreate
  * with one more element available. This enables us to use the index zero
  * special. This index will never be used because we store the first hash
  * index in the field used where zero means not used. Every other value
- * means used. The used field can be used as a first fast comparison for
- * equality of the stored and the parameter value. This helps to prevent
- * unnecessary expensive calls of strcmp.
+ * means used. The full hash value is stored as well, and is used as a
+ * first fast comparison for equality of the stored and the parameter
+ * value. This helps to prevent unnecessary expensive calls of strcmp.
  *
  * This implementation differs from the standard library version of
  * this function in a number of ways:
@@ -188,6 +345,8 @@ void hdestroy_r(struct hsearch_data *htab)
  * - Instead of storing just pointers to the original objects, we
  *   create local copies so the caller does not need to care about the
  *   data any more.
+ * - The table grows when it is 3/4 full, rather than failing when it
+ *   is completely full.
  * - The standard implementation does not provide a way to update an
  *   existing entry.  This version will create a new entry or update an
  *   existing one when both "action == ENV_ENTER" and "item.data != NULL".
@@ -234,10 +393,10 @@ do_callback(const struct env_entry *e, const char *name, const char *value,
  */
 static inline int _compare_and_overwrite_entry(struct env_entry item,
 		enum env_action action, struct env_entry **retval,
-		struct hsearch_data *htab, int flag, unsigned int hval,
-		unsigned int idx)
+		struct hsearch_data *htab, int flag, unsigned int hash,
+		unsigned int idx, struct env_arena *arena)
 {
-	if (htab->table[idx].used == hval
+	if (htab->table[idx].used > 0 && htab->table[idx].hash == hash
 	    && strcmp(item.key, htab->table[idx].entry.key) == 0) {
 		/* Overwrite existing value? */
 		if (action == ENV_ENTER && item.data) {
@@ -262,8 +421,8 @@ static inline int _compare_and_overwrite_entry(struct env_entry item,
 				return 0;
 			}
 
-			free(htab->table[idx].entry.data);
-			htab->table[idx].entry.data = strdup(item.data);
+			hfree_str(htab, htab->table[idx].entry.data);
+			htab->table[idx].entry.data = hstrdup(item.data, arena);
 			if (!htab->table[idx].entry.data) {
 				__set_errno(ENOMEM);
 				*retval = NULL;
@@ -278,32 +437,16 @@ static inline int _compare_and_overwrite_entry(struct env_entry item,
 	return -1;
 }
 
-int hsearch_r(struct env_entry item, enum env_action action,
-	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+static int _hsearch(struct env_entry item, enum env_action action,
+		    struct env_entry **retval, struct hsearch_data *htab,
+		    int flag, struct env_arena *arena)
 {
-	unsigned int hval;
-	unsigned int count;
-	unsigned int len = strlen(item.key);
+	unsigned int hash = hhash(item.key);
+	unsigned int hval = hfirst(hash, htab->size);
 	unsigned int idx;
 	unsigned int first_deleted = 0;
 	int ret;
 
-	/* Compute an value for the given string. Perhaps use a better method. */
-	hval = len;
-	count = len;
-	while (count-- > 0) {
-		hval <<= 4;
-		hval += item.key[count];
-	}
-
-	/*
-	 * First hash function:
-	 * simply take the modul but prevent zero.
-	 */
-	hval %= htab->size;
-	if (hval == 0)
-		++hval;
-
 	/* The first index tried. */
 	idx = hval;
 
@@ -318,7 +461,7 @@ int hsearch_r(struct env_entry item, enum env_action action,
 			first_deleted = idx;
 
 		ret = _compare_and_overwrite_entry(item, action, retval, htab,
-			flag, hval, idx);
+			flag, hash, idx, arena);
 		if (ret != -1)
 			return ret;
 
@@ -351,7 +494,7 @@ int hsearch_r(struct env_entry item, enum env_action action,
 
 			/* If entry is found use it. */
 			ret = _compare_and_overwrite_entry(item, action, retval,
-				htab, flag, hval, idx);
+				htab, flag, hash, idx, arena);
 			if (ret != -1)
 				return ret;
 		}
@@ -374,12 +517,15 @@ int hsearch_r(struct env_entry item, enum env_action action,
 		 * Create new entry;
 		 * create copies of item.key and item.data
 		 */
-		if (first_deleted)
+		if (first_deleted) {
 			idx = first_deleted;
+			--htab->deleted;
+		}
 
 		htab->table[idx].used = hval;
-		htab->table[idx].entry.key = strdup(item.key);
-		htab->table[idx].entry.data = strdup(item.data);
+		htab->table[idx].hash = hash;
+		htab->table[idx].entry.key = hstrdup(item.key, arena);
+		htab->table[idx].entry.data = hstrdup(item.data, arena);
 		if (!htab->table[idx].entry.key ||
 		    !htab->table[idx].entry.data) {
 			__set_errno(ENOMEM);
@@ -426,6 +572,31 @@ int hsearch_r(struct env_entry item, enum env_action action,
 	return 0;
 }
 
+/*
+ * Callbacks may change the environment while an entry is being changed, or
+ * while the table is walked, so the table is marked busy to stop it moving.
+ */
+static int hsearch_arena(struct env_entry item, enum env_action action,
+			 struct env_entry **retval, struct hsearch_data *htab,
+			 int flag, struct env_arena *arena)
+{
+	int ret;
+
+	if (action == ENV_ENTER)
+		hgrow(htab, 1);
+	htab->busy++;
+	ret = _hsearch(item, action, retval, htab, flag, arena);
+	htab->busy--;
+
+	return ret;
+}
+
+int hsearch_r(struct env_entry item, enum env_action action,
+	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+{
+	return hsearch_arena(item, action, retval, htab, flag, NULL);
+}
+
 /*
  * hdelete()
  */
@@ -441,18 +612,19 @@ static void _hdelete(const char *key, struct hsearch_data *htab,
 {
 	/* free used entry */
 	debug("hdelete: DELETING key \"%s\"\n", key);
-	free((void *)ep->key);
-	free(ep->data);
+	hfree_str(htab, ep->key);
+	hfree_str(htab, ep->data);
 	ep->flags = 0;
 	htab->table[idx].used = USED_DELETED;
 
 	--htab->filled;
+	++htab->deleted;
 }
 
 int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 {
 	struct env_entry e, *ep;
-	int idx;
+	int idx, ret;
 
 	debug("hdelete: DELETE key \"%s\"\n", key);
 
@@ -464,13 +636,16 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 		return -ENOENT;	/* not found */
 	}
 
+	htab->busy++;
+
 	/* Check for permission */
 	if (htab->change_ok != NULL &&
 	    htab->change_ok(ep, NULL, env_op_delete, flag)) {
 		debug("change_ok() rejected deleting variable "
 			"%s, skipping it!\n", key);
 		__set_errno(EPERM);
-		return -EPERM;
+		ret = -EPERM;
+		goto out;
 	}
 
 	/* If there is a callback, call it */
@@ -479,12 +654,16 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 		debug("callback() rejected deleting variable "
 			"%s, skipping it!\n", key);
 		__set_errno(EINVAL);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 
 	_hdelete(key, htab, ep, idx);
+	ret = 0;
+out:
+	htab->busy--;
 
-	return 0;
+	return ret;
 }
 
 #if !(defined(CONFIG_SPL_BUILD) && !defined(CONFIG_SPL_SAVEENV))
@@ -600,7 +779,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		 char **resp, size_t size,
 		 int argc, char *const argv[])
 {
-	struct env_entry *list[htab->size];
+	struct env_entry *list[htab->filled + 1];
 	char *res, *p;
 	size_t totlen;
 	int i, n;
@@ -785,12 +964,40 @@ static int drop_var_from_set(const char *name, int nvars, char * vars[])
  * '\0' and '\n' have really been tested.
  */
 
+/*
+ * Count the entries in the data to import, so that the table can be sized
+ * once. Stored environments are padded to their full size, so for
+ * NUL-separated data also drop everything after the last entry.
+ */
+static unsigned int himport_count(const char *env, size_t *sizep,
+				  const char sep)
+{
+	size_t pos, size = *sizep;
+	unsigned int count = 0;
+
+	if (sep == '\0') {
+		for (pos = 0; pos < size && env[pos]; count++)
+			pos += strnlen(env + pos, size - pos) + 1;
+		*sizep = pos < size ? pos : size;
+	} else {
+		for (pos = 0; pos < size; pos++) {
+			if (env[pos] == sep)
+				count++;
+		}
+		count++;
+	}
+
+	return count;
+}
+
 int himport_r(struct hsearch_data *htab,
 		const char *env, size_t size, const char sep, int flag,
 		int crlf_is_lf, int nvars, char * const vars[])
 {
 	char *data, *sp, *dp, *name, *value;
 	char *localvars[nvars];
+	struct env_arena *arena;
+	unsigned int count;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -799,12 +1006,21 @@ int himport_r(struct hsearch_data *htab,
 		return 0;
 	}
 
-	/* we allocate new space to make sure we can write to the array */
-	if ((data = malloc(size + 1)) == NULL) {
+	count = himport_count(env, &size, sep);
+
+	/*
+	 * We allocate new space to make sure we can write to the array. This
+	 * becomes an arena holding the keys and values of the new entries.
+	 */
+	arena = malloc(sizeof(*arena) + size + 1);
+	if (!arena) {
 		debug("himport_r: can't malloc %lu bytes\n", (ulong)size + 1);
 		__set_errno(ENOMEM);
 		return 0;
 	}
+	arena->size = size + 1;
+	arena->refs = 1;
+	data = arena->buf;
 	memcpy(data, env, size);
 	data[size] = '\0';
 	dp = data;
@@ -849,18 +1065,29 @@ int himport_r(struct hsearch_data *htab,
 		if (nent > CONFIG_ENV_MAX_ENTRIES)
 			nent = CONFIG_ENV_MAX_ENTRIES;
 
+		/* The table grows later, but avoid that during the import */
+		if (nent < 2 * count)
+			nent = 2 * count;
+
 		debug("Create Hash Table: N=%d\n", nent);
 
 		if (hcreate_r(nent, htab) == 0) {
-			free(data);
+			free(arena);
 			return 0;
 		}
+	} else {
+		hgrow(htab, count);
 	}
 
 	if (!size) {
-		free(data);
+		free(arena);
 		return 1;		/* everything OK */
 	}
+
+	/* From here the arena is dropped with hfree_str() */
+	arena->next = htab->arena;
+	htab->arena = arena;
+
 	if(crlf_is_lf) {
 		/* Remove Carriage Returns in front of Line Feeds */
 		unsigned ignored_crs = 0;
@@ -924,7 +1151,7 @@ int himport_r(struct hsearch_data *htab,
 		if (*name == 0) {
 			debug("INSERT: unable to use an empty key\n");
 			__set_errno(EINVAL);
-			free(data);
+			hfree_str(htab, data);
 			return 0;
 		}
 
@@ -936,7 +1163,7 @@ int himport_r(struct hsearch_data *htab,
 		e.key = name;
 		e.data = value;
 
-		hsearch_r(e, ENV_ENTER, &rv, htab, flag);
+		hsearch_arena(e, ENV_ENTER, &rv, htab, flag, arena);
 #if !IS_ENABLED(CONFIG_ENV_WRITEABLE_LIST)
 		if (rv == NULL) {
 			printf("himport_r: can't insert \"%s=%s\" into hash table\n",
@@ -949,8 +1176,8 @@ int himport_r(struct hsearch_data *htab,
 			rv, name, value);
 	} while ((dp < data + size) && *dp);	/* size check needed for text */
 						/* without '\0' termination */
-	debug("INSERT: free(data = %p)\n", data);
-	free(data);
+	debug("INSERT: drop arena %p\n", arena);
+	hfree_str(htab, data);
 
 	if (flag & H_NOCLEAR)
 		goto end;
@@ -989,15 +1216,17 @@ end:
 int hwalk_r(struct hsearch_data *htab, int (*callback)(struct env_entry *entry))
 {
 	int i;
-	int retval;
+	int retval = 0;
 
+	htab->busy++;
 	for (i = 1; i <= htab->size; ++i) {
 		if (htab->table[i].used > 0) {
 			retval = callback(&htab->table[i].entry);
 			if (retval)
-				return retval;
+				break;
 		}
 	}
+	htab->busy--;
 
-	return 0;
+	return retval;
 }
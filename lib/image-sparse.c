@@ -47,131 +47,203 @@
 #include <linux/math64.h>
 #include <linux/err.h>
 
+/**
+ * struct sparse_write - state of writing a sparse image
+ *
+ * @info:		storage the image is written to
+ * @blk:		next block to write
+ * @bytes_written:	bytes written to the storage
+ * @buf:		DMA aligned buffer for unaligned raw data and fill
+ *			patterns, allocated when first needed
+ * @buf_blks:		size of @buf in blocks
+ * @fill_blks:		number of blocks at the start of @buf holding
+ *			@fill_val
+ * @fill_val:		fill value in @buf
+ */
+struct sparse_write {
+	struct sparse_storage *info;
+	lbaint_t blk;
+	u64 bytes_written;
+	void *buf;
+	lbaint_t buf_blks;
+	lbaint_t fill_blks;
+	u32 fill_val;
+};
+
 static void default_log(const char *ignored, char *response) {}
 
-static lbaint_t write_sparse_chunk_raw(struct sparse_storage *info,
-				       lbaint_t blk, lbaint_t blkcnt,
-				       void *data,
-				       char *response)
+/**
+ * sparse_write_blocks() - write blocks of the current chunk
+ *
+ * @sw:		write state
+ * @buffer:	DMA aligned data
+ * @blkcnt:	number of blocks
+ * @response:	buffer for an error message
+ * Return:	0 on success, -1 otherwise
+ */
+static int sparse_write_blocks(struct sparse_write *sw, const void *buffer,
+			       lbaint_t blkcnt, char *response)
 {
-	lbaint_t n = blkcnt, write_blks, blks = 0;
-	lbaint_t aligned_buf_blks = FASTBOOT_MAX_BLK_WRITE;
-	uint32_t *aligned_buf = NULL;
-
-	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF)) {
-		write_blks = info->write(info, blk, n, data);
-		if (write_blks < n)
-			goto write_fail;
-
-		return write_blks;
-	}
+	struct sparse_storage *info = sw->info;
+	lbaint_t blks;
 
-	aligned_buf = memalign(ARCH_DMA_MINALIGN, info->blksz * aligned_buf_blks);
-	if (!aligned_buf) {
-		info->mssg("Malloc failed for: CHUNK_TYPE_RAW", response);
-		return -ENOMEM;
+	blks = info->write(info, sw->blk, blkcnt, buffer);
+	if (IS_ERR_VALUE(blks)) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
+		       __func__, sw->blk, blkcnt, (long long)blks);
+		info->mssg("flash write failure", response);
+		return -1;
 	}
-
-	while (blkcnt > 0) {
-		n = min(aligned_buf_blks, blkcnt);
-		memcpy(aligned_buf, data, n * info->blksz);
-
-		/* write_blks might be > n due to NAND bad-blocks */
-		write_blks = info->write(info, blk + blks, n, aligned_buf);
-		if (write_blks < n) {
-			free(aligned_buf);
-			goto write_fail;
-		}
-
-		blks += write_blks;
-		data += n * info->blksz;
-		blkcnt -= n;
+	/* blks might be > blkcnt due to NAND bad-blocks */
+	if (blks < blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, sw->blk, blkcnt);
+		info->mssg("flash write failure(incomplete)", response);
+		return -1;
 	}
+	sw->blk += blks;
+	sw->bytes_written += (u64)blkcnt * info->blksz;
 
-	free(aligned_buf);
-	return blks;
+	return 0;
+}
 
-write_fail:
-	if (IS_ERR_VALUE(write_blks)) {
-		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
-		       __func__, blk + blks, n, (long long)write_blks);
-		info->mssg("flash write failure", response);
-		return write_blks;
+/**
+ * sparse_write_buf() - get the buffer shared by all chunks
+ *
+ * The buffer holds at least FASTBOOT_MAX_BLK_WRITE blocks and
+ * CONFIG_IMAGE_SPARSE_FILLBUF_SIZE bytes.
+ *
+ * @sw:		write state
+ * @response:	buffer for an error message
+ * Return:	the buffer, or NULL if it could not be allocated
+ */
+static void *sparse_write_buf(struct sparse_write *sw, char *response)
+{
+	struct sparse_storage *info = sw->info;
+	lbaint_t buf_blks;
+
+	if (sw->buf)
+		return sw->buf;
+
+	buf_blks = max_t(lbaint_t, FASTBOOT_MAX_BLK_WRITE,
+			 CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz);
+	sw->buf = memalign(ARCH_DMA_MINALIGN,
+			   ROUNDUP(info->blksz * buf_blks, ARCH_DMA_MINALIGN));
+	if (!sw->buf) {
+		info->mssg("Malloc failed for sparse image buffer", response);
+		return NULL;
 	}
+	sw->buf_blks = buf_blks;
 
-	/* write_blks < n */
-	printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
-	       __func__, blk + blks, n);
-	info->mssg("flash write failure(incomplete)", response);
-	return -1;
+	return sw->buf;
 }
 
-int write_sparse_image(struct sparse_storage *info,
-		       const char *part_name, void *data, char *response)
+/**
+ * write_sparse_chunk_raw() - write the data of a CHUNK_TYPE_RAW chunk
+ *
+ * Data which is suitably aligned is written in place, anything else is
+ * copied through the shared buffer.
+ *
+ * @sw:		write state
+ * @data:	chunk data
+ * @blkcnt:	number of blocks
+ * @response:	buffer for an error message
+ * Return:	0 on success, -1 otherwise
+ */
+static int write_sparse_chunk_raw(struct sparse_write *sw, const void *data,
+				  lbaint_t blkcnt, char *response)
 {
-	lbaint_t blk;
-	lbaint_t blkcnt;
-	lbaint_t blks;
-	uint64_t bytes_written = 0;
-	unsigned int chunk;
-	unsigned int offset;
-	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
+	lbaint_t blksz = sw->info->blksz;
+	lbaint_t n;
 
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF) ||
+	    IS_ALIGNED((uintptr_t)data, ARCH_DMA_MINALIGN))
+		return sparse_write_blocks(sw, data, blkcnt, response);
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	if (!sparse_write_buf(sw, response))
+		return -1;
+	/* The fill pattern is overwritten */
+	sw->fill_blks = 0;
 
-	data += sparse_header->file_hdr_sz;
-	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t)) {
-		/*
-		 * Skip the remaining bytes in a header that is longer than
-		 * we expected.
-		 */
-		data += (sparse_header->file_hdr_sz - sizeof(sparse_header_t));
+	for (; blkcnt; blkcnt -= n) {
+		n = min(blkcnt, sw->buf_blks);
+		memcpy(sw->buf, data, n * blksz);
+		if (sparse_write_blocks(sw, sw->buf, n, response))
+			return -1;
+		data += n * blksz;
 	}
 
-	if (!info->mssg)
-		info->mssg = default_log;
+	return 0;
+}
 
-	debug("=== Sparse Image Header ===\n");
-	debug("magic: 0x%x\n", sparse_header->magic);
-	debug("major_version: 0x%x\n", sparse_header->major_version);
-	debug("minor_version: 0x%x\n", sparse_header->minor_version);
-	debug("file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
-	debug("chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
-	debug("blk_sz: %d\n", sparse_header->blk_sz);
-	debug("total_blks: %d\n", sparse_header->total_blks);
-	debug("total_chunks: %d\n", sparse_header->total_chunks);
+/**
+ * write_sparse_chunk_fill() - write the blocks of a CHUNK_TYPE_FILL chunk
+ *
+ * The fill pattern is kept in the shared buffer, so that following chunks
+ * with the same value do not have to fill it again.
+ *
+ * @sw:		write state
+ * @fill_val:	fill value
+ * @blkcnt:	number of blocks
+ * @response:	buffer for an error message
+ * Return:	0 on success, -1 otherwise
+ */
+static int write_sparse_chunk_fill(struct sparse_write *sw, u32 fill_val,
+				   lbaint_t blkcnt, char *response)
+{
+	lbaint_t blksz = sw->info->blksz;
+	u32 *fill_buf;
+	lbaint_t n;
+	size_t i;
 
-	/*
-	 * Verify that the sparse block size is a multiple of our
-	 * storage backend block size
-	 */
-	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
-	if (offset) {
-		printf("%s: Sparse image block size issue [%u]\n",
-		       __func__, sparse_header->blk_sz);
-		info->mssg("sparse image block size issue", response);
+	fill_buf = sparse_write_buf(sw, response);
+	if (!fill_buf)
 		return -1;
+
+	n = min(blkcnt, sw->buf_blks);
+	if (sw->fill_val != fill_val)
+		sw->fill_blks = 0;
+	if (sw->fill_blks < n) {
+		for (i = sw->fill_blks * blksz / sizeof(u32);
+		     i < n * blksz / sizeof(u32); i++)
+			fill_buf[i] = fill_val;
+		sw->fill_blks = n;
+		sw->fill_val = fill_val;
 	}
 
-	puts("Flashing Sparse Image\n");
+	for (; blkcnt; blkcnt -= n) {
+		n = min(blkcnt, sw->buf_blks);
+		if (sparse_write_blocks(sw, fill_buf, n, response))
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * write_sparse_chunks() - write the chunks of a sparse image
+ *
+ * @sw:			write state
+ * @sparse_header:	header of the image, which has been checked
+ * @data:		first chunk header
+ * @response:		buffer for an error message
+ * Return:		number of sparse blocks processed, or -1 on error
+ */
+static long write_sparse_chunks(struct sparse_write *sw,
+				sparse_header_t *sparse_header, void *data,
+				char *response)
+{
+	struct sparse_storage *info = sw->info;
+	chunk_header_t *chunk_header;
+	u32 total_blocks = 0;
+	u64 chunk_data_sz;
+	unsigned int chunk;
+	lbaint_t blkcnt;
 
-	/* Start processing chunks */
-	blk = info->start;
 	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
 		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
+		chunk_header = data;
+		data += sparse_header->chunk_hdr_sz;
 
 		if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
 			debug("=== Chunk Header ===\n");
@@ -180,15 +252,6 @@ int write_sparse_image(struct sparse_storage *info,
 			debug("total_size: 0x%x\n", chunk_header->total_sz);
 		}
 
-		if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t)) {
-			/*
-			 * Skip the remaining bytes in a header that is longer
-			 * than we expected.
-			 */
-			data += (sparse_header->chunk_hdr_sz -
-				 sizeof(chunk_header_t));
-		}
-
 		chunk_data_sz = ((u64)sparse_header->blk_sz) * chunk_header->chunk_sz;
 		blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
 		switch (chunk_header->chunk_type) {
@@ -199,92 +262,26 @@ int write_sparse_image(struct sparse_storage *info,
 					   response);
 				return -1;
 			}
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
-					   response);
-				return -1;
-			}
-
-			blks = write_sparse_chunk_raw(info, blk, blkcnt,
-						      data, response);
-			if (IS_ERR_VALUE(blks))
-				return -1;
-
-			blk += blks;
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
 			break;
 
 		case CHUNK_TYPE_FILL:
 			if (chunk_header->total_sz !=
 			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
-				info->mssg("Bogus chunk size for chunk type FILL", response);
-				return -1;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
+				info->mssg("Bogus chunk size for chunk type FILL",
 					   response);
 				return -1;
 			}
+			break;
 
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
-
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				info->mssg("Request would exceed partition size!",
+		case CHUNK_TYPE_DONT_CARE:
+			if (chunk_header->total_sz != sparse_header->chunk_hdr_sz) {
+				info->mssg("Bogus chunk size for chunk type Dont Care",
 					   response);
 				return -1;
 			}
-
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
-			bytes_written += ((u64)blkcnt) * info->blksz;
-			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
-							 sparse_header->blk_sz);
-			free(fill_buf);
-			break;
-
-		case CHUNK_TYPE_DONT_CARE:
-			blk += info->reserve(info, blk, blkcnt);
+			sw->blk += info->reserve(info, sw->blk, blkcnt);
 			total_blocks += chunk_header->chunk_sz;
-			break;
+			continue;
 
 		case CHUNK_TYPE_CRC32:
 			if (chunk_header->total_sz !=
@@ -294,8 +291,8 @@ int write_sparse_image(struct sparse_storage *info,
 				return -1;
 			}
 			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
-			break;
+			data += sizeof(uint32_t);
+			continue;
 
 		default:
 			printf("%s: Unknown chunk type: %x\n", __func__,
@@ -303,11 +300,90 @@ int write_sparse_image(struct sparse_storage *info,
 			info->mssg("Unknown chunk type", response);
 			return -1;
 		}
+
+		if (sw->blk + blkcnt > info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			info->mssg("Request would exceed partition size!",
+				   response);
+			return -1;
+		}
+
+		if (chunk_header->chunk_type == CHUNK_TYPE_RAW) {
+			if (write_sparse_chunk_raw(sw, data, blkcnt, response))
+				return -1;
+			data += chunk_data_sz;
+		} else {
+			if (write_sparse_chunk_fill(sw, *(uint32_t *)data,
+						    blkcnt, response))
+				return -1;
+			data += sizeof(uint32_t);
+		}
+		total_blocks += chunk_header->chunk_sz;
 	}
 
-	debug("Wrote %d blocks, expected to write %d blocks\n",
+	return total_blocks;
+}
+
+int write_sparse_image(struct sparse_storage *info,
+		       const char *part_name, void *data, char *response)
+{
+	sparse_header_t *sparse_header;
+	struct sparse_write sw = {
+		.info = info,
+		.blk = info->start,
+	};
+	unsigned int offset;
+	long total_blocks;
+
+	if (!info->mssg)
+		info->mssg = default_log;
+
+	/* Read and skip over sparse image header */
+	sparse_header = (sparse_header_t *)data;
+	data += sparse_header->file_hdr_sz;
+
+	debug("=== Sparse Image Header ===\n");
+	debug("magic: 0x%x\n", sparse_header->magic);
+	debug("major_version: 0x%x\n", sparse_header->major_version);
+	debug("minor_version: 0x%x\n", sparse_header->minor_version);
+	debug("file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
+	debug("chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
+	debug("blk_sz: %d\n", sparse_header->blk_sz);
+	debug("total_blks: %d\n", sparse_header->total_blks);
+	debug("total_chunks: %d\n", sparse_header->total_chunks);
+
+	if (!is_sparse_image(sparse_header) ||
+	    sparse_header->file_hdr_sz < sizeof(sparse_header_t) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		printf("%s: Invalid sparse image header\n", __func__);
+		info->mssg("invalid sparse image header", response);
+		return -1;
+	}
+
+	/*
+	 * Verify that the sparse block size is a multiple of our
+	 * storage backend block size
+	 */
+	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	if (!sparse_header->blk_sz || offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse_header->blk_sz);
+		info->mssg("sparse image block size issue", response);
+		return -1;
+	}
+
+	puts("Flashing Sparse Image\n");
+
+	total_blocks = write_sparse_chunks(&sw, sparse_header, data, response);
+	free(sw.buf);
+	if (total_blocks < 0)
+		return -1;
+
+	debug("Wrote %ld blocks, expected to write %d blocks\n",
 	      total_blocks, sparse_header->total_blks);
-	printf("........ wrote %llu bytes to '%s'\n", bytes_written, part_name);
+	printf("........ wrote %llu bytes to '%s'\n", sw.bytes_written,
+	       part_name);
 
 	if (total_blocks != sparse_header->total_blks) {
 		info->mssg("sparse image write failure", response);
@@ -93,15 +93,31 @@ static long lmb_regions_adjacent(struct lmb_region *rgn, unsigned long r1,
 	return lmb_addrs_adjacent(base1, size1, base2, size2);
 }
 
-static void lmb_remove_region(struct lmb_region *rgn, unsigned long r)
+/*
+ * Find the last region starting at or below @addr, -1 if there is none. Since
+ * the regions are sorted and do not overlap, this is the only one which can
+ * contain @addr.
+ */
+static long lmb_find_region(struct lmb_region *rgn, phys_addr_t addr)
 {
-	unsigned long i;
+	long lo = 0, hi = rgn->cnt;
+
+	while (lo < hi) {
+		long mid = lo + (hi - lo) / 2;
 
-	for (i = r; i < rgn->cnt - 1; i++) {
-		rgn->region[i].base = rgn->region[i + 1].base;
-		rgn->region[i].size = rgn->region[i + 1].size;
-		rgn->region[i].flags = rgn->region[i + 1].flags;
+		if (rgn->region[mid].base <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+
+	return lo - 1;
+}
+
+static void lmb_remove_region(struct lmb_region *rgn, unsigned long r)
+{
+	memmove(&rgn->region[r], &rgn->region[r + 1],
+		(rgn->cnt - r - 1) * sizeof(rgn->region[0]));
 	rgn->cnt--;
 }
 
@@ -130,19 +146,57 @@ static void lmb_fix_over_lap_regions(struct lmb_region *rgn, unsigned long r1,
 	lmb_remove_region(rgn, r2);
 }
 
+/* Double the size of a full array, moving it to the heap the first time */
+static int lmb_grow_region(struct lmb_region *rgn)
+{
+	unsigned long max = rgn->max ? rgn->max * 2 : 1;
+	struct lmb_property *region;
+
+	if (!rgn->grow)
+		return -1;
+	if (rgn->allocated) {
+		region = realloc(rgn->region, max * sizeof(*region));
+	} else {
+		region = malloc(max * sizeof(*region));
+		if (region)
+			memcpy(region, rgn->region, rgn->cnt * sizeof(*region));
+	}
+	if (!region)
+		return -1;
+	rgn->region = region;
+	rgn->max = max;
+	rgn->allocated = true;
+
+	return 0;
+}
+
 void lmb_init(struct lmb *lmb)
 {
-#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
-	lmb->memory.max = CONFIG_LMB_MAX_REGIONS;
-	lmb->reserved.max = CONFIG_LMB_MAX_REGIONS;
-#else
-	lmb->memory.max = CONFIG_LMB_MEMORY_REGIONS;
-	lmb->reserved.max = CONFIG_LMB_RESERVED_REGIONS;
+	lmb->memory.max = ARRAY_SIZE(lmb->memory_regions);
+	lmb->reserved.max = ARRAY_SIZE(lmb->reserved_regions);
 	lmb->memory.region = lmb->memory_regions;
 	lmb->reserved.region = lmb->reserved_regions;
-#endif
 	lmb->memory.cnt = 0;
 	lmb->reserved.cnt = 0;
+	lmb->memory.grow = false;
+	lmb->reserved.grow = false;
+	lmb->memory.allocated = false;
+	lmb->reserved.allocated = false;
+}
+
+void lmb_enable_grow(struct lmb *lmb)
+{
+	lmb->memory.grow = true;
+	lmb->reserved.grow = true;
+}
+
+void lmb_release(struct lmb *lmb)
+{
+	if (lmb->memory.allocated)
+		free(lmb->memory.region);
+	if (lmb->reserved.allocated)
+		free(lmb->reserved.region);
+	lmb_init(lmb);
 }
 
 void arch_lmb_reserve_generic(struct lmb *lmb, ulong sp, ulong end, ulong align)
@@ -257,9 +311,11 @@ static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
 				 phys_size_t size, enum lmb_flags flags)
 {
 	unsigned long coalesced = 0;
-	long adjacent, i;
+	long adjacent, i, last;
 
 	if (rgn->cnt == 0) {
+		if (!rgn->max && lmb_grow_region(rgn))
+			return -1;
 		rgn->region[0].base = base;
 		rgn->region[0].size = size;
 		rgn->region[0].flags = flags;
@@ -267,8 +323,14 @@ static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
 		return 0;
 	}
 
-	/* First try and coalesce this LMB with another. */
-	for (i = 0; i < rgn->cnt; i++) {
+	/*
+	 * First try and coalesce this LMB with another. Only the region
+	 * before the one which @base falls in and the one after it can
+	 * contain, touch or overlap the start of the new region.
+	 */
+	i = lmb_find_region(rgn, base);
+	last = min_t(long, i + 1, rgn->cnt - 1);
+	for (i = max_t(long, i - 1, 0); i <= last; i++) {
 		phys_addr_t rgnbase = rgn->region[i].base;
 		phys_size_t rgnsize = rgn->region[i].size;
 		phys_size_t rgnflags = rgn->region[i].flags;
@@ -301,6 +363,8 @@ static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
 			return -1;
 		}
 	}
+	if (i > last)
+		i = rgn->cnt;
 
 	if (i < rgn->cnt - 1 && rgn->region[i].flags == rgn->region[i + 1].flags)  {
 		if (lmb_regions_adjacent(rgn, i, i + 1)) {
@@ -315,29 +379,16 @@ static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
 
 	if (coalesced)
 		return coalesced;
-	if (rgn->cnt >= rgn->max)
+	if (rgn->cnt >= rgn->max && lmb_grow_region(rgn))
 		return -1;
 
 	/* Couldn't coalesce the LMB, so add it to the sorted table. */
-	for (i = rgn->cnt-1; i >= 0; i--) {
-		if (base < rgn->region[i].base) {
-			rgn->region[i + 1].base = rgn->region[i].base;
-			rgn->region[i + 1].size = rgn->region[i].size;
-			rgn->region[i + 1].flags = rgn->region[i].flags;
-		} else {
-			rgn->region[i + 1].base = base;
-			rgn->region[i + 1].size = size;
-			rgn->region[i + 1].flags = flags;
-			break;
-		}
-	}
-
-	if (base < rgn->region[0].base) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].flags = flags;
-	}
-
+	i = lmb_find_region(rgn, base) + 1;
+	memmove(&rgn->region[i + 1], &rgn->region[i],
+		(rgn->cnt - i) * sizeof(rgn->region[0]));
+	rgn->region[i].base = base;
+	rgn->region[i].size = size;
+	rgn->region[i].flags = flags;
 	rgn->cnt++;
 
 	return 0;
@@ -362,21 +413,17 @@ long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	struct lmb_region *rgn = &(lmb->reserved);
 	phys_addr_t rgnbegin, rgnend;
 	phys_addr_t end = base + size - 1;
-	int i;
-
-	rgnbegin = rgnend = 0; /* supress gcc warnings */
+	long i;
 
 	/* Find the region where (base, size) belongs to */
-	for (i = 0; i < rgn->cnt; i++) {
-		rgnbegin = rgn->region[i].base;
-		rgnend = rgnbegin + rgn->region[i].size - 1;
-
-		if ((rgnbegin <= base) && (end <= rgnend))
-			break;
-	}
+	i = lmb_find_region(rgn, base);
+	if (i < 0)
+		return -1;
+	rgnbegin = rgn->region[i].base;
+	rgnend = rgnbegin + rgn->region[i].size - 1;
 
 	/* Didn't find the region */
-	if (i == rgn->cnt)
+	if (end > rgnend)
 		return -1;
 
 	/* Check to see if we are removing entire region */
@@ -423,16 +470,23 @@ long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 static long lmb_overlaps_region(struct lmb_region *rgn, phys_addr_t base,
 				phys_size_t size)
 {
-	unsigned long i;
+	long i, last;
 
-	for (i = 0; i < rgn->cnt; i++) {
+	/*
+	 * Any region overlapping (base, size) either contains @base or is the
+	 * first one after it
+	 */
+	i = lmb_find_region(rgn, base);
+	last = min_t(long, i + 1, rgn->cnt - 1);
+	for (i = max_t(long, i, 0); i <= last; i++) {
 		phys_addr_t rgnbase = rgn->region[i].base;
 		phys_size_t rgnsize = rgn->region[i].size;
+
 		if (lmb_addrs_overlap(base, size, rgnbase, rgnsize))
-			break;
+			return i;
 	}
 
-	return (i < rgn->cnt) ? i : -1;
+	return -1;
 }
 
 phys_addr_t lmb_alloc(struct lmb *lmb, phys_size_t size, ulong align)
@@ -528,22 +582,20 @@ phys_addr_t lmb_alloc_addr(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 /* Return number of bytes from a given address that are free */
 phys_size_t lmb_get_free_size(struct lmb *lmb, phys_addr_t addr)
 {
-	int i;
-	long rgn;
+	long i, rgn;
 
 	/* check if the requested address is in the memory regions */
 	rgn = lmb_overlaps_region(&lmb->memory, addr, 1);
 	if (rgn >= 0) {
-		for (i = 0; i < lmb->reserved.cnt; i++) {
-			if (addr < lmb->reserved.region[i].base) {
-				/* first reserved range > requested address */
-				return lmb->reserved.region[i].base - addr;
-			}
-			if (lmb->reserved.region[i].base +
-			    lmb->reserved.region[i].size > addr) {
-				/* requested addr is in this reserved range */
-				return 0;
-			}
+		i = lmb_find_region(&lmb->reserved, addr);
+		if (i >= 0 && lmb->reserved.region[i].base +
+		    lmb->reserved.region[i].size > addr) {
+			/* requested addr is in this reserved range */
+			return 0;
+		}
+		if (i + 1 < lmb->reserved.cnt) {
+			/* first reserved range > requested address */
+			return lmb->reserved.region[i + 1].base - addr;
 		}
 		/* if we come here: no reserved ranges above requested addr */
 		return lmb->memory.region[lmb->memory.cnt - 1].base +
@@ -554,14 +606,15 @@ phys_size_t lmb_get_free_size(struct lmb *lmb, phys_addr_t addr)
 
 int lmb_is_reserved_flags(struct lmb *lmb, phys_addr_t addr, int flags)
 {
-	int i;
+	long i;
+	phys_addr_t upper;
 
-	for (i = 0; i < lmb->reserved.cnt; i++) {
-		phys_addr_t upper = lmb->reserved.region[i].base +
-			lmb->reserved.region[i].size - 1;
-		if ((addr >= lmb->reserved.region[i].base) && (addr <= upper))
-			return (lmb->reserved.region[i].flags & flags) == flags;
-	}
+	i = lmb_find_region(&lmb->reserved, addr);
+	if (i < 0)
+		return 0;
+	upper = lmb->reserved.region[i].base + lmb->reserved.region[i].size - 1;
+	if (addr <= upper)
+		return (lmb->reserved.region[i].flags & flags) == flags;
 	return 0;
 }
 
@@ -15,12 +15,17 @@
 #include <linux/libfdt.h>
 #include <of_live.h>
 #include <malloc.h>
+#include <asm/global_data.h>
 #include <dm/of_access.h>
+#include <dm/root.h>
 #include <linux/err.h>
 #include <linux/sizes.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 enum {
 	BUF_STEP	= SZ_64K,
+	MAX_DEPTH	= 32,	/* deepest tree unflatten_dt_size() can size */
 };
 
 static void *unflatten_dt_alloc(void **mem, unsigned long size,
@@ -260,6 +265,73 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 	return mem;
 }
 
+/**
+ * unflatten_dt_size() - Work out the memory needed to unflatten a tree
+ *
+ * This walks the tags of the flat tree once, instead of doing a dry run of
+ * unflatten_dt_node(), which looks up every node and property through libfdt.
+ * It allows for alignment padding after every allocation and, in trees
+ * older than version 0x10, for a 'name' property to be created for every
+ * node, so the result may be slightly larger than needed.
+ *
+ * @blob: Flat tree to size
+ * Return: number of bytes needed, or 0 if the tree is too deep or invalid, in
+ * which case the caller should do a dry run instead
+ */
+static unsigned long unflatten_dt_size(const void *blob)
+{
+	const unsigned long align = max(__alignof__(struct device_node),
+					__alignof__(struct property));
+	unsigned long fpsize[MAX_DEPTH + 1];
+	int offset = 0, nextoffset, depth = 0;
+	unsigned long size = 0;
+	const char *name;
+	int len;
+
+	fpsize[0] = 0;
+	do {
+		switch (fdt_next_tag(blob, offset, &nextoffset)) {
+		case FDT_BEGIN_NODE:
+			name = fdt_get_name(blob, offset, &len);
+			if (!name || depth == MAX_DEPTH)
+				return 0;
+			/* Follow the full_name sizing in unflatten_dt_node() */
+			len++;
+			fpsize[depth + 1] = fpsize[depth];
+			if (*name != '/') {
+				fpsize[depth + 1] += depth ? len : 1;
+				len = depth ? fpsize[depth + 1] : 2;
+			}
+			size += ALIGN(sizeof(struct device_node) + len, align);
+			/*
+			 * Old-format nodes may get a 'name' property, at most as
+			 * long as the name
+			 */
+			if (*name == '/')
+				size += ALIGN(sizeof(struct property) + len,
+					      align);
+			depth++;
+			break;
+		case FDT_END_NODE:
+			if (!depth--)
+				return 0;
+			break;
+		case FDT_PROP:
+			size += ALIGN(sizeof(struct property), align);
+			break;
+		case FDT_NOP:
+			break;
+		case FDT_END:
+			return depth ? 0 : size;
+		default:
+			return 0;
+		}
+		offset = nextoffset;
+	} while (offset >= 0);
+
+	return 0;
+}
+
 int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 {
 	unsigned long size;
@@ -284,9 +356,12 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 	}
 
 	/* First pass, scan for size */
-	start = 0;
-	size = (unsigned long)unflatten_dt_node(blob, NULL, &start, NULL, NULL,
-						0, true);
+	size = unflatten_dt_size(blob);
+	if (!size) {
+		start = 0;
+		size = (unsigned long)unflatten_dt_node(blob, NULL, &start,
+							NULL, NULL, 0, true);
+	}
 	if (!size)
 		return -EFAULT;
 	size = ALIGN(size, 4);
@@ -333,11 +408,24 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 		debug("Failed to scan live tree aliases: err=%d\n", ret);
 		return ret;
 	}
+	ret = of_phandle_cache_init(*rootp);
+	if (ret) {
+		/* Lookups still work without the cache, just more slowly */
+		debug("Failed to create phandle cache: err=%d\n", ret);
+		ret = 0;
+	}
 	debug("%s: stop\n", __func__);
 
 	return ret;
 }
 
+void of_live_collect_stats(struct dm_stats *stats)
+{
+	/* The control tree is a single block starting with the root node */
+	if (of_live_active())
+		stats->of_live_size = malloc_usable_size(gd_of_root());
+}
+
 void of_live_free(struct device_node *root)
 {
 	/* the tree is stored as a contiguous block of memory */
@@ -7,6 +7,12 @@
 #include <net.h>
 #include <net/fastboot_tcp.h>
 #include <net/tcp.h>
+#include <asm/unaligned.h>
+
+/* Acknowledge received data at least every FASTBOOT_TCP_ACK_BYTES... */
+#define FASTBOOT_TCP_ACK_BYTES	(8 * TCP_MSS)
+/* ...or once no more data arrived for FASTBOOT_TCP_ACK_DELAY ms */
+#define FASTBOOT_TCP_ACK_DELAY	5
 
 static char command[FASTBOOT_COMMAND_LEN] = {0};
 static char response[FASTBOOT_RESPONSE_LEN] = {0};
@@ -16,23 +22,34 @@ static const uchar *handshake = "FB01";
 
 static u16 curr_sport;
 static u16 curr_dport;
-static u32 curr_tcp_seq_num;
 static u32 curr_tcp_ack_num;
-static unsigned int curr_request_len;
 static enum fastboot_tcp_state {
 	FASTBOOT_CLOSED,
 	FASTBOOT_CONNECTED,
 	FASTBOOT_DISCONNECTING
 } state = FASTBOOT_CLOSED;
 
+/* Next sequence number expected from the host, and the last one acked */
+static u32 rx_next_seq;
+static u32 rx_acked_seq;
+/*
+ * Download data received beyond a missing segment.  It is already stored
+ * in the download buffer and is passed on once the hole is filled.
+ */
+static u32 rx_hill_start;
+static u32 rx_hill_end;
+
+/* Each message is a big endian 8 byte length followed by the payload */
+static u8 msg_header[8];
+static unsigned int msg_header_len;
+static u64 msg_left;
+static unsigned int command_len;
+
 static void fastboot_tcp_answer(u8 action, unsigned int len)
 {
-	const u32 response_seq_num = curr_tcp_ack_num;
-	const u32 response_ack_num = curr_tcp_seq_num +
-		  (curr_request_len > 0 ? curr_request_len : 1);
-
 	net_send_tcp_packet(len, htons(curr_sport), htons(curr_dport),
-			    action, response_seq_num, response_ack_num);
+			    action, curr_tcp_ack_num, rx_next_seq);
+	rx_acked_seq = rx_next_seq;
 }
 
 static void fastboot_tcp_reset(void)
@@ -67,31 +84,196 @@ static void fastboot_tcp_send_message(const char *message, unsigned int len)
 	memset(pkt, '\0', PKTSIZE);
 }
 
+static void fastboot_tcp_ack_timeout(void)
+{
+	if (state == FASTBOOT_CONNECTED && rx_acked_seq != rx_next_seq)
+		fastboot_tcp_answer(TCP_ACK, 0);
+}
+
+/**
+ * fastboot_tcp_consume() - process data received in order
+ *
+ * @data: Pointer to the data
+ * @len: Length of the data
+ *
+ * Splits the data into messages, runs commands and stores downloads.
+ *
+ * Return: false if the connection was reset
+ */
+static bool fastboot_tcp_consume(const uchar *data, unsigned int len)
+{
+	int fastboot_command_id;
+	unsigned int n;
+	bool download;
+
+	while (len) {
+		if (msg_header_len < sizeof(msg_header)) {
+			n = min_t(unsigned int, len,
+				  sizeof(msg_header) - msg_header_len);
+			memcpy(msg_header + msg_header_len, data, n);
+			msg_header_len += n;
+			rx_next_seq += n;
+			data += n;
+			len -= n;
+			if (msg_header_len < sizeof(msg_header))
+				break;
+
+			msg_left = get_unaligned_be64(msg_header);
+			command_len = 0;
+			if (!msg_left)
+				msg_header_len = 0;
+			continue;
+		}
+
+		n = min_t(u64, len, msg_left);
+		download = fastboot_data_remaining() != 0;
+		if (download) {
+			n = min(n, fastboot_data_remaining());
+			fastboot_data_download(data, n, response);
+		} else {
+			if (command_len + n >= FASTBOOT_COMMAND_LEN) {
+				fastboot_tcp_reset();
+				return false;
+			}
+			memcpy(command + command_len, data, n);
+			command_len += n;
+		}
+		msg_left -= n;
+		rx_next_seq += n;
+		data += n;
+		len -= n;
+		if (!msg_left)
+			msg_header_len = 0;
+
+		if (download && !fastboot_data_remaining()) {
+			fastboot_data_complete(response);
+			fastboot_tcp_send_message(response, strlen(response));
+		} else if (!download && !msg_left) {
+			command[command_len] = '\0';
+			command_len = 0;
+			fastboot_command_id = fastboot_handle_command(command,
+								      response);
+			fastboot_tcp_send_message(response, strlen(response));
+			fastboot_handle_boot(fastboot_command_id,
+					     strncmp("OKAY", response, 4) == 0);
+			memset(command, 0, FASTBOOT_COMMAND_LEN);
+		}
+		memset(response, 0, FASTBOOT_RESPONSE_LEN);
+	}
+
+	return true;
+}
+
+/**
+ * fastboot_tcp_place() - store download data received out of order
+ *
+ * @data: Pointer to the data
+ * @tcp_seq_num: Sequence number of the data, beyond rx_next_seq
+ * @len: Length of the data
+ *
+ * Only data which belongs to the current download and extends the data
+ * already stored beyond the hole is kept, the host resends the rest.
+ */
+static void fastboot_tcp_place(const uchar *data, u32 tcp_seq_num,
+			       unsigned int len)
+{
+	u32 offset = tcp_seq_num - rx_next_seq;
+
+	if (msg_header_len < sizeof(msg_header) ||
+	    offset + len > min_t(u64, msg_left, fastboot_data_remaining()))
+		return;
+
+	if (rx_hill_start == rx_hill_end) {
+		rx_hill_start = tcp_seq_num;
+		rx_hill_end = tcp_seq_num + len;
+	} else if (tcp_seq_num == rx_hill_end) {
+		rx_hill_end += len;
+	} else if (tcp_seq_num + len == rx_hill_start) {
+		rx_hill_start = tcp_seq_num;
+	} else {
+		return;
+	}
+	memcpy(fastboot_data_buffer() + offset, data, len);
+}
+
+/**
+ * fastboot_tcp_receive() - process a segment received while connected
+ *
+ * @data: Pointer to the data
+ * @tcp_seq_num: Sequence number of the data
+ * @len: Length of the data
+ * @push: The host set the push flag
+ */
+static void fastboot_tcp_receive(const uchar *data, u32 tcp_seq_num,
+				 unsigned int len, bool push)
+{
+	s32 offset = tcp_seq_num - rx_next_seq;
+	unsigned int n;
+
+	if (offset > 0) {
+		/* A duplicate ack makes the host resend the missing data */
+		fastboot_tcp_place(data, tcp_seq_num, len);
+		fastboot_tcp_answer(TCP_ACK, 0);
+		return;
+	}
+	if (-offset >= (s32)len) {
+		/* Resent data, the ack was probably lost */
+		fastboot_tcp_answer(TCP_ACK, 0);
+		return;
+	}
+	data -= offset;
+	len += offset;
+
+	if (rx_hill_start != rx_hill_end) {
+		/* Data from the hill on is in the download buffer already */
+		len = min(len, rx_hill_start - rx_next_seq);
+		if (!fastboot_tcp_consume(data, len))
+			return;
+		if (rx_next_seq == rx_hill_start) {
+			n = rx_hill_end - rx_hill_start;
+			rx_hill_start = rx_hill_end;
+			if (!fastboot_tcp_consume(fastboot_data_buffer(), n))
+				return;
+		}
+	} else if (!fastboot_tcp_consume(data, len)) {
+		return;
+	}
+
+	if (state != FASTBOOT_CONNECTED || rx_acked_seq == rx_next_seq)
+		return;
+	if (push || rx_next_seq - rx_acked_seq >= FASTBOOT_TCP_ACK_BYTES)
+		fastboot_tcp_answer(TCP_ACK, 0);
+	else
+		net_set_timeout_handler(FASTBOOT_TCP_ACK_DELAY,
+					fastboot_tcp_ack_timeout);
+}
+
 static void fastboot_tcp_handler_ipv4(uchar *pkt, u16 dport,
 				      struct in_addr sip, u16 sport,
 				      u32 tcp_seq_num, u32 tcp_ack_num,
 				      u8 action, unsigned int len)
 {
-	int fastboot_command_id;
-	u64 command_size;
 	u8 tcp_fin = action & TCP_FIN;
 	u8 tcp_push = action & TCP_PUSH;
 
 	curr_sport = sport;
 	curr_dport = dport;
-	curr_tcp_seq_num = tcp_seq_num;
 	curr_tcp_ack_num = tcp_ack_num;
-	curr_request_len = len;
 
 	switch (state) {
 	case FASTBOOT_CLOSED:
 		if (tcp_push) {
+			rx_next_seq = tcp_seq_num + (len > 0 ? len : 1);
 			if (len != handshake_length ||
 			    strlen(pkt) != handshake_length ||
 			    memcmp(pkt, handshake, handshake_length) != 0) {
 				fastboot_tcp_reset();
 				break;
 			}
+			msg_header_len = 0;
+			msg_left = 0;
+			command_len = 0;
+			rx_hill_start = rx_hill_end;
 			fastboot_tcp_send_packet(TCP_ACK | TCP_PUSH,
 						 handshake, handshake_length);
 			state = FASTBOOT_CONNECTED;
@@ -99,41 +281,19 @@ static void fastboot_tcp_handler_ipv4(uchar *pkt, u16 dport,
 		break;
 	case FASTBOOT_CONNECTED:
 		if (tcp_fin) {
+			rx_next_seq = tcp_seq_num + len + 1;
 			fastboot_tcp_answer(TCP_FIN | TCP_ACK, 0);
 			state = FASTBOOT_DISCONNECTING;
 			break;
 		}
-		if (tcp_push) {
-			// First 8 bytes is big endian message length
-			command_size = __be64_to_cpu(*(u64 *)pkt);
-			len -= 8;
-			pkt += 8;
-
-			// Only single packet messages are supported ATM
-			if (strlen(pkt) != command_size) {
-				fastboot_tcp_reset();
-				break;
-			}
-			strlcpy(command, pkt, len + 1);
-			fastboot_command_id = fastboot_handle_command(command, response);
-			fastboot_tcp_send_message(response, strlen(response));
-			fastboot_handle_boot(fastboot_command_id,
-					     strncmp("OKAY", response, 4) == 0);
-		}
+		if (len)
+			fastboot_tcp_receive(pkt, tcp_seq_num, len, tcp_push);
 		break;
 	case FASTBOOT_DISCONNECTING:
 		if (tcp_push)
 			state = FASTBOOT_CLOSED;
 		break;
 	}
-
-	memset(command, 0, FASTBOOT_COMMAND_LEN);
-	memset(response, 0, FASTBOOT_RESPONSE_LEN);
-	curr_sport = 0;
-	curr_dport = 0;
-	curr_tcp_seq_num = 0;
-	curr_tcp_ack_num = 0;
-	curr_request_len = 0;
 }
 
 void fastboot_tcp_start_server(void)
@@ -141,5 +301,7 @@ void fastboot_tcp_start_server(void)
 	printf("Using %s device\n", eth_get_name());
 	printf("Listening for fastboot command on tcp %pI4\n", &net_ip);
 
+	state = FASTBOOT_CLOSED;
 	tcp_set_tcp_handler(fastboot_tcp_handler_ipv4);
+	tcp_set_rx_window(CONFIG_TCP_FUNCTION_FASTBOOT_WINDOW);
 }
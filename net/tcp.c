@@ -33,6 +33,13 @@ static struct tcp_sack_v tcp_lost;
 static u32 loc_timestamp;
 static u32 rmt_timestamp;
 
+/* Peer offered window scaling in its SYN */
+static bool rmt_scale;
+
+/* Receive window advertised to the peer, in bytes */
+#define TCP_RX_WINDOW_DEFAULT	(PKTBUFSRX * TCP_MSS)
+static u32 tcp_rx_window = TCP_RX_WINDOW_DEFAULT;
+
 static u32 tcp_seq_init;
 static u32 tcp_ack_edge;
 
@@ -98,6 +105,8 @@ static void dummy_handler(uchar *pkt, u16 dport,
 /**
  * tcp_set_tcp_handler() - set a handler to receive data
  * @f: handler
+ *
+ * This also restores the default receive window.
  */
 void tcp_set_tcp_handler(rxhand_tcp *f)
 {
@@ -106,6 +115,32 @@ void tcp_set_tcp_handler(rxhand_tcp *f)
 		tcp_packet_handler = dummy_handler;
 	else
 		tcp_packet_handler = f;
+	tcp_rx_window = TCP_RX_WINDOW_DEFAULT;
+}
+
+/**
+ * tcp_set_rx_window() - set the receive window advertised to the peer
+ * @size: window size in bytes
+ */
+void tcp_set_rx_window(u32 size)
+{
+	tcp_rx_window = size;
+}
+
+/**
+ * tcp_rx_window_field() - get the receive window for the TCP header
+ * @syn: the packet is a SYN, whose window is never scaled
+ *
+ * Return: window field in network byte order
+ */
+static u16 tcp_rx_window_field(bool syn)
+{
+	u32 window = tcp_rx_window;
+
+	if (!syn && rmt_scale)
+		window >>= TCP_SCALE;
+
+	return htons(min_t(u32, window, U16_MAX));
 }
 
 /**
@@ -236,6 +271,43 @@ void net_set_syn_options(union tcp_build_pkt *b)
 	b->ip.end = TCP_O_END;
 }
 
+/**
+ * net_set_syn_ack_options() - set TCP options in SYN ACK packets
+ * @b: the packet
+ *
+ * Window scaling is only offered to a peer which offered it.  SACK is not
+ * offered, as the applications which accept connections do not keep all
+ * out of order data.
+ */
+static void net_set_syn_ack_options(union tcp_build_pkt *b)
+{
+	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
+		tcp_lost.len = 0;
+
+	b->ip.hdr.tcp_hlen = 0xa0;
+
+	b->ip.mss.kind = TCP_O_MSS;
+	b->ip.mss.len = TCP_OPT_LEN_4;
+	b->ip.mss.mss = htons(TCP_MSS);
+	if (rmt_scale) {
+		b->ip.scale.kind = TCP_O_SCL;
+		b->ip.scale.scale = TCP_SCALE;
+		b->ip.scale.len = TCP_OPT_LEN_3;
+	} else {
+		b->ip.scale.kind = TCP_1_NOP;
+		b->ip.scale.scale = TCP_1_NOP;
+		b->ip.scale.len = TCP_1_NOP;
+	}
+	b->ip.sack_p.kind = TCP_1_NOP;
+	b->ip.sack_p.len = TCP_1_NOP;
+	b->ip.t_opt.kind = TCP_O_TS;
+	b->ip.t_opt.len = TCP_OPT_LEN_A;
+	loc_timestamp = get_ticks();
+	b->ip.t_opt.t_snd = 0;
+	b->ip.t_opt.t_rcv = rmt_timestamp;
+	b->ip.end = TCP_O_END;
+}
+
 int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		       u8 action, u32 tcp_seq_num, u32 tcp_ack_num)
 {
@@ -271,6 +343,13 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		}
 		break;
 	case TCP_SYN | TCP_ACK:
+		debug_cond(DEBUG_DEV_PKT,
+			   "TCP Hdr:SYN ACK (%pI4, %pI4, s=%u, a=%u)\n",
+			   &net_server_ip, &net_ip, tcp_seq_num, tcp_ack_num);
+		net_set_syn_ack_options(b);
+		b->ip.hdr.tcp_flags = action;
+		pkt_hdr_len = IP_TCP_O_SIZE;
+		break;
 	case TCP_ACK:
 		pkt_hdr_len = IP_HDR_SIZE + net_set_ack_options(b);
 		b->ip.hdr.tcp_flags = action;
@@ -337,9 +416,10 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	 * throughput. Temporary memory use for the boot phase on modern
 	 * SOCs is may not be considered a constraint to buffer space, if
 	 * it is, then the u-boot tftp or nfs kernel netboot should be
-	 * considered.
+	 * considered.  Applications which store data straight away may
+	 * select a larger window with tcp_set_rx_window().
 	 */
-	b->ip.hdr.tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	b->ip.hdr.tcp_win = tcp_rx_window_field(b->ip.hdr.tcp_flags & TCP_SYN);
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
@@ -475,27 +555,33 @@ void tcp_parse_options(uchar *o, int o_len)
 	 * NOPs are options with a zero length, and thus are special.
 	 * All other options have length fields.
 	 */
-	for (p = o; p < (o + o_len); p = p + p[1]) {
-		if (!p[1])
-			return; /* Finished processing options */
+	while (p < (o + o_len)) {
+		if (p[0] == TCP_O_END)
+			return;
+
+		/* Process optional NOPs */
+		if (p[0] == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+
+		if (p + 1 >= o + o_len || p[1] < TCP_OPT_LEN_2)
+			return; /* Malformed option */
 
 		switch (p[0]) {
-		case TCP_O_END:
-			return;
 		case TCP_O_MSS:
-		case TCP_O_SCL:
 		case TCP_P_SACK:
 		case TCP_V_SACK:
 			break;
+		case TCP_O_SCL:
+			rmt_scale = true;
+			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
 			rmt_timestamp = tsopt->t_snd;
-			return;
+			break;
 		}
-
-		/* Process optional NOPs */
-		if (p[0] == TCP_O_NOP)
-			p++;
+		p += p[1];
 	}
 }
 
@@ -672,6 +758,9 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 	tcp_hdr_len = GET_TCP_HDR_LEN_IN_BYTES(b->ip.hdr.tcp_hlen);
 	payload_len = tcp_len - tcp_hdr_len;
 
+	/* Window scaling is only offered in SYN packets */
+	if (b->ip.hdr.tcp_flags & TCP_SYN)
+		rmt_scale = false;
 	if (tcp_hdr_len > TCP_HDR_SIZE)
 		tcp_parse_options((uchar *)b + IP_TCP_HDR_SIZE,
 				  tcp_hdr_len - TCP_HDR_SIZE);
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test for fastboot downloads over TCP
+ *
+ * The sandbox Ethernet device plays the host.  It opens the connection,
+ * downloads an image in segments, one pair of them swapped, and checks
+ * that the device acknowledges each burst of segments only once.
+ */
+
+#include <dm.h>
+#include <env.h>
+#include <fastboot.h>
+#include <malloc.h>
+#include <net.h>
+#include <net/fastboot_tcp.h>
+#include <net/tcp.h>
+#include <asm/eth.h>
+#include <asm/unaligned.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define SHIFT_TO_TCPHDRLEN_FIELD(x) ((x) << 4)
+#define LEN_B_TO_DW(x) ((x) >> 2)
+
+#define FB_TEST_HOST_PORT	50000
+#define FB_TEST_PORT		5554
+#define FB_TEST_SIZE		16384
+/* Segment size and segments per burst, one packet buffer stays in use */
+#define FB_TEST_SEG		1024
+#define FB_TEST_BURST		(PKTBUFSRX - 1)
+
+/**
+ * struct fb_test_host - state of the emulated fastboot host
+ *
+ * @seq: Next sequence number to send
+ * @ack: Next sequence number expected from the device
+ * @connected: The device answered the handshake
+ * @done: The device acknowledged the download
+ * @swap: Swap the last two segments of the next burst
+ * @stream: Download message, length followed by the image
+ * @sent: Bytes of the stream sent
+ * @acks: Acknowledgments of complete bursts
+ * @dup_acks: Acknowledgments which point at a missing segment
+ */
+static struct fb_test_host {
+	u32 seq;
+	u32 ack;
+	bool connected;
+	bool done;
+	bool swap;
+	u8 stream[8 + FB_TEST_SIZE];
+	unsigned int sent;
+	unsigned int acks;
+	unsigned int dup_acks;
+} host;
+
+static int sb_fastboot_send(struct udevice *dev, u32 seq, u8 flags,
+			    const void *data, unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_tcp_hdr *tcp;
+	int pkt_len = IP_TCP_HDR_SIZE + len;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -EOVERFLOW;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	tcp = (void *)eth + ETHER_HDR_SIZE;
+	tcp->tcp_src = htons(FB_TEST_HOST_PORT);
+	tcp->tcp_dst = htons(FB_TEST_PORT);
+	tcp->tcp_seq = htonl(seq);
+	tcp->tcp_ack = htonl(host.ack);
+	tcp->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	tcp->tcp_flags = flags;
+	tcp->tcp_win = htons(U16_MAX);
+	tcp->tcp_xsum = 0;
+	tcp->tcp_ugr = 0;
+	memcpy((void *)tcp + IP_TCP_HDR_SIZE, data, len);
+	tcp->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp, net_server_ip,
+					      net_ip, TCP_HDR_SIZE + len,
+					      pkt_len);
+	net_set_ip_header((uchar *)tcp, net_ip, net_server_ip, pkt_len,
+			  IPPROTO_TCP);
+
+	priv->recv_packet_length[priv->recv_packets] = ETHER_HDR_SIZE + pkt_len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
+static int sb_fastboot_send_msg(struct udevice *dev, const char *msg)
+{
+	u8 buf[8 + FASTBOOT_COMMAND_LEN];
+	unsigned int len = strlen(msg);
+	int ret;
+
+	put_unaligned_be64(len, buf);
+	memcpy(buf + 8, msg, len);
+	ret = sb_fastboot_send(dev, host.seq, TCP_ACK | TCP_PUSH, buf, len + 8);
+	host.seq += len + 8;
+
+	return ret;
+}
+
+/* Send the next burst of the download, the last segment with TCP_PUSH */
+static int sb_fastboot_send_data(struct udevice *dev)
+{
+	unsigned int left = sizeof(host.stream) - host.sent;
+	unsigned int n = min_t(unsigned int, DIV_ROUND_UP(left, FB_TEST_SEG),
+				 FB_TEST_BURST);
+	unsigned int i, j, offset;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		j = host.swap && n > 2 && i >= n - 2 ? 2 * n - 3 - i : i;
+		offset = j * FB_TEST_SEG;
+		ret = sb_fastboot_send(dev, host.seq + offset,
+				       TCP_ACK | (i == n - 1 ? TCP_PUSH : 0),
+				       host.stream + host.sent + offset,
+				       min_t(unsigned int, left - offset,
+					     FB_TEST_SEG));
+		if (ret)
+			return ret;
+	}
+	host.swap = false;
+	left = min(left, n * FB_TEST_SEG);
+	host.sent += left;
+	host.seq += left;
+
+	return 0;
+}
+
+static int sb_fastboot_reply(struct udevice *dev, const u8 *msg,
+			     unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	/* Used by all of the ut_assert macros */
+	struct unit_test_state *uts = priv->priv;
+	char cmd[FASTBOOT_COMMAND_LEN];
+
+	if (!host.connected) {
+		ut_asserteq(4, len);
+		ut_asserteq_mem("FB01", msg, 4);
+		host.connected = true;
+		snprintf(cmd, sizeof(cmd), "download:%08x", FB_TEST_SIZE);
+		return sb_fastboot_send_msg(dev, cmd);
+	}
+
+	ut_assert(len > 8);
+	ut_asserteq(len - 8, get_unaligned_be64(msg));
+	msg += 8;
+	if (!memcmp(msg, "DATA", 4)) {
+		host.swap = true;
+		return sb_fastboot_send_data(dev);
+	}
+
+	ut_asserteq_mem("OKAY", msg, 4);
+	if (host.done)
+		return 0;
+	host.done = true;
+	ut_asserteq(sizeof(host.stream), host.sent);
+
+	return sb_fastboot_send_msg(dev, "continue");
+}
+
+static int sb_fastboot_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	/* Used by all of the ut_assert macros */
+	struct unit_test_state *uts = priv->priv;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	unsigned int hdr_len, payload_len;
+	int ret;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		return sandbox_eth_arp_req_to_reply(dev, packet, len);
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return 0;
+
+	ut_assert(!(tcp->tcp_flags & TCP_RST));
+	hdr_len = IP_HDR_SIZE + ((tcp->tcp_hlen >> 4) << 2);
+	payload_len = ntohs(tcp->ip_len) - hdr_len;
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		/* Without window scaling the window is as large as possible */
+		ut_asserteq(min_t(u32, CONFIG_TCP_FUNCTION_FASTBOOT_WINDOW,
+				  U16_MAX), ntohs(tcp->tcp_win));
+		host.ack = ntohl(tcp->tcp_seq) + 1;
+		ret = sb_fastboot_send(dev, host.seq, TCP_ACK, NULL, 0);
+		if (ret)
+			return ret;
+		ret = sb_fastboot_send(dev, host.seq, TCP_ACK | TCP_PUSH,
+				       "FB01", 4);
+		host.seq += 4;
+		return ret;
+	}
+
+	if (payload_len) {
+		host.ack = ntohl(tcp->tcp_seq) + payload_len;
+		return sb_fastboot_reply(dev, (u8 *)tcp + hdr_len,
+					 payload_len);
+	}
+
+	/* Acknowledgments during the download */
+	if (!host.sent || host.done)
+		return 0;
+	if (ntohl(tcp->tcp_ack) != host.seq) {
+		host.dup_acks++;
+		return 0;
+	}
+	host.acks++;
+
+	return sb_fastboot_send_data(dev);
+}
+
+static int net_test_fastboot_tcp(struct unit_test_state *uts)
+{
+	unsigned int segments = DIV_ROUND_UP(sizeof(host.stream), FB_TEST_SEG);
+	void *buf;
+	int i;
+
+	memset(&host, 0, sizeof(host));
+	host.seq = 1000;
+	put_unaligned_be64(FB_TEST_SIZE, host.stream);
+	for (i = 0; i < FB_TEST_SIZE; i++)
+		host.stream[8 + i] = i * 7 + (i >> 8);
+
+	buf = malloc(FB_TEST_SIZE);
+	ut_assertnonnull(buf);
+	fastboot_init(buf, FB_TEST_SIZE);
+
+	sandbox_eth_set_tx_handler(0, sb_fastboot_handler);
+	sandbox_eth_set_priv(0, uts);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("serverip", "1.1.2.2");
+
+	/* Run the server as net_loop(FASTBOOT_TCP) does */
+	ut_assertok(net_init());
+	ut_assertok(eth_init());
+	net_set_state(NETLOOP_CONTINUE);
+	tcp_set_tcp_state(TCP_CLOSED);
+	fastboot_tcp_start_server();
+
+	/* The host opens the connection */
+	ut_assertok(sb_fastboot_send(eth_get_dev(), host.seq, TCP_SYN,
+				     NULL, 0));
+	host.seq++;
+	for (i = 0; i < 100 && net_state == NETLOOP_CONTINUE; i++)
+		eth_rx();
+
+	net_set_timeout_handler(0, NULL);
+	tcp_set_tcp_handler(NULL);
+	eth_halt();
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	ut_asserteq(NETLOOP_SUCCESS, net_state);
+	ut_assert(host.done);
+	ut_asserteq_mem(host.stream + 8, buf, FB_TEST_SIZE);
+	ut_asserteq(FB_TEST_SIZE, env_get_hex("filesize", 0));
+
+	/* One ack per burst, the last one is the OKAY response */
+	ut_asserteq(DIV_ROUND_UP(segments, FB_TEST_BURST) - 1, host.acks);
+	/* The swapped segment is reported missing once */
+	ut_asserteq(1, host.dup_acks);
+
+	fastboot_init(NULL, 0);
+	free(buf);
+
+	return 0;
+}
+
+LIB_TEST(net_test_fastboot_tcp, 0);
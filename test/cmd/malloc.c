@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for malloc command
+ */
+
+#include <console.h>
+#include <malloc.h>
+#include <test/cmd.h>
+#include <test/ut.h>
+
+/* Test 'malloc info' */
+static int cmd_test_malloc_info(struct unit_test_state *uts)
+{
+	struct malloc_slab_stats stats;
+
+	malloc_slab_get_stats(&stats);
+	ut_assertok(run_command("malloc info", 0));
+	ut_assert_nextlinen("slab region: 1 MiB, %u pages, ", stats.pages);
+	ut_assert_nextlinen("in use:      ");
+	ut_assert_nextline("overflows:   %lu", stats.overflows);
+	ut_assert_nextline("size  pages    in use      allocs       frees");
+	ut_assert_nextlinen("  16  ");
+	ut_assert_skip_to_linen(" 256  ");
+	ut_assert_console_end();
+
+	return 0;
+}
+CMD_TEST(cmd_test_malloc_info, UT_TESTF_CONSOLE_REC);
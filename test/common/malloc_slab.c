@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the slab allocator in front of malloc()
+ */
+
+#include <malloc.h>
+#include <test/common.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* Test that small allocations come from slabs and are freed correctly */
+static int common_test_malloc_slab(struct unit_test_state *uts)
+{
+	struct malloc_slab_stats before, stats;
+	ulong start = ut_check_free();
+	char *ptr, *big;
+	int i;
+
+	malloc_slab_get_stats(&before);
+	ut_assert(before.size);
+
+	ptr = malloc(20);
+	ut_assertnonnull(ptr);
+	ut_assert(malloc_slab_owns(ptr));
+	ut_asserteq(32, malloc_usable_size(ptr));
+	malloc_slab_get_stats(&stats);
+	ut_asserteq(before.cls[1].allocs + 1, stats.cls[1].allocs);
+	ut_asserteq(before.cls[1].in_use + 1, stats.cls[1].in_use);
+	ut_asserteq(32, ut_check_delta(start));
+
+	/* Growing within the class keeps the object */
+	strcpy(ptr, "slab");
+	ut_asserteq_ptr(ptr, realloc(ptr, 30));
+
+	/* Growing beyond the largest class moves it to the heap */
+	big = realloc(ptr, MALLOC_SLAB_MAX + 1);
+	ut_assertnonnull(big);
+	ut_assert(!malloc_slab_owns(big));
+	ut_asserteq_str("slab", big);
+	free(big);
+
+	ptr = calloc(1, MALLOC_SLAB_MAX);
+	ut_assert(malloc_slab_owns(ptr));
+	for (i = 0; i < MALLOC_SLAB_MAX; i++)
+		ut_asserteq(0, ptr[i]);
+	free(ptr);
+
+	/* Larger alignment than malloc() gives needs the heap */
+	ptr = memalign(64, 40);
+	ut_assertnonnull(ptr);
+	ut_asserteq(0, (ulong)ptr & 63);
+	free(ptr);
+
+	ut_assert(!malloc_slab_owns(&i));
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+COMMON_TEST(common_test_malloc_slab, 0);
+
+/* Test that pages go back to the region once all their objects are freed */
+static int common_test_malloc_slab_pages(struct unit_test_state *uts)
+{
+	struct malloc_slab_stats before, stats;
+	void *ptrs[600];
+	int i;
+
+	malloc_slab_get_stats(&before);
+	for (i = 0; i < ARRAY_SIZE(ptrs); i++) {
+		ptrs[i] = malloc(8);
+		ut_assert(malloc_slab_owns(ptrs[i]));
+	}
+	malloc_slab_get_stats(&stats);
+	ut_assert(stats.cls[0].pages >= before.cls[0].pages + 2);
+	ut_asserteq(before.cls[0].in_use + ARRAY_SIZE(ptrs),
+		    stats.cls[0].in_use);
+
+	for (i = 0; i < ARRAY_SIZE(ptrs); i++)
+		free(ptrs[i]);
+	malloc_slab_get_stats(&stats);
+	ut_asserteq(before.cls[0].in_use, stats.cls[0].in_use);
+	ut_assert(stats.cls[0].pages <= before.cls[0].pages + 1);
+
+	/* The tests above did not leave any pages behind */
+	ut_assert(stats.free_pages >= before.free_pages);
+
+	return 0;
+}
+COMMON_TEST(common_test_malloc_slab_pages, 0);
+
+/* Test that malloc() failure injection also covers slabs */
+static int common_test_malloc_slab_testing(struct unit_test_state *uts)
+{
+	void *ptr;
+
+	malloc_enable_testing(0);
+	ptr = malloc(16);
+	malloc_disable_testing();
+	ut_assertnull(ptr);
+
+	return 0;
+}
+COMMON_TEST(common_test_malloc_slab_testing, 0);
+
+/* Test allocating from an arena and freeing it in one go */
+static int common_test_malloc_arena(struct unit_test_state *uts)
+{
+	ulong start = ut_check_free();
+	struct malloc_arena *arena;
+	char *ptr, *big, *last;
+	int i;
+
+	arena = malloc_arena_new(0);
+	ut_assertnonnull(arena);
+
+	for (i = 0; i < 1000; i++) {
+		ptr = malloc_arena_alloc(arena, i % 50 + 1);
+		ut_assertnonnull(ptr);
+		ut_asserteq(0, (ulong)ptr % (2 * sizeof(size_t)));
+		memset(ptr, i, i % 50 + 1);
+	}
+
+	ut_assert(ut_check_delta(start) > 0);
+	malloc_arena_free(arena);
+	ut_assertok(ut_check_delta(start));
+
+	/* A large allocation does not waste the current block */
+	arena = malloc_arena_new(0x1000);
+	ut_assertnonnull(arena);
+	ptr = malloc_arena_alloc(arena, 16);
+	big = malloc_arena_alloc(arena, 0x10000);
+	ut_assertnonnull(big);
+	memset(big, '\xff', 0x10000);
+	last = malloc_arena_alloc(arena, 16);
+	ut_asserteq_ptr(ptr + 16, last);
+	ut_assert(ut_check_delta(start) > 0x10000);
+	malloc_arena_free(arena);
+	ut_assertok(ut_check_delta(start));
+	malloc_arena_free(NULL);
+
+	return 0;
+}
+COMMON_TEST(common_test_malloc_arena, 0);
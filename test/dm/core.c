@@ -12,6 +12,7 @@
 #include <malloc.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
@@ -1352,3 +1353,116 @@ static int dm_test_dev_get_mem(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_dev_get_mem, UT_TESTF_SCAN_FDT);
+
+/* Test that each compatible string finds the first driver which declares it */
+static int dm_test_driver_match_compat(struct unit_test_state *uts)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match, *id, *exp_id;
+	struct driver *entry, *drv, *exp_drv;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match;
+		     of_match && of_match->compatible; of_match++) {
+			exp_id = NULL;
+			for (exp_drv = driver; !exp_id; exp_drv++) {
+				for (id = exp_drv->of_match;
+				     id && id->compatible; id++) {
+					if (!strcmp(id->compatible,
+						    of_match->compatible)) {
+						exp_id = id;
+						break;
+					}
+				}
+			}
+			exp_drv--;
+			drv = lists_driver_match_compat(of_match->compatible,
+							&id);
+			ut_asserteq_ptr(exp_drv, drv);
+			ut_asserteq_ptr(exp_id, id);
+		}
+	}
+	ut_assertnull(lists_driver_match_compat("sandbox,no-such-device",
+						&id));
+
+	return 0;
+}
+DM_TEST(dm_test_driver_match_compat, 0);
+
+/* Find the first device with @node, the way the lookups did before the map */
+static struct udevice *find_first_by_ofnode(struct udevice *parent,
+					    ofnode node)
+{
+	struct udevice *dev, *found;
+
+	if (ofnode_equal(dev_ofnode(parent), node))
+		return parent;
+	device_foreach_child(dev, parent) {
+		found = find_first_by_ofnode(dev, node);
+		if (found)
+			return found;
+	}
+
+	return NULL;
+}
+
+static int check_ofnode_lookups(struct unit_test_state *uts,
+				struct udevice *parent)
+{
+	struct udevice *dev, *exp, *found;
+	ofnode node = dev_ofnode(parent);
+	struct uclass *uc;
+
+	if (ofnode_valid(node)) {
+		ut_assertok(device_find_global_by_ofnode(node, &found));
+		ut_asserteq_ptr(find_first_by_ofnode(dm_root(), node), found);
+
+		uclass_id_foreach_dev(device_get_uclass_id(parent), exp, uc) {
+			if (ofnode_equal(dev_ofnode(exp), node))
+				break;
+		}
+		ut_assertok(uclass_find_device_by_ofnode(
+				device_get_uclass_id(parent), node, &found));
+		ut_asserteq_ptr(exp, found);
+	}
+	device_foreach_child(dev, parent)
+		ut_assertok(check_ofnode_lookups(uts, dev));
+
+	return 0;
+}
+
+/* Test that device lookups by ofnode match a walk of the devices */
+static int dm_test_ofnode_map(struct unit_test_state *uts)
+{
+	struct udevice *dev, *found;
+	ofnode node, other;
+
+	ut_assertok(check_ofnode_lookups(uts, dm_root()));
+
+	/* Move a device to another node, then back */
+	ut_assertok(uclass_find_first_device(UCLASS_TEST_FDT, &dev));
+	ut_assertnonnull(dev);
+	node = dev_ofnode(dev);
+	other = ofnode_path("/some-bus");
+	ut_assert(ofnode_valid(other));
+	dev_set_ofnode(dev, other);
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST_FDT, other,
+						 &found));
+	ut_asserteq_ptr(dev, found);
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_FDT,
+							  node, &found));
+	ut_assertok(check_ofnode_lookups(uts, dm_root()));
+	dev_set_ofnode(dev, node);
+	ut_assertok(check_ofnode_lookups(uts, dm_root()));
+
+	/* Unbinding must drop the device */
+	ut_assertok(device_unbind(dev));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_FDT,
+							  node, &found));
+	ut_asserteq(-ENOENT, device_find_global_by_ofnode(node, &found));
+	ut_assertok(check_ofnode_lookups(uts, dm_root()));
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_map, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
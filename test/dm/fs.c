@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for reading files which are kept open on a block device
+ */
+
+#include <blk.h>
+#include <dm.h>
+#include <fs.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <os.h>
+#include <sandbox_host.h>
+#include <dm/device-internal.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define FS_TEST_SIZE1	0x1800
+#define FS_TEST_SIZE2	0x500
+
+/* Write @size bytes of @buf to @fname on @desc */
+static int fs_test_write(struct unit_test_state *uts, struct blk_desc *desc,
+			 const char *fname, void *buf, loff_t size)
+{
+	loff_t actwrite;
+
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	ut_assertok(fs_write(fname, map_to_sysmem(buf), 0, size, &actwrite));
+	ut_asserteq(size, actwrite);
+
+	return 0;
+}
+
+/* Open @fname on @desc, checking that it has @size bytes */
+static int fs_test_open(struct unit_test_state *uts, struct blk_desc *desc,
+			const char *fname, loff_t size, struct fs_file **filep)
+{
+	struct fs_file *file;
+
+	ut_assertok(fs_set_blk_dev_with_part(desc, 0));
+	file = fs_openfile(fname);
+	ut_assertnonnull(file);
+	ut_asserteq(size, file->size);
+	*filep = file;
+
+	return 0;
+}
+
+/* Read @len bytes at @offset of @file, checking they match @expect */
+static int fs_test_pread(struct unit_test_state *uts, struct fs_file *file,
+			 loff_t offset, loff_t len, const u8 *expect)
+{
+	static u8 buf[FS_TEST_SIZE1];
+	loff_t actread;
+
+	memset(buf, '\0', sizeof(buf));
+	ut_assertok(fs_pread(file, buf, offset, len, &actread));
+	ut_asserteq(len, actread);
+	ut_asserteq_mem(expect + offset, buf, len);
+
+	return 0;
+}
+
+/* Test the files on the filesystem in the image @img */
+static int fs_test_file(struct unit_test_state *uts, const char *img)
+{
+	static u8 data1[FS_TEST_SIZE1], data2[FS_TEST_SIZE2];
+	static u8 newdata1[FS_TEST_SIZE1], buf[0x100];
+	struct fs_file *file1, *file2;
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	char fname[256];
+	loff_t actread;
+	void *disk, *ptr;
+	int i;
+
+	for (i = 0; i < FS_TEST_SIZE1; i++) {
+		data1[i] = i * 3 + i / 256;
+		newdata1[i] = ~data1[i];
+	}
+	for (i = 0; i < FS_TEST_SIZE2; i++)
+		data2[i] = i * 5;
+
+	/* Attach a file created in test_ut_dm_init */
+	ut_assertok(os_persistent_file(fname, sizeof(fname), img));
+	ut_assertok(host_create_attach_file("fs", fname, false, DEFAULT_BLKSZ,
+					    &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+
+	ut_assertok(fs_test_write(uts, desc, "/file1", data1, FS_TEST_SIZE1));
+	ut_assertok(fs_test_write(uts, desc, "/file2", data2, FS_TEST_SIZE2));
+
+	/* Keep a copy of the whole device, to write it back later */
+	disk = malloc(desc->lba * desc->blksz);
+	ut_assertnonnull(disk);
+	ut_asserteq(desc->lba, blk_read(blk, 0, desc->lba, disk));
+
+	/* Read from two files open at once */
+	ut_assertok(fs_test_open(uts, desc, "/file1", FS_TEST_SIZE1, &file1));
+	ut_assertok(fs_test_open(uts, desc, "/file2", FS_TEST_SIZE2, &file2));
+	ut_assertok(fs_test_pread(uts, file1, 0x100, 0x200, data1));
+	ut_assertok(fs_test_pread(uts, file2, 0, FS_TEST_SIZE2, data2));
+	ut_assertok(fs_test_pread(uts, file1, 3, 0x1001, data1));
+	ut_assertok(fs_test_pread(uts, file2, 0x4ff, 1, data2));
+	ut_assertok(fs_test_pread(uts, file1, 0, FS_TEST_SIZE1, data1));
+
+	/* A read running past the end of the file stops there */
+	ut_assertok(fs_pread(file1, buf, FS_TEST_SIZE1 - 0x10, sizeof(buf),
+			     &actread));
+	ut_asserteq(0x10, actread);
+	ut_asserteq_mem(data1 + FS_TEST_SIZE1 - 0x10, buf, 0x10);
+
+	/* ...and one starting beyond it reads nothing */
+	ut_assertok(fs_pread(file1, buf, FS_TEST_SIZE1, sizeof(buf), &actread));
+	ut_asserteq(0, actread);
+	ut_assertok(fs_pread(file2, buf, FS_TEST_SIZE2 + 0x100, sizeof(buf),
+			     &actread));
+	ut_asserteq(0, actread);
+
+	ut_assertok(fs_pread_alloc(file2, 0, &ptr));
+	ut_asserteq_mem(data2, ptr, FS_TEST_SIZE2);
+	ut_asserteq(0, ((u8 *)ptr)[FS_TEST_SIZE2]);
+	free(ptr);
+
+	/* Files which are open see a write through the filesystem... */
+	ut_assertok(fs_test_write(uts, desc, "/file1", newdata1,
+				  FS_TEST_SIZE1));
+	ut_assertok(fs_test_pread(uts, file1, 0, FS_TEST_SIZE1, newdata1));
+	ut_assertok(fs_test_pread(uts, file2, 0, FS_TEST_SIZE2, data2));
+
+	/* ...and one to the block device underneath it */
+	ut_asserteq(desc->lba, blk_write(blk, 0, desc->lba, disk));
+	ut_assertok(fs_test_pread(uts, file1, 0x100, 0x200, data1));
+	ut_assertok(fs_test_pread(uts, file2, 0, FS_TEST_SIZE2, data2));
+
+	fs_closefile(file1);
+	fs_closefile(file2);
+	fs_closefile(NULL);
+
+	/* Closing the files leaves the filesystem usable */
+	ut_assertok(fs_test_open(uts, desc, "/file1", FS_TEST_SIZE1, &file1));
+	ut_assertok(fs_test_pread(uts, file1, 0, FS_TEST_SIZE1, data1));
+	fs_closefile(file1);
+
+	free(disk);
+	ut_assertok(host_detach_file(dev));
+	ut_assertok(device_unbind(dev));
+
+	return 0;
+}
+
+/* Test reading files kept open on an ext2 filesystem */
+static int dm_test_fs_file_ext2(struct unit_test_state *uts)
+{
+	return fs_test_file(uts, "2MB.ext2.img");
+}
+DM_TEST(dm_test_fs_file_ext2, UT_TESTF_SCAN_FDT);
+
+/* Test reading files kept open on a FAT filesystem */
+static int dm_test_fs_file_fat(struct unit_test_state *uts)
+{
+	return fs_test_file(uts, "1MB.fat32.img");
+}
+DM_TEST(dm_test_fs_file_fat, UT_TESTF_SCAN_FDT);
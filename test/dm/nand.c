@@ -102,3 +102,75 @@ DM_TEST(dm_test_nand##dev##_end, UT_TESTF_SCAN_FDT)
 
 DM_NAND_TEST(0);
 DM_NAND_TEST(1);
+
+#if IS_ENABLED(CONFIG_MTD_PAGE_CACHE)
+static int nand_cache_check(struct unit_test_state *uts, struct mtd_info *mtd,
+			    loff_t off, u8 val)
+{
+	u8 buf[16], gold[16];
+	size_t retlen;
+	int ret;
+
+	memset(gold, val, sizeof(gold));
+	ret = mtd_read(mtd, off, sizeof(buf), &retlen, buf);
+	/* The sandbox NAND injects correctable errors */
+	if (ret != -EUCLEAN)
+		ut_assertok(ret);
+	ut_asserteq(sizeof(buf), retlen);
+	ut_asserteq_mem(gold, buf, sizeof(buf));
+
+	return 0;
+}
+
+static int dm_test_nand_cache(struct unit_test_state *uts)
+{
+	struct mtd_cache_stats before, after;
+	struct erase_info instr = { };
+	struct mtd_info *mtd;
+	size_t retlen;
+	loff_t off;
+	u8 *buf;
+
+	mtd = get_nand_dev_by_index(0);
+	ut_assertnonnull(mtd);
+	off = mtd->erasesize * 8;
+	buf = malloc(mtd->writesize * 2);
+	ut_assertnonnull(buf);
+
+	instr.addr = off;
+	instr.len = mtd->erasesize;
+	ut_assertok(mtd_erase(mtd, &instr));
+	memset(buf, 0x5a, mtd->writesize * 2);
+	ut_assertok(mtd_write(mtd, off, mtd->writesize * 2, &retlen, buf));
+
+	/* A second read of the same page is a hit */
+	ut_assertok(nand_cache_check(uts, mtd, off, 0x5a));
+	ut_assertok(mtd_cache_get_stats(mtd, &before));
+	ut_assertok(nand_cache_check(uts, mtd, off + 16, 0x5a));
+	ut_assertok(mtd_cache_get_stats(mtd, &after));
+	ut_asserteq(before.hits + 1, after.hits);
+	ut_asserteq(before.misses, after.misses);
+
+	/* Moving on to the next page reads ahead */
+	ut_assertok(nand_cache_check(uts, mtd, off + mtd->writesize, 0x5a));
+	ut_assertok(mtd_cache_get_stats(mtd, &after));
+	ut_asserteq(before.misses + 1, after.misses);
+	ut_assert(after.readahead > before.readahead);
+
+	/* The erased page read ahead above is dropped when written */
+	ut_assertok(nand_cache_check(uts, mtd, off + mtd->writesize * 2, 0xff));
+	memset(buf, 0xa5, mtd->writesize);
+	ut_assertok(mtd_write(mtd, off + mtd->writesize * 2, mtd->writesize,
+			      &retlen, buf));
+	ut_assertok(nand_cache_check(uts, mtd, off + mtd->writesize * 2, 0xa5));
+
+	/* ...and so is everything in an erased block */
+	ut_assertok(mtd_erase(mtd, &instr));
+	ut_assertok(nand_cache_check(uts, mtd, off, 0xff));
+
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_nand_cache, UT_TESTF_SCAN_FDT);
+#endif
@@ -19,9 +19,11 @@
 #include <abuf.h>
 #include <dm.h>
 #include <log.h>
+#include <malloc.h>
 #include <of_live.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <dm/of_access.h>
 #include <dm/of_extra.h>
 #include <dm/root.h>
 #include <dm/test.h>
@@ -152,6 +154,36 @@ static int dm_test_ofnode_get_by_phandle_ot(struct unit_test_state *uts)
 DM_TEST(dm_test_ofnode_get_by_phandle_ot,
 	UT_TESTF_SCAN_FDT | UT_TESTF_OTHER_FDT);
 
+/* test that the phandle cache gives the same nodes as a tree walk */
+static int dm_test_ofnode_phandle_cache(struct unit_test_state *uts)
+{
+	struct device_node *np, *exp;
+	struct dm_stats before, after;
+	int count = 0;
+
+	dm_get_mem(&before);
+	for_each_of_allnodes(np) {
+		if (!np->phandle)
+			continue;
+		for_each_of_allnodes(exp)
+			if (exp->phandle == np->phandle)
+				break;
+		ut_asserteq_ptr(exp, of_find_node_by_phandle(NULL,
+							     np->phandle));
+		count++;
+	}
+	ut_assert(count > 10);
+	ut_assertnull(of_find_node_by_phandle(NULL, 0x1000000));
+
+	/* Only the unknown phandle needs a walk */
+	dm_get_mem(&after);
+	ut_asserteq(count + 1, after.phandle_lookups - before.phandle_lookups);
+	ut_asserteq(1, after.phandle_scans - before.phandle_scans);
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_phandle_cache, UT_TESTF_LIVE_TREE);
+
 static int check_prop_values(struct unit_test_state *uts, ofnode start,
 			     const char *propname, const char *propval,
 			     int expect_count)
@@ -1346,6 +1378,78 @@ static int dm_test_livetree_align(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_livetree_align, UT_TESTF_SCAN_FDT | UT_TESTF_LIVE_TREE);
 
+/*
+ * check that unflattening the control FDT gives a tree matching the FDT, in a
+ * block sized to fit it
+ */
+static int dm_test_livetree_unflatten(struct unit_test_state *uts)
+{
+	const void *blob = gd->fdt_blob;
+	int fdt_nodes = 0, fdt_props = 0, fdt_phandles = 0;
+	int nodes = 0, props = 0, phandles = 0;
+	struct device_node *root, *np;
+	struct property *pp;
+	int offset, depth, prop;
+	void *end, *used;
+	char path[256];
+	size_t size;
+
+	/* Walk the flat tree first, on its own */
+	for (offset = 0, depth = 0; offset >= 0;
+	     offset = fdt_next_node(blob, offset, &depth)) {
+		fdt_nodes++;
+		if (fdt_get_phandle(blob, offset))
+			fdt_phandles++;
+		fdt_for_each_property_offset(prop, blob, offset)
+			fdt_props++;
+	}
+
+	ut_assertok(unflatten_device_tree(blob, &root));
+	size = malloc_usable_size(root);
+	used = root;
+
+	/* Nodes come in the same order, so paths can be compared as well */
+	for (np = root, offset = 0, depth = 0; np;
+	     np = of_find_all_nodes(np),
+	     offset = fdt_next_node(blob, offset, &depth)) {
+		ut_assert(offset >= 0);
+		ut_assertok(fdt_get_path(blob, offset, path, sizeof(path)));
+		ut_asserteq_str(path, np->full_name);
+		ut_asserteq(fdt_get_phandle(blob, offset), np->phandle);
+
+		nodes++;
+		if (np->phandle)
+			phandles++;
+		end = (void *)(np + 1) + strlen(np->full_name) + 1;
+		used = max(used, end);
+		for (pp = np->properties; pp; pp = pp->next) {
+			props++;
+			end = pp + 1;
+			if (pp->value == end)
+				end += pp->length;
+			if ((void *)pp >= (void *)root &&
+			    (void *)pp < (void *)root + size)
+				used = max(used, end);
+		}
+	}
+	ut_assert(offset < 0);
+
+	ut_asserteq(fdt_nodes, nodes);
+	ut_asserteq(fdt_props, props);
+	ut_asserteq(fdt_phandles, phandles);
+
+	/*
+	 * The block must hold the tree and the end marker, with no more to
+	 * spare than alignment and malloc() rounding
+	 */
+	ut_assert(used - (void *)root + 4 <= size);
+	ut_assert(size - (used - (void *)root) < 128);
+	of_live_free(root);
+
+	return 0;
+}
+DM_TEST(dm_test_livetree_unflatten, UT_TESTF_SCAN_FDT | UT_TESTF_LIVE_TREE);
+
 /* check that it is possible to load an arbitrary livetree */
 static int dm_test_livetree_ensure(struct unit_test_state *uts)
 {
@@ -6,9 +6,12 @@
 
 #include <command.h>
 #include <log.h>
+#include <malloc.h>
 #include <search.h>
 #include <stdio.h>
+#include <time.h>
 #include <vsprintf.h>
+#include <linux/sizes.h>
 #include <test/env.h>
 #include <test/ut.h>
 
@@ -124,3 +127,114 @@ static int env_test_htab_deletes(struct unit_test_state *uts)
 }
 
 ENV_TEST(env_test_htab_deletes, 0);
+
+/* Add many more entries than the table was created for */
+static int env_test_htab_grow(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+
+	memset(&htab, 0, sizeof(htab));
+	ut_asserteq(1, hcreate_r(SIZE, &htab));
+
+	ut_assertok(htab_fill(uts, &htab, SIZE * 32));
+	ut_assertok(htab_check_fill(uts, &htab, SIZE * 32));
+	ut_asserteq(SIZE * 32, htab.filled);
+	ut_assert(htab.size > SIZE * 32);
+
+	hdestroy_r(&htab);
+	return 0;
+}
+
+ENV_TEST(env_test_htab_grow, 0);
+
+#define BENCH_ENV_SIZE	SZ_64K
+#define BENCH_VARS	1024
+#define BENCH_LOOKUPS	16
+
+/*
+ * Import, look up and export a full 64KB environment, checking each step
+ * and optionally showing the time it took
+ */
+static int htab_import_export(struct unit_test_state *uts, bool show_time)
+{
+	struct hsearch_data htab;
+	struct env_entry item, *ritem;
+	char *env, *p, *res = NULL;
+	char key[20], value[50];
+	ulong start, import, lookup, export;
+	size_t len;
+	int i, j;
+
+	env = calloc(1, BENCH_ENV_SIZE);
+	ut_assertnonnull(env);
+
+	/* Keys are in order, so the export must match the input exactly */
+	for (i = 0, p = env; i < BENCH_VARS; i++) {
+		p += sprintf(p, "var%05d=value of variable %d, padded to size",
+			     i, i) + 1;
+	}
+	len = p - env;
+	ut_assert(len < BENCH_ENV_SIZE);
+
+	memset(&htab, 0, sizeof(htab));
+	start = timer_get_us();
+	ut_asserteq(1, himport_r(&htab, env, BENCH_ENV_SIZE, '\0', 0, 0, 0,
+				 NULL));
+	import = timer_get_us() - start;
+	ut_asserteq(BENCH_VARS, htab.filled);
+
+	start = timer_get_us();
+	for (j = 0; j < BENCH_LOOKUPS; j++) {
+		for (i = 0; i < BENCH_VARS; i++) {
+			sprintf(key, "var%05d", i);
+			item.key = key;
+			item.data = NULL;
+			ut_assert(hsearch_r(item, ENV_FIND, &ritem, &htab, 0));
+		}
+	}
+	lookup = timer_get_us() - start;
+
+	/* Each lookup must return its own entry */
+	for (i = 0; i < BENCH_VARS; i++) {
+		sprintf(key, "var%05d", i);
+		sprintf(value, "value of variable %d, padded to size", i);
+		item.key = key;
+		item.data = NULL;
+		ut_assert(hsearch_r(item, ENV_FIND, &ritem, &htab, 0));
+		ut_asserteq_str(key, ritem->key);
+		ut_asserteq_str(value, ritem->data);
+	}
+	item.key = "var99999";
+	item.data = NULL;
+	ut_assert(!hsearch_r(item, ENV_FIND, &ritem, &htab, 0));
+
+	start = timer_get_us();
+	ut_asserteq(len + 1, hexport_r(&htab, '\0', 0, &res, 0, 0, NULL));
+	export = timer_get_us() - start;
+	ut_asserteq_mem(env, res, len);
+
+	if (show_time)
+		printf("import %lu us, %d lookups %lu us, export %lu us\n",
+		       import, BENCH_VARS * BENCH_LOOKUPS, lookup, export);
+
+	free(res);
+	free(env);
+	hdestroy_r(&htab);
+	return 0;
+}
+
+/* Import, look up and export a full 64KB environment */
+static int env_test_htab_import(struct unit_test_state *uts)
+{
+	return htab_import_export(uts, false);
+}
+
+ENV_TEST(env_test_htab_import, 0);
+
+/* Show how long importing, looking up and exporting take */
+static int env_test_htab_bench_norun(struct unit_test_state *uts)
+{
+	return htab_import_export(uts, true);
+}
+
+ENV_TEST(env_test_htab_bench_norun, UT_TESTF_MANUAL);
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Tests for looking up commands run by hush
+ */
+
+#include <command.h>
+#include <env.h>
+#include <time.h>
+#include <test/hush.h>
+#include <test/ut.h>
+
+#define BENCH_LOOPS	200
+
+/* find_cmd() must give the same result as a linear search of the list */
+static int hush_test_find_cmd(struct unit_test_state *uts)
+{
+	struct cmd_tbl *table = ll_entry_start(struct cmd_tbl, cmd);
+	const int count = ll_entry_count(struct cmd_tbl, cmd);
+	char name[40];
+	int i, len;
+
+	for (i = 1; i < count; i++)
+		ut_assert(strcmp(table[i - 1].name, table[i].name) < 0);
+
+	for (i = 0; i < count; i++) {
+		ut_asserteq_ptr(&table[i], find_cmd(table[i].name));
+		for (len = 1; len <= strlen(table[i].name); len++) {
+			strlcpy(name, table[i].name, len + 1);
+			ut_asserteq_ptr(find_cmd_tbl(name, table, count),
+					find_cmd(name));
+			strlcat(name, ".b", sizeof(name));
+			ut_asserteq_ptr(find_cmd_tbl(name, table, count),
+					find_cmd(name));
+		}
+	}
+
+	ut_asserteq_ptr(find_cmd_tbl("?", table, count), find_cmd("?"));
+	ut_assertnull(find_cmd("zzzz"));
+	ut_assertnull(find_cmd(""));
+	ut_assertnull(find_cmd(NULL));
+	ut_asserteq_str("setenv", find_cmd("setenv")->name);
+	ut_asserteq_str("echo", find_cmd("echo")->name);
+
+	return 0;
+}
+HUSH_TEST(hush_test_find_cmd, 0);
+
+/*
+ * Compare the two lookups, then time a script which runs many commands. This
+ * only shows timings, so it is run on request.
+ */
+static int hush_test_cmd_bench_norun(struct unit_test_state *uts)
+{
+	struct cmd_tbl *table = ll_entry_start(struct cmd_tbl, cmd);
+	const int count = ll_entry_count(struct cmd_tbl, cmd);
+	ulong start, linear, sorted, script;
+	int i, j;
+
+	start = timer_get_us();
+	for (j = 0; j < BENCH_LOOPS; j++) {
+		for (i = 0; i < count; i++)
+			ut_asserteq_ptr(&table[i],
+					find_cmd_tbl(table[i].name, table,
+						     count));
+	}
+	linear = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (j = 0; j < BENCH_LOOPS; j++) {
+		for (i = 0; i < count; i++)
+			ut_asserteq_ptr(&table[i], find_cmd(table[i].name));
+	}
+	sorted = timer_get_us() - start;
+
+	ut_assertok(env_set("bench_n", "0"));
+	start = timer_get_us();
+	ut_asserteq(1, run_command("while itest $bench_n < 400; do setexpr bench_n $bench_n + 1; if itest $bench_n == 0; then true; fi; done",
+				   0));
+	script = timer_get_us() - start;
+	ut_asserteq(0x400, env_get_hex("bench_n", 0));
+	ut_assertok(env_set("bench_n", NULL));
+
+	printf("%d commands, %d lookups: linear %lu us, sorted %lu us\n",
+	       count, count * BENCH_LOOPS, linear, sorted);
+	printf("script with %d commands: %lu us\n", 0x400 * 4, script);
+
+	return 0;
+}
+HUSH_TEST(hush_test_cmd_bench_norun, UT_TESTF_MANUAL);
@@ -88,3 +88,38 @@ static int hush_test_until(struct unit_test_state *uts)
 	return 0;
 }
 HUSH_TEST(hush_test_until, 0);
+
+static int hush_test_for_repeat(struct unit_test_state *uts)
+{
+	const char *cmd = "for loop_j in foo bar; do echo ${loop_pre}${loop_j}; done";
+	int i;
+
+	/*
+	 * Running the same string again may reuse its parsed form, which must
+	 * still expand variables with their current value.
+	 */
+	console_record_reset_enable();
+	for (i = 0; i < 3; i++) {
+		env_set_ulong("loop_pre", i);
+		ut_assertok(run_command(cmd, 0));
+		ut_assert_nextline("%dfoo", i);
+		ut_assert_nextline("%dbar", i);
+	}
+	ut_assert_console_end();
+
+	ut_assertok(env_set("loop_cmd", "echo first; echo ${loop_pre}"));
+	for (i = 0; i < 2; i++) {
+		ut_assertok(run_command("run loop_cmd", 0));
+		ut_assert_nextline("first");
+		ut_assert_nextline("2");
+	}
+	ut_assert_console_end();
+	env_set("loop_pre", NULL);
+	env_set("loop_cmd", NULL);
+
+	if (gd->flags & GD_FLG_HUSH_MODERN_PARSER)
+		ut_assertok(run_command("loop_j=", 0));
+
+	return 0;
+}
+HUSH_TEST(hush_test_for_repeat, 0);
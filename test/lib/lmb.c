@@ -823,3 +823,87 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 	return 0;
 }
 LIB_TEST(lib_test_lmb_flags, 0);
+
+/*
+ * Fill an lmb with @count reserved pages separated by free ones, then fill the
+ * gaps with allocations and punch them out again, checking the regions at each
+ * step.
+ */
+static int lmb_test_scale(struct unit_test_state *uts, struct lmb *lmb,
+			  int count)
+{
+	const phys_addr_t ram = 0x40000000;
+	const phys_size_t page = 0x1000;
+	int i, idx;
+
+	ut_asserteq(0, lmb_add(lmb, ram, 2 * count * page));
+
+	/* count is a power of two, so stepping by an odd number visits all */
+	for (i = 0, idx = 0; i < count; i++, idx = (idx + 97) % count)
+		ut_asserteq(0, lmb_reserve(lmb, ram + 2 * idx * page, page));
+	ut_asserteq(count, lmb->reserved.cnt);
+	ut_assert(lmb->reserved.max >= count);
+	for (i = 0; i < count; i++)
+		ut_asserteq(ram + 2 * i * page, lmb->reserved.region[i].base);
+
+	for (i = 0; i < 2 * count; i++)
+		ut_asserteq(!(i & 1), lmb_is_reserved(lmb, ram + i * page));
+	ut_asserteq(page, lmb_get_free_size(lmb, ram + page));
+
+	/* each allocation joins the two reserved pages on either side */
+	for (i = count - 1; i >= 0; i--) {
+		ut_asserteq(ram + (2 * i + 1) * page,
+			    lmb_alloc(lmb, page, page));
+		ut_asserteq(i + 1, lmb->reserved.cnt);
+	}
+	ut_asserteq(ram, lmb->reserved.region[0].base);
+	ut_asserteq(2 * count * page, lmb->reserved.region[0].size);
+	ut_asserteq(0, __lmb_alloc_base(lmb, page, page, 0));
+	ut_asserteq(1, lmb_is_reserved(lmb, ram + page));
+
+	/* freeing the middle of a region splits it */
+	for (i = 0, idx = 0; i < count; i++, idx = (idx + 97) % count) {
+		ut_asserteq(0, lmb_free(lmb, ram + (2 * idx + 1) * page, page));
+		ut_asserteq(0, lmb_is_reserved(lmb, ram + (2 * idx + 1) * page));
+	}
+	ut_asserteq(count, lmb->reserved.cnt);
+	for (i = 0; i < count; i++) {
+		ut_asserteq(ram + 2 * i * page, lmb->reserved.region[i].base);
+		ut_asserteq(page, lmb->reserved.region[i].size);
+	}
+	ut_asserteq(-1, lmb_free(lmb, ram + page, page));
+
+	return 0;
+}
+
+/* Check that a growable lmb handles thousands of regions */
+static int lib_test_lmb_scale(struct unit_test_state *uts)
+{
+	struct lmb lmb;
+	int ret, i;
+
+	lmb_init(&lmb);
+	lmb_enable_grow(&lmb);
+	ret = lmb_test_scale(uts, &lmb, 256);
+	lmb_release(&lmb);
+	ut_assertok(ret);
+
+	lmb_init(&lmb);
+	lmb_enable_grow(&lmb);
+	ret = lmb_test_scale(uts, &lmb, 4096);
+	lmb_release(&lmb);
+	ut_assertok(ret);
+
+	/* without lmb_enable_grow() the array in struct lmb is the limit */
+	lmb_init(&lmb);
+	ut_asserteq(0, lmb_add(&lmb, 0x40000000, 0x10000000));
+	for (i = 0; i < LMB_RESERVED_REGIONS; i++)
+		ut_asserteq(0, lmb_reserve(&lmb, 0x40000000 + i * 0x2000,
+					   0x1000));
+	ut_asserteq(-1, lmb_reserve(&lmb, 0x40000000 + i * 0x2000, 0x1000));
+	ut_asserteq_ptr(lmb.reserved_regions, lmb.reserved.region);
+	ut_assert(!lmb.reserved.allocated);
+
+	return 0;
+}
+LIB_TEST(lib_test_lmb_scale, 0);
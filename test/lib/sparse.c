@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for writing Android sparse images
+ */
+
+#include <image-sparse.h>
+#include <sparse_format.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <asm/cache.h>
+
+#define SPARSE_TEST_BLKSZ	512
+/* first block of the test partition */
+#define SPARSE_TEST_START	4
+/* sparse blocks are two storage blocks */
+#define SPARSE_TEST_SPARSE_BLKSZ	(2 * SPARSE_TEST_BLKSZ)
+/*
+ * The image header and each chunk header carry extra bytes to be skipped. The
+ * data of the first chunk starts 64 bytes into the image, so that it can be
+ * written without copying, while that of the second RAW chunk is unaligned.
+ */
+#define SPARSE_TEST_HDR_EXTRA	20
+#define SPARSE_TEST_CHUNK_EXTRA	4
+#define SPARSE_TEST_FILL1	0xdeadbeef
+#define SPARSE_TEST_FILL2	0x12345678
+/* bytes of storage outside the partition or not written by the image */
+#define SPARSE_TEST_UNTOUCHED	0xa5
+
+/*
+ * The test image has these chunks, each size being in sparse blocks:
+ *
+ * RAW 3, FILL 2, DONT_CARE 1, RAW 1, CRC32 0, FILL 1
+ */
+#define SPARSE_TEST_BLKS	8
+#define SPARSE_TEST_CHUNKS	6
+#define SPARSE_TEST_STORAGE	\
+	((SPARSE_TEST_START + 2 * SPARSE_TEST_BLKS + 2) * SPARSE_TEST_BLKSZ)
+
+static lbaint_t sparse_test_write(struct sparse_storage *info, lbaint_t blk,
+				  lbaint_t blkcnt, const void *buffer)
+{
+	if (blk < info->start || blk + blkcnt > info->start + info->size)
+		return -EINVAL;
+	memcpy(info->priv + blk * info->blksz, buffer, blkcnt * info->blksz);
+
+	return blkcnt;
+}
+
+static lbaint_t sparse_test_reserve(struct sparse_storage *info, lbaint_t blk,
+				    lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+/* Set up @info to write to @mem, a RAM-backed partition */
+static void sparse_test_storage(struct sparse_storage *info, void *mem)
+{
+	memset(mem, SPARSE_TEST_UNTOUCHED, SPARSE_TEST_STORAGE);
+	memset(info, '\0', sizeof(*info));
+	info->blksz = SPARSE_TEST_BLKSZ;
+	info->start = SPARSE_TEST_START;
+	info->size = 2 * SPARSE_TEST_BLKS;
+	info->priv = mem;
+	info->write = sparse_test_write;
+	info->reserve = sparse_test_reserve;
+}
+
+/* Add a chunk header followed by @len bytes of @data to the image at @ptr */
+static void *sparse_test_chunk(void *ptr, uint type, uint blks,
+			       const void *data, uint len)
+{
+	chunk_header_t *chunk = ptr;
+
+	memset(ptr, '\0', sizeof(*chunk) + SPARSE_TEST_CHUNK_EXTRA);
+	chunk->chunk_type = type;
+	chunk->chunk_sz = blks;
+	chunk->total_sz = sizeof(*chunk) + SPARSE_TEST_CHUNK_EXTRA + len;
+	ptr += sizeof(*chunk) + SPARSE_TEST_CHUNK_EXTRA;
+	memcpy(ptr, data, len);
+
+	return ptr + len;
+}
+
+/*
+ * Generate the test image in @img and the partition contents it should
+ * produce in @expect, returning the image size
+ */
+static size_t sparse_test_image(void *img, void *expect)
+{
+	const u32 fill1 = SPARSE_TEST_FILL1, fill2 = SPARSE_TEST_FILL2;
+	const u32 crc = 0;
+	sparse_header_t *header = img;
+	u8 raw[3 * SPARSE_TEST_SPARSE_BLKSZ];
+	void *ptr, *out;
+	int i;
+
+	for (i = 0; i < sizeof(raw); i++)
+		raw[i] = i * 7 + i / 256;
+
+	memset(img, '\0', sizeof(*header) + SPARSE_TEST_HDR_EXTRA);
+	header->magic = SPARSE_HEADER_MAGIC;
+	header->major_version = 1;
+	header->file_hdr_sz = sizeof(*header) + SPARSE_TEST_HDR_EXTRA;
+	header->chunk_hdr_sz = sizeof(chunk_header_t) + SPARSE_TEST_CHUNK_EXTRA;
+	header->blk_sz = SPARSE_TEST_SPARSE_BLKSZ;
+	header->total_blks = SPARSE_TEST_BLKS;
+	header->total_chunks = SPARSE_TEST_CHUNKS;
+	ptr = img + header->file_hdr_sz;
+
+	memset(expect, SPARSE_TEST_UNTOUCHED, SPARSE_TEST_STORAGE);
+	out = expect + SPARSE_TEST_START * SPARSE_TEST_BLKSZ;
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_RAW, 3, raw, sizeof(raw));
+	memcpy(out, raw, sizeof(raw));
+	out += sizeof(raw);
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_FILL, 2, &fill1, sizeof(fill1));
+	for (i = 0; i < 2 * SPARSE_TEST_SPARSE_BLKSZ; i += sizeof(fill1))
+		memcpy(out + i, &fill1, sizeof(fill1));
+	out += 2 * SPARSE_TEST_SPARSE_BLKSZ;
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_DONT_CARE, 1, NULL, 0);
+	out += SPARSE_TEST_SPARSE_BLKSZ;
+
+	/* use the end of the raw data again, so it is not block-aligned */
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_RAW, 1, raw + 100,
+				SPARSE_TEST_SPARSE_BLKSZ);
+	memcpy(out, raw + 100, SPARSE_TEST_SPARSE_BLKSZ);
+	out += SPARSE_TEST_SPARSE_BLKSZ;
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_CRC32, 0, &crc, sizeof(crc));
+
+	ptr = sparse_test_chunk(ptr, CHUNK_TYPE_FILL, 1, &fill2, sizeof(fill2));
+	for (i = 0; i < SPARSE_TEST_SPARSE_BLKSZ; i += sizeof(fill2))
+		memcpy(out + i, &fill2, sizeof(fill2));
+
+	return ptr - img;
+}
+
+static void sparse_test_mssg(const char *str, char *response)
+{
+	strcpy(response, str);
+}
+
+/* Find the first chunk of type @type in the image at @img */
+static chunk_header_t *sparse_test_find(void *img, uint type)
+{
+	sparse_header_t *header = img;
+	chunk_header_t *chunk;
+	void *ptr;
+
+	for (ptr = img + header->file_hdr_sz;; ptr += chunk->total_sz) {
+		chunk = ptr;
+		if (chunk->chunk_type == type)
+			return chunk;
+	}
+}
+
+/* Test writing a sparse image with all types of chunk */
+static int lib_test_sparse_write(struct unit_test_state *uts)
+{
+	static u8 img[SPARSE_TEST_STORAGE] __aligned(ARCH_DMA_MINALIGN);
+	static u8 expect[SPARSE_TEST_STORAGE], mem[SPARSE_TEST_STORAGE];
+	struct sparse_storage info;
+	chunk_header_t *chunk;
+	char response[64];
+
+	memset(img, '\0', sizeof(img));
+	sparse_test_image(img, expect);
+
+	sparse_test_storage(&info, mem);
+	ut_assertok(write_sparse_image(&info, "test", img, NULL));
+	ut_asserteq_mem(expect, mem, SPARSE_TEST_STORAGE);
+
+	/* a DONT_CARE chunk carries no data */
+	chunk = sparse_test_find(img, CHUNK_TYPE_DONT_CARE);
+	chunk->total_sz -= 2;
+	sparse_test_storage(&info, mem);
+	info.mssg = sparse_test_mssg;
+	ut_asserteq(-1, write_sparse_image(&info, "test", img, response));
+	ut_asserteq_str("Bogus chunk size for chunk type Dont Care", response);
+
+	chunk->total_sz += 4;
+	sparse_test_storage(&info, mem);
+	info.mssg = sparse_test_mssg;
+	ut_asserteq(-1, write_sparse_image(&info, "test", img, response));
+	ut_asserteq_str("Bogus chunk size for chunk type Dont Care", response);
+
+	return 0;
+}
+LIB_TEST(lib_test_sparse_write, 0);